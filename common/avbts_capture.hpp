@@ -0,0 +1,282 @@
+/******************************************************************************
+
+  Copyright (c) 2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#ifndef AVBTS_CAPTURE_HPP
+#define AVBTS_CAPTURE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <ptptypes.hpp>
+#include <ieee1588.hpp>
+
+/**@file*/
+
+#define GPTP_CAPTURE_MAGIC "gPTPcap"		/*!< First 8 bytes of a capture file */
+#define GPTP_CAPTURE_VERSION 1			/*!< Capture file format version */
+#define GPTP_CAPTURE_BYTE_ORDER 0x01020304	/*!< Written in host byte order */
+#define GPTP_CAPTURE_HEADER_SIZE 4096		/*!< Records start at this offset */
+#define GPTP_CAPTURE_MAX_FIELDS 16		/*!< Field descriptors in the header */
+
+#define GPTP_CAPTURE_FLAG_SYNC 0x01		/*!< origin, link delay and correction are present */
+#define GPTP_CAPTURE_FLAG_AS_CAPABLE 0x02	/*!< Port was asCapable */
+#define GPTP_CAPTURE_FLAG_SYNTONIZED 0x04	/*!< ppm is the output of the servo */
+#define GPTP_CAPTURE_FLAG_PHASE_STEP 0x08	/*!< Clock phase was stepped by -master_offset_ns */
+
+#define GPTP_CAPTURE_TYPE_UINT 0		/*!< Unsigned integer field */
+#define GPTP_CAPTURE_TYPE_INT 1			/*!< Signed integer field */
+#define GPTP_CAPTURE_TYPE_FLOAT 2		/*!< IEEE 754 floating point field */
+
+/**
+ * @brief One Sync as seen by the slave: the Follow_Up values and what the
+ * clock servo made of them. Records are 64 bytes in host byte order.
+ */
+typedef struct {
+	/** Number of the record in the capture, from 1. Written last; a
+	 * record whose number does not match its position is stale or
+	 * being written */
+	uint64_t sequence;
+	uint64_t sync_arrival_ns;	/*!< t2, Sync ingress in local time */
+	uint64_t origin_ns;		/*!< t1, preciseOriginTimestamp */
+	uint64_t link_delay_ns;		/*!< Mean link delay */
+	int64_t correction_ns;		/*!< Follow_Up correctionField */
+	int64_t master_offset_ns;	/*!< Local minus master time at t2 */
+	double rate_ratio;		/*!< Master to local frequency ratio */
+	float ppm;			/*!< Frequency adjustment applied */
+	uint16_t port_number;		/*!< Receiving port */
+	uint8_t port_state;		/*!< PortState */
+	uint8_t flags;			/*!< GPTP_CAPTURE_FLAG_* */
+} GPTPCaptureRecord;
+
+/**
+ * @brief Describes one record field, so readers can check the layout
+ */
+typedef struct {
+	char name[20];			/*!< Field name, NUL terminated */
+	uint16_t offset;		/*!< Offset in the record */
+	uint8_t size;			/*!< Size in bytes */
+	uint8_t type;			/*!< GPTP_CAPTURE_TYPE_* */
+} GPTPCaptureField;
+
+/**
+ * @brief Start of every capture file
+ *
+ * A capture is a set of file_count files written in turn, each holding
+ * capacity records after the header. When the last file is full the
+ * first is reused. Record n of the capture (from 0) is in file
+ * (n / capacity) % file_count at slot n % capacity.
+ *
+ * Writers do not serialize on the header, so file_sequence, record_count
+ * and start_time_ns are advisory: a writer still finishing a record when
+ * the file is restarted can leave them behind. Readers decide which
+ * records are valid, and their order, from the record sequence alone.
+ */
+typedef struct {
+	char magic[8];			/*!< GPTP_CAPTURE_MAGIC */
+	uint32_t byte_order;		/*!< GPTP_CAPTURE_BYTE_ORDER */
+	uint16_t version;		/*!< GPTP_CAPTURE_VERSION */
+	uint16_t header_size;		/*!< Offset of the first record */
+	uint16_t record_size;		/*!< sizeof(GPTPCaptureRecord) */
+	uint16_t field_count;		/*!< Valid entries of fields */
+	uint32_t file_index;		/*!< Position of the file in the set */
+	uint32_t file_count;		/*!< Files in the set */
+	uint32_t reserved;
+	uint64_t file_sequence;		/*!< Times a file was started before this one, advisory */
+	uint64_t capacity;		/*!< Records the file holds */
+	uint64_t record_count;		/*!< Highest slot written plus one, advisory */
+	uint64_t start_time_ns;		/*!< Wall clock time the file was started, advisory */
+	char profile_name[32];		/*!< gPTP profile, NUL terminated */
+	uint8_t profile_type;		/*!< OpenAvnu::gPTP::ProfileType */
+	int8_t log_sync_interval;	/*!< Nominal Sync interval, log base 2 */
+	uint8_t reserved2[6];
+	GPTPCaptureField fields[GPTP_CAPTURE_MAX_FIELDS];	/*!< Record layout */
+} GPTPCaptureFileHeader;
+
+/**
+ * @brief Fills in the magic, versions and record layout of a header
+ * @param header [out] Header to describe the format in
+ * @return void
+ */
+static inline void gptpCaptureDescribe( GPTPCaptureFileHeader *header )
+{
+	static const GPTPCaptureField fields[] = {
+#define GPTP_CAPTURE_FIELD( name, type )				\
+		{ #name, offsetof( GPTPCaptureRecord, name ),		\
+		  sizeof((( GPTPCaptureRecord *) 0 )->name ), type }
+		GPTP_CAPTURE_FIELD( sequence, GPTP_CAPTURE_TYPE_UINT ),
+		GPTP_CAPTURE_FIELD( sync_arrival_ns, GPTP_CAPTURE_TYPE_UINT ),
+		GPTP_CAPTURE_FIELD( origin_ns, GPTP_CAPTURE_TYPE_UINT ),
+		GPTP_CAPTURE_FIELD( link_delay_ns, GPTP_CAPTURE_TYPE_UINT ),
+		GPTP_CAPTURE_FIELD( correction_ns, GPTP_CAPTURE_TYPE_INT ),
+		GPTP_CAPTURE_FIELD( master_offset_ns, GPTP_CAPTURE_TYPE_INT ),
+		GPTP_CAPTURE_FIELD( rate_ratio, GPTP_CAPTURE_TYPE_FLOAT ),
+		GPTP_CAPTURE_FIELD( ppm, GPTP_CAPTURE_TYPE_FLOAT ),
+		GPTP_CAPTURE_FIELD( port_number, GPTP_CAPTURE_TYPE_UINT ),
+		GPTP_CAPTURE_FIELD( port_state, GPTP_CAPTURE_TYPE_UINT ),
+		GPTP_CAPTURE_FIELD( flags, GPTP_CAPTURE_TYPE_UINT ),
+#undef GPTP_CAPTURE_FIELD
+	};
+
+	memcpy( header->magic, GPTP_CAPTURE_MAGIC, sizeof(header->magic) );
+	header->byte_order = GPTP_CAPTURE_BYTE_ORDER;
+	header->version = GPTP_CAPTURE_VERSION;
+	header->header_size = GPTP_CAPTURE_HEADER_SIZE;
+	header->record_size = sizeof(GPTPCaptureRecord);
+	header->field_count = sizeof(fields) / sizeof(fields[0]);
+	memset( header->fields, 0, sizeof(header->fields) );
+	memcpy( header->fields, fields, sizeof(fields) );
+}
+
+/**
+ * @brief Generic interface for recording every Sync a slave port
+ * processes into a capture
+ *
+ * PTPMessageFollowUp::processMessage() stages the Follow_Up values of a
+ * port with stageSync(); IEEE1588Clock::setMasterOffset() completes the
+ * record with the servo output through recordOffset(). Each port stages
+ * into its own slot, so ports on different threads do not share state.
+ * Implementations must append without blocking or taking locks, as they
+ * are called on the threads processing PTP messages.
+ */
+class GPTPCapture {
+private:
+	GPTPCaptureRecord staged[MAX_PORTS];
+
+protected:
+	/**
+	 * @brief  Appends a completed record to the capture
+	 * @param record [in] Record, numbered by the implementation
+	 * @return void
+	 */
+	virtual void append( const GPTPCaptureRecord &record ) = 0;
+
+public:
+	GPTPCapture() {
+		memset( staged, 0, sizeof(staged) );
+	}
+
+	/**
+	 * @brief  Opens the capture files, creating or replacing them
+	 * @param path Path the files are named after, as <path>.<index>
+	 * @param file_count Number of files to rotate over
+	 * @param file_records Records per file
+	 * @param profile_name [in] gPTP profile name for the file headers
+	 * @param profile_type OpenAvnu::gPTP::ProfileType of the profile
+	 * @param log_sync_interval Nominal Sync interval, log base 2
+	 * @return True on success otherwise False
+	 */
+	virtual bool initCapture
+	( const char *path, unsigned file_count, uint32_t file_records,
+	  const char *profile_name, uint8_t profile_type,
+	  int8_t log_sync_interval ) = 0;
+
+	/**
+	 * @brief  Writes out and closes the capture files. No record may be
+	 * staged or appended concurrently.
+	 * @return True on success otherwise False
+	 */
+	virtual bool closeCapture(void) = 0;
+
+	/**
+	 * @brief  Stages the Follow_Up values of a Sync
+	 * @param port_number Receiving port
+	 * @param origin_ns t1, the preciseOriginTimestamp
+	 * @param sync_arrival_ns t2, Sync ingress in local time
+	 * @param link_delay_ns Mean link delay
+	 * @param correction_ns correctionField in nanoseconds
+	 * @return void
+	 */
+	void stageSync
+	( uint16_t port_number, uint64_t origin_ns, uint64_t sync_arrival_ns,
+	  uint64_t link_delay_ns, int64_t correction_ns )
+	{
+		if( port_number == 0 || port_number > MAX_PORTS ) {
+			return;
+		}
+		GPTPCaptureRecord *record = &staged[port_number - 1];
+		record->origin_ns = origin_ns;
+		record->sync_arrival_ns = sync_arrival_ns;
+		record->link_delay_ns = link_delay_ns;
+		record->correction_ns = correction_ns;
+	}
+
+	/**
+	 * @brief  Records the servo input and output of a Sync, with the
+	 * Follow_Up values staged for the same Sync if there are any
+	 * @param port_number Receiving port
+	 * @param sync_arrival_ns t2, Sync ingress in local time
+	 * @param master_offset_ns Local minus master time at t2
+	 * @param rate_ratio Master to local frequency ratio
+	 * @param ppm Frequency adjustment applied
+	 * @param port_state State of the port
+	 * @param flags GPTP_CAPTURE_FLAG_* other than GPTP_CAPTURE_FLAG_SYNC
+	 * @return void
+	 */
+	void recordOffset
+	( uint16_t port_number, uint64_t sync_arrival_ns,
+	  int64_t master_offset_ns, FrequencyRatio rate_ratio, float ppm,
+	  PortState port_state, uint8_t flags )
+	{
+		GPTPCaptureRecord record;
+
+		if( port_number == 0 || port_number > MAX_PORTS ) {
+			return;
+		}
+		record = staged[port_number - 1];
+		if( record.sync_arrival_ns == sync_arrival_ns ) {
+			flags |= GPTP_CAPTURE_FLAG_SYNC;
+		} else {
+			record.origin_ns = 0;
+			record.link_delay_ns = 0;
+			record.correction_ns = 0;
+		}
+		record.sequence = 0;
+		record.sync_arrival_ns = sync_arrival_ns;
+		record.master_offset_ns = master_offset_ns;
+		record.rate_ratio = (double) rate_ratio;
+		record.ppm = ppm;
+		record.port_number = port_number;
+		record.port_state = (uint8_t) port_state;
+		record.flags = flags;
+		append( record );
+	}
+
+	/*
+	 * Destroys the GPTPCapture instance
+	 */
+	virtual ~GPTPCapture() = 0;
+};
+
+inline GPTPCapture::~GPTPCapture() {}
+
+#endif  // AVBTS_CAPTURE_HPP
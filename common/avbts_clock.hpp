@@ -39,17 +39,13 @@
 #include <common_port.hpp>
 #include <avbts_ostimerq.hpp>
 #include <avbts_osipc.hpp>
+#include <avbts_capture.hpp>
+#include <gptp_servo.hpp>
 
 /**@file*/
 
 #define EVENT_TIMER_GRANULARITY 5000000		/*!< Event timer granularity*/
 
-/* These 4 macros are used only when Syntonize mode is enabled */
-#define INTEGRAL 0.0003				/*!< PI controller integral factor*/
-#define PROPORTIONAL 1.0			/*!< PI controller proportional factor*/
-#define UPPER_FREQ_LIMIT  250.0		/*!< Upper frequency limit */
-#define LOWER_FREQ_LIMIT -250.0		/*!< Lower frequency limit */
-
 #define UPPER_LIMIT_PPM 250
 #define LOWER_LIMIT_PPM -250
 #define PPM_OFFSET_TO_RATIO(ppm) ((ppm) / ((FrequencyRatio)US_PER_SEC) + 1)
@@ -65,28 +61,6 @@
    detection of negative time jump in follow_up message */
 #define NEGATIVE_TIME_JUMP 0.0
 
-/**
- * @brief Provides the clock quality abstraction.
- * Represents the quality of the clock
- * Defined at IEEE 802.1AS-2011
- * Clause 6.3.3.8
- */
-struct ClockQuality {
-	unsigned char cq_class;				/*!< Clock Class - Clause 8.6.2.2
-										  Denotes the tracebility of the synchronized time
-										  distributed by a clock master when it is grandmaster. */
-	unsigned char clockAccuracy; 		/*!< Clock Accuracy - clause 8.6.2.3.
-										  Indicates the expected time accuracy of
-										  a clock master.*/
-	uint16_t offsetScaledLogVariance;	/*!< ::Offset Scaled log variance - Clause 8.6.2.4.
-										  Is the scaled, offset representation
-										  of an estimate of the PTP variance. The
-										  PTP variance characterizes the
-										  precision and frequency stability of the clock
-										  master. The PTP variance is the square of
-										  PTPDEV (See B.1.3.2). */
-};
-
 /**
  * @brief Provides the 1588 clock interface
  */
@@ -121,7 +95,7 @@ private:
 	ClockIdentity LastEBestIdentity;
 	bool _syntonize;
 	bool _new_syntonization_set_point;
-	float _ppm;
+	ClockServo *_servo;
 	int _phase_error_violation;
 
 	CommonPort *port_list[MAX_PORTS];
@@ -138,6 +112,7 @@ private:
 	Timestamp _prev_system_time;
 
 	OS_IPC *ipc;
+	GPTPCapture *capture;
 
 	OSTimerQueue *timerq;
 
@@ -190,11 +165,12 @@ public:
    * @param timerq_factory [in] Provides a factory object for creating timer queues (managing events)
    * @param ipc [in] Inter process communication object
    * @param lock_factory [in] Provides a factory object for creating locking a locking mechanism
+   * @param servo [in] Servo that syntonizes the clock, shared by all ports
    */
   IEEE1588Clock
 	  (bool forceOrdinarySlave, bool syntonize, uint8_t priority1,
 	   OSTimerQueueFactory * timerq_factory, OS_IPC * ipc,
-	   OSLockFactory *lock_factory );
+	   OSLockFactory *lock_factory, const ClockServoConfig &servo );
 
   /*
    * Destroys the IEEE 1588 clock entity
@@ -476,6 +452,23 @@ public:
       return fup_status;
   }
 
+  /**
+   * @brief  Sets the capture every Sync processed as slave is recorded to
+   * @param  capture [in] Capture, or NULL to stop recording
+   * @return void
+   */
+  void setCapture( GPTPCapture *capture ) {
+	  this->capture = capture;
+  }
+
+  /**
+   * @brief  Gets the capture Syncs are recorded to
+   * @return Capture, or NULL when not recording
+   */
+  GPTPCapture *getCapture(void) {
+	  return capture;
+  }
+
   /**
    * @brief Updates the follow up info internal object with the current clock source time
    * status values. This method should be called whenever the clockSource entity time
@@ -497,9 +490,10 @@ public:
    */
 	void registerPort( CommonPort *port, uint16_t index )
 	{
-	  if (index < MAX_PORTS) {
-		  port_list[index - 1] = port;
+	  if (index == 0 || index > MAX_PORTS) {
+		  return;
 	  }
+	  port_list[index - 1] = port;
 	  ++number_ports;
 	}
 
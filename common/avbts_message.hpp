@@ -37,6 +37,7 @@
 #include <stdint.h>
 #include <avbts_osnet.hpp>
 #include <ieee1588.hpp>
+#include <ptp_message_pool.hpp>
 
 #include <list>
 #include <algorithm>
@@ -126,6 +127,10 @@
 
 #define TX_TIMEOUT_BASE 1000 	/*!< Timeout base in microseconds */
 #define TX_TIMEOUT_ITER 6		/*!< Number of timeout iteractions for sending/receiving messages*/
+#define TX_TIMEOUT_TOTAL (TX_TIMEOUT_BASE * ((1 << TX_TIMEOUT_ITER) - 1))	/*!< Total TX timestamp wait in microseconds */
+
+#define PTP_TX_TEMPLATE_SIZE 128	/*!< Largest templated frame, payload offset included */
+#define PTP_TX_TEMPLATE_COUNT 16	/*!< One template per message type */
 
 /**
  * @brief Enumeration message type. IEEE 1588-2008 Clause 13.3.2.2
@@ -203,16 +208,42 @@ public:
 	}
 };
 
+/**
+ * @brief Pre-serialised transmit frame for one message type on one port.
+ * Holds the payload offset, the common header and a zeroed body. The
+ * header inputs it was built from are kept so a change of port identity,
+ * domain, flags or log interval is noticed on the next send.
+ */
+struct PTPFrameTemplate {
+	bool valid;		/*!< frame holds a built template */
+	uint16_t size;		/*!< payload offset plus message length */
+	unsigned payloadOffset;	/*!< offset of the PTP header in frame */
+	unsigned char versionPTP;	/*!< header versionPTP */
+	unsigned char domainNumber;	/*!< header domainNumber */
+	unsigned char flags[PTP_FLAGS_LENGTH];	/*!< header flags */
+	LegacyMessageType control;	/*!< header control field */
+	char logMeanMessageInterval;	/*!< header logMessageInterval */
+	PortIdentity sourcePortIdentity;	/*!< header sourcePortIdentity */
+	uint8_t frame[PTP_TX_TEMPLATE_SIZE];	/*!< serialised frame */
+
+	PTPFrameTemplate() {
+		valid = false;
+	}
+};
+
 /**
  * @brief  Builds PTP message from buffer
  * @param  buf [in] byte buffer containing PTP message
  * @param  size [in] length of buffer in bytes
  * @param  remote [in] address from where message was received
  * @param  port [in] port object that message was recieved on
+ * @param  rx_timestamp [in] RX timestamp received with the frame. If NULL,
+ * the timestamp of an event message is read from the port.
  * @return PTP message object
  */
 PTPMessageCommon *buildPTPMessage
-( char *buf, int size, LinkLayerAddress *remote, CommonPort *port );
+( char *buf, int size, LinkLayerAddress *remote, CommonPort *port,
+  Timestamp *rx_timestamp = NULL );
 
 /**
  * @brief Provides the PTPMessage common interface used during building of
@@ -224,7 +255,7 @@ protected:
 	uint16_t versionNetwork;	/*!< Network version */
 	MessageType messageType;	/*!< MessageType to be built */
 
-	PortIdentity *sourcePortIdentity;	/*!< PortIdentity from source*/
+	PortIdentity sourcePortIdentity;	/*!< PortIdentity from source*/
 
 	uint16_t sequenceId;		/*!< PTP message sequence ID*/
 	LegacyMessageType control;	/*!< Control message type of LegacyMessageType */
@@ -244,6 +275,28 @@ protected:
 	 */
 	PTPMessageCommon(void) { };
  public:
+	/**
+	 * @brief  Allocates message storage from the shared message pool
+	 * @param  size Size of the concrete message class
+	 * @return Pointer to uninitialized storage
+	 */
+	static void *operator new( size_t size );
+
+	/**
+	 * @brief  Returns message storage to the shared message pool
+	 * @param  ptr Storage returned by operator new
+	 * @param  size Size of the concrete message class
+	 * @return void
+	 */
+	static void operator delete( void *ptr, size_t size );
+
+	/**
+	 * @brief  Gets the usage counters of the shared message pool
+	 * @param  stats [out] Pool counters
+	 * @return void
+	 */
+	static void getPoolStats( PTPMessagePoolStats *stats );
+
 	/**
 	 * @brief Creates the PTPMessageCommon interface
 	 * @param port EtherPort where the message interface is
@@ -396,8 +449,22 @@ protected:
 	 */
 	void buildCommonHeader(uint8_t * buf);
 
+	/**
+	 * @brief  Copies the port's pre-serialised frame for this message
+	 * type into buf_t and patches the sequence id and correction field.
+	 * The template is rebuilt first when any other header input changed.
+	 * messageLength must be set by the caller. Each message type is only
+	 * sent from one thread, so templates need no locking.
+	 * @param  port [in] EtherPort owning the template
+	 * @param  buf_t [out] Transmit buffer, at least
+	 * ::PTP_TX_TEMPLATE_SIZE bytes
+	 * @return Pointer to the PTP common header within buf_t
+	 */
+	uint8_t *buildFromTemplate( EtherPort *port, uint8_t *buf_t );
+
 	friend PTPMessageCommon *buildPTPMessage
-	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port );
+	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port,
+	  Timestamp *rx_timestamp );
 };
 
 /*Exact fit. No padding*/
@@ -517,7 +584,7 @@ class PathTraceTLV {
 class PTPMessageAnnounce:public PTPMessageCommon {
  private:
 	uint8_t grandmasterIdentity[PTP_CLOCK_IDENTITY_LENGTH];
-	ClockQuality *grandmasterClockQuality;
+	ClockQuality grandmasterClockQuality;
 
 	PathTraceTLV tlv;
 
@@ -569,7 +636,7 @@ class PTPMessageAnnounce:public PTPMessageCommon {
 	 * @return Pointer to a ClockQuality object.
 	 */
 	ClockQuality *getGrandmasterClockQuality(void) {
-		return grandmasterClockQuality;
+		return &grandmasterClockQuality;
 	}
 
 	/**
@@ -613,7 +680,8 @@ class PTPMessageAnnounce:public PTPMessageCommon {
 	( CommonPort *port, PortIdentity *destIdentity);
 
 	friend PTPMessageCommon *buildPTPMessage
-	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port );
+	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port,
+	  Timestamp *rx_timestamp );
 };
 
 /**
@@ -658,7 +726,8 @@ class PTPMessageSync : public PTPMessageCommon {
 	(EtherPort *port, PortIdentity *destIdentity );
 
 	friend PTPMessageCommon *buildPTPMessage
-	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port );
+	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port,
+	  Timestamp *rx_timestamp );
 };
 
 /* Exact fit. No padding*/
@@ -860,6 +929,8 @@ private:
 	FollowUpTLV tlv;
 
 	PTPMessageFollowUp(void) { }
+
+	void buildBody( CommonPort *port, uint8_t *buf_ptr );
 public:
 	/**
 	 * @brief Builds the PTPMessageFollowUP object
@@ -926,7 +997,8 @@ public:
 	}
 
 	friend PTPMessageCommon *buildPTPMessage
-	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port );
+	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port,
+	  Timestamp *rx_timestamp );
 };
 
 /**
@@ -973,7 +1045,8 @@ class PTPMessagePathDelayReq : public PTPMessageCommon {
 	}
 
 	friend PTPMessageCommon *buildPTPMessage
-	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port );
+	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port,
+	  Timestamp *rx_timestamp );
 };
 
 /**
@@ -981,7 +1054,7 @@ class PTPMessagePathDelayReq : public PTPMessageCommon {
  */
 class PTPMessagePathDelayResp:public PTPMessageCommon {
 private:
-	PortIdentity * requestingPortIdentity;
+	PortIdentity requestingPortIdentity;
 	Timestamp requestReceiptTimestamp;
 
 	PTPMessagePathDelayResp(void) {
@@ -1040,7 +1113,8 @@ public:
 	}
 
 	friend PTPMessageCommon *buildPTPMessage
-	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port );
+	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port,
+	  Timestamp *rx_timestamp );
 };
 
 /**
@@ -1049,7 +1123,7 @@ public:
 class PTPMessagePathDelayRespFollowUp:public PTPMessageCommon {
  private:
 	Timestamp responseOriginTimestamp;
-	PortIdentity *requestingPortIdentity;
+	PortIdentity requestingPortIdentity;
 
 	PTPMessagePathDelayRespFollowUp(void) { }
 
@@ -1104,11 +1178,12 @@ public:
 	 * @return Pointer to requesting PortIdentity object
 	 */
 	PortIdentity *getRequestingPortIdentity(void) {
-		return requestingPortIdentity;
+		return &requestingPortIdentity;
 	}
 
 	friend PTPMessageCommon *buildPTPMessage
-	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port );
+	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port,
+	  Timestamp *rx_timestamp );
 };
 
 /*Exact fit. No padding*/
@@ -1261,7 +1336,8 @@ public:
 	void processMessage( CommonPort *port );
 
 	friend PTPMessageCommon *buildPTPMessage
-	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port );
+	( char *buf, int size, LinkLayerAddress *remote, CommonPort *port,
+	  Timestamp *rx_timestamp );
 };
 
 #endif
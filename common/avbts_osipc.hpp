@@ -72,6 +72,7 @@ public:
 	 * @param pdelay_count Count of pdelays
 	 * @param port_state Port's state
 	 * @param asCapable asCapable flag
+	 * @param port_number Port the values belong to
 	 *
 	 * @return Implementation dependent.
 	 */
@@ -84,19 +85,22 @@ public:
 		uint32_t sync_count,
 		uint32_t pdelay_count,
 		PortState port_state,
-		bool asCapable ) = 0;
+		bool asCapable,
+		uint16_t port_number ) = 0;
 
 	/**
 	 * @brief  Updates grandmaster IPC values
 	 *
 	 * @param gptp_grandmaster_id Current grandmaster id (all 0's if no grandmaster selected)
 	 * @param gptp_domain_number gPTP domain number
+	 * @param port_number Port the grandmaster was learned on
 	 *
 	 * @return Implementation dependent.
 	 */
 	virtual bool update_grandmaster(
 		uint8_t gptp_grandmaster_id[],
-		uint8_t gptp_domain_number ) = 0;
+		uint8_t gptp_domain_number,
+		uint16_t port_number ) = 0;
 
 	/**
 	 * @brief  Updates network interface IPC values
@@ -128,6 +132,31 @@ public:
 		int8_t   log_pdelay_interval,
 		uint16_t port_number ) = 0;
 
+	/**
+	 * @brief  Starts a group of updates that readers must see together.
+	 * Values passed to update(), update_grandmaster() and
+	 * update_network_interface() are published by endUpdate().
+	 * @return void
+	 */
+	virtual void beginUpdate() {}
+
+	/**
+	 * @brief  Publishes the updates made since beginUpdate()
+	 * @return Implementation dependent.
+	 */
+	virtual bool endUpdate() { return true; }
+
+	/**
+	 * @brief  Reports that the local clock phase was stepped, as opposed
+	 * to slewed, so that consumers can discard interpolation state
+	 * @param port_number Port whose sync caused the step
+	 * @param phase_step Step applied to the clock, in ns
+	 * @return Implementation dependent.
+	 */
+	virtual bool update_phase_step
+	( uint16_t /* port_number */, int64_t /* phase_step */ )
+	{ return true; }
+
 	/*
 	 * Destroys IPC
 	 */
@@ -43,6 +43,7 @@
 /**@file*/
 
 class CommonTimestamper;
+class CommonPort;
 
 #define FACTORY_NAME_LENGTH 48		/*!< Factory name maximum length */
 #define DEFAULT_TIMEOUT 1			/*!< Default timeout in milliseconds*/
@@ -290,6 +291,19 @@ typedef enum { net_trfail, net_fatal, net_succeed } net_result;
  */
 typedef enum { NET_LINK_EVENT_DOWN, NET_LINK_EVENT_UP, NET_LINK_EVENT_FAIL } net_link_event;
 
+/**
+ * @brief Callback invoked by a receive loop for every received frame
+ * @param arg [in] Argument given to OSNetworkInterface::receiveLoop
+ * @param addr [in] Source link layer address
+ * @param payload [in] Frame payload. Only valid during the call
+ * @param length Payload length
+ * @param rx_timestamp [in] Hardware RX timestamp decoded with the frame,
+ * NULL if the frame carried none
+ */
+typedef void (*net_frame_handler)
+( void *arg, LinkLayerAddress *addr, uint8_t *payload, size_t length,
+  Timestamp *rx_timestamp );
+
 /**
  * @brief Provides a generic network interface
  */
@@ -330,6 +344,37 @@ class OSNetworkInterface {
 	  */
 	 virtual void watchNetLink( CommonPort *pPort ) = 0;
 
+	 /**
+	  * @brief  Reports whether the interface provides an event driven
+	  * receive loop. When it does, the loop also watches link changes
+	  * and watchNetLink() only reads the initial link state.
+	  * @return TRUE if receiveLoop() is available, FALSE if frames must be
+	  * polled with nrecv()
+	  */
+	 virtual bool supportsReceiveLoop() { return false; }
+
+	 /**
+	  * @brief  Receives frames until stopReceiveLoop() is called, passing
+	  * each one to the handler
+	  * @param  pPort [in] Port that owns the interface
+	  * @param  handler Frame callback
+	  * @param  arg [in] Argument passed to the handler
+	  * @return net_succeed when stopped, net_fatal on error
+	  */
+	 virtual net_result receiveLoop
+	 ( CommonPort * /* pPort */, net_frame_handler /* handler */,
+	   void * /* arg */ )
+	 {
+		 return net_fatal;
+	 }
+
+	 /**
+	  * @brief  Wakes receiveLoop() and makes it return. May be called
+	  * from any thread, before or while the loop runs.
+	  * @return void
+	  */
+	 virtual void stopReceiveLoop() {}
+
 	 /**
 	  * @brief  Provides generic method for getting the payload offset
 	  */
@@ -36,12 +36,15 @@
 
 /**@file*/
 
+#include <ieee1588.hpp>
+
 /**
  * @brief ostimerq callback definition
  */
 typedef void (*ostimerq_handler) (void *);
 
 class IEEE1588Clock;
+class CommonPort;
 
 /**
  * @brief OSTimerQueue generic interface
@@ -66,7 +69,8 @@ public:
 	 * @param func Callback
 	 * @param arg inner argument of type event_descriptor_t
 	 * @param dynamic when true, allows elements to be deleted from the queue
-	 * @param event [inout] Pointer to the event
+	 * @param event [out] If non-null, receives a handle that identifies
+	 * this event in a later cancelEvent() call
 	 * @return TRUE success, FALSE fail
 	 */
 	virtual bool addEvent
@@ -76,10 +80,43 @@ public:
 	/**
 	 * @brief Removes an event from the timer queue
 	 * @param type Event type
-	 * @param event [inout] Pointer to the event
+	 * @param event [in] If non-null, handle returned by addEvent(). Only
+	 * that event is removed. Otherwise every event of type is removed.
 	 * @return TRUE success, FALSE fail
 	 */
 	virtual bool cancelEvent(int type, unsigned *event) = 0;
+
+	/**
+	 * @brief Removes the events of one type armed for one port
+	 * @param target [in] Port the events were armed for
+	 * @param type Event type
+	 * @return TRUE success, FALSE fail
+	 */
+	virtual bool cancelPortEvent(CommonPort * /* target */, int type)
+	{
+		return cancelEvent(type, NULL);
+	}
+
+	/**
+	 * @brief Add an event for a port. The queue owns the event descriptor
+	 * passed to func. Implementations may take it from a preallocated
+	 * pool instead of the heap.
+	 * @param micros Time in microsseconds
+	 * @param target [in] Port stored in the event descriptor
+	 * @param type Event type
+	 * @param func Callback, called with an event_descriptor_t
+	 * @param event [out] If non-null, receives a handle for cancelEvent()
+	 * @return TRUE success, FALSE fail
+	 */
+	virtual bool addPortEvent
+	(unsigned long micros, CommonPort *target, int type,
+	 ostimerq_handler func, unsigned *event)
+	{
+		event_descriptor_t *arg = new event_descriptor_t();
+		arg->port = target;
+		arg->event = (Event) type;
+		return addEvent(micros, type, func, arg, true, event);
+	}
 	virtual ~OSTimerQueue() = 0;
 };
 
@@ -52,6 +52,7 @@ CommonPort::CommonPort( PortInit_t *portInit ) :
 	one_way_delay = ONE_WAY_DELAY_DEFAULT;
 	neighbor_prop_delay_thresh = portInit->neighborPropDelayThreshold;
 	net_label = portInit->net_label;
+	net_iface = NULL;
 	link_thread = thread_factory->createThread();
 	listening_thread = thread_factory->createThread();
 	sync_receipt_thresh = portInit->syncReceiptThreshold;
@@ -406,7 +407,7 @@ bool CommonPort::restoreSerializedState
 }
 
 void CommonPort::startSyncReceiptTimer
-( long long unsigned int waitTime )
+( uint64_t waitTime )
 {
 	clock->getTimerQLock();
 	syncReceiptTimerLock->lock();
@@ -427,7 +428,7 @@ void CommonPort::stopSyncReceiptTimer( void )
 }
 
 void CommonPort::startSyncIntervalTimer
-( long long unsigned int waitTime )
+( uint64_t waitTime )
 {
 	if( syncIntervalTimerLock->trylock() == oslock_fail ) return;
 	clock->deleteEventTimerLocked(this, SYNC_INTERVAL_TIMEOUT_EXPIRES);
@@ -437,7 +438,7 @@ void CommonPort::startSyncIntervalTimer
 }
 
 void CommonPort::startAnnounceIntervalTimer
-( long long unsigned int waitTime )
+( uint64_t waitTime )
 {
 	announceIntervalTimerLock->lock();
 	clock->deleteEventTimerLocked
@@ -842,12 +843,9 @@ bool CommonPort::processEvent( Event e )
 		break;
 	case PDELAY_INTERVAL_TIMEOUT_EXPIRES:
 		GPTP_LOG_DEBUG("PDELAY_INTERVAL_TIMEOUT_EXPIRES occured");
-		// If asCapable is true attempt some media specific action
-		// TODO: implement profile specific handling on that case
-		if( asCapable )
-			ret = _processEvent( e );
-		else
-			ret = true; // No action needed if not asCapable
+		// Pdelay runs whether or not the port is asCapable, it is
+		// how asCapable is earned
+		ret = _processEvent( e );
 		break;
 	}
 
@@ -952,7 +950,8 @@ void CommonPort::sendGeneralPort()
 	// This is a placeholder that does nothing
 }
 
-void CommonPort::sendGeneralPort(int etherType, uint8_t* buf, uint16_t len, MulticastType mcast_type, PortIdentity* destIdentity)
+void CommonPort::sendGeneralPort
+( uint16_t, uint8_t *, int, MulticastType, PortIdentity * )
 {
 	// Default implementation - derived classes should override
 	// This is a placeholder that does nothing
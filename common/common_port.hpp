@@ -53,154 +53,6 @@
 class IEEE1588Clock;
 class MilanProfile;  // Forward declaration for Milan B.1 profile
 
-/**
- * @brief PortIdentity interface
- * Defined at IEEE 802.1AS Clause 8.5.2
- */
-class PortIdentity {
-private:
-	ClockIdentity clock_id;
-	uint16_t portNumber;
-public:
-	/**
-	 * @brief Default Constructor
-	 */
-	PortIdentity() { };
-
-	/**
-	 * @brief  Constructs PortIdentity interface.
-	 * @param  clock_id Clock ID value as defined at IEEE 802.1AS Clause
-	 * 8.5.2.2
-	 * @param  portNumber Port Number
-	 */
-	PortIdentity(uint8_t * clock_id, uint16_t * portNumber)
-	{
-		this->portNumber = *portNumber;
-		this->portNumber = PLAT_ntohs(this->portNumber);
-		this->clock_id.set(clock_id);
-	}
-
-	/**
-	 * @brief  Implements the operator '!=' overloading method. Compares
-	 * clock_id and portNumber.
-	 * @param  cmp Constant PortIdentity value to be compared against.
-	 * @return TRUE if the comparison value differs from the object's
-	 * PortIdentity value. FALSE otherwise.
-	 */
-	bool operator!=(const PortIdentity & cmp) const
-	{
-		return
-			!(this->clock_id == cmp.clock_id) ||
-			this->portNumber != cmp.portNumber ? true : false;
-	}
-
-	/**
-	 * @brief  Implements the operator '==' overloading method. Compares
-	 * clock_id and portNumber.
-	 * @param  cmp Constant PortIdentity value to be compared against.
-	 * @return TRUE if the comparison value equals to the object's
-	 * PortIdentity value. FALSE otherwise.
-	 */
-	bool operator==(const PortIdentity & cmp)const
-	{
-		return
-			this->clock_id == cmp.clock_id &&
-			this->portNumber == cmp.portNumber ? true : false;
-	}
-
-	/**
-	 * @brief  Implements the operator '<' overloading method. Compares
-	 * clock_id and portNumber.
-	 * @param  cmp Constant PortIdentity value to be compared against.
-	 * @return TRUE if the comparison value is lower than the object's
-	 * PortIdentity value. FALSE otherwise.
-	 */
-	bool operator<(const PortIdentity & cmp)const
-	{
-		return
-			this->clock_id < cmp.clock_id ?
-			true : this->clock_id == cmp.clock_id &&
-			this->portNumber < cmp.portNumber ? true : false;
-	}
-
-	/**
-	 * @brief  Implements the operator '>' overloading method. Compares
-	 * clock_id and portNumber.
-	 * @param  cmp Constant PortIdentity value to be compared against.
-	 * @return TRUE if the comparison value is greater than the object's
-	 * PortIdentity value. FALSE otherwise.
-	 */
-	bool operator>(const PortIdentity & cmp)const
-	{
-		return
-			this->clock_id > cmp.clock_id ?
-			true : this->clock_id == cmp.clock_id &&
-			this->portNumber > cmp.portNumber ? true : false;
-	}
-
-	/**
-	 * @brief  Gets the ClockIdentity string
-	 * @param  id [out] Pointer to an array of octets.
-	 * @return void
-	 */
-	void getClockIdentityString(uint8_t *id)
-	{
-		clock_id.getIdentityString(id);
-	}
-
-	/**
-	 * @brief  Sets the ClockIdentity.
-	 * @param  clock_id Clock Identity to be set.
-	 * @return void
-	 */
-	void setClockIdentity(ClockIdentity clock_id)
-	{
-		this->clock_id = clock_id;
-	}
-
-	/**
-	 * @brief  Gets the clockIdentity value
-	 * @return A copy of Clock identity value.
-	 */
-	ClockIdentity getClockIdentity( void ) {
-		return this->clock_id;
-	}
-
-	/**
-	 * @brief  Gets the port number following the network byte order, i.e.
-	 * Big-Endian.
-	 * @param  id [out] Port number
-	 * @return void
-	 */
-	void getPortNumberNO(uint16_t * id)	// Network byte order
-	{
-		uint16_t portNumberNO = PLAT_htons(portNumber);
-		*id = portNumberNO;
-	}
-
-	/**
-	 * @brief  Gets the port number in the host byte order, which can be
-	 * either Big-Endian
-	 * or Little-Endian, depending on the processor where it is running.
-	 * @param  id Port number
-	 * @return void
-	 */
-	void getPortNumber(uint16_t * id)	// Host byte order
-	{
-		*id = portNumber;
-	}
-
-	/**
-	 * @brief  Sets the Port number
-	 * @param  id [in] Port number
-	 * @return void
-	 */
-	void setPortNumber(uint16_t * id)
-	{
-		portNumber = *id;
-	}
-};
-
 /**
  * @brief Physical delay specification for different link speeds
  */
@@ -1064,6 +916,26 @@ public:
 		return result;
 	}
 
+	/**
+	 * @brief Checks whether frames can be received with receiveLoop()
+	 * @return TRUE if the network interface provides a receive loop
+	 */
+	bool supportsReceiveLoop()
+	{
+		return net_iface->supportsReceiveLoop();
+	}
+
+	/**
+	 * @brief Receives frames until the listening thread is stopped
+	 * @param handler Frame callback
+	 * @param arg [in] Argument passed to the handler
+	 * @return net_succeed when stopped, net_fatal on error
+	 */
+	net_result receiveLoop( net_frame_handler handler, void *arg )
+	{
+		return net_iface->receiveLoop( this, handler, arg );
+	}
+
 	/**
 	 * @brief Send frame
 	 */
@@ -1120,6 +992,8 @@ public:
 	{
 		GPTP_LOG_VERBOSE("Stop listening thread");
 		setListeningThreadRunning(false);
+		if( net_iface != NULL )
+			net_iface->stopReceiveLoop();
 	}
 
 	/**
@@ -1352,7 +1226,9 @@ public:
 	bool processSyncAnnounceTimeout(Event);
 	void startAnnounce();
 	void sendGeneralPort();
-	void sendGeneralPort(int, uint8_t*, uint16_t, MulticastType, PortIdentity*);
+	virtual void sendGeneralPort
+	( uint16_t etherType, uint8_t *buf, int len, MulticastType mcast_type,
+	  PortIdentity *destIdentity );
 	Timestamp getTxPhyDelay(uint32_t link_speed) const;
 	Timestamp getRxPhyDelay(uint32_t link_speed) const;
 
@@ -57,8 +57,20 @@
 
 #ifdef _WIN32
 #include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+
+// The thread id in the debug output
+static inline unsigned long GetCurrentThreadId()
+{
+	return (unsigned long) pthread_self();
+}
 #endif
 
+#undef GPTP_LOG_SUBSYSTEM
+#define GPTP_LOG_SUBSYSTEM GPTP_LOG_SUBSYS_NET
+
 LinkLayerAddress EtherPort::other_multicast(OTHER_MULTICAST);
 LinkLayerAddress EtherPort::pdelay_multicast(PDELAY_MULTICAST);
 LinkLayerAddress EtherPort::test_status_multicast
@@ -77,6 +89,15 @@ OSThreadExitCode watchNetLinkWrapper(void *arg)
 		return osthread_error;
 }
 
+static void receiveFrameWrapper
+( void *arg, LinkLayerAddress *addr, uint8_t *payload, size_t length,
+  Timestamp *rx_timestamp )
+{
+	EtherPort *port = (EtherPort *) arg;
+
+	port->receiveFrame( addr, payload, length, rx_timestamp );
+}
+
 OSThreadExitCode openPortWrapper(void *arg)
 {
 	EtherPort *port;
@@ -245,9 +266,43 @@ void EtherPort::startSyncRateIntervalTimer()
 	}
 }
 
+bool EtherPort::acceptFrame( const PtpFrameView &frame )
+{
+	if( !frame.hasBody() )
+	{
+		GPTP_LOG_VERBOSE( "Dropping truncated frame (%u bytes)",
+				  (unsigned) frame.getSize() );
+		incCounter_ieee8021AsPortStatRxPTPPacketDiscard();
+		return false;
+	}
+	if( frame.getTransportSpecific() != 1 )
+	{
+		GPTP_LOG_EXCEPTION( "*** Received message with unsupported "
+				    "transportSpecific type=%d",
+				    frame.getTransportSpecific() );
+		incCounter_ieee8021AsPortStatRxPTPPacketDiscard();
+		return false;
+	}
+	if( frame.getVersionPTP() != GPTP_VERSION ||
+	    frame.getDomainNumber() != clock->getDomain() )
+	{
+		GPTP_LOG_VERBOSE( "Dropping frame for version %u domain %u",
+				  frame.getVersionPTP(),
+				  frame.getDomainNumber() );
+		incCounter_ieee8021AsPortStatRxPTPPacketDiscard();
+		return false;
+	}
+
+	return true;
+}
+
 void EtherPort::processMessage
-( char *buf, int length, LinkLayerAddress *remote, uint32_t link_speed )
+( char *buf, int length, LinkLayerAddress *remote, uint32_t link_speed,
+  Timestamp *rx_timestamp )
 {
+	if( length < 0 || !acceptFrame( PtpFrameView( buf, length )))
+		return;
+
 	GPTP_LOG_VERBOSE("Processing network buffer");
 
 	// Log incoming message details at entry
@@ -256,7 +311,7 @@ void EtherPort::processMessage
 	Timestamp process_start_time = clock->getTime();
 	
 	PTPMessageCommon *msg =
-		buildPTPMessage( buf, (int)length, remote, this );
+		buildPTPMessage( buf, (int)length, remote, this, rx_timestamp );
 
 	if (msg == NULL)
 	{
@@ -403,6 +458,7 @@ void *EtherPort::openPort( EtherPort *port )
     // Initialize heartbeat with defensive checks (removed SEH to avoid C2713/C2712 errors)
     try {
         network_thread_heartbeat.store(0, std::memory_order_relaxed);
+#ifdef _WIN32
         LARGE_INTEGER qpc_init;
         if (QueryPerformanceCounter(&qpc_init) == 0) {
             GPTP_LOG_ERROR("*** ERROR: QueryPerformanceCounter failed during initialization ***");
@@ -411,6 +467,11 @@ void *EtherPort::openPort( EtherPort *port )
         } else {
             network_thread_last_activity.store((uint64_t)qpc_init.QuadPart, std::memory_order_relaxed);
         }
+#else
+        struct timespec ts_init;
+        clock_gettime(CLOCK_MONOTONIC, &ts_init);
+        network_thread_last_activity.store((uint64_t)ts_init.tv_sec * 1000000000ULL + ts_init.tv_nsec, std::memory_order_relaxed);
+#endif
         GPTP_LOG_STATUS("*** NETWORK THREAD: Heartbeat initialization completed ***");
     } catch (...) {
         GPTP_LOG_ERROR("*** FATAL: Exception initializing heartbeat in openPort (thread_id=%lu, port=%p) ***", (unsigned long)GetCurrentThreadId(), port);
@@ -438,6 +499,17 @@ void *EtherPort::openPort( EtherPort *port )
         return (void*)1;
     }
     
+    if( supportsReceiveLoop() ) {
+        GPTP_LOG_STATUS("*** NETWORK THREAD: Starting event driven receive loop ***");
+        if( receiveLoop( receiveFrameWrapper, (void *)this ) == net_fatal ) {
+            GPTP_LOG_ERROR("*** NETWORK THREAD: Fatal error in receive loop - terminating ***");
+            this->processEvent(FAULT_DETECTED);
+        }
+        GPTP_LOG_STATUS("*** NETWORK THREAD: Receive loop stopped ***");
+        setListeningThreadRunning(false);
+        return NULL;
+    }
+
     try {
         while ( getListeningThreadRunning() ) {
             GPTP_LOG_DEBUG("*** NETWORK THREAD: LOOP START (loop_counter=%llu, thread_id=%lu, stack_ptr=%p) ***", loop_counter, (unsigned long)GetCurrentThreadId(), (void*)&loop_counter);
@@ -453,12 +525,18 @@ void *EtherPort::openPort( EtherPort *port )
             try {
                 if (&network_thread_heartbeat != nullptr && &network_thread_last_activity != nullptr) {
                     network_thread_heartbeat.fetch_add(1, std::memory_order_relaxed);
+#ifdef _WIN32
                     LARGE_INTEGER qpc_loop;
                     if (QueryPerformanceCounter(&qpc_loop) != 0) {
                         network_thread_last_activity.store((uint64_t)qpc_loop.QuadPart, std::memory_order_relaxed);
                     } else {
                         GPTP_LOG_ERROR("*** ERROR: QueryPerformanceCounter failed in main loop ***");
                     }
+#else
+                    struct timespec ts_loop;
+                    clock_gettime(CLOCK_MONOTONIC, &ts_loop);
+                    network_thread_last_activity.store((uint64_t)ts_loop.tv_sec * 1000000000ULL + ts_loop.tv_nsec, std::memory_order_relaxed);
+#endif
                 } else {
                     GPTP_LOG_ERROR("*** FATAL: Heartbeat pointers are null in main loop ***");
                     break;
@@ -513,9 +591,6 @@ void *EtherPort::openPort( EtherPort *port )
 
             // Log before every recv call
             GPTP_LOG_DEBUG("*** NETWORK THREAD: About to call recv() - loop #%llu", loop_counter);
-            // Add a flush to ensure log is written before possible crash
-            fflush(stdout);
-            fflush(stderr);
             rrecv = recv( &remote, buf, length, link_speed );
             GPTP_LOG_DEBUG("*** NETWORK THREAD: recv() returned %d - loop #%llu", rrecv, loop_counter);
 
@@ -570,6 +645,17 @@ void *EtherPort::openPort( EtherPort *port )
     return NULL;
 }
 
+void EtherPort::receiveFrame
+( LinkLayerAddress *remote, uint8_t *buf, size_t length,
+  Timestamp *rx_timestamp )
+{
+	network_thread_heartbeat.fetch_add(1, std::memory_order_relaxed);
+
+	GPTP_LOG_DEBUG("*** NETWORK RX: Received %zu bytes from network", length);
+	processMessage
+		( (char *)buf, (int)length, remote, getLinkSpeed(), rx_timestamp );
+}
+
 net_result EtherPort::port_send
 ( uint16_t etherType, uint8_t *buf, int size, MulticastType mcast_type,
   PortIdentity *destIdentity, bool timestamp )
@@ -1028,6 +1114,7 @@ bool EtherPort::_processEvent( Event e )
 			}
 			delete sync;
 		}
+		ret = true;
 		break;
 	case FAULT_DETECTED:
 		GPTP_LOG_ERROR("Received FAULT_DETECTED event");
@@ -1289,6 +1376,32 @@ int EtherPort::getTxTimestamp
 		(&identity, msg->getMessageId(), timestamp, counter_value, last);
 }
 
+bool EtherPort::txTimestampWaitable()
+{
+	EtherTimestamper *timestamper =
+		dynamic_cast<EtherTimestamper *>(_hw_timestamper);
+
+	return timestamper != NULL &&
+		timestamper->HWTimestamper_txtimestamp_waitable();
+}
+
+int EtherPort::waitTxTimestamp
+( PTPMessageCommon *msg, Timestamp &timestamp, unsigned &counter_value,
+  unsigned timeout_us )
+{
+	EtherTimestamper *timestamper =
+		dynamic_cast<EtherTimestamper *>(_hw_timestamper);
+	PortIdentity identity;
+
+	if (timestamper == NULL)
+		return GPTP_EC_FAILURE;
+
+	msg->getPortIdentity(&identity);
+	return timestamper->HWTimestamper_txtimestamp_wait
+		( &identity, msg->getMessageId(), timestamp, counter_value,
+		  timeout_us );
+}
+
 int EtherPort::getRxTimestamp
 ( PTPMessageCommon * msg, Timestamp & timestamp, unsigned &counter_value,
   bool last )
@@ -52,6 +52,7 @@
 #include <list>
 
 #include <common_port.hpp>
+#include <ptp_frame_view.hpp>
 
 /**@file*/
 
@@ -129,6 +130,8 @@ class EtherPort : public CommonPort
 
 	PTPMessageSync *last_sync;
 
+	PTPFrameTemplate tx_template[PTP_TX_TEMPLATE_COUNT];
+
 	OSCondition *port_ready_condition;
 
 	OSLock *pdelay_rx_lock;
@@ -234,10 +237,32 @@ protected:
 	 * @param [in] length buffer length
 	 * @param [in] remote address of sender
 	 * @param [in] link_speed of the receiving device
+	 * @param [in] rx_timestamp RX timestamp received with the frame. When
+	 * NULL, event message timestamps are read from the timestamper.
 	 */
 	void processMessage
 	( char *buf, int length, LinkLayerAddress *remote,
-	  uint32_t link_speed );
+	  uint32_t link_speed, Timestamp *rx_timestamp = NULL );
+
+	/**
+	 * @brief Validates the raw frame before any message object is
+	 * built: length, transportSpecific, PTP version and domain
+	 * @param [in] frame received frame
+	 * @return TRUE if the frame should be processed, FALSE to drop it
+	 */
+	bool acceptFrame( const PtpFrameView &frame );
+
+	/**
+	 * @brief Handles one frame delivered by the network interface
+	 * receive loop
+	 * @param [in] remote address of sender
+	 * @param [in] buf buffer containing message
+	 * @param [in] length buffer length
+	 * @param [in] rx_timestamp RX timestamp received with the frame or NULL
+	 */
+	void receiveFrame
+	( LinkLayerAddress *remote, uint8_t *buf, size_t length,
+	  Timestamp *rx_timestamp );
 
 	/**
 	 * @brief Receives messages from the network interface
@@ -339,6 +364,15 @@ protected:
 		last_sync = msg;
 	}
 
+	/**
+	 * @brief  Gets the transmit frame template of a message type
+	 * @param  type Message type
+	 * @return Template, invalid until the first send of that type
+	 */
+	PTPFrameTemplate *getTxTemplate( MessageType type ) {
+		return &tx_template[type & (PTP_TX_TEMPLATE_COUNT-1)];
+	}
+
 	/**
 	 * @brief  Gets last sync message
 	 * @return PTPMessageSync last sync
@@ -468,6 +502,24 @@ protected:
 	(PTPMessageCommon * msg, Timestamp & timestamp, unsigned &counter_value,
 	 bool last);
 
+	/**
+	 * @brief  Checks whether TX timestamps can be waited for
+	 * @return TRUE if waitTxTimestamp() is supported by the timestamper
+	 */
+	bool txTimestampWaitable();
+
+	/**
+	 * @brief  Waits for the TX timestamp of a PTP message
+	 * @param  msg PTPMessageCommon message
+	 * @param  timestamp [out] TX timestamp
+	 * @param  counter_value [out] timestamp count value
+	 * @param  timeout_us Maximum wait in microseconds
+	 * @return GPTP_EC_SUCCESS if no error, GPTP_EC_FAILURE if error and GPTP_EC_EAGAIN on timeout.
+	 */
+	int waitTxTimestamp
+	(PTPMessageCommon * msg, Timestamp & timestamp, unsigned &counter_value,
+	 unsigned timeout_us);
+
 	/**
 	 * @brief  Gets RX timestamp based on PTP message
 	 * @param  msg PTPMessageCommon message
@@ -52,6 +52,38 @@ public:
 	( PortIdentity * identity, PTPMessageId messageId,
 	  Timestamp &timestamp, unsigned &clock_value, bool last ) = 0;
 
+	/**
+	 * @brief  Reports whether HWTimestamper_txtimestamp_wait() is
+	 * implemented
+	 * @return TRUE if TX timestamps can be waited for, FALSE if they must
+	 * be polled with HWTimestamper_txtimestamp()
+	 */
+	virtual bool HWTimestamper_txtimestamp_waitable() const {
+		return false;
+	}
+
+	/**
+	 * @brief  Blocks until the TX timestamp of a message is available.
+	 * The caller is woken as soon as the timestamp arrives instead of
+	 * retrying on a sleep schedule. Always releases the lock, like a call
+	 * to HWTimestamper_txtimestamp() with last set. The calling thread
+	 * stays blocked for up to timeout_us, holding the network lock and
+	 * any lock of its own, if the timestamp never arrives.
+	 * @param  identity PTP port identity
+	 * @param  messageId Message ID
+	 * @param  timestamp [out] Timestamp value
+	 * @param  clock_value [out] Clock value
+	 * @param  timeout_us Maximum time to wait in microseconds
+	 * @return GPTP_EC_SUCCESS if no error, GPTP_EC_FAILURE if error and GPTP_EC_EAGAIN on timeout.
+	 */
+	virtual int HWTimestamper_txtimestamp_wait
+	( PortIdentity * /* identity */, PTPMessageId /* messageId */,
+	  Timestamp & /* timestamp */, unsigned & /* clock_value */,
+	  unsigned /* timeout_us */ )
+	{
+		return GPTP_EC_FAILURE;
+	}
+
 	/**
 	 * @brief  Get rx timestamp
 	 * @param  identity PTP port identity
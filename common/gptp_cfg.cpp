@@ -287,6 +287,16 @@ int GptpIniParser::iniCallBack(void *user, const char *section, const char *name
         }
     }
 
+    else if( parseMatch(section, "servo") )
+    {
+        // Validated here, applied on top of the profile's servo later
+        ClockServoConfig check;
+        if( check.set(name, value) ) {
+            valOK = true;
+            parser->_servo_settings.push_back(std::make_pair(std::string(name), std::string(value)));
+        }
+    }
+
     if(!valOK)
     {
         std::cerr << "Unrecognized configuration item: section=" << section << ", name=" << name << std::endl;
@@ -304,6 +314,16 @@ bool GptpIniParser::parseMatch(const char *s1, const char *s2)
     return strcasecmp(s1, s2) == 0;
 }
 
+void GptpIniParser::applyServoConfig(ClockServoConfig &servo)
+{
+    for( size_t i = 0; i < _servo_settings.size(); ++i )
+    {
+        servo.set(_servo_settings[i].first.c_str(), _servo_settings[i].second.c_str());
+    }
+}
+
+/****************************************************************************/
+
 #define PHY_DELAY_DESC_LEN 21
 
 void GptpIniParser::print_phy_delay( void )
@@ -35,10 +35,13 @@ https://github.com/benhoyt/inih/commit/74d2ca064fb293bc60a77b0bd068075b293cf175.
  */
 
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "ini.h"
 #include <limits.h>
 #include <common_port.hpp>
+#include <gptp_servo.hpp>
 
 const uint32_t LINKSPEED_10G =		10000000;
 const uint32_t LINKSPEED_2_5G =		2500000;
@@ -210,6 +213,14 @@ class GptpIniParser
             return _config.allowNegativeCorrField;
         }
 
+        /**
+         * @brief  Applies the keys of the [servo] section on top of the
+         * servo configuration of the selected profile
+         * @param  servo [in,out] Profile servo configuration
+         * @return void
+         */
+        void applyServoConfig(ClockServoConfig &servo);
+
 	/**
 	 * @brief Dump PHY delays to screen
 	 */
@@ -218,6 +229,7 @@ class GptpIniParser
     private:
         int _error;
         gptp_cfg_t _config;
+        std::vector< std::pair<std::string, std::string> > _servo_settings;
 
         static int iniCallBack(void *user, const char *section, const char *name, const char *value);
         static bool parseMatch(const char *s1, const char *s2);
@@ -4,6 +4,7 @@
  */
 
 #include "gptp_clock_quality.hpp"
+#include "gptp_clock_quality_tlv.hpp"
 #include <algorithm>
 #include <cmath>
 #include <sstream>
@@ -65,17 +66,376 @@ static double calculate_rms_error(const std::vector<int64_t>& values) {
     return std::sqrt(sum_squared / values.size());
 }
 
+// Accuracy the certification percentage check counts against
+static const int64_t CERTIFICATION_ACCURACY_NS = 80;
+
+// Consecutive good measurements that constitute lock
+static const uint32_t LOCK_REQUIRED_CONSECUTIVE = 5;
+
+static const uint64_t NO_LOCK = UINT64_MAX;
+
+// ============================================================================
+// MeasurementRing Implementation
+// ============================================================================
+
+MeasurementRing::MeasurementRing(size_t capacity)
+    : head_(0)
+    , size_(0)
+{
+    set_capacity(capacity);
+}
+
+void MeasurementRing::set_capacity(size_t capacity) {
+    if (capacity == offsets_ns_.size()) {
+        return;
+    }
+    
+    MeasurementRing resized;
+    resized.timestamps_ns_.resize(capacity);
+    resized.t1_master_tx_ns_.resize(capacity);
+    resized.t2_slave_rx_ns_.resize(capacity);
+    resized.path_delays_ns_.resize(capacity);
+    resized.offsets_ns_.resize(capacity);
+    resized.corrections_ns_.resize(capacity);
+    resized.valid_bits_.resize((capacity + 63) / 64);
+    
+    size_t keep = std::min(size_, capacity);
+    for (size_t i = size_ - keep; i < size_; ++i) {
+        resized.push_back((*this)[i]);
+    }
+    
+    std::swap(*this, resized);
+}
+
+size_t MeasurementRing::split(size_t first, size_t count, Segment segments[2]) const {
+    if (count == 0) {
+        return 0;
+    }
+    
+    size_t begin = physical(first);
+    size_t tail = offsets_ns_.size() - begin;
+    if (count <= tail) {
+        segments[0].begin = begin;
+        segments[0].end = begin + count;
+        return 1;
+    }
+    
+    segments[0].begin = begin;
+    segments[0].end = offsets_ns_.size();
+    segments[1].begin = 0;
+    segments[1].end = count - tail;
+    return 2;
+}
+
+void MeasurementRing::push_back(const ClockQualityMeasurement& measurement) {
+    assert(!full());
+    
+    size_t p = physical(size_);
+    timestamps_ns_[p] = measurement.timestamp_ns;
+    t1_master_tx_ns_[p] = measurement.t1_master_tx_ns;
+    t2_slave_rx_ns_[p] = measurement.t2_slave_rx_ns;
+    path_delays_ns_[p] = measurement.path_delay_ns;
+    offsets_ns_[p] = measurement.offset_from_master_ns;
+    corrections_ns_[p] = measurement.correction_field_ns;
+    
+    uint64_t bit = 1ULL << (p % 64);
+    if (measurement.valid) {
+        valid_bits_[p / 64] |= bit;
+    } else {
+        valid_bits_[p / 64] &= ~bit;
+    }
+    size_++;
+}
+
+void MeasurementRing::pop_front() {
+    assert(!empty());
+    
+    head_ = physical(1);
+    size_--;
+}
+
+ClockQualityMeasurement MeasurementRing::operator[](size_t index) const {
+    size_t p = physical(index);
+    ClockQualityMeasurement measurement;
+    
+    measurement.timestamp_ns = timestamps_ns_[p];
+    measurement.t1_master_tx_ns = t1_master_tx_ns_[p];
+    measurement.t2_slave_rx_ns = t2_slave_rx_ns_[p];
+    measurement.path_delay_ns = path_delays_ns_[p];
+    measurement.offset_from_master_ns = offsets_ns_[p];
+    measurement.correction_field_ns = corrections_ns_[p];
+    measurement.valid = (valid_bits_[p / 64] >> (p % 64)) & 1;
+    
+    return measurement;
+}
+
+uint32_t MeasurementRing::count_within(size_t first, size_t count, int64_t limit_ns) const {
+    const TimeErrorKernels& kernels = get_time_error_kernels();
+    Segment segments[2];
+    size_t n = split(first, count, segments);
+    uint32_t within = 0;
+    
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t block = segments[i].begin; block < segments[i].end; block += 64) {
+            size_t block_count = std::min<size_t>(64, segments[i].end - block);
+            within += count_set_bits(kernels.within_mask(&offsets_ns_[block], block_count, limit_ns));
+        }
+    }
+    return within;
+}
+
+uint32_t MeasurementRing::count_valid(size_t first, size_t count) const {
+    Segment segments[2];
+    size_t n = split(first, count, segments);
+    uint32_t valid = 0;
+    
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t block = segments[i].begin; block < segments[i].end; block += 64) {
+            size_t block_count = std::min<size_t>(64, segments[i].end - block);
+            valid += count_set_bits(extract_bits(valid_bits_.data(), block, block_count));
+        }
+    }
+    return valid;
+}
+
+uint32_t MeasurementRing::count_valid_within(size_t first, size_t count, int64_t limit_ns) const {
+    const TimeErrorKernels& kernels = get_time_error_kernels();
+    Segment segments[2];
+    size_t n = split(first, count, segments);
+    uint32_t within = 0;
+    
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t block = segments[i].begin; block < segments[i].end; block += 64) {
+            size_t block_count = std::min<size_t>(64, segments[i].end - block);
+            within += count_set_bits(
+                kernels.within_mask(&offsets_ns_[block], block_count, limit_ns) &
+                extract_bits(valid_bits_.data(), block, block_count));
+        }
+    }
+    return within;
+}
+
+void MeasurementRing::scan(size_t first, size_t count, int64_t target_accuracy_ns,
+                           TimeErrorSummary& summary) const {
+    Segment segments[2];
+    size_t n = split(first, count, segments);
+    
+    for (size_t i = 0; i < n; ++i) {
+        scan_time_errors(offsets_ns_.data(), valid_bits_.data(), segments[i].begin,
+                         segments[i].end, target_accuracy_ns, summary);
+    }
+}
+
+size_t MeasurementRing::find_good_run(size_t first, int64_t target_accuracy_ns,
+                                      uint32_t run_length) const {
+    Segment segments[2];
+    size_t n = split(first, size_ - first, segments);
+    size_t index = first;
+    uint32_t run = 0;
+    
+    for (size_t i = 0; i < n; ++i) {
+        size_t found = ::OpenAvnu::gPTP::find_good_run(
+            offsets_ns_.data(), valid_bits_.data(), segments[i].begin, segments[i].end,
+            target_accuracy_ns, run_length, run);
+        if (found != segments[i].end) {
+            return index + (found - segments[i].begin);
+        }
+        index += segments[i].end - segments[i].begin;
+    }
+    return size_;
+}
+
+size_t MeasurementRing::lower_bound_timestamp(uint64_t timestamp_ns) const {
+    size_t low = 0;
+    size_t high = size_;
+    
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (this->timestamp_ns(middle) < timestamp_ns) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/**
+ * Time error statistics from the power sums and extremes of the valid
+ * measurements, matching ClockQualityAnalyzer::calculate_statistics()
+ */
+static void fill_time_error_statistics(ClockQualityMetrics& metrics, uint32_t count,
+                                       int64_t sum_ns, uint64_t sum_squares,
+                                       int64_t min_ns, int64_t max_ns) {
+    metrics.total_measurements = count;
+    metrics.mean_time_error_ns = sum_ns / static_cast<int64_t>(count);
+    metrics.min_time_error_ns = min_ns;
+    metrics.max_time_error_ns = max_ns;
+    
+    // Squared deviations around the integer mean, as the batch
+    // computation takes them: sum((x - m)^2) = Q - 2mS + nm^2. The
+    // intermediate terms may wrap, the result is exact.
+    if (count > 1) {
+        uint64_t mean = static_cast<uint64_t>(metrics.mean_time_error_ns);
+        uint64_t deviation = sum_squares
+            - 2 * mean * static_cast<uint64_t>(sum_ns)
+            + static_cast<uint64_t>(count) * mean * mean;
+        metrics.std_dev_ns = std::sqrt(static_cast<double>(deviation) / (count - 1));
+    }
+    metrics.rms_error_ns = std::sqrt(static_cast<double>(sum_squares) / count);
+}
+
+// ============================================================================
+// TimeErrorWindowStatistics Implementation
+// ============================================================================
+
+TimeErrorWindowStatistics::TimeErrorWindowStatistics(uint32_t window_seconds,
+                                                     int64_t target_accuracy_ns)
+    : window_seconds_(window_seconds)
+    , target_accuracy_ns_(target_accuracy_ns)
+    , query_time_ns_(0)
+{
+    reset(0);
+}
+
+void TimeErrorWindowStatistics::reset(uint64_t next_sequence) {
+    first_sequence_ = next_sequence;
+    next_sequence_ = next_sequence;
+    first_valid_ = 0;
+    next_valid_ = 0;
+    sum_ns_ = 0;
+    sum_squares_ = 0;
+    outlier_count_ = 0;
+    within_80ns_count_ = 0;
+    min_queue_.clear();
+    max_queue_.clear();
+    runs_.clear();
+    longest_runs_.clear();
+    run_open_ = false;
+}
+
+void TimeErrorWindowStatistics::push_back(int64_t error, bool valid) {
+    next_sequence_++;
+    if (std::abs(error) <= CERTIFICATION_ACCURACY_NS) {
+        within_80ns_count_++;
+    }
+    if (!valid) {
+        return;
+    }
+    
+    uint64_t index = next_valid_++;
+    
+    // Power sums. Valid time errors are bounded to ±10ms, so the squares
+    // sum exactly in 64 bits for windows of up to ~180000 measurements.
+    sum_ns_ += error;
+    sum_squares_ += static_cast<uint64_t>(error) * static_cast<uint64_t>(error);
+    
+    while (!min_queue_.empty() && min_queue_.back().value >= error) {
+        min_queue_.pop_back();
+    }
+    min_queue_.push_back({index, error});
+    while (!max_queue_.empty() && max_queue_.back().value <= error) {
+        max_queue_.pop_back();
+    }
+    max_queue_.push_back({index, error});
+    
+    if (std::abs(error) > target_accuracy_ns_) {
+        outlier_count_++;
+        if (run_open_) {
+            run_open_ = false;
+            // The front run is clipped as the window slides and is
+            // accounted for separately
+            if (runs_.size() > 1) {
+                const GoodRun& closed = runs_.back();
+                while (!longest_runs_.empty() &&
+                       longest_runs_.back().end - longest_runs_.back().begin <=
+                       closed.end - closed.begin) {
+                    longest_runs_.pop_back();
+                }
+                longest_runs_.push_back(closed);
+            }
+        }
+    } else if (run_open_) {
+        runs_.back().end = index + 1;
+    } else {
+        runs_.push_back({index, index + 1});
+        run_open_ = true;
+    }
+}
+
+void TimeErrorWindowStatistics::pop_front(int64_t error, bool valid) {
+    first_sequence_++;
+    if (std::abs(error) <= CERTIFICATION_ACCURACY_NS) {
+        within_80ns_count_--;
+    }
+    if (!valid) {
+        return;
+    }
+    
+    uint64_t index = first_valid_++;
+    
+    sum_ns_ -= error;
+    sum_squares_ -= static_cast<uint64_t>(error) * static_cast<uint64_t>(error);
+    
+    if (!min_queue_.empty() && min_queue_.front().index == index) {
+        min_queue_.pop_front();
+    }
+    if (!max_queue_.empty() && max_queue_.front().index == index) {
+        max_queue_.pop_front();
+    }
+    
+    if (std::abs(error) > target_accuracy_ns_) {
+        outlier_count_--;
+    } else if (runs_.front().end <= first_valid_) {
+        runs_.pop_front();
+        if (runs_.empty()) {
+            run_open_ = false;
+        } else if (!longest_runs_.empty() &&
+                   longest_runs_.front().begin == runs_.front().begin) {
+            longest_runs_.pop_front();
+        }
+    }
+}
+
+void TimeErrorWindowStatistics::fill_statistics(ClockQualityMetrics& metrics) const {
+    uint32_t count = get_valid_count();
+    if (count == 0) {
+        return;
+    }
+    
+    fill_time_error_statistics(metrics, count, sum_ns_, sum_squares_,
+                               min_queue_.front().value, max_queue_.front().value);
+    metrics.outlier_count = outlier_count_;
+    
+    uint64_t longest = 0;
+    if (!runs_.empty()) {
+        const GoodRun& front = runs_.front();
+        longest = front.end - std::max(front.begin, first_valid_);
+        if (!longest_runs_.empty()) {
+            longest = std::max(longest, longest_runs_.front().end - longest_runs_.front().begin);
+        }
+        if (run_open_ && runs_.size() > 1) {
+            longest = std::max(longest, runs_.back().end - runs_.back().begin);
+        }
+    }
+    metrics.consecutive_good_measurements = static_cast<uint32_t>(longest);
+}
+
 // ============================================================================
 // IngressEventMonitor Implementation
 // ============================================================================
 
 IngressEventMonitor::IngressEventMonitor(const ClockQualityConfig& config)
-    : config_(config)
+    : measurements_(config.max_history_measurements)
+    , config_(config)
     , monitoring_enabled_(false)
     , monitoring_start_time_(0)
     , last_sync_sequence_id_(0)
+    , first_sequence_(0)
+    , lock_target_ns_(config.target_accuracy_ns)
+    , lock_sequence_(NO_LOCK)
+    , good_run_begin_(0)
 {
-    measurements_.clear();
 }
 
 uint64_t IngressEventMonitor::get_monotonic_time_ns() const {
@@ -86,7 +446,7 @@ void IngressEventMonitor::enable_monitoring(uint32_t interval_ms) {
     config_.measurement_interval_ms = interval_ms;
     monitoring_enabled_ = true;
     monitoring_start_time_ = get_monotonic_time_ns();
-    measurements_.clear();
+    reset_history();
     
     // Log monitoring start
     // TODO: Add proper logging framework integration
@@ -120,9 +480,49 @@ bool IngressEventMonitor::is_measurement_valid(const ClockQualityMeasurement& me
     return true;
 }
 
-void IngressEventMonitor::trim_measurement_history() {
-    while (measurements_.size() > config_.max_history_measurements) {
+void IngressEventMonitor::trim_measurement_history(size_t limit) {
+    while (measurements_.size() > limit) {
+        int64_t offset = measurements_.offset_ns(0);
+        bool valid = measurements_.valid(0);
+        for (auto& window : windows_) {
+            if (window.second.get_first_sequence() == first_sequence_) {
+                window.second.pop_front(offset, valid);
+            }
+        }
         measurements_.pop_front();
+        first_sequence_++;
+        
+        // The lock point is searched from the front of the history; once
+        // the front cuts into its good run it moves or disappears
+        if (lock_sequence_ != NO_LOCK &&
+            lock_sequence_ < first_sequence_ + LOCK_REQUIRED_CONSECUTIVE - 1) {
+            find_lock_point();
+        }
+    }
+}
+
+void IngressEventMonitor::reset_history() {
+    measurements_.clear();
+    windows_.clear();
+    stability_.reset();
+    first_sequence_ = 0;
+    lock_sequence_ = NO_LOCK;
+    good_run_begin_ = 0;
+}
+
+void IngressEventMonitor::find_lock_point() const {
+    lock_sequence_ = NO_LOCK;
+    good_run_begin_ = first_sequence_;
+    
+    for (size_t i = 0; i < measurements_.size(); ++i) {
+        uint64_t sequence = first_sequence_ + i;
+        if (!measurements_.valid(i) ||
+            std::abs(measurements_.offset_ns(i)) > lock_target_ns_) {
+            good_run_begin_ = sequence + 1;
+        } else if (sequence + 1 - good_run_begin_ >= LOCK_REQUIRED_CONSECUTIVE) {
+            lock_sequence_ = sequence;
+            return;
+        }
     }
 }
 
@@ -156,13 +556,98 @@ void IngressEventMonitor::record_sync_ingress(uint64_t t1_master_tx, uint64_t t2
     // Validate measurement
     measurement.valid = is_measurement_valid(measurement);
     
+    record_measurement(measurement);
+}
+
+void IngressEventMonitor::record_measurement(const ClockQualityMeasurement& measurement) {
+    if (config_.max_history_measurements == 0) {
+        return;
+    }
+    
+    // Make room for the measurement
+    trim_measurement_history(config_.max_history_measurements - 1);
+    
+    uint64_t sequence = first_sequence_ + measurements_.size();
+    
     // Store measurement
     measurements_.push_back(measurement);
-    trim_measurement_history();
+    for (auto& window : windows_) {
+        window.second.push_back(measurement.offset_from_master_ns, measurement.valid);
+    }
+    if (measurement.valid) {
+        stability_.add_sample(measurement.timestamp_ns, measurement.offset_from_master_ns);
+    }
+    
+    if (lock_sequence_ == NO_LOCK) {
+        if (!measurement.valid ||
+            std::abs(measurement.offset_from_master_ns) > lock_target_ns_) {
+            good_run_begin_ = sequence + 1;
+        } else if (sequence + 1 - std::max(good_run_begin_, first_sequence_) >=
+                   LOCK_REQUIRED_CONSECUTIVE) {
+            lock_sequence_ = sequence;
+        }
+    }
+}
+
+std::deque<ClockQualityMeasurement> IngressEventMonitor::get_measurement_history() const {
+    std::deque<ClockQualityMeasurement> history;
+    for (size_t i = 0; i < measurements_.size(); ++i) {
+        history.push_back(measurements_[i]);
+    }
+    return history;
+}
+
+const TimeErrorWindowStatistics& IngressEventMonitor::get_window_statistics(
+    uint32_t window_seconds, int64_t target_accuracy_ns, uint64_t now_ns) const {
+    
+    auto it = windows_.find(window_seconds);
+    
+    // Expired measurements cannot re-enter a window, so a query for an
+    // earlier time replays the history like a new window does
+    bool replay = it == windows_.end() ||
+        it->second.get_target_accuracy_ns() != target_accuracy_ns ||
+        (window_seconds != 0 && now_ns < it->second.get_query_time_ns());
+    
+    TimeErrorWindowStatistics& window = windows_[window_seconds];
+    if (replay) {
+        window = TimeErrorWindowStatistics(window_seconds, target_accuracy_ns);
+        window.reset(first_sequence_);
+        for (size_t i = 0; i < measurements_.size(); ++i) {
+            window.push_back(measurements_.offset_ns(i), measurements_.valid(i));
+        }
+    }
+    if (window_seconds != 0) {
+        uint64_t window_start = now_ns - (static_cast<uint64_t>(window_seconds) * 1000000000ULL);
+        while (window.size() > 0) {
+            size_t index = static_cast<size_t>(window.get_first_sequence() - first_sequence_);
+            if (measurements_.timestamp_ns(index) >= window_start) {
+                break;
+            }
+            window.pop_front(measurements_.offset_ns(index), measurements_.valid(index));
+        }
+    }
+    window.set_query_time_ns(now_ns);
+    
+    return window;
+}
+
+uint32_t IngressEventMonitor::get_lock_time_seconds(int64_t target_accuracy_ns) const {
+    if (target_accuracy_ns != lock_target_ns_) {
+        lock_target_ns_ = target_accuracy_ns;
+        find_lock_point();
+    }
+    
+    if (lock_sequence_ == NO_LOCK) {
+        return 0;
+    }
+    
+    uint64_t lock_time_ns = measurements_.timestamp_ns(static_cast<size_t>(lock_sequence_ - first_sequence_)) -
+                            measurements_.timestamp_ns(0);
+    return static_cast<uint32_t>(lock_time_ns / 1000000000ULL);
 }
 
 void IngressEventMonitor::clear_measurements() {
-    measurements_.clear();
+    reset_history();
     monitoring_start_time_ = get_monotonic_time_ns();
 }
 
@@ -171,91 +656,73 @@ void IngressEventMonitor::update_config(const ClockQualityConfig& config) {
     
     // Trim history if new limit is smaller
     if (measurements_.size() > config_.max_history_measurements) {
-        trim_measurement_history();
+        trim_measurement_history(config_.max_history_measurements);
     }
+    measurements_.set_capacity(config_.max_history_measurements);
 }
 
 std::vector<uint8_t> IngressEventMonitor::export_tlv_data() const {
-    // TODO: Implement TLV encoding for remote monitoring
-    // This would follow IEEE 1588 TLV format for ingress monitoring data
     std::vector<uint8_t> tlv_data;
     
-    // TLV Header (simplified)
-    // Type: 0x8001 (custom OpenAvnu clock quality TLV)
-    tlv_data.push_back(0x80);
-    tlv_data.push_back(0x01);
-    
-    // Length: (measurements count * measurement size) + header
-    uint16_t length = static_cast<uint16_t>(measurements_.size() * 32 + 8);
-    tlv_data.push_back((length >> 8) & 0xFF);
-    tlv_data.push_back(length & 0xFF);
-    
-    // Config data
-    tlv_data.push_back((config_.measurement_interval_ms >> 8) & 0xFF);
-    tlv_data.push_back(config_.measurement_interval_ms & 0xFF);
-    tlv_data.push_back(static_cast<uint8_t>(config_.profile_type));
-    tlv_data.push_back(monitoring_enabled_ ? 1 : 0);
-    
-    // Measurement count
-    uint32_t count = static_cast<uint32_t>(measurements_.size());
-    tlv_data.push_back((count >> 24) & 0xFF);
-    tlv_data.push_back((count >> 16) & 0xFF);
-    tlv_data.push_back((count >> 8) & 0xFF);
-    tlv_data.push_back(count & 0xFF);
-    
-    // Measurements (simplified encoding - timestamp + offset)
-    for (const auto& measurement : measurements_) {
-        if (!measurement.valid) continue;
-        
-        // Timestamp (8 bytes)
-        uint64_t ts = measurement.timestamp_ns;
-        for (int i = 7; i >= 0; i--) {
-            tlv_data.push_back((ts >> (i * 8)) & 0xFF);
-        }
-        
-        // Offset from master (8 bytes, signed)
-        uint64_t offset = static_cast<uint64_t>(measurement.offset_from_master_ns);
-        for (int i = 7; i >= 0; i--) {
-            tlv_data.push_back((offset >> (i * 8)) & 0xFF);
-        }
-        
-        // Path delay (8 bytes)
-        uint64_t delay = measurement.path_delay_ns;
-        for (int i = 7; i >= 0; i--) {
-            tlv_data.push_back((delay >> (i * 8)) & 0xFF);
-        }
-        
-        // Correction field (8 bytes)
-        uint64_t corr = measurement.correction_field_ns;
-        for (int i = 7; i >= 0; i--) {
-            tlv_data.push_back((corr >> (i * 8)) & 0xFF);
+    // Measurements take about 12 bytes at 8/s, the stability TLV a few hundred
+    tlv_data.reserve(measurements_.size() * 16 + 1024);
+    ClockQualityTlvVectorSink sink(tlv_data);
+    export_tlv_data(sink, CLOCK_QUALITY_TLV_MAX_LENGTH);
+    return tlv_data;
+}
+
+bool IngressEventMonitor::export_tlv_data(ClockQualityTlvSink& sink, uint16_t max_length) const {
+    ClockQualityTlvInfo info;
+    info.measurement_interval_ms = static_cast<uint16_t>(config_.measurement_interval_ms);
+    info.profile_type = config_.profile_type;
+    info.monitoring_enabled = monitoring_enabled_;
+    
+    ClockQualityTlvEncoder encoder(sink, info, max_length);
+    for (size_t i = 0; i < measurements_.size(); ++i) {
+        if (!encoder.add(measurements_[i])) {
+            return false;
         }
     }
+    if (!encoder.flush()) {
+        return false;
+    }
     
-    return tlv_data;
+    if (config_.stability_analysis_enabled) {
+        return encoder.write_stability(
+            stability_.get_results(config_.measurement_interval_ms / 1000.0));
+    }
+    return true;
 }
 
 bool IngressEventMonitor::import_tlv_data(const std::vector<uint8_t>& tlv_data) {
-    // TODO: Implement TLV decoding for remote monitoring data
-    // This would parse the TLV format created by export_tlv_data()
+    std::vector<ClockQualityMeasurement> imported;
+    size_t pos = 0;
     
-    if (tlv_data.size() < 8) {
-        return false; // Minimum TLV header size
+    if (tlv_data.empty()) {
+        return false;
     }
     
-    // Validate TLV type
-    uint16_t type = (static_cast<uint16_t>(tlv_data[0]) << 8) | tlv_data[1];
-    if (type != 0x8001) {
-        return false; // Wrong TLV type
+    // Decode everything before recording, so a malformed TLV imports nothing
+    while (pos < tlv_data.size()) {
+        if (tlv_data.size() - pos < 4) {
+            return false; // Truncated TLV header
+        }
+        uint16_t type = static_cast<uint16_t>((tlv_data[pos] << 8) | tlv_data[pos + 1]);
+        uint16_t length = static_cast<uint16_t>((tlv_data[pos + 2] << 8) | tlv_data[pos + 3]);
+        if (tlv_data.size() - pos - 4 < length) {
+            return false; // Insufficient data
+        }
+        
+        if (type == CLOCK_QUALITY_TLV_MEASUREMENTS &&
+            !decode_clock_quality_measurements(&tlv_data[pos + 4], length, nullptr, imported)) {
+            return false;
+        }
+        pos += 4 + length;
     }
     
-    // Parse length  
-    uint16_t length = (static_cast<uint16_t>(tlv_data[2]) << 8) | tlv_data[3];
-    if (tlv_data.size() < length + 4) {
-        return false; // Insufficient data
+    for (const auto& measurement : imported) {
+        record_measurement(measurement);
     }
-    
-    // TODO: Complete implementation
     return true;
 }
 
@@ -387,7 +854,7 @@ uint32_t ClockQualityAnalyzer::calculate_lock_time(
 
 ClockQualityMetrics ClockQualityAnalyzer::analyze_measurements(
     const std::deque<ClockQualityMeasurement>& measurements,
-    uint32_t window_seconds) const {
+    uint32_t window_seconds, uint64_t now_ns) const {
     
     ClockQualityMetrics metrics;
     metrics.active_profile = config_.profile_type;
@@ -405,7 +872,7 @@ ClockQualityMetrics ClockQualityAnalyzer::analyze_measurements(
         window_measurements = measurements;
     } else {
         // Select recent measurements within window
-        uint64_t current_time = get_monotonic_time_ns();
+        uint64_t current_time = now_ns != 0 ? now_ns : get_monotonic_time_ns();
         uint64_t window_start = current_time - (static_cast<uint64_t>(window_seconds) * 1000000000ULL);
         
         for (const auto& measurement : measurements) {
@@ -422,36 +889,170 @@ ClockQualityMetrics ClockQualityAnalyzer::analyze_measurements(
     metrics.is_locked = detect_lock_state(window_measurements);
     metrics.lock_time_seconds = calculate_lock_time(measurements); // Use full history for lock time
     
-    // Validate certification requirements - use percentage-based accuracy
     uint32_t measurements_within_80ns = 0;
     for (const auto& m : window_measurements) {
-        if (std::abs(m.offset_from_master_ns) <= 80) {
+        if (std::abs(m.offset_from_master_ns) <= CERTIFICATION_ACCURACY_NS) {
             measurements_within_80ns++;
         }
     }
     
+    apply_certification_checks(metrics, window_measurements.size(), measurements_within_80ns);
+    
+    if (config_.stability_analysis_enabled) {
+        TimeStabilityAnalyzer stability;
+        for (const auto& measurement : measurements) {
+            if (measurement.valid) {
+                stability.add_sample(measurement.timestamp_ns, measurement.offset_from_master_ns);
+            }
+        }
+        apply_stability(metrics, stability);
+    }
+    
+    return metrics;
+}
+
+ClockQualityMetrics ClockQualityAnalyzer::analyze_measurements(
+    const IngressEventMonitor& monitor,
+    uint32_t window_seconds, uint64_t now_ns) const {
+    
+    ClockQualityMetrics metrics;
+    metrics.active_profile = config_.profile_type;
+    metrics.measurement_method = ClockQualityMethod::INGRESS_REPORTING;
+    metrics.measurement_interval_ms = config_.measurement_interval_ms;
+    
+    if (monitor.get_measurement_count() == 0) {
+        return metrics;
+    }
+    
+    if (now_ns == 0) {
+        now_ns = get_monotonic_time_ns();
+    }
+    const TimeErrorWindowStatistics& window =
+        monitor.get_window_statistics(window_seconds, config_.target_accuracy_ns, now_ns);
+    uint64_t first = window.get_first_sequence();
+    uint64_t last = window.get_next_sequence() - 1;
+    
+    window.fill_statistics(metrics);
+    if (window.get_valid_count() > 0) {
+        metrics.measurement_start_time = monitor.get_measurement(first).timestamp_ns;
+        metrics.last_measurement_time = monitor.get_measurement(last).timestamp_ns;
+        
+        uint64_t duration_ns = metrics.last_measurement_time - metrics.measurement_start_time;
+        metrics.observation_window_s = static_cast<uint32_t>(duration_ns / 1000000000ULL);
+    }
+    
+    // Same criterion as detect_lock_state(), on the newest measurements
+    // of the window
+    const uint32_t CHECK_COUNT = 10;
+    if (window.size() >= CHECK_COUNT) {
+        size_t index = static_cast<size_t>(last + 1 - CHECK_COUNT - monitor.get_first_sequence());
+        uint32_t recent_good_count = monitor.get_measurement_ring().count_valid_within(
+            index, CHECK_COUNT, config_.target_accuracy_ns);
+        metrics.is_locked = (recent_good_count * 100 / CHECK_COUNT) >= 80;
+    }
+    metrics.lock_time_seconds = monitor.get_lock_time_seconds(config_.target_accuracy_ns);
+    
+    apply_certification_checks(metrics, window.size(), window.get_within_80ns_count());
+    if (config_.stability_analysis_enabled) {
+        apply_stability(metrics, monitor.get_stability_analyzer());
+    }
+    
+    return metrics;
+}
+
+ClockQualityMetrics ClockQualityAnalyzer::analyze_measurements(
+    const MeasurementRing& ring,
+    uint32_t window_seconds, uint64_t now_ns) const {
+    
+    ClockQualityMetrics metrics;
+    metrics.active_profile = config_.profile_type;
+    metrics.measurement_method = ClockQualityMethod::INGRESS_REPORTING;
+    metrics.measurement_interval_ms = config_.measurement_interval_ms;
+    
+    if (ring.empty()) {
+        return metrics;
+    }
+    
+    // Select measurements within the specified window
+    size_t first = 0;
+    if (window_seconds != 0) {
+        uint64_t current_time = now_ns != 0 ? now_ns : get_monotonic_time_ns();
+        uint64_t window_start = current_time - (static_cast<uint64_t>(window_seconds) * 1000000000ULL);
+        first = ring.lower_bound_timestamp(window_start);
+    }
+    size_t count = ring.size() - first;
+    size_t last = ring.size() - 1;
+    
+    TimeErrorSummary summary;
+    ring.scan(first, count, config_.target_accuracy_ns, summary);
+    if (summary.valid_count > 0) {
+        fill_time_error_statistics(metrics, summary.valid_count, summary.sum_ns,
+                                   summary.sum_squares, summary.min_ns, summary.max_ns);
+        metrics.outlier_count = summary.outlier_count;
+        metrics.consecutive_good_measurements = summary.longest_good_run;
+        
+        metrics.measurement_start_time = ring.timestamp_ns(first);
+        metrics.last_measurement_time = ring.timestamp_ns(last);
+        
+        uint64_t duration_ns = metrics.last_measurement_time - metrics.measurement_start_time;
+        metrics.observation_window_s = static_cast<uint32_t>(duration_ns / 1000000000ULL);
+    }
+    
+    // Same criteria as detect_lock_state() and calculate_lock_time()
+    const uint32_t CHECK_COUNT = 10;
+    if (count >= CHECK_COUNT) {
+        uint32_t recent_good_count = ring.count_valid_within(
+            ring.size() - CHECK_COUNT, CHECK_COUNT, config_.target_accuracy_ns);
+        metrics.is_locked = (recent_good_count * 100 / CHECK_COUNT) >= 80;
+    }
+    size_t lock = ring.find_good_run(0, config_.target_accuracy_ns, LOCK_REQUIRED_CONSECUTIVE);
+    if (lock != ring.size()) {
+        uint64_t lock_time_ns = ring.timestamp_ns(lock) - ring.timestamp_ns(0);
+        metrics.lock_time_seconds = static_cast<uint32_t>(lock_time_ns / 1000000000ULL);
+    }
+    
+    apply_certification_checks(metrics, count, summary.within_80ns_count);
+    
+    if (config_.stability_analysis_enabled) {
+        TimeStabilityAnalyzer stability;
+        for (size_t i = 0; i < ring.size(); ++i) {
+            if (ring.valid(i)) {
+                stability.add_sample(ring.timestamp_ns(i), ring.offset_ns(i));
+            }
+        }
+        apply_stability(metrics, stability);
+    }
+    
+    return metrics;
+}
+
+void ClockQualityAnalyzer::apply_certification_checks(
+    ClockQualityMetrics& metrics, size_t window_size, uint32_t within_80ns) const {
+    
+    // Validate certification requirements - use percentage-based accuracy
     // Require 95% of measurements to be within ±80ns tolerance
-    double accuracy_percentage = (double)measurements_within_80ns / window_measurements.size();
+    double accuracy_percentage = (double)within_80ns / window_size;
     metrics.meets_80ns_requirement = (accuracy_percentage >= 0.95) && (std::abs(metrics.mean_time_error_ns) <= 80);
     metrics.meets_lock_time_requirement = (metrics.lock_time_seconds <= config_.max_lock_time_s);
     metrics.meets_stability_requirement = (metrics.observation_window_s >= config_.stability_window_s) &&
                                         metrics.is_locked;
-    
-    // Calculate frequency stability (simplified)
-    if (window_measurements.size() > 1) {
-        // Estimate frequency stability from time error drift
-        double time_span_s = static_cast<double>(metrics.observation_window_s);
-        double error_drift_ns = static_cast<double>(
-            window_measurements.back().offset_from_master_ns - 
-            window_measurements.front().offset_from_master_ns);
-        
-        if (time_span_s > 0) {
-            // Convert to parts per billion
-            metrics.frequency_stability_ppb = (error_drift_ns / time_span_s) / 1000.0;
-        }
+}
+
+void ClockQualityAnalyzer::apply_stability(ClockQualityMetrics& metrics,
+                                           const TimeStabilityAnalyzer& stability) const {
+    metrics.stability = stability.get_results(config_.measurement_interval_ms / 1000.0);
+    if (metrics.stability.empty()) {
+        return;
     }
     
-    return metrics;
+    // Frequency stability is the Allan deviation at the first observation
+    // interval of at least 1s, or the longest one observed so far
+    auto point = std::find_if(metrics.stability.begin(), metrics.stability.end(),
+                              [](const TimeStabilityPoint& p) { return p.tau_s >= 1.0; });
+    if (point == metrics.stability.end()) {
+        --point;
+    }
+    metrics.frequency_stability_ppb = point->adev * 1e9;
 }
 
 bool ClockQualityAnalyzer::validate_certification_requirements(
@@ -582,6 +1183,17 @@ std::string ClockQualityAnalyzer::generate_compliance_report(const ClockQualityM
     } else {
         report << "\n";
     }
+    if (!metrics.stability.empty()) {
+        report << "\n";
+        report << std::setw(10) << "Tau (s)" << std::setw(14) << "ADEV"
+               << std::setw(14) << "TDEV (ns)" << std::setw(14) << "MTIE (ns)" << "\n";
+        for (const auto& point : metrics.stability) {
+            report << std::fixed << std::setprecision(3) << std::setw(10) << point.tau_s
+                   << std::scientific << std::setprecision(3) << std::setw(14) << point.adev
+                   << std::fixed << std::setprecision(2) << std::setw(14) << point.tdev_ns
+                   << std::setw(14) << point.mtie_ns << "\n";
+        }
+    }
     report << "\n";
     
     // Certification compliance
@@ -22,9 +22,14 @@
 #include <string>
 #include <map>
 
+#include "gptp_time_error_kernels.hpp"
+#include "gptp_time_stability.hpp"
+
 namespace OpenAvnu {
 namespace gPTP {
 
+class ClockQualityTlvSink;
+
 /**
  * @brief Clock quality measurement method
  */
@@ -106,7 +111,8 @@ struct ClockQualityMetrics {
     uint64_t window_start_time;      ///< Window start timestamp
     
     // Stability Metrics
-    double frequency_stability_ppb;   ///< Frequency stability (parts per billion)
+    double frequency_stability_ppb;   ///< Allan deviation near tau = 1s (parts per billion)
+    std::vector<TimeStabilityPoint> stability; ///< ADEV, TDEV and MTIE by observation interval
     uint32_t consecutive_good_measurements; ///< Consecutive measurements within spec
     uint32_t total_measurements;     ///< Total measurements in window
     uint32_t outlier_count;          ///< Measurements outside tolerance
@@ -152,6 +158,7 @@ struct ClockQualityConfig {
     uint32_t analysis_window_seconds;    ///< Analysis window (default: 300s)
     uint32_t max_history_measurements;   ///< Maximum stored measurements
     bool real_time_analysis_enabled;     ///< Enable real-time analysis
+    bool stability_analysis_enabled;     ///< Report ADEV, TDEV and MTIE
     
     // Certification Requirements
     int64_t target_accuracy_ns;          ///< Target accuracy (default: ±80ns)
@@ -182,6 +189,7 @@ struct ClockQualityConfig {
         , primary_measurement_method(MeasurementMethod::INGRESS_REPORTING)
         , measurement_interval_ms(125), analysis_window_seconds(300)
         , max_history_measurements(10000), real_time_analysis_enabled(true)
+        , stability_analysis_enabled(true)
         , target_accuracy_ns(80), max_lock_time_s(6), stability_window_s(300)
         , tlv_reporting_enabled(false), console_output_enabled(true)
         , csv_export_enabled(false), csv_export_path("")
@@ -190,6 +198,217 @@ struct ClockQualityConfig {
         , profile_type(ProfileType::STANDARD) {}
 };
 
+/**
+ * @brief Fixed-capacity ring of measurements stored as separate arrays
+ *
+ * Each measurement field lives in its own contiguous array, with the
+ * validity flags packed into a bitmap, so scans over time errors touch
+ * only the time errors and run on the vectorized kernels of
+ * gptp_time_error_kernels.hpp. Storage is allocated by set_capacity();
+ * appends and removals never allocate.
+ */
+class MeasurementRing {
+private:
+    struct Segment {
+        size_t begin;   ///< First physical index
+        size_t end;     ///< One past the last physical index
+    };
+
+    std::vector<uint64_t> timestamps_ns_;
+    std::vector<uint64_t> t1_master_tx_ns_;
+    std::vector<uint64_t> t2_slave_rx_ns_;
+    std::vector<uint64_t> path_delays_ns_;
+    std::vector<int64_t> offsets_ns_;
+    std::vector<uint64_t> corrections_ns_;
+    std::vector<uint64_t> valid_bits_;  ///< Bit i set if measurement i is valid
+    size_t head_;                       ///< Physical index of the front measurement
+    size_t size_;
+
+    size_t physical(size_t index) const {
+        size_t p = head_ + index;
+        return p >= offsets_ns_.size() ? p - offsets_ns_.size() : p;
+    }
+
+    /**
+     * @brief Split a logical range into at most two physical ranges
+     * @return Number of segments filled in
+     */
+    size_t split(size_t first, size_t count, Segment segments[2]) const;
+
+public:
+    /**
+     * @brief Constructor
+     * @param capacity Number of measurements the ring holds
+     */
+    explicit MeasurementRing(size_t capacity = 0);
+
+    /**
+     * @brief Change the capacity, keeping the newest measurements
+     */
+    void set_capacity(size_t capacity);
+
+    size_t capacity() const { return offsets_ns_.size(); }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    bool full() const { return size_ == offsets_ns_.size(); }
+    void clear() { head_ = 0; size_ = 0; }
+
+    /**
+     * @brief Append a measurement; the ring must not be full
+     */
+    void push_back(const ClockQualityMeasurement& measurement);
+
+    /**
+     * @brief Remove the oldest measurement; the ring must not be empty
+     */
+    void pop_front();
+
+    /**
+     * @brief Get measurement by index, 0 being the oldest
+     */
+    ClockQualityMeasurement operator[](size_t index) const;
+
+    uint64_t timestamp_ns(size_t index) const { return timestamps_ns_[physical(index)]; }
+    int64_t offset_ns(size_t index) const { return offsets_ns_[physical(index)]; }
+    bool valid(size_t index) const {
+        size_t p = physical(index);
+        return (valid_bits_[p / 64] >> (p % 64)) & 1;
+    }
+
+    /**
+     * @brief Count measurements in [first, first + count) with |time error| <= limit_ns
+     */
+    uint32_t count_within(size_t first, size_t count, int64_t limit_ns) const;
+
+    /**
+     * @brief Count valid measurements in [first, first + count)
+     */
+    uint32_t count_valid(size_t first, size_t count) const;
+
+    /**
+     * @brief Count valid measurements in [first, first + count) with |time error| <= limit_ns
+     */
+    uint32_t count_valid_within(size_t first, size_t count, int64_t limit_ns) const;
+
+    /**
+     * @brief Summarize the measurements in [first, first + count)
+     */
+    void scan(size_t first, size_t count, int64_t target_accuracy_ns,
+              TimeErrorSummary& summary) const;
+
+    /**
+     * @brief Find the first run of good measurements at or after first
+     * @param run_length Consecutive valid measurements within target accuracy
+     * @return Index of the measurement completing the run, or size()
+     */
+    size_t find_good_run(size_t first, int64_t target_accuracy_ns, uint32_t run_length) const;
+
+    /**
+     * @brief Index of the first measurement taken at or after timestamp_ns
+     *
+     * Requires timestamps that do not decrease.
+     */
+    size_t lower_bound_timestamp(uint64_t timestamp_ns) const;
+};
+
+/**
+ * @brief Time error statistics of a sliding measurement window
+ *
+ * Maintains the quantities ClockQualityAnalyzer derives from a window of
+ * measurements while measurements enter at the back and leave at the
+ * front, at O(1) amortized cost per measurement and per query:
+ * - exact integer power sums of the valid time errors, from which mean,
+ *   standard deviation and RMS follow without a pass over the window
+ * - monotonic deques holding the sliding minimum and maximum
+ * - the runs of measurements within target accuracy, with a monotonic
+ *   deque of run lengths for the longest run
+ *
+ * Measurements are identified by sequence number; the owner pushes and
+ * pops them in order and passes the time error and validity of the
+ * measurement being removed.
+ */
+class TimeErrorWindowStatistics {
+private:
+    struct Extreme {
+        uint64_t index;     ///< Valid measurement index
+        int64_t value;      ///< Time error in nanoseconds
+    };
+
+    struct GoodRun {
+        uint64_t begin;     ///< First valid measurement index of the run
+        uint64_t end;       ///< One past the last valid measurement index
+    };
+
+    uint32_t window_seconds_;
+    int64_t target_accuracy_ns_;
+    uint64_t query_time_ns_;         ///< Time of the last window query
+
+    uint64_t first_sequence_;        ///< Sequence number of the front measurement
+    uint64_t next_sequence_;         ///< Sequence number the next measurement gets
+    uint64_t first_valid_;           ///< Index of the front valid measurement
+    uint64_t next_valid_;            ///< Index the next valid measurement gets
+
+    int64_t sum_ns_;                 ///< Sum of valid time errors
+    uint64_t sum_squares_;           ///< Sum of squared valid time errors
+    uint32_t outlier_count_;         ///< Valid measurements outside target accuracy
+    uint32_t within_80ns_count_;     ///< Measurements within ±80ns, valid or not
+
+    std::deque<Extreme> min_queue_;  ///< Increasing values, front is the minimum
+    std::deque<Extreme> max_queue_;  ///< Decreasing values, front is the maximum
+    std::deque<GoodRun> runs_;       ///< Good runs overlapping the window
+    std::deque<GoodRun> longest_runs_; ///< Closed runs after runs_.front(), decreasing length
+    bool run_open_;                  ///< runs_.back() extends to the newest measurement
+
+public:
+    /**
+     * @brief Constructor
+     * @param window_seconds Window length in seconds (0 = all measurements)
+     * @param target_accuracy_ns Accuracy beyond which a time error is an outlier
+     */
+    explicit TimeErrorWindowStatistics(uint32_t window_seconds = 0,
+                                       int64_t target_accuracy_ns = 80);
+
+    /**
+     * @brief Empty the window
+     * @param next_sequence Sequence number of the next measurement pushed
+     */
+    void reset(uint64_t next_sequence);
+
+    /**
+     * @brief Add the measurement with sequence number get_next_sequence()
+     * @param offset_ns Time error of the measurement
+     * @param valid Validity of the measurement
+     */
+    void push_back(int64_t offset_ns, bool valid);
+
+    /**
+     * @brief Remove the measurement with sequence number get_first_sequence()
+     * @param offset_ns Time error of the measurement
+     * @param valid Validity of the measurement
+     */
+    void pop_front(int64_t offset_ns, bool valid);
+
+    /**
+     * @brief Fill the statistics ClockQualityAnalyzer computes over the window
+     *
+     * Sets total_measurements, the time error statistics, outlier_count
+     * and consecutive_good_measurements; leaves metrics untouched when
+     * the window holds no valid measurement.
+     */
+    void fill_statistics(ClockQualityMetrics& metrics) const;
+
+    uint32_t get_window_seconds() const { return window_seconds_; }
+    int64_t get_target_accuracy_ns() const { return target_accuracy_ns_; }
+    uint64_t get_query_time_ns() const { return query_time_ns_; }
+    void set_query_time_ns(uint64_t time_ns) { query_time_ns_ = time_ns; }
+
+    uint64_t get_first_sequence() const { return first_sequence_; }
+    uint64_t get_next_sequence() const { return next_sequence_; }
+    size_t size() const { return static_cast<size_t>(next_sequence_ - first_sequence_); }
+    uint32_t get_valid_count() const { return static_cast<uint32_t>(next_valid_ - first_valid_); }
+    uint32_t get_within_80ns_count() const { return within_80ns_count_; }
+};
+
 /**
  * @brief Ingress Event Monitor for software-based clock quality measurement
  * 
@@ -198,11 +417,23 @@ struct ClockQualityConfig {
  */
 class IngressEventMonitor {
 private:
-    std::deque<ClockQualityMeasurement> measurements_;
+    MeasurementRing measurements_;   ///< History, sized to max_history_measurements
     ClockQualityConfig config_;
     bool monitoring_enabled_;
     uint64_t monitoring_start_time_;
     uint64_t last_sync_sequence_id_;
+    uint64_t first_sequence_;        ///< Sequence number of measurements_.front()
+    
+    // Lock point tracking, see get_lock_time_seconds()
+    mutable int64_t lock_target_ns_;
+    mutable uint64_t lock_sequence_;   ///< Measurement completing the first good run
+    mutable uint64_t good_run_begin_;  ///< Start of the good run ending at the newest measurement
+    
+    /// Sliding windows by length in seconds, created on first query
+    mutable std::map<uint32_t, TimeErrorWindowStatistics> windows_;
+    
+    /// Stability of the valid time errors since monitoring was last reset
+    TimeStabilityAnalyzer stability_;
     
     /**
      * @brief Get current monotonic timestamp in nanoseconds
@@ -210,14 +441,19 @@ private:
     uint64_t get_monotonic_time_ns() const;
     
     /**
-     * @brief Validate measurement against outlier detection
+     * @brief Trim measurement history to at most limit measurements
      */
-    bool is_measurement_valid(const ClockQualityMeasurement& measurement) const;
+    void trim_measurement_history(size_t limit);
     
     /**
-     * @brief Trim measurement history to configured maximum
+     * @brief Drop all measurements and derived window state
      */
-    void trim_measurement_history();
+    void reset_history();
+    
+    /**
+     * @brief Search for the lock point from the front of the history
+     */
+    void find_lock_point() const;
     
 public:
     /**
@@ -258,18 +494,74 @@ public:
                            uint64_t path_delay, uint64_t correction_field,
                            uint16_t sequence_id);
     
+    /**
+     * @brief Store a prepared measurement, e.g. one replayed from a capture
+     * @param measurement Measurement; timestamps must not decrease
+     */
+    void record_measurement(const ClockQualityMeasurement& measurement);
+    
+    /**
+     * @brief Validate measurement against outlier detection, as
+     *        record_sync_ingress() does before storing it
+     */
+    bool is_measurement_valid(const ClockQualityMeasurement& measurement) const;
+    
     /**
      * @brief Get current measurement count
      */
     size_t get_measurement_count() const { return measurements_.size(); }
     
     /**
-     * @brief Get measurement history (read-only)
+     * @brief Get a copy of the measurement history, oldest first
+     */
+    std::deque<ClockQualityMeasurement> get_measurement_history() const;
+    
+    /**
+     * @brief Get measurement history storage (read-only)
+     */
+    const MeasurementRing& get_measurement_ring() const { return measurements_; }
+    
+    /**
+     * @brief Get sequence number of the oldest stored measurement
+     *
+     * Measurements are numbered in arrival order; the newest one is
+     * get_first_sequence() + get_measurement_count() - 1.
      */
-    const std::deque<ClockQualityMeasurement>& get_measurement_history() const {
-        return measurements_;
+    uint64_t get_first_sequence() const { return first_sequence_; }
+    
+    /**
+     * @brief Get stored measurement by sequence number
+     */
+    ClockQualityMeasurement get_measurement(uint64_t sequence) const {
+        return measurements_[static_cast<size_t>(sequence - first_sequence_)];
     }
     
+    /**
+     * @brief Get incrementally maintained statistics of a window
+     * @param window_seconds Window length in seconds (0 = all measurements)
+     * @param target_accuracy_ns Accuracy beyond which a time error is an outlier
+     * @param now_ns Current monotonic time; the window holds the measurements
+     *               taken at or after now_ns - window_seconds
+     *
+     * The first query for a window length replays the history; later
+     * queries only account for measurements added or expired since.
+     */
+    const TimeErrorWindowStatistics& get_window_statistics(
+        uint32_t window_seconds, int64_t target_accuracy_ns, uint64_t now_ns) const;
+    
+    /**
+     * @brief Get time from the oldest stored measurement to lock
+     * @param target_accuracy_ns Accuracy a measurement must meet to count as good
+     * @return Seconds until 5 consecutive good measurements, 0 if never locked
+     */
+    uint32_t get_lock_time_seconds(int64_t target_accuracy_ns) const;
+    
+    /**
+     * @brief Get stability analysis of all valid measurements since monitoring
+     *        was enabled or cleared, including ones dropped from the history
+     */
+    const TimeStabilityAnalyzer& get_stability_analyzer() const { return stability_; }
+    
     /**
      * @brief Clear all measurement history
      */
@@ -287,14 +579,27 @@ public:
     
     /**
      * @brief Export measurement data as TLV for remote monitoring
-     * @return TLV-encoded measurement data
+     * @return Measurement TLVs of the history, then a stability TLV,
+     *         in the format of gptp_clock_quality_tlv.hpp
      */
     std::vector<uint8_t> export_tlv_data() const;
     
+    /**
+     * @brief Stream measurement data as TLVs, e.g. into Signalling messages or a file
+     * @param sink Destination of the TLVs
+     * @param max_length Largest lengthField per TLV
+     * @return false if the sink failed
+     */
+    bool export_tlv_data(ClockQualityTlvSink& sink, uint16_t max_length) const;
+    
     /**
      * @brief Import measurement data from TLV
-     * @param tlv_data TLV-encoded measurement data
-     * @return true if successfully imported
+     *
+     * Appends the measurements of every measurement TLV to the history,
+     * as record_measurement() would; call clear_measurements() first to
+     * replace it. Other TLVs are skipped.
+     * @param tlv_data TLVs as produced by export_tlv_data()
+     * @return true if successfully imported; nothing is imported otherwise
      */
     bool import_tlv_data(const std::vector<uint8_t>& tlv_data);
 };
@@ -328,6 +633,20 @@ private:
      */
     uint32_t calculate_lock_time(const std::deque<ClockQualityMeasurement>& measurements) const;
     
+    /**
+     * @brief Apply the certification checks common to all analysis paths
+     * @param window_size Measurements in the window, valid or not
+     * @param within_80ns Measurements in the window within ±80ns
+     */
+    void apply_certification_checks(ClockQualityMetrics& metrics, size_t window_size,
+                                    uint32_t within_80ns) const;
+    
+    /**
+     * @brief Store stability results and the frequency stability derived from them
+     */
+    void apply_stability(ClockQualityMetrics& metrics,
+                         const TimeStabilityAnalyzer& stability) const;
+    
 public:
     /**
      * @brief Constructor
@@ -336,13 +655,48 @@ public:
     
     /**
      * @brief Analyze measurement window and generate metrics
+     *
+     * Like the lock time, stability covers the whole history, as long
+     * observation intervals need more than one window.
      * @param measurements Measurement history to analyze
      * @param window_seconds Analysis window in seconds (0 = all measurements)
+     * @param now_ns Monotonic time the window ends at (0 = current time)
      * @return Comprehensive clock quality metrics
      */
     ClockQualityMetrics analyze_measurements(
         const std::deque<ClockQualityMeasurement>& measurements,
-        uint32_t window_seconds = 0) const;
+        uint32_t window_seconds = 0, uint64_t now_ns = 0) const;
+    
+    /**
+     * @brief Analyze a monitor's measurement window and generate metrics
+     *
+     * Produces the same metrics as analyze_measurements() on the monitor's
+     * history, from window statistics the monitor maintains incrementally,
+     * so the cost does not grow with the window. Stability also covers
+     * measurements already dropped from the history.
+     * @param monitor Monitor holding the measurement history
+     * @param window_seconds Analysis window in seconds (0 = all measurements)
+     * @param now_ns Monotonic time the window ends at (0 = current time)
+     * @return Comprehensive clock quality metrics
+     */
+    ClockQualityMetrics analyze_measurements(
+        const IngressEventMonitor& monitor,
+        uint32_t window_seconds = 0, uint64_t now_ns = 0) const;
+    
+    /**
+     * @brief Analyze a measurement ring and generate metrics
+     *
+     * Produces the same metrics as analyze_measurements() on the ring's
+     * contents with vectorized scans, for offline analysis of long
+     * captures. Timestamps must not decrease.
+     * @param ring Measurements to analyze
+     * @param window_seconds Analysis window in seconds (0 = all measurements)
+     * @param now_ns Monotonic time the window ends at (0 = current time)
+     * @return Comprehensive clock quality metrics
+     */
+    ClockQualityMetrics analyze_measurements(
+        const MeasurementRing& ring,
+        uint32_t window_seconds = 0, uint64_t now_ns = 0) const;
     
     /**
      * @brief Validate certification requirements for specific profile
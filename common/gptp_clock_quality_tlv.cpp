@@ -0,0 +1,286 @@
+/**
+ * @file gptp_clock_quality_tlv.cpp
+ * @brief Implementation of the clock quality TLV encoding
+ */
+
+#include "gptp_clock_quality_tlv.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace OpenAvnu {
+namespace gPTP {
+
+// ============================================================================
+// Field Encoding
+// ============================================================================
+
+static const size_t TLV_HEADER_SIZE = 4;        ///< tlvType and lengthField
+static const size_t MEASUREMENTS_PREFIX = 8;    ///< version to count
+static const size_t STABILITY_PREFIX = 4;       ///< version to count
+static const size_t MAX_VARINT_SIZE = 10;
+static const size_t MAX_MEASUREMENT_SIZE = 6 * MAX_VARINT_SIZE;
+
+static uint64_t zigzag(uint64_t difference) {
+    return (difference << 1) ^ (~((difference >> 63) & 1) + 1);
+}
+
+static uint64_t unzigzag(uint64_t value) {
+    return (value >> 1) ^ (~(value & 1) + 1);
+}
+
+static size_t put_varint(uint8_t* out, uint64_t value) {
+    size_t size = 0;
+    while (value >= 0x80) {
+        out[size++] = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    out[size++] = static_cast<uint8_t>(value);
+    return size;
+}
+
+static bool get_varint(const uint8_t*& in, const uint8_t* end, uint64_t& value) {
+    value = 0;
+    for (unsigned shift = 0; shift < 64 && in < end; shift += 7) {
+        uint8_t byte = *in++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void put_uint16(uint8_t* out, uint16_t value) {
+    out[0] = static_cast<uint8_t>(value >> 8);
+    out[1] = static_cast<uint8_t>(value);
+}
+
+static uint16_t get_uint16(const uint8_t* in) {
+    return static_cast<uint16_t>((in[0] << 8) | in[1]);
+}
+
+// ============================================================================
+// Sinks
+// ============================================================================
+
+bool ClockQualityTlvVectorSink::write_tlv(const uint8_t* tlv, size_t size) {
+    data_.insert(data_.end(), tlv, tlv + size);
+    return true;
+}
+
+bool ClockQualityTlvFileSink::write_tlv(const uint8_t* tlv, size_t size) {
+    return fwrite(tlv, 1, size, file_) == size;
+}
+
+// ============================================================================
+// ClockQualityTlvEncoder Implementation
+// ============================================================================
+
+ClockQualityTlvEncoder::ClockQualityTlvEncoder(ClockQualityTlvSink& sink,
+                                               const ClockQualityTlvInfo& info,
+                                               uint16_t max_length)
+    : sink_(sink)
+    , info_(info)
+    , max_length_(static_cast<uint16_t>(std::max<uint16_t>(max_length, 72) & ~1))
+{
+    tlv_.reserve(TLV_HEADER_SIZE + max_length_);
+    valid_.reserve(max_length_ / 8);
+    begin_tlv();
+}
+
+void ClockQualityTlvEncoder::begin_tlv() {
+    tlv_.assign(TLV_HEADER_SIZE + MEASUREMENTS_PREFIX, 0);
+    valid_.clear();
+    count_ = 0;
+    previous_ = ClockQualityMeasurement();
+}
+
+size_t ClockQualityTlvEncoder::encode(const ClockQualityMeasurement& measurement,
+                                      uint8_t* out) const {
+    // Differences modulo 2^64, so any field values round-trip
+    uint64_t timestamp_step = measurement.timestamp_ns - previous_.timestamp_ns;
+    uint64_t t1_step = measurement.t1_master_tx_ns - previous_.t1_master_tx_ns;
+    uint64_t t2_residual = measurement.t2_slave_rx_ns - measurement.t1_master_tx_ns -
+                           measurement.path_delay_ns - measurement.correction_field_ns -
+                           static_cast<uint64_t>(measurement.offset_from_master_ns);
+    size_t size = 0;
+
+    size += put_varint(out + size, zigzag(timestamp_step));
+    size += put_varint(out + size, zigzag(static_cast<uint64_t>(measurement.offset_from_master_ns) -
+                                          static_cast<uint64_t>(previous_.offset_from_master_ns)));
+    size += put_varint(out + size, zigzag(measurement.path_delay_ns - previous_.path_delay_ns));
+    size += put_varint(out + size, zigzag(measurement.correction_field_ns -
+                                          previous_.correction_field_ns));
+    size += put_varint(out + size, zigzag(t1_step - timestamp_step));
+    size += put_varint(out + size, zigzag(t2_residual));
+    return size;
+}
+
+bool ClockQualityTlvEncoder::add(const ClockQualityMeasurement& measurement) {
+    uint8_t encoded[MAX_MEASUREMENT_SIZE];
+    size_t size = encode(measurement, encoded);
+
+    // Room for the measurement and its bit; padding fits as max_length_ is even
+    size_t length = tlv_.size() - TLV_HEADER_SIZE + size + (count_ + 8) / 8;
+    if (length > max_length_ || count_ == UINT16_MAX) {
+        if (!flush()) {
+            return false;
+        }
+        size = encode(measurement, encoded);
+    }
+
+    tlv_.insert(tlv_.end(), encoded, encoded + size);
+    if (count_ % 8 == 0) {
+        valid_.push_back(0);
+    }
+    if (measurement.valid) {
+        valid_.back() |= static_cast<uint8_t>(1 << (count_ % 8));
+    }
+    count_++;
+    previous_ = measurement;
+    return true;
+}
+
+bool ClockQualityTlvEncoder::flush() {
+    if (count_ == 0) {
+        return true;
+    }
+
+    // The bitmap ends the TLV, so decoders find it from the count
+    if ((tlv_.size() + valid_.size()) % 2 != 0) {
+        tlv_.push_back(0);
+    }
+    tlv_.insert(tlv_.end(), valid_.begin(), valid_.end());
+
+    uint8_t* header = tlv_.data();
+    put_uint16(header, CLOCK_QUALITY_TLV_MEASUREMENTS);
+    put_uint16(header + 2, static_cast<uint16_t>(tlv_.size() - TLV_HEADER_SIZE));
+    header[4] = CLOCK_QUALITY_TLV_VERSION;
+    header[5] = info_.monitoring_enabled ? CLOCK_QUALITY_TLV_MONITORING_ENABLED : 0;
+    header[6] = static_cast<uint8_t>(info_.profile_type);
+    header[7] = 0;
+    put_uint16(header + 8, info_.measurement_interval_ms);
+    put_uint16(header + 10, count_);
+
+    bool written = sink_.write_tlv(tlv_.data(), tlv_.size());
+    begin_tlv();
+    return written;
+}
+
+bool ClockQualityTlvEncoder::write_stability(const std::vector<TimeStabilityPoint>& stability) {
+    // Point: tau in samples and ns, ADEV in parts per 10^15, TDEV in ps, MTIE in ns
+    std::vector<uint8_t> tlv(TLV_HEADER_SIZE + STABILITY_PREFIX +
+                             stability.size() * 5 * MAX_VARINT_SIZE + 1);
+    size_t size = TLV_HEADER_SIZE + STABILITY_PREFIX;
+    for (const auto& point : stability) {
+        size += put_varint(&tlv[size], point.tau_samples);
+        size += put_varint(&tlv[size], static_cast<uint64_t>(std::llround(point.tau_s * 1e9)));
+        size += put_varint(&tlv[size], static_cast<uint64_t>(std::llround(point.adev * 1e15)));
+        size += put_varint(&tlv[size], static_cast<uint64_t>(std::llround(point.tdev_ns * 1e3)));
+        size += put_varint(&tlv[size], zigzag(static_cast<uint64_t>(point.mtie_ns)));
+    }
+    if (size % 2 != 0) {
+        tlv[size++] = 0;
+    }
+    if (size - TLV_HEADER_SIZE > max_length_ || stability.size() > UINT16_MAX) {
+        return false;
+    }
+
+    put_uint16(&tlv[0], CLOCK_QUALITY_TLV_STABILITY);
+    put_uint16(&tlv[2], static_cast<uint16_t>(size - TLV_HEADER_SIZE));
+    tlv[4] = CLOCK_QUALITY_TLV_VERSION;
+    tlv[5] = 0;
+    put_uint16(&tlv[6], static_cast<uint16_t>(stability.size()));
+    return sink_.write_tlv(tlv.data(), size);
+}
+
+// ============================================================================
+// Decoding
+// ============================================================================
+
+bool decode_clock_quality_measurements(const uint8_t* value, size_t length,
+                                       ClockQualityTlvInfo* info,
+                                       std::vector<ClockQualityMeasurement>& measurements) {
+    if (length < MEASUREMENTS_PREFIX || value[0] != CLOCK_QUALITY_TLV_VERSION) {
+        return false;
+    }
+
+    uint16_t count = get_uint16(value + 6);
+    size_t bitmap_size = (count + 7) / 8;
+    if (length < MEASUREMENTS_PREFIX + bitmap_size) {
+        return false;
+    }
+    const uint8_t* in = value + MEASUREMENTS_PREFIX;
+    const uint8_t* end = value + length - bitmap_size;
+
+    size_t first = measurements.size();
+    ClockQualityMeasurement previous;
+    for (uint16_t i = 0; i < count; ++i) {
+        uint64_t fields[6];
+        for (uint64_t& field : fields) {
+            if (!get_varint(in, end, field)) {
+                measurements.resize(first);
+                return false;
+            }
+            field = unzigzag(field);
+        }
+
+        ClockQualityMeasurement measurement;
+        measurement.timestamp_ns = previous.timestamp_ns + fields[0];
+        measurement.offset_from_master_ns = static_cast<int64_t>(
+            static_cast<uint64_t>(previous.offset_from_master_ns) + fields[1]);
+        measurement.path_delay_ns = previous.path_delay_ns + fields[2];
+        measurement.correction_field_ns = previous.correction_field_ns + fields[3];
+        measurement.t1_master_tx_ns = previous.t1_master_tx_ns + fields[0] + fields[4];
+        measurement.t2_slave_rx_ns = measurement.t1_master_tx_ns + measurement.path_delay_ns +
+                                     measurement.correction_field_ns +
+                                     static_cast<uint64_t>(measurement.offset_from_master_ns) +
+                                     fields[5];
+        measurement.valid = (end[i / 8] >> (i % 8)) & 1;
+        measurements.push_back(measurement);
+        previous = measurement;
+    }
+
+    // Only the padding byte may follow the last measurement
+    if (end - in > 1) {
+        measurements.resize(first);
+        return false;
+    }
+
+    if (info != nullptr) {
+        info->monitoring_enabled = (value[1] & CLOCK_QUALITY_TLV_MONITORING_ENABLED) != 0;
+        info->profile_type = static_cast<ProfileType>(value[2]);
+        info->measurement_interval_ms = get_uint16(value + 4);
+    }
+    return true;
+}
+
+bool decode_clock_quality_stability(const uint8_t* value, size_t length,
+                                    std::vector<TimeStabilityPoint>& stability) {
+    if (length < STABILITY_PREFIX || value[0] != CLOCK_QUALITY_TLV_VERSION) {
+        return false;
+    }
+
+    uint16_t count = get_uint16(value + 2);
+    const uint8_t* in = value + STABILITY_PREFIX;
+    const uint8_t* end = value + length;
+    std::vector<TimeStabilityPoint> points(count);
+    for (auto& point : points) {
+        uint64_t fields[5];
+        for (uint64_t& field : fields) {
+            if (!get_varint(in, end, field)) {
+                return false;
+            }
+        }
+        point.tau_samples = static_cast<uint32_t>(fields[0]);
+        point.tau_s = static_cast<double>(fields[1]) / 1e9;
+        point.adev = static_cast<double>(fields[2]) / 1e15;
+        point.tdev_ns = static_cast<double>(fields[3]) / 1e3;
+        point.mtie_ns = static_cast<int64_t>(unzigzag(fields[4]));
+    }
+    stability.swap(points);
+    return true;
+}
+
+} // namespace gPTP
+} // namespace OpenAvnu
@@ -0,0 +1,180 @@
+/**
+ * @file gptp_clock_quality_tlv.hpp
+ * @brief Compact binary TLV encoding of clock quality measurements
+ *
+ * Measurements are exported as a sequence of self-contained TLVs, each
+ * small enough for its destination (a Signalling message or a file), so
+ * a TLV lost in transit only loses its own measurements.
+ *
+ * Measurement TLV (type CLOCK_QUALITY_TLV_MEASUREMENTS), big-endian:
+ *
+ *   tlvType (2) lengthField (2)
+ *   version (1) flags (1) profile (1) reserved (1)
+ *   measurement_interval_ms (2) count (2)
+ *   count encoded measurements
+ *   padding to an even length (0 or 1 byte)
+ *   validity bitmap, bit i % 8 of byte i / 8 for measurement i
+ *
+ * Each measurement is six LEB128 varints of zigzag-encoded differences,
+ * so the usual small changes take one or two bytes each:
+ *
+ *   timestamp_ns - previous timestamp_ns
+ *   offset_from_master_ns - previous offset_from_master_ns
+ *   path_delay_ns - previous path_delay_ns
+ *   correction_field_ns - previous correction_field_ns
+ *   (t1_master_tx_ns - previous t1_master_tx_ns) - timestamp difference
+ *   t2_slave_rx_ns - t1 - path delay - correction - offset
+ *
+ * The previous values start at 0 in every TLV. Stability results follow
+ * in a TLV of type CLOCK_QUALITY_TLV_STABILITY.
+ *
+ * @author OpenAvnu Development Team
+ * @copyright (c) 2025 OpenAvnu Alliance
+ */
+
+#ifndef GPTP_CLOCK_QUALITY_TLV_HPP
+#define GPTP_CLOCK_QUALITY_TLV_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "gptp_clock_quality.hpp"
+
+namespace OpenAvnu {
+namespace gPTP {
+
+static const uint16_t CLOCK_QUALITY_TLV_MEASUREMENTS = 0x8001;  ///< Measurement TLV type
+static const uint16_t CLOCK_QUALITY_TLV_STABILITY = 0x8002;     ///< Stability TLV type
+static const uint8_t CLOCK_QUALITY_TLV_VERSION = 1;             ///< Encoding version
+
+static const uint8_t CLOCK_QUALITY_TLV_MONITORING_ENABLED = 0x01;  ///< flags bit
+
+/// Largest lengthField, the TLV length less its 4-byte header
+static const uint16_t CLOCK_QUALITY_TLV_MAX_LENGTH = 65534;
+/// Largest lengthField that fits a Signalling message in a 1500-byte frame
+static const uint16_t CLOCK_QUALITY_TLV_SIGNALLING_LENGTH = 1452;
+
+/**
+ * @brief Context carried in every measurement TLV
+ */
+struct ClockQualityTlvInfo {
+    uint16_t measurement_interval_ms;
+    ProfileType profile_type;
+    bool monitoring_enabled;
+
+    ClockQualityTlvInfo()
+        : measurement_interval_ms(125), profile_type(ProfileType::STANDARD)
+        , monitoring_enabled(false) {}
+};
+
+/**
+ * @brief Destination of encoded TLVs
+ */
+class ClockQualityTlvSink {
+public:
+    virtual ~ClockQualityTlvSink() {}
+
+    /**
+     * @brief Take one complete TLV, header included
+     * @return false if it could not be stored
+     */
+    virtual bool write_tlv(const uint8_t* tlv, size_t size) = 0;
+};
+
+/**
+ * @brief Sink appending TLVs to a byte vector
+ */
+class ClockQualityTlvVectorSink : public ClockQualityTlvSink {
+private:
+    std::vector<uint8_t>& data_;
+public:
+    explicit ClockQualityTlvVectorSink(std::vector<uint8_t>& data) : data_(data) {}
+    bool write_tlv(const uint8_t* tlv, size_t size) override;
+};
+
+/**
+ * @brief Sink writing TLVs to a stdio stream
+ */
+class ClockQualityTlvFileSink : public ClockQualityTlvSink {
+private:
+    FILE* file_;
+public:
+    explicit ClockQualityTlvFileSink(FILE* file) : file_(file) {}
+    bool write_tlv(const uint8_t* tlv, size_t size) override;
+};
+
+/**
+ * @brief Streaming encoder of measurements into measurement TLVs
+ *
+ * Measurements are packed into a TLV until the next one would not fit
+ * max_length; the TLV is then handed to the sink and a new one begun.
+ * Call flush() to emit the last, partly filled TLV.
+ */
+class ClockQualityTlvEncoder {
+private:
+    ClockQualityTlvSink& sink_;
+    ClockQualityTlvInfo info_;
+    uint16_t max_length_;
+
+    std::vector<uint8_t> tlv_;       ///< TLV being filled, reserved to max_length_
+    std::vector<uint8_t> valid_;     ///< Validity bitmap of the TLV being filled
+    uint16_t count_;
+    ClockQualityMeasurement previous_;
+
+    size_t encode(const ClockQualityMeasurement& measurement, uint8_t* out) const;
+    void begin_tlv();
+
+public:
+    /**
+     * @brief Constructor
+     * @param sink Destination of the TLVs
+     * @param info Context to carry in every TLV
+     * @param max_length Largest lengthField to emit, at least 72
+     */
+    ClockQualityTlvEncoder(ClockQualityTlvSink& sink, const ClockQualityTlvInfo& info,
+                           uint16_t max_length = CLOCK_QUALITY_TLV_MAX_LENGTH);
+
+    /**
+     * @brief Append a measurement
+     * @return false if a full TLV could not be written to the sink
+     */
+    bool add(const ClockQualityMeasurement& measurement);
+
+    /**
+     * @brief Write the measurements added since the last TLV, if any
+     * @return false if the sink failed
+     */
+    bool flush();
+
+    /**
+     * @brief Write stability results as a stability TLV
+     * @return false if the sink failed or the results do not fit max_length
+     */
+    bool write_stability(const std::vector<TimeStabilityPoint>& stability);
+};
+
+/**
+ * @brief Decode the value of a measurement TLV
+ * @param value First byte after the lengthField
+ * @param length lengthField
+ * @param info [out] Context of the TLV, may be nullptr
+ * @param measurements [out] Decoded measurements are appended
+ * @return false, leaving measurements unchanged, if the TLV is malformed
+ *         or of an unknown version
+ */
+bool decode_clock_quality_measurements(const uint8_t* value, size_t length,
+                                       ClockQualityTlvInfo* info,
+                                       std::vector<ClockQualityMeasurement>& measurements);
+
+/**
+ * @brief Decode the value of a stability TLV
+ * @return false if the TLV is malformed or of an unknown version
+ */
+bool decode_clock_quality_stability(const uint8_t* value, size_t length,
+                                    std::vector<TimeStabilityPoint>& stability);
+
+} // namespace gPTP
+} // namespace OpenAvnu
+
+#endif // GPTP_CLOCK_QUALITY_TLV_HPP
@@ -28,20 +28,744 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
 #include <platform.hpp>
 
 // MS VC++ 2013 has C++11 but not C11 support, use this to get millisecond resolution
 #include <chrono>
+#include <atomic>
+#include <thread>
+#ifdef __linux__
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#else
+#include <mutex>
+#include <condition_variable>
+#endif
 
 #ifdef GENIVI_DLT
 DLT_DECLARE_CONTEXT(dlt_con_gptp);
 #endif
 
+std::atomic<int> gptp_log_level[GPTP_LOG_SUBSYS_COUNT] = {
+	{ GPTP_LOG_LVL_VERBOSE }, { GPTP_LOG_LVL_VERBOSE },
+	{ GPTP_LOG_LVL_VERBOSE }, { GPTP_LOG_LVL_VERBOSE },
+	{ GPTP_LOG_LVL_VERBOSE }, { GPTP_LOG_LVL_VERBOSE },
+};
+
+static const char *const gptp_log_subsys_name[GPTP_LOG_SUBSYS_COUNT] = {
+	"general", "timer", "net", "servo", "bmca", "pdelay"
+};
+
+static const char *const gptp_log_level_name[] = {
+	"critical", "error", "exception", "warning",
+	"info", "status", "debug", "verbose"
+};
+
+void gptplogSetLevel(GPTP_LOG_SUBSYS subsys, GPTP_LOG_LEVEL level)
+{
+	if (subsys < 0 || subsys >= GPTP_LOG_SUBSYS_COUNT)
+		return;
+	gptp_log_level[subsys].store(level, std::memory_order_relaxed);
+}
+
+static int lookupName(const char *name, size_t len, const char *const *table, int count)
+{
+	for (int i = 0; i < count; ++i) {
+		if (strlen(table[i]) == len && strncmp(table[i], name, len) == 0)
+			return i;
+	}
+	return -1;
+}
+
+bool gptplogSetLevels(const char *spec)
+{
+	const int level_count = (int)(sizeof(gptp_log_level_name) / sizeof(gptp_log_level_name[0]));
+	int levels[GPTP_LOG_SUBSYS_COUNT];
+	const char *p = spec;
+
+	for (int i = 0; i < GPTP_LOG_SUBSYS_COUNT; ++i)
+		levels[i] = gptp_log_level[i].load(std::memory_order_relaxed);
+
+	while (p != NULL && *p != '\0') {
+		const char *end = strchr(p, ',');
+		size_t len = end ? (size_t)(end - p) : strlen(p);
+		const char *eq = (const char *) memchr(p, '=', len);
+		int subsys = -1;
+		int level;
+
+		if (eq != NULL) {
+			subsys = lookupName(p, eq - p, gptp_log_subsys_name, GPTP_LOG_SUBSYS_COUNT);
+			if (subsys < 0)
+				return false;
+			level = lookupName(eq + 1, len - (eq + 1 - p), gptp_log_level_name, level_count);
+		} else {
+			level = lookupName(p, len, gptp_log_level_name, level_count);
+		}
+		if (level < 0)
+			return false;
+
+		for (int i = 0; i < GPTP_LOG_SUBSYS_COUNT; ++i) {
+			if (subsys < 0 || subsys == i)
+				levels[i] = level;
+		}
+		p = end ? end + 1 : NULL;
+	}
+
+	for (int i = 0; i < GPTP_LOG_SUBSYS_COUNT; ++i)
+		gptplogSetLevel((GPTP_LOG_SUBSYS) i, (GPTP_LOG_LEVEL) levels[i]);
+
+	return true;
+}
+
+#ifndef GENIVI_DLT
+
+/*
+ * Asynchronous backend
+ *
+ * Each logging thread owns a single-producer/single-consumer ring of fixed
+ * size records. gptpLog() stores the level, tag, source location, format
+ * pointer, a monotonic timestamp and the raw arguments in the next free
+ * record and returns; it never formats, takes a lock, allocates (after the
+ * first call on a thread) or touches stderr. When the ring is full the record
+ * is dropped and counted. One writer thread merges the rings in timestamp
+ * order, formats each record and writes it to stderr.
+ *
+ * While every ring is empty the writer sleeps on an eventfd (a condition
+ * variable on other platforms). A producer that publishes a record while
+ * it sleeps wakes it. The writer then lets the burst collect for up to
+ * GPTP_LOG_WRITER_BATCH_MS, or until a ring is half full, before it
+ * formats the records, so a burst costs one wakeup rather than one per
+ * record, and an idle daemon none at all.
+ * Each ring also carries a flag that is set while its thread is inside the
+ * asynchronous path, which gptplogUnregister() waits on instead of a
+ * counter shared by every thread.
+ *
+ * Format strings are assumed to be string literals, which is the case for
+ * every GPTP_LOG_* call site. %s arguments are copied into the record, and
+ * are truncated when they do not fit.
+ *
+ * Until gptplogRegister() starts the writer thread, and after
+ * gptplogUnregister() stops it, gptpLog() formats and writes synchronously.
+ */
+
+#define GPTP_LOG_RING_SIZE		512	/* records per thread, power of 2 */
+#define GPTP_LOG_ARGS_SIZE		224	/* argument bytes per record */
+#define GPTP_LOG_WRITER_BATCH_MS	2	/* wait for a burst to collect */
+#define GPTP_LOG_MSG_SIZE		1024
+
+typedef struct {
+	uint64_t timestamp;		/* steady_clock, nanoseconds */
+	const char *tag;
+	const char *path;
+	const char *fmt;
+	int line;
+	uint16_t args_size;
+	bool truncated;
+	uint8_t args[GPTP_LOG_ARGS_SIZE];
+} GptpLogRecord;
+
+struct GptpLogRing {
+	std::atomic<uint32_t> head;	/* written by the producer */
+	std::atomic<uint32_t> tail;	/* written by the writer thread */
+	std::atomic<uint64_t> dropped;
+	std::atomic<bool> in_use;
+	std::atomic<bool> producing;	/* owner is in the asynchronous path */
+	uint64_t dropped_reported;	/* writer thread only */
+	GptpLogRing *next;
+	GptpLogRecord record[GPTP_LOG_RING_SIZE];
+
+	GptpLogRing() : head(0), tail(0), dropped(0), in_use(true),
+			producing(false), dropped_reported(0), next(NULL) {}
+};
+
+/* One conversion specification of a printf format string */
+typedef struct {
+	const char *start;	/* the '%' */
+	size_t length;		/* up to and including the conversion */
+	int stars;		/* '*' width/precision arguments */
+	char size;		/* length modifier, see parseConversion() */
+	char conv;		/* conversion character, 0 if not understood */
+} GptpLogConversion;
+
+static std::atomic<GptpLogRing *> ring_list( NULL );
+static std::atomic<bool> writer_running( false );
+static std::atomic<bool> writer_stop( false );
+static std::atomic<bool> writer_asleep( false );	/* waiting for a wakeup */
+static std::thread writer_thread;
+#ifdef __linux__
+static int writer_event = -1;		/* eventfd the writer sleeps on */
+#else
+static std::mutex writer_mutex;
+static std::condition_variable writer_cond;
+static bool writer_woken = false;
+#endif
+static int64_t wall_offset = 0;		/* system_clock - steady_clock, ns */
+
+static uint64_t steadyNow()
+{
+	return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>
+		( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+/*
+ * Parses the conversion starting at p (which points at '%'). Length
+ * modifiers are folded into one character: 'H' hh, 'h', 'l', 'q' ll or q,
+ * 'L', 'z', 'j', 't', or 0 for none. As in glibc, 'L' on an integer
+ * conversion and 'q' mean long long.
+ */
+static const char *parseConversion( const char *p, GptpLogConversion *c )
+{
+	c->start = p++;
+	c->stars = 0;
+	c->size = 0;
+	c->conv = 0;
+
+	while( *p && strchr( "-+ #0", *p ))
+		++p;
+	if( *p == '*' ) {
+		++c->stars;
+		++p;
+	}
+	while( *p >= '0' && *p <= '9' )
+		++p;
+	if( *p == '.' ) {
+		++p;
+		if( *p == '*' ) {
+			++c->stars;
+			++p;
+		}
+		while( *p >= '0' && *p <= '9' )
+			++p;
+	}
+	switch( *p ) {
+	case 'h':
+		c->size = ( p[1] == 'h' ) ? 'H' : 'h';
+		p += ( c->size == 'H' ) ? 2 : 1;
+		break;
+	case 'l':
+		c->size = ( p[1] == 'l' ) ? 'q' : 'l';
+		p += ( c->size == 'q' ) ? 2 : 1;
+		break;
+	case 'q': case 'L': case 'z': case 'j': case 't':
+		c->size = *p++;
+		break;
+	}
+	if( *p && strchr( "diouxXcfFeEgGaAspn%", *p ))
+		c->conv = *p++;
+	c->length = p - c->start;
+
+	return p;
+}
+
+static bool isSignedConversion( char conv )
+{
+	return conv == 'd' || conv == 'i';
+}
+
+static bool isFloatConversion( char conv )
+{
+	return conv && strchr( "fFeEgGaA", conv ) != NULL;
+}
+
+/* Appends a value to the record arguments, returns false if it does not fit */
+static bool putArg( GptpLogRecord *record, const void *value, size_t size )
+{
+	if( record->args_size + size > GPTP_LOG_ARGS_SIZE )
+		return false;
+	memcpy( record->args + record->args_size, value, size );
+	record->args_size += (uint16_t) size;
+	return true;
+}
+
+/*
+ * Copies the arguments described by fmt into the record. Integers are
+ * read with their promoted type and widened to 64 bits so the writer can
+ * narrow them again with the same length modifier.
+ */
+static void captureArgs( GptpLogRecord *record, const char *fmt, va_list ap )
+{
+	GptpLogConversion c;
+	const char *p = fmt;
+
+	record->args_size = 0;
+	record->truncated = false;
+
+	while(( p = strchr( p, '%' )) != NULL ) {
+		p = parseConversion( p, &c );
+		if( c.conv == 0 ) {
+			record->truncated = true;
+			return;
+		}
+		uint16_t mark = record->args_size;
+		bool fits = true;
+		for( int i = 0; i < c.stars && fits; ++i ) {
+			int star = va_arg( ap, int );
+			fits = putArg( record, &star, sizeof( star ));
+		}
+		if( !fits ) {
+			record->args_size = mark;
+			record->truncated = true;
+			return;
+		}
+
+		if( c.conv == '%' ) {
+			continue;
+		} else if( c.conv == 'n' ) {
+			(void) va_arg( ap, void * );
+		} else if( c.conv == 's' ) {
+			const char *s = va_arg( ap, const char * );
+			if( s == NULL )
+				s = "(null)";
+			size_t room = GPTP_LOG_ARGS_SIZE - record->args_size;
+			size_t len = strlen( s );
+			if( room == 0 ) {
+				fits = false;
+			} else {
+				if( len >= room )
+					len = room - 1;
+				memcpy( record->args + record->args_size, s, len );
+				record->args[record->args_size + len] = '\0';
+				record->args_size += (uint16_t)( len + 1 );
+			}
+		} else if( c.conv == 'p' ) {
+			void *ptr = va_arg( ap, void * );
+			fits = putArg( record, &ptr, sizeof( ptr ));
+		} else if( isFloatConversion( c.conv )) {
+			if( c.size == 'L' ) {
+				long double v = va_arg( ap, long double );
+				fits = putArg( record, &v, sizeof( v ));
+			} else {
+				double v = va_arg( ap, double );
+				fits = putArg( record, &v, sizeof( v ));
+			}
+		} else {
+			uint64_t v;
+			bool sgn = isSignedConversion( c.conv );
+			switch( c.size ) {
+			case 'l':
+				v = sgn ? (uint64_t) va_arg( ap, long ) :
+					(uint64_t) va_arg( ap, unsigned long );
+				break;
+			case 'q':
+			case 'L':
+				v = sgn ? (uint64_t) va_arg( ap, long long ) :
+					(uint64_t) va_arg( ap, unsigned long long );
+				break;
+			case 'z':
+				v = (uint64_t) va_arg( ap, size_t );
+				break;
+			case 'j':
+				v = (uint64_t) va_arg( ap, intmax_t );
+				break;
+			case 't':
+				v = (uint64_t) va_arg( ap, ptrdiff_t );
+				break;
+			default:
+				v = sgn ? (uint64_t)(int64_t) va_arg( ap, int ) :
+					(uint64_t) va_arg( ap, unsigned int );
+				break;
+			}
+			fits = putArg( record, &v, sizeof( v ));
+		}
+		if( !fits ) {
+			record->args_size = mark;
+			record->truncated = true;
+			return;
+		}
+	}
+}
+
+static size_t getArg( const GptpLogRecord *record, size_t *offset, void *value, size_t size )
+{
+	memcpy( value, record->args + *offset, size );
+	*offset += size;
+	return size;
+}
+
+/*
+ * Formats one conversion with its stored arguments. The length modifier
+ * is kept in the specification, so each integer is passed back with the
+ * type it was logged with.
+ */
+static int formatConversion
+( char *out, size_t room, const GptpLogConversion *c, const GptpLogRecord *record, size_t *offset )
+{
+	char spec[32];
+	int star[2] = { 0, 0 };
+
+	if( c->length >= sizeof( spec ))
+		return 0;
+	memcpy( spec, c->start, c->length );
+	spec[c->length] = '\0';
+
+	for( int i = 0; i < c->stars; ++i )
+		getArg( record, offset, &star[i], sizeof( int ));
+
+#define GPTP_LOG_FORMAT_ARG( value )					\
+	( c->stars == 2 ? snprintf( out, room, spec, star[0], star[1], value ) : \
+	  c->stars == 1 ? snprintf( out, room, spec, star[0], value ) :	\
+	  snprintf( out, room, spec, value ))
+
+	if( c->conv == 's' ) {
+		const char *s = (const char *) record->args + *offset;
+		*offset += strlen( s ) + 1;
+		return GPTP_LOG_FORMAT_ARG( s );
+	}
+	if( c->conv == 'p' ) {
+		void *ptr;
+		getArg( record, offset, &ptr, sizeof( ptr ));
+		return GPTP_LOG_FORMAT_ARG( ptr );
+	}
+	if( isFloatConversion( c->conv )) {
+		if( c->size == 'L' ) {
+			long double v;
+			getArg( record, offset, &v, sizeof( v ));
+			return GPTP_LOG_FORMAT_ARG( v );
+		}
+		double v;
+		getArg( record, offset, &v, sizeof( v ));
+		return GPTP_LOG_FORMAT_ARG( v );
+	}
+
+	uint64_t v;
+	getArg( record, offset, &v, sizeof( v ));
+	switch( c->size ) {
+	case 'l':
+		return GPTP_LOG_FORMAT_ARG( (unsigned long) v );
+	case 'q':
+	case 'L':
+		return GPTP_LOG_FORMAT_ARG( (unsigned long long) v );
+	case 'z':
+		return GPTP_LOG_FORMAT_ARG( (size_t) v );
+	case 'j':
+		return GPTP_LOG_FORMAT_ARG( (intmax_t) v );
+	case 't':
+		return GPTP_LOG_FORMAT_ARG( (ptrdiff_t) v );
+	default:
+		return GPTP_LOG_FORMAT_ARG( (unsigned int) v );
+	}
+#undef GPTP_LOG_FORMAT_ARG
+}
+
+/* Rebuilds the message text of a record */
+static void formatRecord( const GptpLogRecord *record, char *msg, size_t size )
+{
+	GptpLogConversion c;
+	const char *p = record->fmt;
+	size_t offset = 0;
+	size_t pos = 0;
+
+	msg[0] = '\0';
+	while( *p && pos < size - 1 ) {
+		const char *pct = strchr( p, '%' );
+		size_t literal = pct ? (size_t)( pct - p ) : strlen( p );
+		if( literal > size - 1 - pos )
+			literal = size - 1 - pos;
+		memcpy( msg + pos, p, literal );
+		pos += literal;
+		msg[pos] = '\0';
+		if( pct == NULL || pos >= size - 1 )
+			return;
+
+		const char *next = parseConversion( pct, &c );
+		if( c.conv == '%' ) {
+			msg[pos++] = '%';
+			msg[pos] = '\0';
+		} else if( c.conv == 'n' ) {
+			/* never written back */
+		} else if( c.conv == 0 || offset >= record->args_size ) {
+			/* Not captured, print the rest of the format as is */
+			snprintf( msg + pos, size - pos, "%s", pct );
+			return;
+		} else {
+			int n = formatConversion( msg + pos, size - pos, &c, record, &offset );
+			if( n > 0 )
+				pos += ( (size_t) n < size - pos ) ? n : size - 1 - pos;
+		}
+		p = next;
+	}
+}
+
+static void writeLine
+( const char *tag, const char *path, int line, const char *msg,
+  const struct tm *tmNow, long int millis )
+{
+	if (path) {
+		fprintf(stderr, "%s: GPTP [%2.2d:%2.2d:%2.2d:%3.3ld] [%s:%u] %s\n",
+			   tag, tmNow->tm_hour, tmNow->tm_min, tmNow->tm_sec, millis, path, line, msg);
+	}
+	else {
+		fprintf(stderr, "%s: GPTP [%2.2d:%2.2d:%2.2d:%3.3ld] %s\n",
+			   tag, tmNow->tm_hour, tmNow->tm_min, tmNow->tm_sec, millis, msg);
+	}
+}
+
+/*
+ * Writes every record currently queued, oldest first across all rings.
+ * Only called from the writer thread, or after it has been joined.
+ */
+static void drainRings()
+{
+	static time_t last_second = (time_t) -1;
+	static struct tm tm_last;
+	char msg[GPTP_LOG_MSG_SIZE];
+	bool wrote = false;
+
+	for( ;; ) {
+		GptpLogRing *oldest = NULL;
+		uint64_t oldest_ts = 0;
+
+		for( GptpLogRing *ring = ring_list.load( std::memory_order_acquire );
+		     ring != NULL; ring = ring->next ) {
+			uint32_t tail = ring->tail.load( std::memory_order_relaxed );
+			if( tail == ring->head.load( std::memory_order_acquire ))
+				continue;
+			uint64_t ts = ring->record[tail & ( GPTP_LOG_RING_SIZE - 1 )].timestamp;
+			if( oldest == NULL || ts < oldest_ts ) {
+				oldest = ring;
+				oldest_ts = ts;
+			}
+		}
+		if( oldest == NULL )
+			break;
+
+		uint32_t tail = oldest->tail.load( std::memory_order_relaxed );
+		const GptpLogRecord *record = &oldest->record[tail & ( GPTP_LOG_RING_SIZE - 1 )];
+
+		int64_t wall_ns = (int64_t) record->timestamp + wall_offset;
+		time_t tNow = (time_t)( wall_ns / 1000000000 );
+		long int millis = (long int)(( wall_ns % 1000000000 ) / 1000000 );
+		if( tNow != last_second ) {
+			PLAT_localtime( &tNow, &tm_last );
+			last_second = tNow;
+		}
+
+		formatRecord( record, msg, sizeof( msg ));
+		writeLine( record->tag, record->path, record->line, msg, &tm_last, millis );
+		wrote = true;
+
+		oldest->tail.store( tail + 1, std::memory_order_release );
+	}
+
+	for( GptpLogRing *ring = ring_list.load( std::memory_order_acquire );
+	     ring != NULL; ring = ring->next ) {
+		uint64_t dropped = ring->dropped.load( std::memory_order_relaxed );
+		if( dropped != ring->dropped_reported ) {
+			fprintf( stderr, "WARNING  : GPTP logging dropped %llu records "
+				 "(ring full)\n", (unsigned long long)
+				 ( dropped - ring->dropped_reported ));
+			ring->dropped_reported = dropped;
+			wrote = true;
+		}
+	}
+
+	if( wrote )
+		fflush( stderr );
+}
+
+static bool ringsEmpty()
+{
+	for( GptpLogRing *ring = ring_list.load(); ring != NULL;
+	     ring = ring->next ) {
+		if( ring->head.load() !=
+		    ring->tail.load( std::memory_order_relaxed ))
+			return false;
+	}
+
+	return true;
+}
+
+static void wakeWriter()
+{
+#ifdef __linux__
+	uint64_t one = 1;
+
+	// Fails only when the counter is saturated, so the writer is awake
+	if( write( writer_event, &one, sizeof( one )) == -1 )
+		return;
+#else
+	{
+		std::lock_guard<std::mutex> guard( writer_mutex );
+		writer_woken = true;
+	}
+	writer_cond.notify_one();
+#endif
+}
+
+/* Waits for wakeWriter(), for at most timeout_ms unless it is -1 */
+static void waitForWakeup( int timeout_ms )
+{
+#ifdef __linux__
+	struct pollfd pfd;
+	uint64_t count;
+	int ret;
+
+	pfd.fd = writer_event;
+	pfd.events = POLLIN;
+	do {
+		ret = poll( &pfd, 1, timeout_ms );
+	} while( ret == -1 && errno == EINTR && timeout_ms == -1 );
+	if( ret == 1 && read( writer_event, &count, sizeof( count )) == -1 )
+		return;
+#else
+	std::unique_lock<std::mutex> guard( writer_mutex );
+
+	if( timeout_ms == -1 )
+		writer_cond.wait( guard, [] { return writer_woken; } );
+	else
+		writer_cond.wait_for( guard,
+				      std::chrono::milliseconds( timeout_ms ),
+				      [] { return writer_woken; } );
+	writer_woken = false;
+#endif
+}
+
+static void writerMain()
+{
+	while( !writer_stop.load() ) {
+		drainRings();
+		/*
+		 * writer_asleep is set before the rings are looked at again, and
+		 * producers set head before they look at writer_asleep. Either
+		 * this check sees the new record or its producer sees the flag
+		 * and wakes the writer.
+		 */
+		writer_asleep.store( true );
+		if( ringsEmpty() && !writer_stop.load() ) {
+			waitForWakeup( -1 );
+			writer_asleep.store( false, std::memory_order_relaxed );
+			waitForWakeup( GPTP_LOG_WRITER_BATCH_MS );
+		}
+		writer_asleep.store( false, std::memory_order_relaxed );
+	}
+}
+
+/* Gives the ring back when its thread exits so a later thread can reuse it */
+class GptpLogRingOwner {
+public:
+	GptpLogRing *ring;
+	GptpLogRingOwner() : ring( NULL ) {}
+	~GptpLogRingOwner() {
+		if( ring != NULL )
+			ring->in_use.store( false, std::memory_order_release );
+	}
+};
+
+static GptpLogRing *threadRing()
+{
+	static thread_local GptpLogRingOwner owner;
+
+	if( owner.ring != NULL )
+		return owner.ring;
+
+	GptpLogRing *ring;
+	for( ring = ring_list.load( std::memory_order_acquire ); ring != NULL;
+	     ring = ring->next ) {
+		bool expected = false;
+		if( ring->in_use.compare_exchange_strong( expected, true ))
+			break;
+	}
+	if( ring == NULL ) {
+		ring = new GptpLogRing();
+		ring->next = ring_list.load( std::memory_order_relaxed );
+		// Sequentially consistent so stopWriter() sees every ring
+		while( !ring_list.compare_exchange_weak( ring->next, ring ))
+			;
+	}
+	owner.ring = ring;
+
+	return ring;
+}
+
+static void logAsync
+( GptpLogRing *ring, const char *tag, const char *path, int line,
+  const char *fmt, va_list ap )
+{
+	uint32_t head = ring->head.load( std::memory_order_relaxed );
+	uint32_t tail = ring->tail.load( std::memory_order_acquire );
+
+	if( head - tail >= GPTP_LOG_RING_SIZE ) {
+		ring->dropped.fetch_add( 1, std::memory_order_relaxed );
+		return;
+	}
+
+	GptpLogRecord *record = &ring->record[head & ( GPTP_LOG_RING_SIZE - 1 )];
+	record->timestamp = steadyNow();
+	record->tag = tag;
+	record->path = path;
+	record->line = line;
+	record->fmt = fmt;
+	captureArgs( record, fmt, ap );
+
+	// Ordered before the writer_asleep load, see writerMain()
+	ring->head.store( head + 1 );
+	if( writer_asleep.load() || head + 1 - tail == GPTP_LOG_RING_SIZE / 2 )
+		wakeWriter();
+}
+
+static void startWriter()
+{
+	if( writer_running.load() )
+		return;
+#ifdef __linux__
+	if( writer_event == -1 ) {
+		writer_event = eventfd( 0, EFD_CLOEXEC );
+		// Without it, keep logging synchronously
+		if( writer_event == -1 )
+			return;
+	}
+#endif
+
+	wall_offset = (int64_t) std::chrono::duration_cast<std::chrono::nanoseconds>
+		( std::chrono::system_clock::now().time_since_epoch() ).count() -
+		(int64_t) steadyNow();
+	writer_stop.store( false );
+	writer_thread = std::thread( writerMain );
+	writer_running.store( true );
+}
+
+static void stopWriter()
+{
+	if( !writer_running.exchange( false ))
+		return;
+
+	writer_stop.store( true );
+	wakeWriter();
+	writer_thread.join();
+	/*
+	 * Producers that saw writer_running set may still be filling a
+	 * record; later ones see it cleared and write synchronously.
+	 */
+	for( GptpLogRing *ring = ring_list.load(); ring != NULL;
+	     ring = ring->next ) {
+		while( ring->producing.load() )
+			std::this_thread::yield();
+	}
+	// Records queued while the writer was stopping
+	drainRings();
+}
+
+#endif/*GENIVI_DLT*/
+
 void gptplogRegister(void)
 {
 #ifdef GENIVI_DLT
 	DLT_REGISTER_APP("GPTP","OpenAVB gPTP");
 	DLT_REGISTER_CONTEXT(dlt_con_gptp, "GNRL", "General Context");
+#else
+	static bool atexit_registered = false;
+
+	startWriter();
+	// Flush what is queued if the process exits without unregistering
+	if( !atexit_registered ) {
+		atexit( stopWriter );
+		atexit_registered = true;
+	}
 #endif
 }
 
@@ -50,16 +774,41 @@ void gptplogUnregister(void)
 #ifdef GENIVI_DLT
 	DLT_UNREGISTER_CONTEXT(dlt_con_gptp);
 	DLT_UNREGISTER_APP();
+#else
+	stopWriter();
 #endif
 }
 
 void gptpLog(GPTP_LOG_LEVEL level, const char *tag, const char *path, int line, const char *fmt, ...)
 {
+	va_list args;
+	va_start(args, fmt);
+
+#ifndef GENIVI_DLT
+	if( writer_running.load( std::memory_order_relaxed )) {
+		GptpLogRing *ring = threadRing();
+
+		/*
+		 * Set before writer_running is checked again, while
+		 * stopWriter() clears writer_running before it waits for the
+		 * flag: either this thread sees the writer stopping or
+		 * stopWriter() waits for the record.
+		 */
+		ring->producing.store( true );
+		if( writer_running.load() ) {
+			logAsync( ring, tag, path, line, fmt, args );
+			ring->producing.store( false, std::memory_order_release );
+			va_end(args);
+			return;
+		}
+		ring->producing.store( false, std::memory_order_relaxed );
+	}
+#endif
+
 	char msg[1024];
 
-       va_list args;
-       va_start(args, fmt);
-       vsnprintf(msg, sizeof(msg), fmt, args);
+	vsnprintf(msg, sizeof(msg), fmt, args);
+	va_end(args);
 
 #ifndef GENIVI_DLT
 	std::chrono::system_clock::time_point cNow = std::chrono::system_clock::now();
@@ -69,14 +818,7 @@ void gptpLog(GPTP_LOG_LEVEL level, const char *tag, const char *path, int line,
 	std::chrono::system_clock::duration roundNow = cNow - std::chrono::system_clock::from_time_t(tNow);
 	long int millis = (long int) std::chrono::duration_cast<std::chrono::milliseconds>(roundNow).count();
 
-	if (path) {
-		fprintf(stderr, "%s: GPTP [%2.2d:%2.2d:%2.2d:%3.3ld] [%s:%u] %s\n",
-			   tag, tmNow.tm_hour, tmNow.tm_min, tmNow.tm_sec, millis, path, line, msg);
-	}
-	else {
-		fprintf(stderr, "%s: GPTP [%2.2d:%2.2d:%2.2d:%3.3ld] %s\n",
-			   tag, tmNow.tm_hour, tmNow.tm_min, tmNow.tm_sec, millis, msg);
-	}
+	writeLine(tag, path, line, msg, &tmNow, millis);
 #else
 	DltLogLevelType dlt_level; 
 
@@ -32,18 +32,46 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdarg.h>
 #include <time.h>
 
+#include <atomic>
+
 #ifdef GENIVI_DLT
 #include "dlt.h"
 #endif
 
+/**
+ * @brief Least severe level compiled in, as a GPTP_LOG_LEVEL value
+ * (0 = CRITICAL ... 7 = VERBOSE). Log sites below it expand to nothing, so
+ * their arguments are never evaluated. Set with -DGPTP_LOG_COMPILE_LEVEL=n
+ * or the GPTP_LOG_LEVEL CMake option.
+ */
+#ifndef GPTP_LOG_COMPILE_LEVEL
+#define GPTP_LOG_COMPILE_LEVEL		7
+#endif
+
+#if GPTP_LOG_COMPILE_LEVEL >= 0
 #define GPTP_LOG_CRITICAL_ON		1
+#endif
+#if GPTP_LOG_COMPILE_LEVEL >= 1
 #define GPTP_LOG_ERROR_ON			1
+#endif
+#if GPTP_LOG_COMPILE_LEVEL >= 2
 #define GPTP_LOG_EXCEPTION_ON		1
+#endif
+#if GPTP_LOG_COMPILE_LEVEL >= 3
 #define GPTP_LOG_WARNING_ON			1
+#endif
+#if GPTP_LOG_COMPILE_LEVEL >= 4
 #define GPTP_LOG_INFO_ON			1
+#endif
+#if GPTP_LOG_COMPILE_LEVEL >= 5
 #define GPTP_LOG_STATUS_ON			1
+#endif
+#if GPTP_LOG_COMPILE_LEVEL >= 6
 #define GPTP_LOG_DEBUG_ON			1
+#endif
+#if GPTP_LOG_COMPILE_LEVEL >= 7
 #define GPTP_LOG_VERBOSE_ON		1
+#endif
 
 typedef enum {
 	GPTP_LOG_LVL_CRITICAL,
@@ -56,60 +84,115 @@ typedef enum {
 	GPTP_LOG_LVL_VERBOSE,
 } GPTP_LOG_LEVEL;
 
+/**
+ * @brief Subsystems with their own runtime log level
+ */
+typedef enum {
+	GPTP_LOG_SUBSYS_GENERAL,
+	GPTP_LOG_SUBSYS_TIMER,
+	GPTP_LOG_SUBSYS_NET,
+	GPTP_LOG_SUBSYS_SERVO,
+	GPTP_LOG_SUBSYS_BMCA,
+	GPTP_LOG_SUBSYS_PDELAY,
+	GPTP_LOG_SUBSYS_COUNT
+} GPTP_LOG_SUBSYS;
+
+/**
+ * @brief Subsystem the GPTP_LOG_* macros log under. Source files (or
+ * sections of them) select another one with
+ * \#undef GPTP_LOG_SUBSYSTEM / \#define GPTP_LOG_SUBSYSTEM ...
+ */
+#define GPTP_LOG_SUBSYSTEM GPTP_LOG_SUBSYS_GENERAL
+
+/**
+ * @brief Runtime level of each subsystem. Messages less severe than the
+ * level of their subsystem are skipped before their arguments are
+ * evaluated. Defaults to GPTP_LOG_LVL_VERBOSE.
+ */
+extern std::atomic<int> gptp_log_level[GPTP_LOG_SUBSYS_COUNT];
 
 void gptplogRegister(void);
 void gptplogUnregister(void);
 void gptpLog(GPTP_LOG_LEVEL level, const char *tag, const char *path, int line, const char *fmt, ...);
 
+/**
+ * @brief Sets the runtime level of one subsystem
+ * @param subsys Subsystem
+ * @param level Least severe level that is logged
+ */
+void gptplogSetLevel(GPTP_LOG_SUBSYS subsys, GPTP_LOG_LEVEL level);
+
+/**
+ * @brief Sets runtime levels from a comma separated list of
+ * [subsystem=]level entries, e.g. "status,timer=error,pdelay=debug".
+ * An entry without a subsystem applies to all of them.
+ * @param spec [in] Level list
+ * @return TRUE on success, FALSE if an entry is not understood
+ */
+bool gptplogSetLevels(const char *spec);
+
+/**
+ * @brief TRUE if a message of this level is logged for the subsystem.
+ * A single relaxed load.
+ */
+#define GPTP_LOG_ENABLED(subsys, lvl) \
+	((int)(lvl) <= gptp_log_level[subsys].load(std::memory_order_relaxed))
+
+#define GPTP_LOG_SITE(lvl, tag, path, line, fmt, ...)			\
+	do {								\
+		if (GPTP_LOG_ENABLED(GPTP_LOG_SUBSYSTEM, lvl))		\
+			gptpLog(lvl, tag, path, line, fmt, ## __VA_ARGS__); \
+	} while (0)
+
 
 #define GPTP_LOG_REGISTER() gptplogRegister()
 
 #define GPTP_LOG_UNREGISTER() gptplogUnregister()
 
 #ifdef GPTP_LOG_CRITICAL_ON
-#define GPTP_LOG_CRITICAL(fmt,...) gptpLog(GPTP_LOG_LVL_CRITICAL, "CRITICAL ", NULL, 0, fmt, ## __VA_ARGS__)
+#define GPTP_LOG_CRITICAL(fmt,...) GPTP_LOG_SITE(GPTP_LOG_LVL_CRITICAL, "CRITICAL ", NULL, 0, fmt, ## __VA_ARGS__)
 #else
 #define GPTP_LOG_CRITICAL(fmt,...)
 #endif
 
 #ifdef GPTP_LOG_ERROR_ON
-#define GPTP_LOG_ERROR(fmt,...) gptpLog(GPTP_LOG_LVL_ERROR, "ERROR    ", NULL, 0, fmt, ## __VA_ARGS__)
+#define GPTP_LOG_ERROR(fmt,...) GPTP_LOG_SITE(GPTP_LOG_LVL_ERROR, "ERROR    ", NULL, 0, fmt, ## __VA_ARGS__)
 #else
 #define GPTP_LOG_ERROR(fmt,...)
 #endif
 
 #ifdef GPTP_LOG_EXCEPTION_ON
-#define GPTP_LOG_EXCEPTION(fmt,...) gptpLog(GPTP_LOG_LVL_EXCEPTION, "EXCEPTION", NULL, 0, fmt, ## __VA_ARGS__)
+#define GPTP_LOG_EXCEPTION(fmt,...) GPTP_LOG_SITE(GPTP_LOG_LVL_EXCEPTION, "EXCEPTION", NULL, 0, fmt, ## __VA_ARGS__)
 #else
 #define GPTP_LOG_EXCEPTION(fmt,...)
 #endif
 
 #ifdef GPTP_LOG_WARNING_ON
-#define GPTP_LOG_WARNING(fmt,...) gptpLog(GPTP_LOG_LVL_WARNING, "WARNING  ", NULL, 0, fmt, ## __VA_ARGS__)
+#define GPTP_LOG_WARNING(fmt,...) GPTP_LOG_SITE(GPTP_LOG_LVL_WARNING, "WARNING  ", NULL, 0, fmt, ## __VA_ARGS__)
 #else
 #define GPTP_LOG_WARNING(fmt,...)
 #endif
 
 #ifdef GPTP_LOG_INFO_ON
-#define GPTP_LOG_INFO(fmt,...) gptpLog(GPTP_LOG_LVL_INFO, "INFO     ", NULL, 0, fmt, ## __VA_ARGS__)
+#define GPTP_LOG_INFO(fmt,...) GPTP_LOG_SITE(GPTP_LOG_LVL_INFO, "INFO     ", NULL, 0, fmt, ## __VA_ARGS__)
 #else
 #define GPTP_LOG_INFO(fmt,...)
 #endif
 
 #ifdef GPTP_LOG_STATUS_ON
-#define GPTP_LOG_STATUS(fmt,...) gptpLog(GPTP_LOG_LVL_STATUS, "STATUS   ", NULL, 0, fmt, ## __VA_ARGS__)
+#define GPTP_LOG_STATUS(fmt,...) GPTP_LOG_SITE(GPTP_LOG_LVL_STATUS, "STATUS   ", NULL, 0, fmt, ## __VA_ARGS__)
 #else
 #define GPTP_LOG_STATUS(fmt,...)
 #endif
 
 #ifdef GPTP_LOG_DEBUG_ON
-#define GPTP_LOG_DEBUG(fmt,...) gptpLog(GPTP_LOG_LVL_DEBUG, "DEBUG    ", __FILE__, __LINE__, fmt, ## __VA_ARGS__)
+#define GPTP_LOG_DEBUG(fmt,...) GPTP_LOG_SITE(GPTP_LOG_LVL_DEBUG, "DEBUG    ", __FILE__, __LINE__, fmt, ## __VA_ARGS__)
 #else
 #define GPTP_LOG_DEBUG(fmt,...)
 #endif
 
 #ifdef GPTP_LOG_VERBOSE_ON
-#define GPTP_LOG_VERBOSE(fmt,...) gptpLog(GPTP_LOG_LVL_VERBOSE, "VERBOSE  ", __FILE__, __LINE__, fmt, ## __VA_ARGS__)
+#define GPTP_LOG_VERBOSE(fmt,...) GPTP_LOG_SITE(GPTP_LOG_LVL_VERBOSE, "VERBOSE  ", __FILE__, __LINE__, fmt, ## __VA_ARGS__)
 #else
 #define GPTP_LOG_VERBOSE(fmt,...)
 #endif
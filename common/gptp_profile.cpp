@@ -610,8 +610,8 @@ void gPTPProfile::enable_clock_quality_monitoring() const {
         config.max_history_measurements = clock_quality_max_history;
         config.profile_type = get_clock_quality_profile_type();
         
-        clock_monitor = std::make_unique<OpenAvnu::gPTP::IngressEventMonitor>(config);
-        quality_analyzer = std::make_unique<OpenAvnu::gPTP::ClockQualityAnalyzer>(config);
+        clock_monitor.reset(new OpenAvnu::gPTP::IngressEventMonitor(config));
+        quality_analyzer.reset(new OpenAvnu::gPTP::ClockQualityAnalyzer(config));
     }
     
     // Enable monitoring
@@ -649,8 +649,7 @@ OpenAvnu::gPTP::ClockQualityMetrics gPTPProfile::get_clock_quality_metrics(uint3
         return OpenAvnu::gPTP::ClockQualityMetrics(); // Return empty metrics
     }
     
-    const auto& measurements = clock_monitor->get_measurement_history();
-    return quality_analyzer->analyze_measurements(measurements, window_seconds);
+    return quality_analyzer->analyze_measurements(*clock_monitor, window_seconds);
 }
 
 bool gPTPProfile::validate_clock_quality_certification() const {
@@ -19,6 +19,7 @@
 
 // Include full definitions for clock quality monitoring
 #include "gptp_clock_quality.hpp"
+#include "gptp_servo.hpp"
 
 /**
  * @brief Unified gPTP Profile Configuration
@@ -126,6 +127,10 @@ struct gPTPProfile {
     uint32_t signaling_send_timeout_s;      // Timeout for sending signaling after sync (60s)
     bool revert_to_initial_on_link_event;   // Revert to initial intervals on link down/up
     
+    // Clock servo used when syntonizing (gptp_cfg.ini [servo] section),
+    // passed to the IEEE1588Clock constructor
+    ClockServoConfig servo;                // Servo type and gains
+
     // Performance and compliance limits
     uint32_t max_convergence_time_ms;      // Maximum convergence time (0=no limit)
     uint32_t max_sync_jitter_ns;           // Maximum sync jitter (0=no limit)
@@ -0,0 +1,402 @@
+/******************************************************************************
+
+  Copyright (c) 2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#include <gptp_servo.hpp>
+#include <gptp_log.hpp>
+
+/* need Microsoft version for strcasecmp() from GCC strings.h */
+#ifdef _MSC_VER
+#define strcasecmp _stricmp
+#else
+#include <strings.h>
+#endif
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#undef GPTP_LOG_SUBSYSTEM
+#define GPTP_LOG_SUBSYSTEM GPTP_LOG_SUBSYS_SERVO
+
+/* A locked servo unlocks when the phase error exceeds this many times
+   the lock threshold */
+#define SERVO_UNLOCK_FACTOR 8
+
+/* Default LQR adjustment change weight, per (ppb/s) squared per second */
+#define LQR_CONTROL_WEIGHT 1.0
+
+/* The Riccati iteration stops once no term of the cost matrix moves by
+   more than this fraction, or after LQR_MAX_ITERATIONS */
+#define LQR_TOLERANCE 1e-9
+#define LQR_MAX_ITERATIONS 10000
+
+ClockServoConfig::ClockServoConfig()
+{
+	type = CLOCK_SERVO_PI;
+	kp = PROPORTIONAL;
+	ki = INTEGRAL;
+	max_ppm = UPPER_FREQ_LIMIT;
+	lock_threshold_ns = SERVO_LOCK_THRESHOLD_NS;
+	lock_samples = SERVO_LOCK_SAMPLES;
+	locked_kp = 0.3;
+	locked_ki = INTEGRAL / 2;
+	kalman_time_constant = 1.0;
+	kalman_phase_noise = 50.0;
+	kalman_rate_noise = 0.0;
+	kalman_freq_wander = 10.0;
+	lqr_phase_weight = 1.0;
+	lqr_freq_weight = 0.0;
+	lqr_control_weight = LQR_CONTROL_WEIGHT;
+}
+
+static bool parseDouble( const char *value, double *result )
+{
+	char *end;
+	double d;
+
+	errno = 0;
+	d = strtod( value, &end );
+	if( end == value || *end != '\0' || errno != 0 || !isfinite( d ) || d < 0 )
+		return false;
+	*result = d;
+	return true;
+}
+
+bool ClockServoConfig::set( const char *name, const char *value )
+{
+	double d;
+
+	if( strcasecmp( name, "type" ) == 0 ) {
+		if( strcasecmp( value, "pi" ) == 0 )
+			type = CLOCK_SERVO_PI;
+		else if( strcasecmp( value, "adaptive_pi" ) == 0 )
+			type = CLOCK_SERVO_ADAPTIVE_PI;
+		else if( strcasecmp( value, "kalman" ) == 0 )
+			type = CLOCK_SERVO_KALMAN;
+		else if( strcasecmp( value, "lqr" ) == 0 )
+			type = CLOCK_SERVO_LQR;
+		else
+			return false;
+		return true;
+	}
+
+	if( !parseDouble( value, &d ))
+		return false;
+
+	if( strcasecmp( name, "kp" ) == 0 )
+		kp = d;
+	else if( strcasecmp( name, "ki" ) == 0 )
+		ki = d;
+	else if( strcasecmp( name, "max_ppm" ) == 0 && d > 0 )
+		max_ppm = d;
+	else if( strcasecmp( name, "lock_threshold" ) == 0 )
+		lock_threshold_ns = (int64_t) d;
+	else if( strcasecmp( name, "lock_samples" ) == 0 && d >= 1 )
+		lock_samples = (unsigned) d;
+	else if( strcasecmp( name, "locked_kp" ) == 0 )
+		locked_kp = d;
+	else if( strcasecmp( name, "locked_ki" ) == 0 )
+		locked_ki = d;
+	else if( strcasecmp( name, "kalman_time_constant" ) == 0 && d > 0 )
+		kalman_time_constant = d;
+	else if( strcasecmp( name, "kalman_phase_noise" ) == 0 && d > 0 )
+		kalman_phase_noise = d;
+	else if( strcasecmp( name, "kalman_rate_noise" ) == 0 )
+		kalman_rate_noise = d;
+	else if( strcasecmp( name, "kalman_freq_wander" ) == 0 )
+		kalman_freq_wander = d;
+	else if( strcasecmp( name, "lqr_phase_weight" ) == 0 && d > 0 )
+		lqr_phase_weight = d;
+	else if( strcasecmp( name, "lqr_freq_weight" ) == 0 )
+		lqr_freq_weight = d;
+	else if( strcasecmp( name, "lqr_control_weight" ) == 0 && d > 0 )
+		lqr_control_weight = d;
+	else
+		return false;
+
+	return true;
+}
+
+const char *ClockServoConfig::typeName( ClockServoType type )
+{
+	switch( type ) {
+	case CLOCK_SERVO_PI:
+		return "pi";
+	case CLOCK_SERVO_ADAPTIVE_PI:
+		return "adaptive_pi";
+	case CLOCK_SERVO_KALMAN:
+		return "kalman";
+	case CLOCK_SERVO_LQR:
+		return "lqr";
+	}
+	return "unknown";
+}
+
+ClockServo::ClockServo( const ClockServoConfig &config )
+{
+	this->config = config;
+	ppm = 0;
+	state = CLOCK_SERVO_UNLOCKED;
+	samples_in_threshold = 0;
+}
+
+ClockServo *ClockServo::create( const ClockServoConfig &config )
+{
+	switch( config.type ) {
+	case CLOCK_SERVO_ADAPTIVE_PI:
+		return new AdaptivePIClockServo( config );
+	case CLOCK_SERVO_KALMAN:
+		return new KalmanClockServo( config );
+	case CLOCK_SERVO_LQR:
+		return new LQRClockServo( config );
+	case CLOCK_SERVO_PI:
+	default:
+		return new PIClockServo( config );
+	}
+}
+
+void ClockServo::reset()
+{
+	state = CLOCK_SERVO_UNLOCKED;
+	samples_in_threshold = 0;
+}
+
+bool ClockServo::trackLock( double phase_error )
+{
+	double magnitude = fabs( phase_error );
+
+	if( state == CLOCK_SERVO_LOCKED ) {
+		if( magnitude <= (double) config.lock_threshold_ns * SERVO_UNLOCK_FACTOR )
+			return false;
+		state = CLOCK_SERVO_UNLOCKED;
+		samples_in_threshold = 0;
+		GPTP_LOG_STATUS( "%s servo unlocked, phase error %.0f ns",
+				 getName(), phase_error );
+		return true;
+	}
+
+	if( magnitude > (double) config.lock_threshold_ns ) {
+		samples_in_threshold = 0;
+		return false;
+	}
+	if( ++samples_in_threshold < config.lock_samples )
+		return false;
+	state = CLOCK_SERVO_LOCKED;
+	GPTP_LOG_STATUS( "%s servo locked, %f ppm", getName(), ppm );
+	return true;
+}
+
+double ClockServo::clamp( double value ) const
+{
+	if( value < -config.max_ppm )
+		return -config.max_ppm;
+	if( value > config.max_ppm )
+		return config.max_ppm;
+	return value;
+}
+
+float PIClockServo::sample( double phase_error, double freq_error, double interval )
+{
+	// Accumulated and clamped in float, as the loop always has been
+	float syncPerSec = (float) ( 1.0 / interval );
+	float adjusted = (float) ppm;
+
+	adjusted += (float) (( config.ki * syncPerSec * phase_error ) +
+			     config.kp * freq_error );
+	ppm = (float) clamp( adjusted );
+	trackLock( phase_error );
+
+	return (float) ppm;
+}
+
+float AdaptivePIClockServo::sample( double phase_error, double freq_error, double interval )
+{
+	trackLock( phase_error );
+	if( state == CLOCK_SERVO_LOCKED ) {
+		ppm += config.locked_ki / interval * phase_error +
+			config.locked_kp * freq_error;
+	} else {
+		ppm += config.ki / interval * phase_error + config.kp * freq_error;
+	}
+	ppm = clamp( ppm );
+
+	return (float) ppm;
+}
+
+void KalmanClockServo::reset()
+{
+	ClockServo::reset();
+	initialized = false;
+	last_step = 0;
+}
+
+void KalmanClockServo::update( int index, double measurement, double variance )
+{
+	double innovation = measurement - ( index == 0 ? x_phase : x_freq );
+	double s = p[index][index] + variance;
+	double k0 = p[0][index] / s;
+	double k1 = p[1][index] / s;
+	double pi0 = p[index][0];
+	double pi1 = p[index][1];
+
+	x_phase += k0 * innovation;
+	x_freq += k1 * innovation;
+
+	p[0][0] -= k0 * pi0;
+	p[0][1] -= k0 * pi1;
+	p[1][0] -= k1 * pi0;
+	p[1][1] -= k1 * pi1;
+}
+
+float KalmanClockServo::sample( double phase_error, double freq_error, double interval )
+{
+	double phase_var = config.kalman_phase_noise * config.kalman_phase_noise;
+	double rate_var;
+	double wander = config.kalman_freq_wander * config.kalman_freq_wander;
+	double step, adjusted;
+
+	// The rate is measured between two syncs, so it carries the noise of
+	// both phase measurements
+	if( config.kalman_rate_noise > 0 )
+		rate_var = config.kalman_rate_noise * 1000 * config.kalman_rate_noise * 1000;
+	else
+		rate_var = 2 * phase_var / ( interval * interval );
+
+	if( !initialized ) {
+		x_phase = phase_error;
+		x_freq = freq_error * 1000;
+		p[0][0] = phase_var;
+		p[1][1] = rate_var;
+		p[0][1] = p[1][0] = 0;
+		initialized = true;
+	} else {
+		double dt = interval;
+
+		// The adjustment made at the last sample took out last_step of
+		// the frequency error for the whole interval
+		x_freq -= last_step;
+		x_phase += x_freq * dt;
+
+		p[0][0] += 2 * dt * p[0][1] + dt * dt * p[1][1] + wander * dt * dt * dt / 3;
+		p[0][1] += dt * p[1][1] + wander * dt * dt / 2;
+		p[1][0] = p[0][1];
+		p[1][1] += wander * dt;
+
+		update( 0, phase_error, phase_var );
+		update( 1, freq_error * 1000, rate_var );
+	}
+
+	// Cancel the frequency error and remove the phase error over the time
+	// constant, never faster than one interval
+	step = x_freq + x_phase / fmax( config.kalman_time_constant, interval );
+	adjusted = clamp( ppm + step / 1000 );
+	last_step = ( adjusted - ppm ) * 1000;
+	ppm = adjusted;
+
+	trackLock( phase_error );
+
+	GPTP_LOG_VERBOSE( "Kalman servo: phase %.1f ns, frequency %.3f ppm, adjustment %f ppm",
+			  x_phase, x_freq / 1000, ppm );
+
+	return (float) ppm;
+}
+
+void LQRClockServo::computeGains( double interval )
+{
+	double t = interval;
+	// The weights are rates, per second of error and per squared ns/s
+	// of adjustment change per second, so the loop keeps its bandwidth
+	// whatever the sync interval
+	double q_phase = config.lqr_phase_weight * t;
+	double q_freq = config.lqr_freq_weight * t;
+	double r = config.lqr_control_weight / t;
+	// Cost to go matrix [[a, b], [b, c]], starting from the state weights
+	double a = q_phase;
+	double b = 0;
+	double c = q_freq;
+	double g0 = 0, g1 = 0, s = r;
+	unsigned i;
+
+	// State (phase ns, frequency ns/s), advancing by A = [[1, t], [0, 1]]
+	// over a sync interval; an adjustment change u acts through
+	// B = [-t, -1]. Iterates P = Q + A'PA - A'PB (r + B'PB)^-1 B'PA
+	for( i = 0; i < LQR_MAX_ITERATIONS; ++i ) {
+		double na, nb, nc;
+		bool done;
+
+		// g = -B'PA, s = r + B'PB
+		g0 = t * a + b;
+		g1 = g0 * t + t * b + c;
+		s = r + t * t * a + 2 * t * b + c;
+
+		na = q_phase + a - g0 * g0 / s;
+		nb = a * t + b - g0 * g1 / s;
+		nc = q_freq + a * t * t + 2 * b * t + c - g1 * g1 / s;
+
+		done = fabs( na - a ) <= LQR_TOLERANCE * fabs( na ) &&
+			fabs( nb - b ) <= LQR_TOLERANCE * fabs( nb ) &&
+			fabs( nc - c ) <= LQR_TOLERANCE * fabs( nc );
+		a = na;
+		b = nb;
+		c = nc;
+		if( done )
+			break;
+	}
+	if( i == LQR_MAX_ITERATIONS )
+		GPTP_LOG_WARNING( "LQR servo gains did not converge for a %f s interval",
+				  interval );
+
+	g0 = t * a + b;
+	g1 = g0 * t + t * b + c;
+	s = r + t * t * a + 2 * t * b + c;
+	phase_gain = g0 / s;
+	freq_gain = g1 / s;
+	gain_interval = interval;
+
+	GPTP_LOG_VERBOSE( "LQR servo gains for a %f s interval: %f ppb/ns, %f",
+			  interval, phase_gain, freq_gain );
+}
+
+float LQRClockServo::sample( double phase_error, double freq_error, double interval )
+{
+	if( interval != gain_interval )
+		computeGains( interval );
+
+	// The change that minimizes the cost, u = -Kx
+	ppm = clamp( ppm + ( phase_gain * phase_error +
+			     freq_gain * freq_error * 1000 ) / 1000 );
+	trackLock( phase_error );
+
+	return (float) ppm;
+}
@@ -0,0 +1,303 @@
+/******************************************************************************
+
+  Copyright (c) 2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#ifndef GPTP_SERVO_HPP
+#define GPTP_SERVO_HPP
+
+#include <stdint.h>
+
+/**@file*/
+
+/* Defaults of the PI servo, and of the gains of the other servos */
+#define INTEGRAL 0.0003				/*!< PI controller integral factor*/
+#define PROPORTIONAL 1.0			/*!< PI controller proportional factor*/
+#define UPPER_FREQ_LIMIT  250.0		/*!< Upper frequency limit */
+#define LOWER_FREQ_LIMIT -250.0		/*!< Lower frequency limit */
+
+#define SERVO_LOCK_THRESHOLD_NS 1000	/*!< Phase error below which a servo counts as locked */
+#define SERVO_LOCK_SAMPLES 8		/*!< Consecutive samples below the threshold to lock */
+
+/**
+ * @brief Servo algorithms
+ */
+typedef enum {
+	CLOCK_SERVO_PI,			//!< Fixed gain PI loop scaled by sync rate
+	CLOCK_SERVO_ADAPTIVE_PI,	//!< PI loop with lower gains once locked
+	CLOCK_SERVO_KALMAN,		//!< Joint phase and frequency Kalman estimator
+	CLOCK_SERVO_LQR,		//!< Linear quadratic regulator on phase and frequency
+} ClockServoType;
+
+/**
+ * @brief Lock state reported by a servo
+ */
+typedef enum {
+	CLOCK_SERVO_UNLOCKED,
+	CLOCK_SERVO_LOCKED,
+} ClockServoState;
+
+/**
+ * @brief Servo selection and tuning, part of the profile and settable
+ * from the [servo] section of gptp_cfg.ini
+ */
+struct ClockServoConfig {
+	ClockServoType type;		//!< Algorithm
+	double kp;			//!< Fraction of the measured frequency error corrected per sync
+	double ki;			//!< ppm of correction per ns of phase error, times syncs per second
+	double max_ppm;			//!< Largest frequency adjustment, either direction
+	int64_t lock_threshold_ns;	//!< Phase error below which the servo counts as locked
+	unsigned lock_samples;		//!< Consecutive samples below the threshold to lock
+	double locked_kp;		//!< Adaptive PI: kp once locked
+	double locked_ki;		//!< Adaptive PI: ki once locked
+	double kalman_time_constant;	//!< Kalman: time to remove a phase error, in seconds
+	double kalman_phase_noise;	//!< Kalman: phase measurement noise, standard deviation in ns
+	double kalman_rate_noise;	//!< Kalman: rate measurement noise in ppm, 0 to derive it from the phase noise
+	double kalman_freq_wander;	//!< Kalman: oscillator frequency random walk, in ppb per square root of second
+	double lqr_phase_weight;	//!< LQR: cost of a phase error, per ns squared per second
+	double lqr_freq_weight;		//!< LQR: cost of a frequency error, per ppb squared per second
+	double lqr_control_weight;	//!< LQR: cost of adjusting, per (ppb/s) squared per second
+
+	/**
+	 * @brief Defaults: the PI servo with the historical gains
+	 */
+	ClockServoConfig();
+
+	/**
+	 * @brief Sets one field from its gptp_cfg.ini key
+	 * @param name [in] Key, e.g. "type" or "kp"
+	 * @param value [in] Value as written in the file
+	 * @return FALSE if the key is unknown or the value invalid
+	 */
+	bool set( const char *name, const char *value );
+
+	/**
+	 * @brief Returns the gptp_cfg.ini name of a servo type
+	 * @param type Servo type
+	 * @return "pi", "adaptive_pi", "kalman" or "lqr"
+	 */
+	static const char *typeName( ClockServoType type );
+};
+
+/**
+ * @brief Clock servo interface.
+ *
+ * IEEE1588Clock feeds the servo the phase and frequency error measured
+ * at each sync and programs the returned frequency adjustment. The clock
+ * handles phase steps itself and calls reset() after each one. Samples
+ * whose phase error exceeds PHASE_ERROR_THRESHOLD are not passed on.
+ *
+ * Sign conventions follow the historical PI loop: a positive phase error
+ * means the local clock is behind the master, a positive frequency error
+ * that the master runs faster, and a positive adjustment speeds the
+ * local clock up.
+ */
+class ClockServo {
+protected:
+	ClockServoConfig config;
+	double ppm;
+	ClockServoState state;
+	unsigned samples_in_threshold;
+
+	/**
+	 * @brief Updates the lock state with a new phase error
+	 * @param phase_error Phase error in ns
+	 * @return TRUE if the state changed
+	 */
+	bool trackLock( double phase_error );
+
+	/**
+	 * @brief Limits an adjustment to +/- max_ppm
+	 * @param value Adjustment in ppm
+	 * @return Limited adjustment
+	 */
+	double clamp( double value ) const;
+public:
+	/**
+	 * @brief Creates a servo with no adjustment applied
+	 * @param config [in] Tuning
+	 */
+	ClockServo( const ClockServoConfig &config );
+
+	/**
+	 * @brief Destroys the servo
+	 */
+	virtual ~ClockServo() {}
+
+	/**
+	 * @brief Processes one sync
+	 * @param phase_error Phase error in ns
+	 * @param freq_error Frequency error over the last sync interval, in ppm
+	 * @param interval Sync interval in seconds
+	 * @return Frequency adjustment to apply, in ppm
+	 */
+	virtual float sample( double phase_error, double freq_error, double interval ) = 0;
+
+	/**
+	 * @brief Forgets the phase history after the clock was stepped. The
+	 * frequency adjustment is kept.
+	 * @return void
+	 */
+	virtual void reset();
+
+	/**
+	 * @brief Returns the algorithm name
+	 * @return Same as ClockServoConfig::typeName()
+	 */
+	const char *getName() const {
+		return ClockServoConfig::typeName( config.type );
+	}
+
+	/**
+	 * @brief Returns the adjustment currently applied
+	 * @return ppm
+	 */
+	float getPpm() const {
+		return (float) ppm;
+	}
+
+	/**
+	 * @brief Returns the lock state
+	 * @return CLOCK_SERVO_LOCKED once lock_samples consecutive samples
+	 * were within lock_threshold_ns, until a phase error exceeds eight
+	 * times lock_threshold_ns
+	 */
+	ClockServoState getState() const {
+		return state;
+	}
+
+	/**
+	 * @brief Creates the servo selected by a configuration
+	 * @param config [in] Servo type and tuning
+	 * @return New servo, owned by the caller
+	 */
+	static ClockServo *create( const ClockServoConfig &config );
+};
+
+/**
+ * @brief The historical PI loop. Each sample adds kp times the measured
+ * frequency error and ki times the phase error scaled by the sync rate.
+ */
+class PIClockServo : public ClockServo {
+public:
+	/**
+	 * @brief Creates the servo
+	 * @param config [in] Tuning
+	 */
+	PIClockServo( const ClockServoConfig &config ) : ClockServo( config ) {}
+
+	virtual float sample( double phase_error, double freq_error, double interval );
+};
+
+/**
+ * @brief PI loop with gain scheduling. Uses kp and ki until the servo
+ * locks, then locked_kp and locked_ki, which filter more of the
+ * timestamp noise. Goes back to the acquisition gains when it loses
+ * lock.
+ */
+class AdaptivePIClockServo : public ClockServo {
+public:
+	/**
+	 * @brief Creates the servo
+	 * @param config [in] Tuning
+	 */
+	AdaptivePIClockServo( const ClockServoConfig &config ) : ClockServo( config ) {}
+
+	virtual float sample( double phase_error, double freq_error, double interval );
+};
+
+/**
+ * @brief Kalman filter servo.
+ *
+ * Estimates the phase error and the residual frequency error together
+ * from both measurements, with a constant frequency model driven by a
+ * frequency random walk. The adjustment cancels the estimated frequency
+ * error and removes the estimated phase error over kalman_time_constant.
+ * The applied adjustment is fed back into the prediction, so a noisy
+ * rate measurement does not move the clock directly.
+ */
+class KalmanClockServo : public ClockServo {
+private:
+	bool initialized;
+	double x_phase;		// Estimated phase error, ns
+	double x_freq;		// Estimated frequency error, ns/s
+	double p[2][2];		// Estimate covariance
+	double last_step;	// Adjustment change at the last sample, ns/s
+
+	void update( int index, double measurement, double variance );
+public:
+	/**
+	 * @brief Creates the servo
+	 * @param config [in] Tuning
+	 */
+	KalmanClockServo( const ClockServoConfig &config ) : ClockServo( config ) {
+		initialized = false;
+		x_phase = x_freq = 0;
+		p[0][0] = p[0][1] = p[1][0] = p[1][1] = 0;
+		last_step = 0;
+	}
+
+	virtual float sample( double phase_error, double freq_error, double interval );
+	virtual void reset();
+};
+
+/**
+ * @brief Linear quadratic regulator servo.
+ *
+ * Models the phase error and the residual frequency error, both as
+ * measured, as a double integrator driven by the change of adjustment
+ * made at each sync. The gains minimize the weighted squared phase
+ * error, frequency error and rate of adjustment over time; they are the
+ * solution of the discrete Riccati equation for the sync interval,
+ * recomputed when the interval changes. Raising lqr_control_weight
+ * slows the loop down and filters more of the timestamp noise.
+ */
+class LQRClockServo : public ClockServo {
+private:
+	double gain_interval;	// Sync interval the gains were computed for, s
+	double phase_gain;	// Adjustment change per ns of phase error, ns/s
+	double freq_gain;	// Adjustment change per ns/s of frequency error
+
+	void computeGains( double interval );
+public:
+	/**
+	 * @brief Creates the servo
+	 * @param config [in] Tuning
+	 */
+	LQRClockServo( const ClockServoConfig &config ) : ClockServo( config ) {
+		gain_interval = 0;
+		phase_gain = freq_gain = 0;
+	}
+
+	virtual float sample( double phase_error, double freq_error, double interval );
+};
+
+#endif/*GPTP_SERVO_HPP*/
@@ -0,0 +1,445 @@
+/**
+ * @file gptp_time_error_kernels.cpp
+ * @brief Implementation of the vectorized time error scans
+ */
+
+#include "gptp_time_error_kernels.hpp"
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define TIME_ERROR_KERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang compile intrinsics only inside functions built for the
+// instruction set; MSVC accepts them anywhere
+#if defined(__GNUC__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+
+namespace OpenAvnu {
+namespace gPTP {
+
+// ============================================================================
+// Bit Utilities
+// ============================================================================
+
+uint32_t count_set_bits(uint64_t bits) {
+    return static_cast<uint32_t>(std::bitset<64>(bits).count());
+}
+
+static uint64_t lane_mask(size_t count) {
+    return count >= 64 ? ~0ULL : (1ULL << count) - 1;
+}
+
+static uint32_t lowest_set_bit(uint64_t bits) {
+    return count_set_bits((bits & (~bits + 1)) - 1);
+}
+
+static uint32_t highest_set_bit(uint64_t bits) {
+    bits |= bits >> 1;
+    bits |= bits >> 2;
+    bits |= bits >> 4;
+    bits |= bits >> 8;
+    bits |= bits >> 16;
+    bits |= bits >> 32;
+    return count_set_bits(bits) - 1;
+}
+
+uint64_t extract_bits(const uint64_t* bits, size_t first, size_t count) {
+    if (count == 0) {
+        return 0;
+    }
+
+    size_t word = first / 64;
+    size_t shift = first % 64;
+    uint64_t value = bits[word] >> shift;
+    if (shift != 0 && shift + count > 64) {
+        value |= bits[word + 1] << (64 - shift);
+    }
+    return value & lane_mask(count);
+}
+
+// ============================================================================
+// Scalar Kernels
+// ============================================================================
+
+static uint64_t scalar_within_mask(const int64_t* offsets, size_t count, int64_t limit_ns) {
+    uint64_t mask = 0;
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t within = (offsets[i] >= -limit_ns) & (offsets[i] <= limit_ns);
+        mask |= within << i;
+    }
+    return mask;
+}
+
+static void scalar_masked_min_max(const int64_t* offsets, size_t count, uint64_t mask,
+                                  int64_t* min_ns, int64_t* max_ns) {
+    int64_t lowest = *min_ns;
+    int64_t highest = *max_ns;
+    for (size_t i = 0; i < count; ++i) {
+        if ((mask >> i) & 1) {
+            lowest = std::min(lowest, offsets[i]);
+            highest = std::max(highest, offsets[i]);
+        }
+    }
+    *min_ns = lowest;
+    *max_ns = highest;
+}
+
+static void scalar_masked_sums(const int64_t* offsets, size_t count, uint64_t mask,
+                               int64_t* sum_ns, uint64_t* sum_squares) {
+    uint64_t sum = static_cast<uint64_t>(*sum_ns);
+    uint64_t squares = *sum_squares;
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t selected = ~((mask >> i) & 1) + 1;
+        uint64_t value = static_cast<uint64_t>(offsets[i]) & selected;
+        sum += value;
+        squares += value * value;
+    }
+    *sum_ns = static_cast<int64_t>(sum);
+    *sum_squares = squares;
+}
+
+static const TimeErrorKernels scalar_kernels = {
+    TimeErrorKernelIsa::SCALAR, "scalar",
+    scalar_within_mask, scalar_masked_min_max, scalar_masked_sums
+};
+
+#if defined(TIME_ERROR_KERNELS_X86)
+
+// ============================================================================
+// SSE2 Kernels
+// ============================================================================
+
+// SSE2 has no 64-bit compare: compare the high halves signed and, where
+// they are equal, the low halves unsigned
+TARGET_SSE2 static inline __m128i sse2_cmpgt_epi64(__m128i a, __m128i b) {
+    const __m128i low_sign = _mm_set_epi32(0, INT32_MIN, 0, INT32_MIN);
+    __m128i a_biased = _mm_xor_si128(a, low_sign);
+    __m128i b_biased = _mm_xor_si128(b, low_sign);
+    __m128i greater = _mm_cmpgt_epi32(a_biased, b_biased);
+    __m128i equal = _mm_cmpeq_epi32(a_biased, b_biased);
+    __m128i low_greater = _mm_shuffle_epi32(greater, _MM_SHUFFLE(2, 2, 0, 0));
+    __m128i result = _mm_or_si128(greater, _mm_and_si128(equal, low_greater));
+    return _mm_shuffle_epi32(result, _MM_SHUFFLE(3, 3, 1, 1));
+}
+
+TARGET_SSE2 static uint64_t sse2_within_mask(const int64_t* offsets, size_t count, int64_t limit_ns) {
+    const __m128i upper = _mm_set1_epi64x(limit_ns);
+    const __m128i lower = _mm_set1_epi64x(-limit_ns);
+    uint64_t mask = 0;
+    size_t i = 0;
+
+    for (; i + 2 <= count; i += 2) {
+        __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(offsets + i));
+        __m128i outside = _mm_or_si128(sse2_cmpgt_epi64(value, upper),
+                                       sse2_cmpgt_epi64(lower, value));
+        uint64_t within = ~_mm_movemask_pd(_mm_castsi128_pd(outside)) & 0x3;
+        mask |= within << i;
+    }
+    if (i < count) {
+        mask |= scalar_within_mask(offsets + i, count - i, limit_ns) << i;
+    }
+    return mask;
+}
+
+// Squares modulo 2^64 from 32-bit halves: x^2 = lo^2 + 2 lo hi 2^32
+TARGET_SSE2 static inline __m128i sse2_square_epi64(__m128i value) {
+    __m128i low_squared = _mm_mul_epu32(value, value);
+    __m128i cross = _mm_mul_epu32(value, _mm_srli_epi64(value, 32));
+    return _mm_add_epi64(low_squared, _mm_slli_epi64(cross, 33));
+}
+
+TARGET_SSE2 static void sse2_masked_sums(const int64_t* offsets, size_t count, uint64_t mask,
+                                         int64_t* sum_ns, uint64_t* sum_squares) {
+    __m128i sum = _mm_setzero_si128();
+    __m128i squares = _mm_setzero_si128();
+    size_t i = 0;
+
+    for (; i + 2 <= count; i += 2) {
+        uint64_t lanes = (mask >> i) & 0x3;
+        __m128i selected = _mm_set_epi64x(-static_cast<int64_t>(lanes >> 1),
+                                          -static_cast<int64_t>(lanes & 1));
+        __m128i value = _mm_and_si128(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(offsets + i)), selected);
+        sum = _mm_add_epi64(sum, value);
+        squares = _mm_add_epi64(squares, sse2_square_epi64(value));
+    }
+
+    uint64_t lanes_sum[2], lanes_squares[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes_sum), sum);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes_squares), squares);
+    *sum_ns = static_cast<int64_t>(static_cast<uint64_t>(*sum_ns) + lanes_sum[0] + lanes_sum[1]);
+    *sum_squares += lanes_squares[0] + lanes_squares[1];
+
+    if (i < count) {
+        scalar_masked_sums(offsets + i, count - i, mask >> i, sum_ns, sum_squares);
+    }
+}
+
+// Without a 64-bit compare, an SSE2 minimum and maximum takes more
+// instructions than the scalar loop, which compiles to conditional moves
+static const TimeErrorKernels sse2_kernels = {
+    TimeErrorKernelIsa::SSE2, "sse2",
+    sse2_within_mask, scalar_masked_min_max, sse2_masked_sums
+};
+
+// ============================================================================
+// AVX2 Kernels
+// ============================================================================
+
+TARGET_AVX2 static uint64_t avx2_within_mask(const int64_t* offsets, size_t count, int64_t limit_ns) {
+    const __m256i upper = _mm256_set1_epi64x(limit_ns);
+    const __m256i lower = _mm256_set1_epi64x(-limit_ns);
+    uint64_t mask = 0;
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(offsets + i));
+        __m256i outside = _mm256_or_si256(_mm256_cmpgt_epi64(value, upper),
+                                          _mm256_cmpgt_epi64(lower, value));
+        uint64_t within = ~_mm256_movemask_pd(_mm256_castsi256_pd(outside)) & 0xF;
+        mask |= within << i;
+    }
+    if (i < count) {
+        mask |= scalar_within_mask(offsets + i, count - i, limit_ns) << i;
+    }
+    return mask;
+}
+
+TARGET_AVX2 static void avx2_masked_min_max(const int64_t* offsets, size_t count, uint64_t mask,
+                                            int64_t* min_ns, int64_t* max_ns) {
+    const __m256i lane_bits = _mm256_set_epi64x(8, 4, 2, 1);
+    __m256i lowest = _mm256_set1_epi64x(*min_ns);
+    __m256i highest = _mm256_set1_epi64x(*max_ns);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        uint64_t lanes = (mask >> i) & 0xF;
+        if (lanes == 0) {
+            continue;
+        }
+        __m256i selected = _mm256_cmpeq_epi64(
+            _mm256_and_si256(_mm256_set1_epi64x(static_cast<int64_t>(lanes)), lane_bits), lane_bits);
+        __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(offsets + i));
+        __m256i low_candidate = _mm256_blendv_epi8(lowest, value, selected);
+        __m256i high_candidate = _mm256_blendv_epi8(highest, value, selected);
+        lowest = _mm256_blendv_epi8(lowest, low_candidate,
+                                    _mm256_cmpgt_epi64(lowest, low_candidate));
+        highest = _mm256_blendv_epi8(highest, high_candidate,
+                                     _mm256_cmpgt_epi64(high_candidate, highest));
+    }
+
+    int64_t lanes_min[4], lanes_max[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes_min), lowest);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes_max), highest);
+    *min_ns = std::min(std::min(lanes_min[0], lanes_min[1]), std::min(lanes_min[2], lanes_min[3]));
+    *max_ns = std::max(std::max(lanes_max[0], lanes_max[1]), std::max(lanes_max[2], lanes_max[3]));
+
+    if (i < count) {
+        scalar_masked_min_max(offsets + i, count - i, mask >> i, min_ns, max_ns);
+    }
+}
+
+TARGET_AVX2 static void avx2_masked_sums(const int64_t* offsets, size_t count, uint64_t mask,
+                                         int64_t* sum_ns, uint64_t* sum_squares) {
+    const __m256i lane_bits = _mm256_set_epi64x(8, 4, 2, 1);
+    __m256i sum = _mm256_setzero_si256();
+    __m256i squares = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        uint64_t lanes = (mask >> i) & 0xF;
+        __m256i selected = _mm256_cmpeq_epi64(
+            _mm256_and_si256(_mm256_set1_epi64x(static_cast<int64_t>(lanes)), lane_bits), lane_bits);
+        __m256i value = _mm256_and_si256(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(offsets + i)), selected);
+        // Squares modulo 2^64 from 32-bit halves: x^2 = lo^2 + 2 lo hi 2^32
+        __m256i low_squared = _mm256_mul_epu32(value, value);
+        __m256i cross = _mm256_mul_epu32(value, _mm256_srli_epi64(value, 32));
+        sum = _mm256_add_epi64(sum, value);
+        squares = _mm256_add_epi64(squares, _mm256_add_epi64(low_squared,
+                                                             _mm256_slli_epi64(cross, 33)));
+    }
+
+    uint64_t lanes_sum[4], lanes_squares[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes_sum), sum);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes_squares), squares);
+    *sum_ns = static_cast<int64_t>(static_cast<uint64_t>(*sum_ns) +
+                                   lanes_sum[0] + lanes_sum[1] + lanes_sum[2] + lanes_sum[3]);
+    *sum_squares += lanes_squares[0] + lanes_squares[1] + lanes_squares[2] + lanes_squares[3];
+
+    if (i < count) {
+        scalar_masked_sums(offsets + i, count - i, mask >> i, sum_ns, sum_squares);
+    }
+}
+
+static const TimeErrorKernels avx2_kernels = {
+    TimeErrorKernelIsa::AVX2, "avx2",
+    avx2_within_mask, avx2_masked_min_max, avx2_masked_sums
+};
+
+static bool cpu_supports(TimeErrorKernelIsa isa) {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool sse2 = (info[3] & (1 << 26)) != 0;
+    // AVX state must be enabled by the OS as well
+    bool avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) &&
+               (_xgetbv(0) & 0x6) == 0x6;
+    __cpuidex(info, 7, 0);
+    bool avx2 = avx && (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    bool sse2 = __builtin_cpu_supports("sse2");
+    bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+    switch (isa) {
+        case TimeErrorKernelIsa::SSE2: return sse2;
+        case TimeErrorKernelIsa::AVX2: return avx2;
+        case TimeErrorKernelIsa::SCALAR:
+        default:
+            return true;
+    }
+}
+
+#endif // TIME_ERROR_KERNELS_X86
+
+// ============================================================================
+// Dispatch
+// ============================================================================
+
+static std::atomic<const TimeErrorKernels*> selected_kernels(nullptr);
+
+const TimeErrorKernels* get_time_error_kernels(TimeErrorKernelIsa isa) {
+    switch (isa) {
+#if defined(TIME_ERROR_KERNELS_X86)
+        case TimeErrorKernelIsa::SSE2:
+            return cpu_supports(isa) ? &sse2_kernels : nullptr;
+        case TimeErrorKernelIsa::AVX2:
+            return cpu_supports(isa) ? &avx2_kernels : nullptr;
+#endif
+        case TimeErrorKernelIsa::SCALAR:
+            return &scalar_kernels;
+        default:
+            return nullptr;
+    }
+}
+
+const TimeErrorKernels& get_time_error_kernels() {
+    const TimeErrorKernels* kernels = selected_kernels.load(std::memory_order_acquire);
+    if (kernels == nullptr) {
+        const TimeErrorKernelIsa preferred[] = {
+            TimeErrorKernelIsa::AVX2, TimeErrorKernelIsa::SSE2, TimeErrorKernelIsa::SCALAR
+        };
+        for (TimeErrorKernelIsa isa : preferred) {
+            kernels = get_time_error_kernels(isa);
+            if (kernels != nullptr) {
+                break;
+            }
+        }
+        selected_kernels.store(kernels, std::memory_order_release);
+    }
+    return *kernels;
+}
+
+bool select_time_error_kernels(TimeErrorKernelIsa isa) {
+    const TimeErrorKernels* kernels = get_time_error_kernels(isa);
+    if (kernels == nullptr) {
+        return false;
+    }
+    selected_kernels.store(kernels, std::memory_order_release);
+    return true;
+}
+
+// ============================================================================
+// Scans
+// ============================================================================
+
+void scan_time_errors(const int64_t* offsets, const uint64_t* valid_bits,
+                      size_t begin, size_t end, int64_t target_accuracy_ns,
+                      TimeErrorSummary& summary, const TimeErrorKernels& kernels) {
+    const int64_t CERTIFICATION_ACCURACY_NS = 80;
+
+    for (size_t i = begin; i < end; i += 64) {
+        size_t count = std::min<size_t>(64, end - i);
+        const int64_t* block = offsets + i;
+
+        uint64_t valid = extract_bits(valid_bits, i, count);
+        uint64_t within = kernels.within_mask(block, count, target_accuracy_ns);
+        uint64_t within_80ns = target_accuracy_ns == CERTIFICATION_ACCURACY_NS ? within :
+            kernels.within_mask(block, count, CERTIFICATION_ACCURACY_NS);
+        uint64_t bad = valid & ~within;
+
+        summary.within_80ns_count += count_set_bits(within_80ns);
+        summary.valid_count += count_set_bits(valid);
+        summary.outlier_count += count_set_bits(bad);
+        if (valid == 0) {
+            continue;
+        }
+
+        kernels.masked_min_max(block, count, valid, &summary.min_ns, &summary.max_ns);
+        kernels.masked_sums(block, count, valid, &summary.sum_ns, &summary.sum_squares);
+
+        // Good runs only end at outliers, invalid measurements are skipped
+        uint64_t remaining = valid;
+        while (bad != 0) {
+            uint64_t outlier = bad & (~bad + 1);
+            summary.current_good_run += count_set_bits(remaining & (outlier - 1));
+            summary.longest_good_run = std::max(summary.longest_good_run, summary.current_good_run);
+            summary.current_good_run = 0;
+            remaining &= ~(outlier | (outlier - 1));
+            bad &= bad - 1;
+        }
+        summary.current_good_run += count_set_bits(remaining);
+        summary.longest_good_run = std::max(summary.longest_good_run, summary.current_good_run);
+    }
+}
+
+size_t find_good_run(const int64_t* offsets, const uint64_t* valid_bits,
+                     size_t begin, size_t end, int64_t target_accuracy_ns,
+                     uint32_t run_length, uint32_t& run, const TimeErrorKernels& kernels) {
+    if (run_length == 0) {
+        return begin;
+    }
+
+    for (size_t i = begin; i < end; i += 64) {
+        size_t count = std::min<size_t>(64, end - i);
+        uint64_t lanes = lane_mask(count);
+        uint64_t good = kernels.within_mask(offsets + i, count, target_accuracy_ns) &
+                        extract_bits(valid_bits, i, count);
+
+        // Bits of the previous block's final run, as if they sat above bit 63
+        uint64_t carry = run >= 64 ? ~0ULL : ~(~0ULL >> run);
+
+        // Bit j survives if measurements j - k are good for all k < run_length
+        uint64_t complete = good;
+        for (uint32_t k = 1; k < run_length && complete != 0; ++k) {
+            uint64_t shifted = k < 64 ? (good << k) | (carry >> (64 - k)) : carry;
+            complete &= shifted;
+        }
+        if (complete != 0) {
+            return i + lowest_set_bit(complete);
+        }
+
+        uint64_t breaks = ~good & lanes;
+        run = breaks == 0 ? run + static_cast<uint32_t>(count) :
+                            static_cast<uint32_t>(count - 1 - highest_set_bit(breaks));
+    }
+
+    return end;
+}
+
+} // namespace gPTP
+} // namespace OpenAvnu
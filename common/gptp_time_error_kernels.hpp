@@ -0,0 +1,156 @@
+/**
+ * @file gptp_time_error_kernels.hpp
+ * @brief Vectorized scans over time error arrays for clock quality analysis
+ *
+ * The compliance checks of ClockQualityAnalyzer reduce to a few scans over
+ * time errors: counting errors within a bound, counting valid ones, the
+ * longest run within target accuracy and the minimum and maximum. This
+ * module implements the inner kernels with SSE2 and AVX2 and a scalar
+ * fallback, selecting the best supported set at run time, and builds the
+ * scans on top of them.
+ *
+ * Time errors are contiguous int64_t arrays; validity is a bitmap with
+ * bit i of word i / 64 set if measurement i is valid.
+ *
+ * @author OpenAvnu Development Team
+ * @copyright (c) 2025 OpenAvnu Alliance
+ */
+
+#ifndef GPTP_TIME_ERROR_KERNELS_HPP
+#define GPTP_TIME_ERROR_KERNELS_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace OpenAvnu {
+namespace gPTP {
+
+/**
+ * @brief Instruction set of a kernel implementation
+ */
+enum class TimeErrorKernelIsa {
+    SCALAR,  ///< Portable C++
+    SSE2,    ///< 2 time errors per instruction
+    AVX2     ///< 4 time errors per instruction
+};
+
+/**
+ * @brief Set of kernels over blocks of up to 64 time errors
+ *
+ * Bit i of a mask refers to offsets[i].
+ */
+struct TimeErrorKernels {
+    TimeErrorKernelIsa isa;
+    const char* name;
+
+    /**
+     * @brief Mask of the time errors with |offsets[i]| <= limit_ns
+     * @param offsets Time errors
+     * @param count Number of time errors, at most 64
+     * @param limit_ns Bound, not negative
+     */
+    uint64_t (*within_mask)(const int64_t* offsets, size_t count, int64_t limit_ns);
+
+    /**
+     * @brief Fold the minimum and maximum of the selected time errors into min_ns and max_ns
+     * @param offsets Time errors
+     * @param count Number of time errors, at most 64
+     * @param mask Time errors to consider
+     */
+    void (*masked_min_max)(const int64_t* offsets, size_t count, uint64_t mask,
+                           int64_t* min_ns, int64_t* max_ns);
+
+    /**
+     * @brief Add the selected time errors and their squares (modulo 2^64) to sum_ns and sum_squares
+     * @param offsets Time errors
+     * @param count Number of time errors, at most 64
+     * @param mask Time errors to consider
+     */
+    void (*masked_sums)(const int64_t* offsets, size_t count, uint64_t mask,
+                        int64_t* sum_ns, uint64_t* sum_squares);
+};
+
+/**
+ * @brief Get the kernels for the best instruction set the CPU supports
+ *
+ * The choice is made on first use, unless select_time_error_kernels()
+ * was called before.
+ */
+const TimeErrorKernels& get_time_error_kernels();
+
+/**
+ * @brief Get the kernels for an instruction set
+ * @return nullptr if the build or the CPU does not support it
+ */
+const TimeErrorKernels* get_time_error_kernels(TimeErrorKernelIsa isa);
+
+/**
+ * @brief Make get_time_error_kernels() return the kernels for an instruction set
+ * @return false, leaving the selection unchanged, if it is not supported
+ */
+bool select_time_error_kernels(TimeErrorKernelIsa isa);
+
+/**
+ * @brief Extract count bits starting at bit index first, count at most 64
+ */
+uint64_t extract_bits(const uint64_t* bits, size_t first, size_t count);
+
+/**
+ * @brief Count set bits
+ */
+uint32_t count_set_bits(uint64_t bits);
+
+/**
+ * @brief Summary of a range of time errors, accumulated over successive scans
+ *
+ * Statistics other than within_80ns_count cover valid measurements only.
+ * Runs skip invalid measurements, as ClockQualityAnalyzer counts them.
+ */
+struct TimeErrorSummary {
+    uint32_t within_80ns_count;   ///< Measurements within ±80ns, valid or not
+    uint32_t valid_count;         ///< Valid measurements
+    uint32_t outlier_count;       ///< Valid measurements outside target accuracy
+    uint32_t longest_good_run;    ///< Longest run of valid measurements within target
+    uint32_t current_good_run;    ///< Run within target at the end of the range
+    int64_t sum_ns;               ///< Sum of valid time errors
+    uint64_t sum_squares;         ///< Sum of squared valid time errors (modulo 2^64)
+    int64_t min_ns;               ///< Minimum valid time error
+    int64_t max_ns;               ///< Maximum valid time error
+
+    TimeErrorSummary()
+        : within_80ns_count(0), valid_count(0), outlier_count(0)
+        , longest_good_run(0), current_good_run(0)
+        , sum_ns(0), sum_squares(0)
+        , min_ns(INT64_MAX), max_ns(INT64_MIN) {}
+};
+
+/**
+ * @brief Add offsets[begin, end) to a summary
+ * @param offsets Time errors
+ * @param valid_bits Validity bitmap, indexed like offsets
+ * @param target_accuracy_ns Accuracy beyond which a valid time error is an outlier
+ */
+void scan_time_errors(const int64_t* offsets, const uint64_t* valid_bits,
+                      size_t begin, size_t end, int64_t target_accuracy_ns,
+                      TimeErrorSummary& summary,
+                      const TimeErrorKernels& kernels = get_time_error_kernels());
+
+/**
+ * @brief Search offsets[begin, end) for a run of good measurements
+ *
+ * A measurement is good if it is valid and within target accuracy; an
+ * invalid measurement ends a run. Searches continue across calls through
+ * run, the length of the good run ending at the previous range, which
+ * must start at 0.
+ * @param run_length Length of the run searched for, at most 64
+ * @return Index of the measurement completing a run of run_length, or end
+ */
+size_t find_good_run(const int64_t* offsets, const uint64_t* valid_bits,
+                     size_t begin, size_t end, int64_t target_accuracy_ns,
+                     uint32_t run_length, uint32_t& run,
+                     const TimeErrorKernels& kernels = get_time_error_kernels());
+
+} // namespace gPTP
+} // namespace OpenAvnu
+
+#endif // GPTP_TIME_ERROR_KERNELS_HPP
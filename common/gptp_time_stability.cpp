@@ -0,0 +1,142 @@
+/**
+ * @file gptp_time_stability.cpp
+ * @brief Implementation of the streaming stability analysis
+ */
+
+#include "gptp_time_stability.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace OpenAvnu {
+namespace gPTP {
+
+const uint32_t TimeStabilityAnalyzer::DEFAULT_OCTAVES;
+const uint32_t TimeStabilityAnalyzer::MAX_OCTAVES;
+
+TimeStabilityAnalyzer::TimeStabilityAnalyzer(uint32_t octaves)
+{
+    octaves = std::max(1u, std::min(octaves, MAX_OCTAVES));
+    octaves_.resize(octaves);
+    for (uint32_t k = 0; k < octaves; ++k) {
+        octaves_[k].tau_samples = 1u << k;
+        octaves_[k].min_history.resize(2 * octaves_[k].tau_samples);
+        octaves_[k].max_history.resize(2 * octaves_[k].tau_samples);
+    }
+
+    // TDEV of the longest tau needs the prefix sums of its last 3 tau + 1 samples
+    prefix_sums_.resize(4 * octaves_.back().tau_samples);
+    reset();
+}
+
+void TimeStabilityAnalyzer::reset() {
+    for (auto& octave : octaves_) {
+        octave.adev_sum = 0.0;
+        octave.tdev_sum = 0.0;
+        octave.mtie_ns = 0;
+    }
+    prefix_sums_[0] = 0;
+    sample_count_ = 0;
+    first_timestamp_ns_ = 0;
+    last_timestamp_ns_ = 0;
+}
+
+void TimeStabilityAnalyzer::add_sample(uint64_t timestamp_ns, int64_t time_error_ns) {
+    if (sample_count_ == 0) {
+        first_timestamp_ns_ = timestamp_ns;
+    }
+    last_timestamp_ns_ = timestamp_ns;
+
+    uint64_t j = sample_count_++;
+    uint64_t end = prefix_sum(j) + static_cast<uint64_t>(time_error_ns);
+    prefix_sums_[(j + 1) & (prefix_sums_.size() - 1)] = end;
+
+    for (size_t k = 0; k < octaves_.size(); ++k) {
+        Octave& octave = octaves_[k];
+        uint64_t m = octave.tau_samples;
+        uint64_t slot = j & (2 * m - 1);
+
+        // Extremes over samples max(0, j - m) to j, from those of the
+        // octave below ending at j and j - m / 2
+        int64_t min_ns, max_ns;
+        if (k == 0) {
+            min_ns = max_ns = time_error_ns;
+            if (j >= 1) {
+                int64_t previous = time_error(j - 1);
+                min_ns = std::min(min_ns, previous);
+                max_ns = std::max(max_ns, previous);
+            }
+        } else {
+            const Octave& below = octaves_[k - 1];
+            uint64_t half = below.tau_samples;
+            uint64_t mask = 2 * half - 1;
+            min_ns = below.min_history[j & mask];
+            max_ns = below.max_history[j & mask];
+            if (j >= half) {
+                min_ns = std::min(min_ns, below.min_history[(j - half) & mask]);
+                max_ns = std::max(max_ns, below.max_history[(j - half) & mask]);
+            }
+        }
+        octave.min_history[slot] = min_ns;
+        octave.max_history[slot] = max_ns;
+        if (j < m) {
+            continue;
+        }
+        octave.mtie_ns = std::max(octave.mtie_ns, max_ns - min_ns);
+
+        // Second difference x[j] - 2 x[j - m] + x[j - 2m]
+        if (j >= 2 * m) {
+            int64_t difference = static_cast<int64_t>(
+                (end - prefix_sum(j)) - 2 * (prefix_sum(j + 1 - m) - prefix_sum(j - m)) +
+                (prefix_sum(j + 1 - 2 * m) - prefix_sum(j - 2 * m)));
+            octave.adev_sum += static_cast<double>(difference) * static_cast<double>(difference);
+        }
+
+        // Sum of the m second differences ending at j, from prefix sums:
+        // P[j+1] - 3 P[j+1-m] + 3 P[j+1-2m] - P[j+1-3m]
+        if (j + 1 >= 3 * m) {
+            int64_t sum = static_cast<int64_t>(
+                end - 3 * prefix_sum(j + 1 - m) + 3 * prefix_sum(j + 1 - 2 * m) -
+                prefix_sum(j + 1 - 3 * m));
+            octave.tdev_sum += static_cast<double>(sum) * static_cast<double>(sum);
+        }
+    }
+}
+
+double TimeStabilityAnalyzer::get_sample_interval_s(double nominal_interval_s) const {
+    if (sample_count_ < 2 || last_timestamp_ns_ <= first_timestamp_ns_) {
+        return nominal_interval_s;
+    }
+    return static_cast<double>(last_timestamp_ns_ - first_timestamp_ns_) / 1e9 /
+           static_cast<double>(sample_count_ - 1);
+}
+
+std::vector<TimeStabilityPoint> TimeStabilityAnalyzer::get_results(double nominal_interval_s) const {
+    std::vector<TimeStabilityPoint> results;
+    double interval_s = get_sample_interval_s(nominal_interval_s);
+    double n = static_cast<double>(sample_count_);
+
+    for (const auto& octave : octaves_) {
+        uint64_t m = octave.tau_samples;
+        if (sample_count_ < 3 * m) {
+            break;
+        }
+
+        TimeStabilityPoint point;
+        point.tau_samples = octave.tau_samples;
+        point.tau_s = m * interval_s;
+
+        // AVAR = sum / (2 (N - 2m) tau^2), with time errors in ns
+        double avar_ns2 = octave.adev_sum / (2.0 * (n - 2.0 * m));
+        point.adev = point.tau_s > 0.0 ? std::sqrt(avar_ns2) / 1e9 / point.tau_s : 0.0;
+
+        // TVAR = sum / (6 m^2 (N - 3m + 1))
+        point.tdev_ns = std::sqrt(octave.tdev_sum /
+                                  (6.0 * m * m * (n - 3.0 * m + 1.0)));
+        point.mtie_ns = octave.mtie_ns;
+        results.push_back(point);
+    }
+    return results;
+}
+
+} // namespace gPTP
+} // namespace OpenAvnu
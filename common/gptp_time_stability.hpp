@@ -0,0 +1,128 @@
+/**
+ * @file gptp_time_stability.hpp
+ * @brief Streaming Allan deviation, TDEV and MTIE of a time error sequence
+ *
+ * Computes the overlapping Allan deviation (ADEV), time deviation (TDEV)
+ * and maximum time interval error (MTIE) of the time errors measured by
+ * IngressEventMonitor at octave-spaced observation intervals
+ * tau = 2^k * tau0, following the estimators of ITU-T G.810 and
+ * IEEE Std 1139.
+ *
+ * Each sample updates every octave in constant time: the second
+ * differences behind ADEV and TDEV come from a ring of prefix sums of the
+ * time errors, and the extremes behind MTIE from those of the octave
+ * below, as the extreme over 2 tau is the larger of two over tau. A
+ * sequence of n samples thus costs O(n log n) for log n octaves, and
+ * memory stays within twelve samples per sample interval of the longest
+ * tau.
+ *
+ * @author OpenAvnu Development Team
+ * @copyright (c) 2025 OpenAvnu Alliance
+ */
+
+#ifndef GPTP_TIME_STABILITY_HPP
+#define GPTP_TIME_STABILITY_HPP
+
+#include <cstdint>
+#include <vector>
+
+namespace OpenAvnu {
+namespace gPTP {
+
+/**
+ * @brief Stability of a time error sequence at one observation interval
+ */
+struct TimeStabilityPoint {
+    uint32_t tau_samples;  ///< Observation interval in sample intervals
+    double tau_s;          ///< Observation interval in seconds
+    double adev;           ///< Overlapping Allan deviation (fractional frequency)
+    double tdev_ns;        ///< Time deviation in nanoseconds
+    int64_t mtie_ns;       ///< Maximum time interval error in nanoseconds
+
+    TimeStabilityPoint()
+        : tau_samples(0), tau_s(0.0), adev(0.0), tdev_ns(0.0), mtie_ns(0) {}
+};
+
+/**
+ * @brief Streaming stability analysis over octave-spaced observation intervals
+ *
+ * Samples are taken as evenly spaced; tau0 is their mean spacing. An
+ * octave is reported once three of its observation intervals have been
+ * observed, the minimum for TDEV.
+ */
+class TimeStabilityAnalyzer {
+public:
+    static const uint32_t DEFAULT_OCTAVES = 12;  ///< tau up to 2048 * tau0
+    static const uint32_t MAX_OCTAVES = 20;   ///< tau up to 2^19 * tau0
+
+private:
+    struct Octave {
+        uint32_t tau_samples;
+        double adev_sum;         ///< Sum of squared second differences
+        double tdev_sum;         ///< Sum of squared second difference sums over tau
+        int64_t mtie_ns;
+        /// Extremes of the time error over the tau + 1 samples ending at
+        /// each of the last 2 tau samples, by sample index modulo 2 tau
+        std::vector<int64_t> min_history;
+        std::vector<int64_t> max_history;
+    };
+
+    std::vector<Octave> octaves_;
+
+    /// Prefix sums of the time errors, modulo 2^64: entry i % size holds
+    /// the sum of the first i samples; the size is a power of two
+    std::vector<uint64_t> prefix_sums_;
+    uint64_t sample_count_;
+    uint64_t first_timestamp_ns_;
+    uint64_t last_timestamp_ns_;
+
+    uint64_t prefix_sum(uint64_t index) const {
+        return prefix_sums_[index & (prefix_sums_.size() - 1)];
+    }
+    int64_t time_error(uint64_t index) const {
+        return static_cast<int64_t>(prefix_sum(index + 1) - prefix_sum(index));
+    }
+
+public:
+    /**
+     * @brief Constructor
+     * @param octaves Number of observation intervals, tau0 to 2^(octaves-1) * tau0,
+     *                at most MAX_OCTAVES
+     */
+    explicit TimeStabilityAnalyzer(uint32_t octaves = DEFAULT_OCTAVES);
+
+    /**
+     * @brief Forget all samples
+     */
+    void reset();
+
+    /**
+     * @brief Add the next time error of the sequence
+     * @param timestamp_ns Time the sample was taken; must not decrease
+     * @param time_error_ns Time error; differences over three times the
+     *                      longest tau must fit in 64 bits
+     */
+    void add_sample(uint64_t timestamp_ns, int64_t time_error_ns);
+
+    /**
+     * @brief Get number of samples added since the last reset
+     */
+    uint64_t get_sample_count() const { return sample_count_; }
+
+    /**
+     * @brief Get mean sample spacing in seconds
+     * @param nominal_interval_s Spacing to assume until two samples are known
+     */
+    double get_sample_interval_s(double nominal_interval_s) const;
+
+    /**
+     * @brief Get stability at every octave observed three times, shortest tau first
+     * @param nominal_interval_s Sample spacing to assume until two samples are known
+     */
+    std::vector<TimeStabilityPoint> get_results(double nominal_interval_s) const;
+};
+
+} // namespace gPTP
+} // namespace OpenAvnu
+
+#endif // GPTP_TIME_STABILITY_HPP
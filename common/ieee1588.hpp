@@ -50,7 +50,7 @@
 #include <gptp_log.hpp>
 #include <limits.h>
 
-#define MAX_PORTS 32	/*!< Maximum number of EtherPort instances */
+#define MAX_PORTS 64	/*!< Maximum number of EtherPort instances */
 
 
 /**
@@ -226,6 +226,176 @@ class ClockIdentity {
 	}
 };
 
+/**
+ * @brief Provides the clock quality abstraction.
+ * Represents the quality of the clock
+ * Defined at IEEE 802.1AS-2011
+ * Clause 6.3.3.8
+ */
+struct ClockQuality {
+	unsigned char cq_class;				/*!< Clock Class - Clause 8.6.2.2
+										  Denotes the tracebility of the synchronized time
+										  distributed by a clock master when it is grandmaster. */
+	unsigned char clockAccuracy; 		/*!< Clock Accuracy - clause 8.6.2.3.
+										  Indicates the expected time accuracy of
+										  a clock master.*/
+	uint16_t offsetScaledLogVariance;	/*!< ::Offset Scaled log variance - Clause 8.6.2.4.
+										  Is the scaled, offset representation
+										  of an estimate of the PTP variance. The
+										  PTP variance characterizes the
+										  precision and frequency stability of the clock
+										  master. The PTP variance is the square of
+										  PTPDEV (See B.1.3.2). */
+};
+
+/**
+ * @brief PortIdentity interface
+ * Defined at IEEE 802.1AS Clause 8.5.2
+ */
+class PortIdentity {
+private:
+	ClockIdentity clock_id;
+	uint16_t portNumber;
+public:
+	/**
+	 * @brief Default Constructor
+	 */
+	PortIdentity() { };
+
+	/**
+	 * @brief  Constructs PortIdentity interface.
+	 * @param  clock_id Clock ID value as defined at IEEE 802.1AS Clause
+	 * 8.5.2.2
+	 * @param  portNumber Port Number
+	 */
+	PortIdentity(uint8_t * clock_id, uint16_t * portNumber)
+	{
+		this->portNumber = *portNumber;
+		this->portNumber = PLAT_ntohs(this->portNumber);
+		this->clock_id.set(clock_id);
+	}
+
+	/**
+	 * @brief  Implements the operator '!=' overloading method. Compares
+	 * clock_id and portNumber.
+	 * @param  cmp Constant PortIdentity value to be compared against.
+	 * @return TRUE if the comparison value differs from the object's
+	 * PortIdentity value. FALSE otherwise.
+	 */
+	bool operator!=(const PortIdentity & cmp) const
+	{
+		return
+			!(this->clock_id == cmp.clock_id) ||
+			this->portNumber != cmp.portNumber ? true : false;
+	}
+
+	/**
+	 * @brief  Implements the operator '==' overloading method. Compares
+	 * clock_id and portNumber.
+	 * @param  cmp Constant PortIdentity value to be compared against.
+	 * @return TRUE if the comparison value equals to the object's
+	 * PortIdentity value. FALSE otherwise.
+	 */
+	bool operator==(const PortIdentity & cmp)const
+	{
+		return
+			this->clock_id == cmp.clock_id &&
+			this->portNumber == cmp.portNumber ? true : false;
+	}
+
+	/**
+	 * @brief  Implements the operator '<' overloading method. Compares
+	 * clock_id and portNumber.
+	 * @param  cmp Constant PortIdentity value to be compared against.
+	 * @return TRUE if the comparison value is lower than the object's
+	 * PortIdentity value. FALSE otherwise.
+	 */
+	bool operator<(const PortIdentity & cmp)const
+	{
+		return
+			this->clock_id < cmp.clock_id ?
+			true : this->clock_id == cmp.clock_id &&
+			this->portNumber < cmp.portNumber ? true : false;
+	}
+
+	/**
+	 * @brief  Implements the operator '>' overloading method. Compares
+	 * clock_id and portNumber.
+	 * @param  cmp Constant PortIdentity value to be compared against.
+	 * @return TRUE if the comparison value is greater than the object's
+	 * PortIdentity value. FALSE otherwise.
+	 */
+	bool operator>(const PortIdentity & cmp)const
+	{
+		return
+			this->clock_id > cmp.clock_id ?
+			true : this->clock_id == cmp.clock_id &&
+			this->portNumber > cmp.portNumber ? true : false;
+	}
+
+	/**
+	 * @brief  Gets the ClockIdentity string
+	 * @param  id [out] Pointer to an array of octets.
+	 * @return void
+	 */
+	void getClockIdentityString(uint8_t *id)
+	{
+		clock_id.getIdentityString(id);
+	}
+
+	/**
+	 * @brief  Sets the ClockIdentity.
+	 * @param  clock_id Clock Identity to be set.
+	 * @return void
+	 */
+	void setClockIdentity(ClockIdentity clock_id)
+	{
+		this->clock_id = clock_id;
+	}
+
+	/**
+	 * @brief  Gets the clockIdentity value
+	 * @return A copy of Clock identity value.
+	 */
+	ClockIdentity getClockIdentity( void ) {
+		return this->clock_id;
+	}
+
+	/**
+	 * @brief  Gets the port number following the network byte order, i.e.
+	 * Big-Endian.
+	 * @param  id [out] Port number
+	 * @return void
+	 */
+	void getPortNumberNO(uint16_t * id)	// Network byte order
+	{
+		uint16_t portNumberNO = PLAT_htons(portNumber);
+		*id = portNumberNO;
+	}
+
+	/**
+	 * @brief  Gets the port number in the host byte order, which can be
+	 * either Big-Endian
+	 * or Little-Endian, depending on the processor where it is running.
+	 * @param  id Port number
+	 * @return void
+	 */
+	void getPortNumber(uint16_t * id)	// Host byte order
+	{
+		*id = portNumber;
+	}
+
+	/**
+	 * @brief  Sets the Port number
+	 * @param  id [in] Port number
+	 * @return void
+	 */
+	void setPortNumber(uint16_t * id)
+	{
+		portNumber = *id;
+	}
+};
+
 #define INVALID_TIMESTAMP_VERSION 0xFF		/*!< Value defining invalid timestamp version*/
 #define MAX_NANOSECONDS 1000000000			/*!< Maximum value of nanoseconds (1 second)*/
 #define MAX_TSTAMP_STRLEN 25				/*!< Maximum size of timestamp strlen*/
@@ -96,7 +96,7 @@ void ClockIdentity::set(LinkLayerAddress * addr)
 IEEE1588Clock::IEEE1588Clock
 ( bool forceOrdinarySlave, bool syntonize, uint8_t priority1,
   OSTimerQueueFactory *timerq_factory, OS_IPC *ipc,
-  OSLockFactory *lock_factory )
+  OSLockFactory *lock_factory, const ClockServoConfig &servo )
 {
 	this->priority1 = priority1;
 	priority2 = 248;
@@ -117,7 +117,7 @@ IEEE1588Clock::IEEE1588Clock
 
 	_syntonize = syntonize;
 	_new_syntonization_set_point = false;
-	_ppm = 0;
+	_servo = ClockServo::create( servo );
 
 	_phase_error_violation = 0;
 
@@ -125,6 +125,7 @@ IEEE1588Clock::IEEE1588Clock
 	_local_system_freq_offset_init = false;
 
 	this->ipc = ipc;
+	capture = NULL;
 
  	memset( &LastEBestIdentity, 0xFF, sizeof( LastEBestIdentity ));
 
@@ -251,14 +252,13 @@ void timerq_handler(void *arg)
 void IEEE1588Clock::addEventTimer
 ( CommonPort *target, Event e, unsigned long long time_ns )
 {
-	event_descriptor_t *event_descriptor = new event_descriptor_t();
-	event_descriptor->event = e;
-	event_descriptor->port = target;
-	timerq->addEvent
-		((unsigned)(time_ns / 1000), (int)e, timerq_handler, event_descriptor,
-		 true, NULL);
+	timerq->addPortEvent
+		((unsigned)(time_ns / 1000), target, (int)e, timerq_handler, NULL);
 }
 
+#undef GPTP_LOG_SUBSYSTEM
+#define GPTP_LOG_SUBSYSTEM GPTP_LOG_SUBSYS_TIMER
+
 void IEEE1588Clock::addEventTimerLocked
 ( CommonPort *target, Event e, unsigned long long time_ns )
 {
@@ -332,7 +332,7 @@ void IEEE1588Clock::addEventTimerLocked
 void IEEE1588Clock::deleteEventTimer
 ( CommonPort *target, Event event )
 {
-	timerq->cancelEvent((int)event, NULL);
+	timerq->cancelPortEvent(target, (int)event);
 }
 
 void IEEE1588Clock::deleteEventTimerLocked
@@ -361,7 +361,7 @@ void IEEE1588Clock::deleteEventTimerLocked
     GPTP_LOG_DEBUG("*** deleteEventTimerLocked: Timer queue lock acquired successfully (result=%d) ***", (int)lock_result);
 
     try {
-        GPTP_LOG_DEBUG("*** deleteEventTimerLocked: About to call timerq->cancelEvent ***");
+        GPTP_LOG_DEBUG("*** deleteEventTimerLocked: About to call timerq->cancelPortEvent ***");
         
         // Extra defensive check - verify timerq pointer is still valid
         if (!timerq) {
@@ -373,11 +373,11 @@ void IEEE1588Clock::deleteEventTimerLocked
             return;
         }
         
-        GPTP_LOG_DEBUG("*** deleteEventTimerLocked: timerq=%p, event=%d, calling cancelEvent ***", timerq, (int)event);
-        timerq->cancelEvent((int)event, NULL);
-        GPTP_LOG_DEBUG("*** deleteEventTimerLocked: timerq->cancelEvent completed successfully ***");
+        GPTP_LOG_DEBUG("*** deleteEventTimerLocked: timerq=%p, event=%d, calling cancelPortEvent ***", timerq, (int)event);
+        timerq->cancelPortEvent(target, (int)event);
+        GPTP_LOG_DEBUG("*** deleteEventTimerLocked: timerq->cancelPortEvent completed successfully ***");
     } catch (const std::exception& ex) {
-        GPTP_LOG_ERROR("*** FATAL: Exception in timerq->cancelEvent: %s ***", ex.what());
+        GPTP_LOG_ERROR("*** FATAL: Exception in timerq->cancelPortEvent: %s ***", ex.what());
         // Always release the lock on exception
         OSLockResult unlock_result = putTimerQLock();
         if (unlock_result == oslock_fail) {
@@ -385,7 +385,7 @@ void IEEE1588Clock::deleteEventTimerLocked
         }
         return;
     } catch (...) {
-        GPTP_LOG_ERROR("*** FATAL: Unknown exception in timerq->cancelEvent ***");
+        GPTP_LOG_ERROR("*** FATAL: Unknown exception in timerq->cancelPortEvent ***");
         // Always release the lock on exception
         OSLockResult unlock_result = putTimerQLock();
         if (unlock_result == oslock_fail) {
@@ -405,6 +405,9 @@ void IEEE1588Clock::deleteEventTimerLocked
 
 
 
+#undef GPTP_LOG_SUBSYSTEM
+#define GPTP_LOG_SUBSYSTEM GPTP_LOG_SUBSYS_SERVO
+
 FrequencyRatio IEEE1588Clock::calcLocalSystemClockRateDifference( Timestamp local_time, Timestamp system_time ) {
 	unsigned long long inter_system_time;
 	unsigned long long inter_local_time;
@@ -491,6 +494,10 @@ void IEEE1588Clock::setMasterOffset
   FrequencyRatio local_system_freq_offset, unsigned sync_count,
   unsigned pdelay_count, PortState port_state, bool asCapable )
 {
+	int64_t captured_offset = master_local_offset;
+	uint8_t capture_flags = asCapable ? GPTP_CAPTURE_FLAG_AS_CAPABLE : 0;
+	float ppm = 0;
+
 	_master_local_freq_offset = master_local_freq_offset;
 	_local_system_freq_offset = local_system_freq_offset;
 
@@ -510,13 +517,15 @@ void IEEE1588Clock::setMasterOffset
 		port->getPortIdentity(port_identity);
 		port_identity.getPortNumber(&port_number);
 
+		ipc->beginUpdate();
+
 		ipc->update(
 			master_local_offset, local_system_offset, master_local_freq_offset,
 			local_system_freq_offset, TIMESTAMP_TO_NS(local_time),
-			sync_count, pdelay_count, port_state, asCapable);
+			sync_count, pdelay_count, port_state, asCapable, port_number);
 
 		ipc->update_grandmaster(
-			grandmaster_id, domain_number);
+			grandmaster_id, domain_number, port_number);
 
 		ipc->update_network_interface(
 			clock_id, priority1,
@@ -527,13 +536,13 @@ void IEEE1588Clock::setMasterOffset
 			port->getAnnounceInterval(),
 			0, // TODO:  Was port->getPDelayInterval() before refactoring.  What do we do now?
 			port_number);
-	}
 
-	if( master_local_offset == 0 && master_local_freq_offset == 1.0 ) {
-		return;
+		ipc->endUpdate();
 	}
 
-	if( _syntonize ) {
+	// Nothing to correct yet, but the Sync is still captured below
+	if( _syntonize &&
+	    ( master_local_offset != 0 || master_local_freq_offset != 1.0 )) {
 		if( _new_syntonization_set_point || _phase_error_violation > PHASE_ERROR_MAX_COUNT ) {
 			_new_syntonization_set_point = false;
 			_phase_error_violation = 0;
@@ -544,38 +553,64 @@ void IEEE1588Clock::setMasterOffset
 				GPTP_LOG_STATUS("Adjust clock phase offset:%lld", -master_local_offset);
 			}
 			port->adjustClockPhase( -master_local_offset );
+			if( ipc != NULL ) {
+				PortIdentity port_identity;
+				uint16_t port_number;
+
+				port->getPortIdentity(port_identity);
+				port_identity.getPortNumber(&port_number);
+				ipc->update_phase_step( port_number, -master_local_offset );
+			}
 			_master_local_freq_offset_init = false;
+			_servo->reset();
 			restartPDelayAll();
 			putTxLockAll();
 			master_local_offset = 0;
+			capture_flags |= GPTP_CAPTURE_FLAG_PHASE_STEP;
 		}
 
 		// Adjust for frequency offset
 		long double phase_error = (long double) -master_local_offset;
+		ppm = _servo->getPpm();
+		capture_flags |= GPTP_CAPTURE_FLAG_SYNTONIZED;
 		if( fabsl(phase_error) > PHASE_ERROR_THRESHOLD ) {
 			++_phase_error_violation;
 		} else {
 			_phase_error_violation = 0;
 
-			float syncPerSec = (float)(1.0 / pow((float)2, port->getSyncInterval()));
-			_ppm += (float) ((INTEGRAL * syncPerSec * phase_error) + PROPORTIONAL*((master_local_freq_offset-1.0)*1000000));
+			ppm = _servo->sample
+				( (double) phase_error,
+				  (double) (( master_local_freq_offset - 1.0 ) * 1000000 ),
+				  pow( 2.0, port->getSyncInterval() ));
 
-			GPTP_LOG_DEBUG("phase_error = %Lf, ppm = %f", phase_error, _ppm );
+			GPTP_LOG_DEBUG("phase_error = %Lf, ppm = %f", phase_error, ppm );
 		}
 
-		if( _ppm < LOWER_FREQ_LIMIT ) _ppm = LOWER_FREQ_LIMIT;
-		if( _ppm > UPPER_FREQ_LIMIT ) _ppm = UPPER_FREQ_LIMIT;
 		if ( port->getTestMode() ) {
-			GPTP_LOG_STATUS("Adjust clock rate ppm:%f", _ppm);
+			GPTP_LOG_STATUS("Adjust clock rate ppm:%f", ppm);
 		}
-		if( !port->adjustClockRate( _ppm ) ) {
+		if( !port->adjustClockRate( ppm ) ) {
 			GPTP_LOG_ERROR( "Failed to adjust clock rate" );
 		}
 	}
 
+	if( capture != NULL ) {
+		PortIdentity port_identity;
+		uint16_t port_number;
+
+		port->getPortIdentity(port_identity);
+		port_identity.getPortNumber(&port_number);
+		capture->recordOffset
+			( port_number, TIMESTAMP_TO_NS(local_time), captured_offset,
+			  master_local_freq_offset, ppm, port_state, capture_flags );
+	}
+
 	return;
 }
 
+#undef GPTP_LOG_SUBSYSTEM
+#define GPTP_LOG_SUBSYSTEM GPTP_LOG_SUBSYS_GENERAL
+
 /* Get current time from system clock */
 Timestamp IEEE1588Clock::getTime(void)
 {
@@ -588,6 +623,9 @@ Timestamp IEEE1588Clock::getPreciseTime(void)
 	return getSystemTime();
 }
 
+#undef GPTP_LOG_SUBSYSTEM
+#define GPTP_LOG_SUBSYSTEM GPTP_LOG_SUBSYS_BMCA
+
 bool IEEE1588Clock::isBetterThan(PTPMessageAnnounce * msg)
 {
 	unsigned char this1[14];
@@ -631,6 +669,9 @@ bool IEEE1588Clock::isBetterThan(PTPMessageAnnounce * msg)
 	return (memcmp(this1, that1, 14) < 0) ? true : false;
 }
 
+#undef GPTP_LOG_SUBSYSTEM
+#define GPTP_LOG_SUBSYSTEM GPTP_LOG_SUBSYS_GENERAL
+
 /**
  * @brief Set clock quality based on profile configuration
  * @param milan_profile Enable Milan Baseline profile clock quality
@@ -694,5 +735,5 @@ bool IEEE1588Clock::validateClockQuality()
 
 IEEE1588Clock::~IEEE1588Clock(void)
 {
-	// Do nothing
+	delete _servo;
 }
@@ -367,7 +367,8 @@ bool MilanProfile::handleGrandmasterChange(const ClockIdentity& new_gm, const Cl
     // Store the grandmaster change information
     m_stats.previous_grandmaster = old_gm;
     m_stats.current_grandmaster = new_gm;
-    m_stats.last_gm_change_time = TIMESTAMP_TO_NS(IEEE1588Clock::getSystemTime());
+    Timestamp system_time = IEEE1588Clock::getSystemTime();
+    m_stats.last_gm_change_time = TIMESTAMP_TO_NS(system_time);
     
     // B.1.1: Set tu (timestamp uncertain) bit for 0.25 seconds
     m_stats.tu_bit_active = true;
@@ -408,7 +409,8 @@ bool MilanProfile::shouldSetTimestampUncertain() const {
         return false;
     }
     
-    uint64_t current_time = TIMESTAMP_TO_NS(IEEE1588Clock::getSystemTime());
+    Timestamp system_time = IEEE1588Clock::getSystemTime();
+    uint64_t current_time = TIMESTAMP_TO_NS(system_time);
     uint64_t elapsed_time_ms = (current_time - m_stats.tu_bit_start_time) / 1000000ULL;
     
     return elapsed_time_ms < m_config.tu_bit_duration_ms;
@@ -440,7 +442,8 @@ uint64_t MilanProfile::getStreamStabilityTime() const {
 
 void MilanProfile::notifyStreamStart() {
     // Called when a stream starts or becomes stable
-    uint64_t current_time = TIMESTAMP_TO_NS(IEEE1588Clock::getSystemTime());
+    Timestamp system_time = IEEE1588Clock::getSystemTime();
+    uint64_t current_time = TIMESTAMP_TO_NS(system_time);
     
     if (m_stats.current_stream_stability_time == 0) {
         // First time stream is starting
@@ -467,7 +470,8 @@ bool MilanProfile::isWithinGrandmasterConvergenceTime() const {
         return true; // No GM change yet
     }
     
-    uint64_t current_time = TIMESTAMP_TO_NS(IEEE1588Clock::getSystemTime());
+    Timestamp system_time = IEEE1588Clock::getSystemTime();
+    uint64_t current_time = TIMESTAMP_TO_NS(system_time);
     uint64_t elapsed_time_ms = (current_time - m_stats.last_gm_change_time) / 1000000ULL;
     
     bool within_time = elapsed_time_ms < m_config.gm_change_convergence_time_ms;
@@ -0,0 +1,469 @@
+/******************************************************************************
+
+  Copyright (c) 2009-2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#ifndef PTP_FRAME_VIEW_HPP
+#define PTP_FRAME_VIEW_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <ieee1588.hpp>
+#include <avbts_message.hpp>
+
+/**@file*/
+
+#define PTP_TLV_HEADER_LENGTH 4		/*!< TLV type and length fields in bytes */
+#define PTP_PORT_IDENTITY_LENGTH 10	/*!< Clock identity and port number in bytes */
+#define PTP_TIMESTAMP_LENGTH 10		/*!< Seconds and nanoseconds fields in bytes */
+#define PTP_BROADCOM_PDELAY_REQ_SIZE 46	/*!< Short Pdelay_Req sent by some Broadcom parts */
+
+/**
+ * @brief Reads and writes big-endian frame fields. The compiler folds
+ * each of these into a single load or store and byte swap.
+ */
+class PtpWire {
+public:
+	static uint16_t load16( const uint8_t *p ) {
+		return (uint16_t)(( p[0] << 8 ) | p[1] );
+	}
+	static uint32_t load32( const uint8_t *p ) {
+		return
+			((uint32_t) p[0] << 24 ) | ((uint32_t) p[1] << 16 ) |
+			((uint32_t) p[2] << 8 ) | (uint32_t) p[3];
+	}
+	static uint64_t load64( const uint8_t *p ) {
+		return ((uint64_t) load32( p ) << 32 ) | load32( p + 4 );
+	}
+
+	static void store16( uint8_t *p, uint16_t v ) {
+		p[0] = (uint8_t)( v >> 8 );
+		p[1] = (uint8_t) v;
+	}
+	static void store32( uint8_t *p, uint32_t v ) {
+		p[0] = (uint8_t)( v >> 24 );
+		p[1] = (uint8_t)( v >> 16 );
+		p[2] = (uint8_t)( v >> 8 );
+		p[3] = (uint8_t) v;
+	}
+	static void store64( uint8_t *p, uint64_t v ) {
+		store32( p, (uint32_t)( v >> 32 ));
+		store32( p + 4, (uint32_t) v );
+	}
+
+	/**
+	 * @brief  Encodes a PTP Timestamp field
+	 * @param  p [out] First byte of the field
+	 * @param  ts Timestamp
+	 * @return void
+	 */
+	static void storeTimestamp( uint8_t *p, const Timestamp &ts ) {
+		store16( p, ts.seconds_ms );
+		store32( p + 2, ts.seconds_ls );
+		store32( p + 6, ts.nanoseconds );
+	}
+
+	/**
+	 * @brief  Decodes a PTP Timestamp field (48 bit seconds, 32 bit
+	 * nanoseconds)
+	 * @param  p [in] First byte of the field
+	 * @return Timestamp
+	 */
+	static Timestamp loadTimestamp( const uint8_t *p ) {
+		return Timestamp( load32( p + 6 ), load32( p + 2 ), load16( p ));
+	}
+
+	/**
+	 * @brief  Decodes a PortIdentity field
+	 * @param  p [in] First byte of the field
+	 * @return PortIdentity
+	 */
+	static PortIdentity loadPortIdentity( const uint8_t *p ) {
+		PortIdentity identity;
+		ClockIdentity clock_id;
+		uint16_t port_number = load16( p + PTP_CLOCK_IDENTITY_LENGTH );
+
+		clock_id.set( (uint8_t *) p );
+		identity.setClockIdentity( clock_id );
+		identity.setPortNumber( &port_number );
+		return identity;
+	}
+};
+
+/**
+ * @brief One TLV inside a received frame
+ */
+struct PtpTlv {
+	uint16_t type;		/*!< tlvType, host byte order */
+	uint16_t length;	/*!< lengthField, host byte order */
+	const uint8_t *value;	/*!< First byte after the length field */
+};
+
+/**
+ * @brief Walks the TLVs that follow a message body. Stops at the first
+ * TLV whose length runs past the end of the frame.
+ */
+class PtpTlvIterator {
+private:
+	const uint8_t *pos;
+	const uint8_t *end;
+public:
+	/**
+	 * @brief  Creates an iterator over a byte range
+	 * @param  begin [in] First TLV
+	 * @param  size Bytes left in the frame from begin
+	 */
+	PtpTlvIterator( const uint8_t *begin, size_t size ) {
+		pos = begin;
+		end = begin + size;
+	}
+
+	/**
+	 * @brief  Advances to the next TLV
+	 * @param  tlv [out] Next TLV
+	 * @return TRUE if a complete TLV was found, FALSE at the end of the
+	 * frame or on a truncated TLV
+	 */
+	bool next( PtpTlv *tlv ) {
+		if( end - pos < PTP_TLV_HEADER_LENGTH )
+			return false;
+		tlv->type = PtpWire::load16( pos );
+		tlv->length = PtpWire::load16( pos + 2 );
+		if( end - pos - PTP_TLV_HEADER_LENGTH < tlv->length )
+			return false;
+		tlv->value = pos + PTP_TLV_HEADER_LENGTH;
+		pos += PTP_TLV_HEADER_LENGTH + tlv->length;
+		return true;
+	}
+};
+
+/**
+ * @brief Read-only view of a received PTP frame
+ *
+ * Nothing is copied or allocated: every accessor decodes its field
+ * straight from the receive buffer. Construction checks that the common
+ * header fits, and hasBody() checks the fixed part of the message body,
+ * so the accessors themselves never read out of bounds once those
+ * checks pass. This lets the receive path reject a frame (wrong domain,
+ * wrong version, port not asCapable) before any message object is built.
+ */
+class PtpFrameView {
+protected:
+	const uint8_t *buf;
+	size_t size;
+public:
+	/**
+	 * @brief  Creates a view over a received frame
+	 * @param  frame [in] First byte of the PTP common header
+	 * @param  length Number of valid bytes at frame
+	 */
+	PtpFrameView( const void *frame, size_t length ) {
+		buf = (const uint8_t *) frame;
+		size = length;
+	}
+
+	/**
+	 * @brief  Checks that the common header fits in the frame
+	 * @return TRUE if the header accessors may be used
+	 */
+	bool valid() const {
+		return buf != NULL && size >= PTP_COMMON_HDR_LENGTH;
+	}
+
+	/**
+	 * @brief  Gets the length of the fixed body of a message type
+	 * @param  type Message type
+	 * @return Body length in bytes, 0 for types the daemon does not parse
+	 */
+	static size_t bodyLength( MessageType type ) {
+		switch( type ) {
+		case SYNC_MESSAGE:
+			return PTP_SYNC_LENGTH;
+		case FOLLOWUP_MESSAGE:
+			return PTP_FOLLOWUP_LENGTH;
+		case PATH_DELAY_REQ_MESSAGE:
+			return PTP_PDELAY_REQ_LENGTH;
+		case PATH_DELAY_RESP_MESSAGE:
+			return PTP_PDELAY_RESP_LENGTH;
+		case PATH_DELAY_FOLLOWUP_MESSAGE:
+			return PTP_PDELAY_FOLLOWUP_LENGTH;
+		case ANNOUNCE_MESSAGE:
+			return PTP_ANNOUNCE_LENGTH;
+		case SIGNALLING_MESSAGE:
+			return PTP_SIGNALLING_LENGTH;
+		default:
+			return 0;
+		}
+	}
+
+	/**
+	 * @brief  Checks that the fixed body of the message type fits in
+	 * the frame. A short Pdelay_Req from Broadcom parts is accepted, as
+	 * buildPTPMessage() does.
+	 * @return TRUE if the body accessors of the type's view may be used
+	 */
+	bool hasBody() const {
+		if( !valid() )
+			return false;
+		if( getMessageType() == PATH_DELAY_REQ_MESSAGE &&
+		    size == PTP_BROADCOM_PDELAY_REQ_SIZE )
+			return true;
+		return size >= PTP_COMMON_HDR_LENGTH +
+			bodyLength( getMessageType() );
+	}
+
+	/**
+	 * @brief  Gets the frame length
+	 * @return Number of valid bytes in the frame
+	 */
+	size_t getSize() const {
+		return size;
+	}
+
+	/**
+	 * @brief  Gets the raw frame
+	 * @return First byte of the common header
+	 */
+	const uint8_t *getBuffer() const {
+		return buf;
+	}
+
+	MessageType getMessageType() const {
+		return (MessageType)
+			( buf[PTP_COMMON_HDR_TRANSSPEC_MSGTYPE
+			      (PTP_COMMON_HDR_OFFSET)] & 0xF );
+	}
+	uint8_t getTransportSpecific() const {
+		return buf[PTP_COMMON_HDR_TRANSSPEC_MSGTYPE
+			   (PTP_COMMON_HDR_OFFSET)] >> 4;
+	}
+	/**
+	 * @brief  Checks whether the frame carries an event message
+	 * @return TRUE for event messages, which are timestamped
+	 */
+	bool isEvent() const {
+		return (( getMessageType() >> 3 ) & 0x1 ) == 0;
+	}
+	uint8_t getVersionPTP() const {
+		return buf[PTP_COMMON_HDR_PTP_VERSION(PTP_COMMON_HDR_OFFSET)] &
+			0xF;
+	}
+	uint16_t getMessageLength() const {
+		return PtpWire::load16
+			( buf + PTP_COMMON_HDR_MSG_LENGTH(PTP_COMMON_HDR_OFFSET));
+	}
+	uint8_t getDomainNumber() const {
+		return buf[PTP_COMMON_HDR_DOMAIN_NUMBER(PTP_COMMON_HDR_OFFSET)];
+	}
+	/**
+	 * @brief  Tests one bit of the flags field
+	 * @param  byte Flags byte, e.g. ::PTP_ASSIST_BYTE
+	 * @param  bit Bit within the byte, e.g. ::PTP_ASSIST_BIT
+	 * @return TRUE if the bit is set
+	 */
+	bool getFlag( unsigned byte, unsigned bit ) const {
+		return ( buf[PTP_COMMON_HDR_FLAGS(PTP_COMMON_HDR_OFFSET) + byte] >>
+			 bit ) & 0x1;
+	}
+	int64_t getCorrectionField() const {
+		return (int64_t) PtpWire::load64
+			( buf + PTP_COMMON_HDR_CORRECTION(PTP_COMMON_HDR_OFFSET));
+	}
+	/**
+	 * @brief  Gets the source clock identity without copying it
+	 * @return Pointer to ::PTP_CLOCK_IDENTITY_LENGTH bytes
+	 */
+	const uint8_t *getSourceClockIdentity() const {
+		return buf + PTP_COMMON_HDR_SOURCE_CLOCK_ID(PTP_COMMON_HDR_OFFSET);
+	}
+	uint16_t getSourcePortNumber() const {
+		return PtpWire::load16
+			( buf + PTP_COMMON_HDR_SOURCE_PORT_ID(PTP_COMMON_HDR_OFFSET));
+	}
+	PortIdentity getSourcePortIdentity() const {
+		return PtpWire::loadPortIdentity( getSourceClockIdentity() );
+	}
+	uint16_t getSequenceId() const {
+		return PtpWire::load16
+			( buf + PTP_COMMON_HDR_SEQUENCE_ID(PTP_COMMON_HDR_OFFSET));
+	}
+	uint8_t getControl() const {
+		return buf[PTP_COMMON_HDR_CONTROL(PTP_COMMON_HDR_OFFSET)];
+	}
+	int8_t getLogMessageInterval() const {
+		return (int8_t)
+			buf[PTP_COMMON_HDR_LOG_MSG_INTRVL(PTP_COMMON_HDR_OFFSET)];
+	}
+	PTPMessageId getMessageId() const {
+		return PTPMessageId( getMessageType(), getSequenceId() );
+	}
+
+	/**
+	 * @brief  Gets the TLVs that follow the fixed message body
+	 * @return Iterator, empty if the body does not fit
+	 */
+	PtpTlvIterator getTlvs() const {
+		size_t offset = PTP_COMMON_HDR_LENGTH +
+			bodyLength( getMessageType() );
+		if( !valid() || size < offset )
+			return PtpTlvIterator( buf, 0 );
+		return PtpTlvIterator( buf + offset, size - offset );
+	}
+};
+
+/**
+ * @brief View of a Sync or Follow_Up frame. Both carry one timestamp at
+ * the same offset.
+ */
+class PtpSyncView : public PtpFrameView {
+public:
+	PtpSyncView( const PtpFrameView &frame ) : PtpFrameView( frame ) { }
+
+	/**
+	 * @brief  Gets originTimestamp (Sync) or preciseOriginTimestamp
+	 * (Follow_Up)
+	 * @return Timestamp
+	 */
+	Timestamp getOriginTimestamp() const {
+		return PtpWire::loadTimestamp
+			( buf + PTP_SYNC_SEC_MS(PTP_SYNC_OFFSET));
+	}
+};
+
+/**
+ * @brief View of a Pdelay_Resp or Pdelay_Resp_Follow_Up frame. Both
+ * carry a timestamp and the requesting PortIdentity at the same offsets.
+ */
+class PtpPdelayRespView : public PtpFrameView {
+public:
+	PtpPdelayRespView( const PtpFrameView &frame ) :
+		PtpFrameView( frame ) { }
+
+	/**
+	 * @brief  Gets requestReceiptTimestamp (Pdelay_Resp) or
+	 * responseOriginTimestamp (Pdelay_Resp_Follow_Up)
+	 * @return Timestamp
+	 */
+	Timestamp getTimestamp() const {
+		return PtpWire::loadTimestamp
+			( buf + PTP_PDELAY_RESP_SEC_MS(PTP_PDELAY_RESP_OFFSET));
+	}
+	PortIdentity getRequestingPortIdentity() const {
+		return PtpWire::loadPortIdentity
+			( buf + PTP_PDELAY_RESP_REQ_CLOCK_ID
+			  (PTP_PDELAY_RESP_OFFSET));
+	}
+};
+
+/**
+ * @brief View of an Announce frame
+ */
+class PtpAnnounceView : public PtpFrameView {
+public:
+	PtpAnnounceView( const PtpFrameView &frame ) :
+		PtpFrameView( frame ) { }
+
+	uint16_t getCurrentUtcOffset() const {
+		return PtpWire::load16
+			( buf + PTP_ANNOUNCE_CURRENT_UTC_OFFSET
+			  (PTP_ANNOUNCE_OFFSET));
+	}
+	uint8_t getGrandmasterPriority1() const {
+		return buf[PTP_ANNOUNCE_GRANDMASTER_PRIORITY1
+			   (PTP_ANNOUNCE_OFFSET)];
+	}
+	ClockQuality getGrandmasterClockQuality() const {
+		const uint8_t *p = buf + PTP_ANNOUNCE_GRANDMASTER_CLOCK_QUALITY
+			(PTP_ANNOUNCE_OFFSET);
+		ClockQuality quality;
+
+		quality.cq_class = p[0];
+		quality.clockAccuracy = p[1];
+		quality.offsetScaledLogVariance = PtpWire::load16( p + 2 );
+		return quality;
+	}
+	uint8_t getGrandmasterPriority2() const {
+		return buf[PTP_ANNOUNCE_GRANDMASTER_PRIORITY2
+			   (PTP_ANNOUNCE_OFFSET)];
+	}
+	/**
+	 * @brief  Gets the grandmaster identity without copying it
+	 * @return Pointer to ::PTP_CLOCK_IDENTITY_LENGTH bytes
+	 */
+	const uint8_t *getGrandmasterIdentity() const {
+		return buf + PTP_ANNOUNCE_GRANDMASTER_IDENTITY
+			(PTP_ANNOUNCE_OFFSET);
+	}
+	uint16_t getStepsRemoved() const {
+		return PtpWire::load16
+			( buf + PTP_ANNOUNCE_STEPS_REMOVED(PTP_ANNOUNCE_OFFSET));
+	}
+	uint8_t getTimeSource() const {
+		return buf[PTP_ANNOUNCE_TIME_SOURCE(PTP_ANNOUNCE_OFFSET)];
+	}
+
+	/**
+	 * @brief  Finds the path trace TLV
+	 * @param  count [out] Number of clock identities in the path
+	 * @return Pointer to the first clock identity, NULL if the frame has
+	 * no path trace TLV
+	 */
+	const uint8_t *getPathTrace( unsigned *count ) const {
+		PtpTlvIterator iter = getTlvs();
+		PtpTlv tlv;
+
+		while( iter.next( &tlv )) {
+			if( tlv.type == PATH_TRACE_TLV_TYPE ) {
+				*count = tlv.length / PTP_CLOCK_IDENTITY_LENGTH;
+				return tlv.value;
+			}
+		}
+		*count = 0;
+		return NULL;
+	}
+};
+
+/**
+ * @brief View of a Signalling frame
+ */
+class PtpSignallingView : public PtpFrameView {
+public:
+	PtpSignallingView( const PtpFrameView &frame ) :
+		PtpFrameView( frame ) { }
+
+	PortIdentity getTargetPortIdentity() const {
+		return PtpWire::loadPortIdentity
+			( buf + PTP_SIGNALLING_TARGET_PORT_IDENTITY
+			  (PTP_SIGNALLING_OFFSET));
+	}
+};
+
+#endif/*PTP_FRAME_VIEW_HPP*/
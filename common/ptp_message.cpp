@@ -37,11 +37,50 @@
 #include <ether_port.hpp>
 #include <avbts_ostimer.hpp>
 #include <ether_tstamper.hpp>
+#include <ptp_frame_view.hpp>
 
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
 
+#undef GPTP_LOG_SUBSYSTEM
+#define GPTP_LOG_SUBSYSTEM GPTP_LOG_SUBSYS_NET
+
+#define MAX_SIZEOF(a, b) ((a) > (b) ? (a) : (b))
+
+/* Every message class fits in one pool block */
+#define PTP_MESSAGE_BLOCK_SIZE						\
+	MAX_SIZEOF( MAX_SIZEOF( MAX_SIZEOF( sizeof( PTPMessageAnnounce ),	\
+					    sizeof( PTPMessageSync )),		\
+				MAX_SIZEOF( sizeof( PTPMessageFollowUp ),	\
+					    sizeof( PTPMessagePathDelayReq ))), \
+		    MAX_SIZEOF( MAX_SIZEOF( sizeof( PTPMessagePathDelayResp ), \
+					    sizeof( PTPMessagePathDelayRespFollowUp )), \
+				sizeof( PTPMessageSignalling )))
+
+/* Never destroyed; messages may still be released during static teardown */
+static PTPMessagePool *messagePool()
+{
+	static PTPMessagePool *pool =
+		new PTPMessagePool( PTP_MESSAGE_BLOCK_SIZE );
+	return pool;
+}
+
+void *PTPMessageCommon::operator new( size_t size )
+{
+	return messagePool()->allocate( size );
+}
+
+void PTPMessageCommon::operator delete( void *ptr, size_t size )
+{
+	messagePool()->release( ptr, size );
+}
+
+void PTPMessageCommon::getPoolStats( PTPMessagePoolStats *stats )
+{
+	messagePool()->getStats( stats );
+}
+
 PTPMessageCommon::PTPMessageCommon( CommonPort *port )
 {
 	// Fill in fields using port/clock dataset as a template
@@ -53,7 +92,6 @@ PTPMessageCommon::PTPMessageCommon( CommonPort *port )
 	flags[PTP_PTPTIMESCALE_BYTE] |= (0x1 << PTP_PTPTIMESCALE_BIT);
 	correctionField = 0;
 	_gc = false;
-	sourcePortIdentity = new PortIdentity();
 
 	return;
 }
@@ -62,22 +100,21 @@ PTPMessageCommon::PTPMessageCommon( CommonPort *port )
    uuid, and port id fields */
 bool PTPMessageCommon::isSenderEqual(PortIdentity portIdentity)
 {
-	return portIdentity == *sourcePortIdentity;
+	return portIdentity == sourcePortIdentity;
 }
 
 PTPMessageCommon *buildPTPMessage
 ( char *buf, int size, LinkLayerAddress *remote,
-  CommonPort *port )
+  CommonPort *port, Timestamp *rx_timestamp )
 {
-	OSTimer *timer = port->getTimerFactory()->createTimer();
+	OSTimer *timer = NULL;
 	PTPMessageCommon *msg = NULL;
+	PtpFrameView frame( buf, size > 0 ? size : 0 );
 	PTPMessageId messageId;
 	MessageType messageType;
-	unsigned char tspec_msg_t = 0;
 	unsigned char transportSpecific = 0;
 
 	uint16_t sequenceId;
-	PortIdentity *sourcePortIdentity;
 	Timestamp timestamp(0, 0, 0);
 	unsigned counter_value = 0;
 	EtherPort *eport = NULL;
@@ -96,25 +133,15 @@ PTPMessageCommon *buildPTPMessage
 	}
 #endif
 
-	memcpy(&tspec_msg_t,
-	       buf + PTP_COMMON_HDR_TRANSSPEC_MSGTYPE(PTP_COMMON_HDR_OFFSET),
-	       sizeof(tspec_msg_t));
-	messageType = (MessageType) (tspec_msg_t & 0xF);
-	transportSpecific = (tspec_msg_t >> 4) & 0x0F;
-
-	sourcePortIdentity = new PortIdentity
-		((uint8_t *)
-		 (buf + PTP_COMMON_HDR_SOURCE_CLOCK_ID
-		  (PTP_COMMON_HDR_OFFSET)),
-		 (uint16_t *)
-		 (buf + PTP_COMMON_HDR_SOURCE_PORT_ID
-		  (PTP_COMMON_HDR_OFFSET)));
-
-	memcpy
-		(&(sequenceId),
-		 buf + PTP_COMMON_HDR_SEQUENCE_ID(PTP_COMMON_HDR_OFFSET),
-		 sizeof(sequenceId));
-	sequenceId = PLAT_ntohs(sequenceId);
+	if (!frame.valid()) {
+		GPTP_LOG_ERROR("*** Received frame shorter than the PTP header (%d bytes)", size);
+		return NULL;
+	}
+
+	messageType = frame.getMessageType();
+	transportSpecific = frame.getTransportSpecific();
+	PortIdentity sourcePortIdentity = frame.getSourcePortIdentity();
+	sequenceId = frame.getSequenceId();
 
 	GPTP_LOG_VERBOSE("Captured Sequence Id: %u", sequenceId);
 	messageId.setMessageType(messageType);
@@ -134,10 +161,21 @@ PTPMessageCommon *buildPTPMessage
 			goto abort;
 		}
 
-		int ts_good =
-		    eport->getRxTimestamp
-			(sourcePortIdentity, messageId, timestamp, counter_value, false);
+		int ts_good;
+		if (rx_timestamp != NULL) {
+			// Decoded along with the frame by the receive loop
+			timestamp = *rx_timestamp;
+			ts_good = GPTP_EC_SUCCESS;
+		} else {
+			ts_good =
+			    eport->getRxTimestamp
+				(&sourcePortIdentity, messageId, timestamp,
+				 counter_value, false);
+		}
 		while (ts_good != GPTP_EC_SUCCESS && iter-- != 0) {
+			// Only the retry path needs a timer
+			if (timer == NULL)
+				timer = port->getTimerFactory()->createTimer();
 			// Waits at least 1 time slice regardless of size of 'req'
 			timer->sleep(req);
 			if (ts_good != GPTP_EC_EAGAIN)
@@ -145,7 +183,7 @@ PTPMessageCommon *buildPTPMessage
 					"Error (RX) timestamping RX event packet (Retrying), error=%d",
 					  ts_good );
 			ts_good =
-			    eport->getRxTimestamp(sourcePortIdentity, messageId,
+			    eport->getRxTimestamp(&sourcePortIdentity, messageId,
 						 timestamp, counter_value,
 						 iter == 0);
 			req *= 2;
@@ -173,8 +211,8 @@ PTPMessageCommon *buildPTPMessage
  
 	uint8_t clock_id_str[8];
 	uint16_t port_num;
-	sourcePortIdentity->getClockIdentityString(clock_id_str);
-	sourcePortIdentity->getPortNumber(&port_num);
+	sourcePortIdentity.getClockIdentityString(clock_id_str);
+	sourcePortIdentity.getPortNumber(&port_num);
 	GPTP_LOG_DEBUG("Received message type %d, sequenceId %u, sourcePortIdentity %02x:%02x:%02x:%02x:%02x:%02x:%02x:%02x:%u",
 		messageType, sequenceId, 
 		clock_id_str[0], clock_id_str[1], clock_id_str[2], clock_id_str[3],
@@ -322,7 +360,7 @@ PTPMessageCommon *buildPTPMessage
 			pdelay_resp_msg->messageType = messageType;
 			// Copy in v2 PDelay Response specific fields
 			pdelay_resp_msg->requestingPortIdentity =
-			    new PortIdentity((uint8_t *) buf +
+			    PortIdentity((uint8_t *) buf +
 					     PTP_PDELAY_RESP_REQ_CLOCK_ID
 					     (PTP_PDELAY_RESP_OFFSET),
 					     (uint16_t *) (buf +
@@ -381,7 +419,7 @@ PTPMessageCommon *buildPTPMessage
 			pdelay_resp_fwup_msg->messageType = messageType;
 			// Copy in v2 PDelay Response specific fields
 			pdelay_resp_fwup_msg->requestingPortIdentity =
-			    new PortIdentity((uint8_t *) buf +
+			    PortIdentity((uint8_t *) buf +
 					     PTP_PDELAY_FOLLOWUP_REQ_CLOCK_ID
 					     (PTP_PDELAY_RESP_OFFSET),
 					     (uint16_t *) (buf +
@@ -461,15 +499,15 @@ PTPMessageCommon *buildPTPMessage
 			       PTP_ANNOUNCE_GRANDMASTER_PRIORITY1
 			       (PTP_ANNOUNCE_OFFSET),
 			       sizeof(annc->grandmasterPriority1));
-			memcpy( annc->grandmasterClockQuality,
+			memcpy( &annc->grandmasterClockQuality,
 				buf+
 				PTP_ANNOUNCE_GRANDMASTER_CLOCK_QUALITY
 				(PTP_ANNOUNCE_OFFSET),
-				sizeof( *annc->grandmasterClockQuality ));
+				sizeof( annc->grandmasterClockQuality ));
 			annc->
-			  grandmasterClockQuality->offsetScaledLogVariance =
+			  grandmasterClockQuality.offsetScaledLogVariance =
 			  PLAT_ntohs
-			  ( annc->grandmasterClockQuality->
+			  ( annc->grandmasterClockQuality.
 			    offsetScaledLogVariance );
 			memcpy(&(annc->grandmasterPriority2),
 			       buf +
@@ -533,19 +571,11 @@ PTPMessageCommon *buildPTPMessage
 	memcpy(&(msg->versionPTP),
 	       buf + PTP_COMMON_HDR_PTP_VERSION(PTP_COMMON_HDR_OFFSET),
 	       sizeof(msg->versionPTP));
-	memcpy(&(msg->messageLength),
-	       buf + PTP_COMMON_HDR_MSG_LENGTH(PTP_COMMON_HDR_OFFSET),
-	       sizeof(msg->messageLength));
-	msg->messageLength = PLAT_ntohs(msg->messageLength);
-	memcpy(&(msg->domainNumber),
-	       buf + PTP_COMMON_HDR_DOMAIN_NUMBER(PTP_COMMON_HDR_OFFSET),
-	       sizeof(msg->domainNumber));
+	msg->messageLength = frame.getMessageLength();
+	msg->domainNumber = frame.getDomainNumber();
 	memcpy(&(msg->flags), buf + PTP_COMMON_HDR_FLAGS(PTP_COMMON_HDR_OFFSET),
 	       PTP_FLAGS_LENGTH);
-	memcpy(&(msg->correctionField),
-	       buf + PTP_COMMON_HDR_CORRECTION(PTP_COMMON_HDR_OFFSET),
-	       sizeof(msg->correctionField));
-	msg->correctionField = PLAT_ntohll(msg->correctionField);
+	msg->correctionField = frame.getCorrectionField();
 	msg->sourcePortIdentity = sourcePortIdentity;
 	msg->sequenceId = sequenceId;
 	memcpy(&(msg->control),
@@ -556,7 +586,7 @@ PTPMessageCommon *buildPTPMessage
 	       sizeof(msg->logMeanMessageInterval));
 
 	if( eport != NULL )
-		eport->addSockAddrMap( msg->sourcePortIdentity, remote );
+		eport->addSockAddrMap( &msg->sourcePortIdentity, remote );
 
 	msg->_timestamp = timestamp;
 	msg->_timestamp_counter_value = counter_value;
@@ -567,24 +597,39 @@ PTPMessageCommon *buildPTPMessage
 
 abort:
 	GPTP_LOG_ERROR("*** ABORT: Entered abort label in buildPTPMessage or message processing. Returning NULL. ***");
-	delete sourcePortIdentity;
 	delete timer;
 	return NULL;
 }
 
 bool PTPMessageCommon::getTxTimestamp( EtherPort *port, uint32_t link_speed )
 {
-	OSTimer *timer = port->getTimerFactory()->createTimer();
+	OSTimer *timer = NULL;
 	int ts_good;
 	Timestamp tx_timestamp;
 	uint32_t unused;
 	unsigned req = TX_TIMEOUT_BASE;
 	int iter = TX_TIMEOUT_ITER;
 
-	ts_good = port->getTxTimestamp
-		( this, tx_timestamp, unused, false );
-	while( ts_good != GPTP_EC_SUCCESS && iter-- != 0 )
+	if( port->txTimestampWaitable() )
+	{
+		// Woken when the timestamp arrives, no retry schedule. If it
+		// never does, this thread stalls for TX_TIMEOUT_TOTAL (63 ms),
+		// the same worst case as the retry loop below. For Sync and
+		// Pdelay_Req that is the timer dispatch thread, so no timer of
+		// any port fires meanwhile; for Pdelay_Resp it is the receive
+		// thread, so the port reads no frame meanwhile
+		ts_good = port->waitTxTimestamp
+			( this, tx_timestamp, unused, TX_TIMEOUT_TOTAL );
+		iter = 0;
+	} else
 	{
+		ts_good = port->getTxTimestamp
+			( this, tx_timestamp, unused, false );
+	}
+	while( ts_good != GPTP_EC_SUCCESS && iter-- > 0 )
+	{
+		if( timer == NULL )
+			timer = port->getTimerFactory()->createTimer();
 		timer->sleep(req);
 		if (ts_good != GPTP_EC_EAGAIN && iter < 1)
 			GPTP_LOG_ERROR(
@@ -645,10 +690,10 @@ void PTPMessageCommon::buildCommonHeader(uint8_t * buf)
 	memcpy(buf + PTP_COMMON_HDR_CORRECTION(PTP_COMMON_HDR_OFFSET),
 	       &correctionField_BE, sizeof(correctionField));
 
-	sourcePortIdentity->getClockIdentityString
+	sourcePortIdentity.getClockIdentityString
 	  ((uint8_t *) buf+
 	   PTP_COMMON_HDR_SOURCE_CLOCK_ID(PTP_COMMON_HDR_OFFSET));
-	sourcePortIdentity->getPortNumberNO
+	sourcePortIdentity.getPortNumberNO
 	  ((uint16_t *) (buf + PTP_COMMON_HDR_SOURCE_PORT_ID
 			 (PTP_COMMON_HDR_OFFSET)));
 
@@ -665,32 +710,81 @@ void PTPMessageCommon::buildCommonHeader(uint8_t * buf)
 	return;
 }
 
+uint8_t *PTPMessageCommon::buildFromTemplate
+( EtherPort *port, uint8_t *buf_t )
+{
+	PTPFrameTemplate *tmpl = port->getTxTemplate( messageType );
+	unsigned offset = port->getPayloadOffset();
+	uint8_t *buf_ptr = buf_t + offset;
+
+	if( offset + messageLength > PTP_TX_TEMPLATE_SIZE ) {
+		memset( buf_t, 0, offset + messageLength );
+		buildCommonHeader( buf_ptr );
+		return buf_ptr;
+	}
+
+	if( !tmpl->valid ||
+	    tmpl->size != offset + messageLength ||
+	    tmpl->payloadOffset != offset ||
+	    tmpl->versionPTP != versionPTP ||
+	    tmpl->domainNumber != domainNumber ||
+	    memcmp( tmpl->flags, flags, PTP_FLAGS_LENGTH ) != 0 ||
+	    tmpl->control != control ||
+	    tmpl->logMeanMessageInterval != logMeanMessageInterval ||
+	    tmpl->sourcePortIdentity != sourcePortIdentity )
+	{
+		GPTP_LOG_VERBOSE( "Rebuilding TX template for message type %d",
+				  messageType );
+		memset( tmpl->frame, 0, sizeof( tmpl->frame ));
+		buildCommonHeader( tmpl->frame + offset );
+		tmpl->size = offset + messageLength;
+		tmpl->payloadOffset = offset;
+		tmpl->versionPTP = versionPTP;
+		tmpl->domainNumber = domainNumber;
+		memcpy( tmpl->flags, flags, PTP_FLAGS_LENGTH );
+		tmpl->control = control;
+		tmpl->logMeanMessageInterval = logMeanMessageInterval;
+		tmpl->sourcePortIdentity = sourcePortIdentity;
+		tmpl->valid = true;
+	}
+
+	memcpy( buf_t, tmpl->frame, tmpl->size );
+	PtpWire::store16
+		( buf_ptr + PTP_COMMON_HDR_SEQUENCE_ID(PTP_COMMON_HDR_OFFSET),
+		  sequenceId );
+	PtpWire::store64
+		( buf_ptr + PTP_COMMON_HDR_CORRECTION(PTP_COMMON_HDR_OFFSET),
+		  (uint64_t) correctionField );
+
+	return buf_ptr;
+}
+
 void PTPMessageCommon::getPortIdentity(PortIdentity * identity)
 {
-	*identity = *sourcePortIdentity;
+	*identity = sourcePortIdentity;
 }
 
 void PTPMessageCommon::setPortIdentity(PortIdentity * identity)
 {
-	*sourcePortIdentity = *identity;
+	sourcePortIdentity = *identity;
 }
 
 PTPMessageCommon::~PTPMessageCommon(void)
 {
-	delete sourcePortIdentity;
 	return;
 }
 
 PTPMessageAnnounce::PTPMessageAnnounce(void)
 {
-	grandmasterClockQuality = new ClockQuality();
 }
 
 PTPMessageAnnounce::~PTPMessageAnnounce(void)
 {
-	delete grandmasterClockQuality;
 }
 
+#undef GPTP_LOG_SUBSYSTEM
+#define GPTP_LOG_SUBSYSTEM GPTP_LOG_SUBSYS_BMCA
+
 bool PTPMessageAnnounce::isBetterThan(PTPMessageAnnounce * msg)
 {
 	unsigned char this1[14];
@@ -700,13 +794,13 @@ bool PTPMessageAnnounce::isBetterThan(PTPMessageAnnounce * msg)
 	this1[0] = grandmasterPriority1;
 	that1[0] = msg->getGrandmasterPriority1();
 
-	this1[1] = grandmasterClockQuality->cq_class;
+	this1[1] = grandmasterClockQuality.cq_class;
 	that1[1] = msg->getGrandmasterClockQuality()->cq_class;
 
-	this1[2] = grandmasterClockQuality->clockAccuracy;
+	this1[2] = grandmasterClockQuality.clockAccuracy;
 	that1[2] = msg->getGrandmasterClockQuality()->clockAccuracy;
 
-	tmp = grandmasterClockQuality->offsetScaledLogVariance;
+	tmp = grandmasterClockQuality.offsetScaledLogVariance;
 	tmp = PLAT_htons(tmp);
 	memcpy(this1 + 3, &tmp, sizeof(tmp));
 	tmp = msg->getGrandmasterClockQuality()->offsetScaledLogVariance;
@@ -759,33 +853,17 @@ bool PTPMessageSync::sendPort
 ( EtherPort *port, PortIdentity *destIdentity )
 {
 	uint8_t buf_t[256];
-	uint8_t *buf_ptr = buf_t + port->getPayloadOffset();
-	unsigned char tspec_msg_t = 0x0;
-	Timestamp originTimestamp_BE;
+	uint8_t *buf_ptr;
 	uint32_t link_speed;
 
-	memset(buf_t, 0, 256);
-	// Create packet in buf
 	// Copy in common header
 	messageLength = PTP_COMMON_HDR_LENGTH + PTP_SYNC_LENGTH;
-	tspec_msg_t |= messageType & 0xF;
-	buildCommonHeader(buf_ptr);
+	buf_ptr = buildFromTemplate(port, buf_t);
 	// Get timestamp
 	originTimestamp = port->getClock()->getTime();
-	originTimestamp_BE.seconds_ms = PLAT_htons(originTimestamp.seconds_ms);
-	originTimestamp_BE.seconds_ls = PLAT_htonl(originTimestamp.seconds_ls);
-	originTimestamp_BE.nanoseconds =
-	    PLAT_htonl(originTimestamp.nanoseconds);
 	// Copy in v2 sync specific fields
-	memcpy(buf_ptr + PTP_SYNC_SEC_MS(PTP_SYNC_OFFSET),
-	       &(originTimestamp_BE.seconds_ms),
-	       sizeof(originTimestamp.seconds_ms));
-	memcpy(buf_ptr + PTP_SYNC_SEC_LS(PTP_SYNC_OFFSET),
-	       &(originTimestamp_BE.seconds_ls),
-	       sizeof(originTimestamp.seconds_ls));
-	memcpy(buf_ptr + PTP_SYNC_NSEC(PTP_SYNC_OFFSET),
-	       &(originTimestamp_BE.nanoseconds),
-	       sizeof(originTimestamp.nanoseconds));
+	PtpWire::storeTimestamp
+		(buf_ptr + PTP_SYNC_SEC_MS(PTP_SYNC_OFFSET), originTimestamp);
 
 	port->sendEventPort
 		( PTP_ETHERTYPE, buf_t, messageLength, MCAST_OTHER,
@@ -810,8 +888,7 @@ PTPMessageAnnounce::PTPMessageAnnounce( CommonPort *port ) :
 	currentUtcOffset = port->getClock()->getCurrentUtcOffset();
 	grandmasterPriority1 = port->getClock()->getPriority1();
 	grandmasterPriority2 = port->getClock()->getPriority2();
-	grandmasterClockQuality = new ClockQuality();
-	*grandmasterClockQuality = port->getClock()->getClockQuality();
+	grandmasterClockQuality = port->getClock()->getClockQuality();
 	stepsRemoved = 0;
 	timeSource = port->getClock()->getTimeSource();
 	clock_identity = port->getClock()->getGrandmasterClockIdentity();
@@ -830,7 +907,7 @@ bool PTPMessageAnnounce::sendPort
 
 	uint16_t currentUtcOffset_l = PLAT_htons(currentUtcOffset);
 	uint16_t stepsRemoved_l = PLAT_htons(stepsRemoved);
-	ClockQuality clockQuality_l = *grandmasterClockQuality;
+	ClockQuality clockQuality_l = grandmasterClockQuality;
 	clockQuality_l.offsetScaledLogVariance =
 	    PLAT_htons(clockQuality_l.offsetScaledLogVariance);
 
@@ -881,7 +958,7 @@ void PTPMessageAnnounce::processMessage( CommonPort *port )
 
 	// Reject Announce message from myself
 	my_clock_identity = port->getClock()->getClockIdentity();
-	if( sourcePortIdentity->getClockIdentity() == my_clock_identity ) {
+	if( sourcePortIdentity.getClockIdentity() == my_clock_identity ) {
 		goto bail;
 	}
 
@@ -904,6 +981,9 @@ void PTPMessageAnnounce::processMessage( CommonPort *port )
 		   1000000000.0)));
 }
 
+#undef GPTP_LOG_SUBSYSTEM
+#define GPTP_LOG_SUBSYSTEM GPTP_LOG_SUBSYS_SERVO
+
 void PTPMessageSync::processMessage( CommonPort *port )
 {
 	EtherPort *eport = dynamic_cast <EtherPort *> (port);
@@ -918,12 +998,14 @@ void PTPMessageSync::processMessage( CommonPort *port )
 
 	if (port->getPortState() == PTP_DISABLED ) {
 		// Do nothing Sync messages should be ignored in this state
-		return;
+		_gc = true;
+		goto done;
 	}
 	if (port->getPortState() == PTP_FAULTY) {
 		// According to spec recovery is implementation specific
 		eport->recoverPort();
-		return;
+		_gc = true;
+		goto done;
 	}
 
 	port->incCounter_ieee8021AsPortStatRxSyncCount();
@@ -962,33 +1044,12 @@ PTPMessageFollowUp::PTPMessageFollowUp( CommonPort *port ) :
 	return;
 }
 
-size_t PTPMessageFollowUp::buildMessage( CommonPort *port, uint8_t *buf_ptr )
+void PTPMessageFollowUp::buildBody( CommonPort *port, uint8_t *buf_ptr )
 {
-	/* Create packet in buf
-	Copy in common header */
-	messageLength =
-		PTP_COMMON_HDR_LENGTH + PTP_FOLLOWUP_LENGTH + sizeof(tlv);
-	unsigned char tspec_msg_t = 0;
-	Timestamp preciseOriginTimestamp_BE;
-
-	tspec_msg_t |= messageType & 0xF;
-	buildCommonHeader(buf_ptr);
-	preciseOriginTimestamp_BE.seconds_ms =
-		PLAT_htons(preciseOriginTimestamp.seconds_ms);
-	preciseOriginTimestamp_BE.seconds_ls =
-		PLAT_htonl(preciseOriginTimestamp.seconds_ls);
-	preciseOriginTimestamp_BE.nanoseconds =
-		PLAT_htonl(preciseOriginTimestamp.nanoseconds);
 	/* Copy in v2 sync specific fields */
-	memcpy(buf_ptr + PTP_FOLLOWUP_SEC_MS(PTP_FOLLOWUP_OFFSET),
-		&(preciseOriginTimestamp_BE.seconds_ms),
-		sizeof(preciseOriginTimestamp.seconds_ms));
-	memcpy(buf_ptr + PTP_FOLLOWUP_SEC_LS(PTP_FOLLOWUP_OFFSET),
-		&(preciseOriginTimestamp_BE.seconds_ls),
-		sizeof(preciseOriginTimestamp.seconds_ls));
-	memcpy(buf_ptr + PTP_FOLLOWUP_NSEC(PTP_FOLLOWUP_OFFSET),
-		&(preciseOriginTimestamp_BE.nanoseconds),
-		sizeof(preciseOriginTimestamp.nanoseconds));
+	PtpWire::storeTimestamp
+		(buf_ptr + PTP_FOLLOWUP_SEC_MS(PTP_FOLLOWUP_OFFSET),
+		 preciseOriginTimestamp);
 
 	/*Change time base indicator to Network Order before sending it*/
 	uint16_t tbi_NO = PLAT_htonl(tlv.getGMTimeBaseIndicator());
@@ -997,6 +1058,16 @@ size_t PTPMessageFollowUp::buildMessage( CommonPort *port, uint8_t *buf_ptr )
 			 PTP_FOLLOWUP_LENGTH);
 
 	port->incCounter_ieee8021AsPortStatTxFollowUpCount();
+}
+
+size_t PTPMessageFollowUp::buildMessage( CommonPort *port, uint8_t *buf_ptr )
+{
+	/* Create packet in buf
+	Copy in common header */
+	messageLength =
+		PTP_COMMON_HDR_LENGTH + PTP_FOLLOWUP_LENGTH + sizeof(tlv);
+	buildCommonHeader(buf_ptr);
+	buildBody(port, buf_ptr);
 
 	return PTP_COMMON_HDR_LENGTH + PTP_FOLLOWUP_LENGTH + sizeof(tlv);
 }
@@ -1005,11 +1076,13 @@ bool PTPMessageFollowUp::sendPort
 ( EtherPort *port, PortIdentity *destIdentity )
 {
 	uint8_t buf_t[256];
-	uint8_t *buf_ptr = buf_t + port->getPayloadOffset();
-	memset(buf_t, 0, 256);
+	uint8_t *buf_ptr;
 	/* Create packet in buf
 	   Copy in common header */
-	buildMessage(port, buf_ptr);
+	messageLength =
+		PTP_COMMON_HDR_LENGTH + PTP_FOLLOWUP_LENGTH + sizeof(tlv);
+	buf_ptr = buildFromTemplate(port, buf_t);
+	buildBody(port, buf_ptr);
 
 	GPTP_LOG_VERBOSE( "Follow-Up Time: %u seconds(hi)",
 			  preciseOriginTimestamp.seconds_ms);
@@ -1083,6 +1156,17 @@ void PTPMessageFollowUp::processMessage
 	correction = (int64_t)
 		((delay * master_local_freq_offset) + correctionField);
 
+	if( port->getClock()->getCapture() != NULL ) {
+		PortIdentity port_identity;
+		uint16_t port_number;
+
+		port->getPortIdentity(port_identity);
+		port_identity.getPortNumber(&port_number);
+		port->getClock()->getCapture()->stageSync
+			( port_number, TIMESTAMP_TO_NS( preciseOriginTimestamp ),
+			  TIMESTAMP_TO_NS( sync_arrival ), delay, correctionField );
+	}
+
 	if (correction > 0)
 		TIMESTAMP_ADD_NS(preciseOriginTimestamp, correction);
 	else TIMESTAMP_SUB_NS(preciseOriginTimestamp, -correction);
@@ -1155,7 +1239,33 @@ void PTPMessageFollowUp::processMessage
 			port->checkProfileConvergence();
 		}
 
-		// ...existing code...
+		local_system_offset =
+			TIMESTAMP_TO_NS( system_time ) -
+			TIMESTAMP_TO_NS( sync_arrival );
+		local_system_freq_offset =
+			port->getClock()->calcLocalSystemClockRateDifference
+			( device_time, system_time );
+		TIMESTAMP_SUB_NS
+			( system_time, (uint64_t)
+			  (((FrequencyRatio) device_sync_time_offset ) /
+			   local_system_freq_offset ));
+		local_system_offset =
+			TIMESTAMP_TO_NS( system_time ) -
+			TIMESTAMP_TO_NS( sync_arrival );
+
+		port->getClock()->setMasterOffset
+			( port, scalar_offset, sync_arrival,
+			  local_clock_adjustment, local_system_offset,
+			  system_time, local_system_freq_offset,
+			  port->getSyncCount(), port->getPdelayCount(),
+			  port->getPortState(), port->getAsCapable() );
+		port->syncDone();
+
+		// Restart the SYNC_RECEIPT timer
+		port->startSyncReceiptTimer((unsigned long long)
+			( SYNC_RECEIPT_TIMEOUT_MULTIPLIER *
+			  ((double) pow( (double)2, port->getSyncInterval() ) *
+			   1000000000.0 )));
 	}
 
 	uint16_t lastGmTimeBaseIndicator;
@@ -1211,7 +1321,7 @@ void PTPMessageFollowUp::processMessage( CommonPort *port )
 		sync->getPortIdentity(&sync_id);
 
 		if( sync->getSequenceId() != sequenceId ||
-		    sync_id != *sourcePortIdentity )
+		    sync_id != sourcePortIdentity )
 		{
 			unsigned int cnt = 0;
 
@@ -1253,12 +1363,14 @@ PTPMessagePathDelayReq::PTPMessagePathDelayReq
 	return;
 }
 
+#undef GPTP_LOG_SUBSYSTEM
+#define GPTP_LOG_SUBSYSTEM GPTP_LOG_SUBSYS_PDELAY
+
 void PTPMessagePathDelayReq::processMessage( CommonPort *port )
 {
 	GPTP_LOG_INFO("*** PTPMessagePathDelayReq::processMessage - START processing PDelay Request");
 	GPTP_LOG_DEBUG("PDELAY RESPONSE: Processing request seq=%u", sequenceId);
 	
-	OSTimer *timer = port->getTimerFactory()->createTimer();
 	PortIdentity resp_fwup_id;
 	PortIdentity requestingPortIdentity_p;
 	PTPMessagePathDelayResp *resp;
@@ -1313,7 +1425,7 @@ void PTPMessagePathDelayReq::processMessage( CommonPort *port )
 	GPTP_LOG_INFO("*** About to send PDelay Response - acquiring TX lock");
 	port->getTxLock();
 	GPTP_LOG_INFO("*** TX lock acquired, calling sendPort");
-	resp->sendPort(eport, sourcePortIdentity);
+	resp->sendPort(eport, &sourcePortIdentity);
 	GPTP_LOG_INFO("*** sendPort returned, releasing TX lock");
 	GPTP_LOG_DEBUG("*** Sent PDelay Response message");
 	port->putTxLock();
@@ -1332,7 +1444,7 @@ void PTPMessagePathDelayReq::processMessage( CommonPort *port )
 	port->getPortIdentity(resp_fwup_id);
 	resp_fwup->setPortIdentity(&resp_fwup_id);
 	resp_fwup->setSequenceId(sequenceId);
-	resp_fwup->setRequestingPortIdentity(sourcePortIdentity);
+	resp_fwup->setRequestingPortIdentity(&sourcePortIdentity);
 	resp_fwup->setResponseOriginTimestamp(resp->getTimestamp());
 	long long turnaround;
 	turnaround = (resp->getTimestamp().seconds_ls - _timestamp.seconds_ls)
@@ -1352,7 +1464,7 @@ void PTPMessagePathDelayReq::processMessage( CommonPort *port )
 	GPTP_LOG_VERBOSE("#3 Correction Field: %Ld", turnaround);
 
 	resp_fwup->setCorrectionField(0);
-	resp_fwup->sendPort(eport, sourcePortIdentity);
+	resp_fwup->sendPort(eport, &sourcePortIdentity);
 
 	GPTP_LOG_DEBUG("*** Sent PDelay Response FollowUp message");
 
@@ -1360,7 +1472,6 @@ void PTPMessagePathDelayReq::processMessage( CommonPort *port )
 	delete resp_fwup;
 
 done:
-	delete timer;
 	_gc = true;
 	return;
 }
@@ -1376,14 +1487,10 @@ bool PTPMessagePathDelayReq::sendPort
 	}
 
 	uint8_t buf_t[256];
-	uint8_t *buf_ptr = buf_t + port->getPayloadOffset();
-	unsigned char tspec_msg_t = 0;
-	memset(buf_t, 0, 256);
 	/* Create packet in buf */
-	/* Copy in common header */
+	/* Copy in common header; the body is all zero */
 	messageLength = PTP_COMMON_HDR_LENGTH + PTP_PDELAY_REQ_LENGTH;
-	tspec_msg_t |= messageType & 0xF;
-	buildCommonHeader(buf_ptr);
+	buildFromTemplate(port, buf_t);
 	port->sendEventPort
 		( PTP_ETHERTYPE, buf_t, messageLength, MCAST_PDELAY,
 		  destIdentity, &link_speed );
@@ -1400,7 +1507,6 @@ PTPMessagePathDelayResp::PTPMessagePathDelayResp
 	control = MESSAGE_OTHER;
 	messageType = PATH_DELAY_RESP_MESSAGE;
 	versionPTP = GPTP_VERSION;
-	requestingPortIdentity = new PortIdentity();
 
 	flags[PTP_ASSIST_BYTE] |= (0x1 << PTP_ASSIST_BIT);
 
@@ -1409,7 +1515,6 @@ PTPMessagePathDelayResp::PTPMessagePathDelayResp
 
 PTPMessagePathDelayResp::~PTPMessagePathDelayResp()
 {
-	delete requestingPortIdentity;
 }
 
 void PTPMessagePathDelayResp::processMessage( CommonPort *port )
@@ -1509,41 +1614,25 @@ bool PTPMessagePathDelayResp::sendPort
 ( EtherPort *port, PortIdentity *destIdentity )
 {
 	uint8_t buf_t[256];
-	uint8_t *buf_ptr = buf_t + port->getPayloadOffset();
-	unsigned char tspec_msg_t = 0;
-	Timestamp requestReceiptTimestamp_BE;
+	uint8_t *buf_ptr;
 	uint32_t link_speed;
 
-	memset(buf_t, 0, 256);
 	// Create packet in buf
 	// Copy in common header
 	messageLength = PTP_COMMON_HDR_LENGTH + PTP_PDELAY_RESP_LENGTH;
-	tspec_msg_t |= messageType & 0xF;
-	buildCommonHeader(buf_ptr);
-	requestReceiptTimestamp_BE.seconds_ms =
-	    PLAT_htons(requestReceiptTimestamp.seconds_ms);
-	requestReceiptTimestamp_BE.seconds_ls =
-	    PLAT_htonl(requestReceiptTimestamp.seconds_ls);
-	requestReceiptTimestamp_BE.nanoseconds =
-	    PLAT_htonl(requestReceiptTimestamp.nanoseconds);
+	buf_ptr = buildFromTemplate(port, buf_t);
 
 	// Copy in v2 PDelay_Req specific fields
-	requestingPortIdentity->getClockIdentityString
+	requestingPortIdentity.getClockIdentityString
 	  (buf_ptr + PTP_PDELAY_RESP_REQ_CLOCK_ID
 	   (PTP_PDELAY_RESP_OFFSET));
-	requestingPortIdentity->getPortNumberNO
+	requestingPortIdentity.getPortNumberNO
 		((uint16_t *)
 		 (buf_ptr + PTP_PDELAY_RESP_REQ_PORT_ID
 		  (PTP_PDELAY_RESP_OFFSET)));
-	memcpy(buf_ptr + PTP_PDELAY_RESP_SEC_MS(PTP_PDELAY_RESP_OFFSET),
-	       &(requestReceiptTimestamp_BE.seconds_ms),
-	       sizeof(requestReceiptTimestamp.seconds_ms));
-	memcpy(buf_ptr + PTP_PDELAY_RESP_SEC_LS(PTP_PDELAY_RESP_OFFSET),
-	       &(requestReceiptTimestamp_BE.seconds_ls),
-	       sizeof(requestReceiptTimestamp.seconds_ls));
-	memcpy(buf_ptr + PTP_PDELAY_RESP_NSEC(PTP_PDELAY_RESP_OFFSET),
-	       &(requestReceiptTimestamp_BE.nanoseconds),
-	       sizeof(requestReceiptTimestamp.nanoseconds));
+	PtpWire::storeTimestamp
+		(buf_ptr + PTP_PDELAY_RESP_SEC_MS(PTP_PDELAY_RESP_OFFSET),
+		 requestReceiptTimestamp);
 
 	GPTP_LOG_VERBOSE("PDelay Resp Timestamp: %u,%u",
 		   requestReceiptTimestamp.seconds_ls,
@@ -1560,13 +1649,13 @@ bool PTPMessagePathDelayResp::sendPort
 void PTPMessagePathDelayResp::setRequestingPortIdentity
 (PortIdentity * identity)
 {
-	*requestingPortIdentity = *identity;
+	requestingPortIdentity = *identity;
 }
 
 void PTPMessagePathDelayResp::getRequestingPortIdentity
 (PortIdentity * identity)
 {
-	*identity = *requestingPortIdentity;
+	*identity = requestingPortIdentity;
 }
 
 PTPMessagePathDelayRespFollowUp::PTPMessagePathDelayRespFollowUp
@@ -1576,14 +1665,12 @@ PTPMessagePathDelayRespFollowUp::PTPMessagePathDelayRespFollowUp
 	control = MESSAGE_OTHER;
 	messageType = PATH_DELAY_FOLLOWUP_MESSAGE;
 	versionPTP = GPTP_VERSION;
-	requestingPortIdentity = new PortIdentity();
 
 	return;
 }
 
 PTPMessagePathDelayRespFollowUp::~PTPMessagePathDelayRespFollowUp()
 {
-	delete requestingPortIdentity;
 }
 
 #define US_PER_SEC 1000000
@@ -1681,7 +1768,7 @@ void PTPMessagePathDelayRespFollowUp::processMessage
 		resp->getRequestingPortIdentity(&resp_id);
 
 		resp_id.getPortNumber(&resp_port_number);
-		requestingPortIdentity->getPortNumber(&req_port_number);
+		requestingPortIdentity.getPortNumber(&req_port_number);
 
 		resp->getPortIdentity(&resp_sourcePortIdentity);
 		getPortIdentity(&fup_sourcePortIdentity);
@@ -1967,42 +2054,23 @@ bool PTPMessagePathDelayRespFollowUp::sendPort
 ( EtherPort *port, PortIdentity *destIdentity )
 {
 	uint8_t buf_t[256];
-	uint8_t *buf_ptr = buf_t + port->getPayloadOffset();
-	unsigned char tspec_msg_t = 0;
-	Timestamp responseOriginTimestamp_BE;
-	memset(buf_t, 0, 256);
+	uint8_t *buf_ptr;
 	/* Create packet in buf
 	   Copy in common header */
 	messageLength = PTP_COMMON_HDR_LENGTH + PTP_PDELAY_RESP_LENGTH;
-	tspec_msg_t |= messageType & 0xF;
-	buildCommonHeader(buf_ptr);
-	responseOriginTimestamp_BE.seconds_ms =
-		PLAT_htons(responseOriginTimestamp.seconds_ms);
-	responseOriginTimestamp_BE.seconds_ls =
-		PLAT_htonl(responseOriginTimestamp.seconds_ls);
-	responseOriginTimestamp_BE.nanoseconds =
-		PLAT_htonl(responseOriginTimestamp.nanoseconds);
+	buf_ptr = buildFromTemplate(port, buf_t);
 
 	// Copy in v2 PDelay_Req specific fields
-	requestingPortIdentity->getClockIdentityString
+	requestingPortIdentity.getClockIdentityString
 		(buf_ptr + PTP_PDELAY_FOLLOWUP_REQ_CLOCK_ID
 		 (PTP_PDELAY_FOLLOWUP_OFFSET));
-	requestingPortIdentity->getPortNumberNO
+	requestingPortIdentity.getPortNumberNO
 		((uint16_t *)
 		 (buf_ptr + PTP_PDELAY_FOLLOWUP_REQ_PORT_ID
 		  (PTP_PDELAY_FOLLOWUP_OFFSET)));
-	memcpy
+	PtpWire::storeTimestamp
 		(buf_ptr + PTP_PDELAY_FOLLOWUP_SEC_MS(PTP_PDELAY_FOLLOWUP_OFFSET),
-		 &(responseOriginTimestamp_BE.seconds_ms),
-		 sizeof(responseOriginTimestamp.seconds_ms));
-	memcpy
-		(buf_ptr + PTP_PDELAY_FOLLOWUP_SEC_LS(PTP_PDELAY_FOLLOWUP_OFFSET),
-		 &(responseOriginTimestamp_BE.seconds_ls),
-		 sizeof(responseOriginTimestamp.seconds_ls));
-	memcpy
-		(buf_ptr + PTP_PDELAY_FOLLOWUP_NSEC(PTP_PDELAY_FOLLOWUP_OFFSET),
-		 &(responseOriginTimestamp_BE.nanoseconds),
-		 sizeof(responseOriginTimestamp.nanoseconds));
+		 responseOriginTimestamp);
 
 	GPTP_LOG_VERBOSE("PDelay Resp Timestamp: %u,%u",
 		   responseOriginTimestamp.seconds_ls,
@@ -2017,7 +2085,7 @@ bool PTPMessagePathDelayRespFollowUp::sendPort
 void PTPMessagePathDelayRespFollowUp::setRequestingPortIdentity
 (PortIdentity * identity)
 {
-	*requestingPortIdentity = *identity;
+	requestingPortIdentity = *identity;
 }
 
 
@@ -2045,6 +2113,9 @@ PTPMessageSignalling::PTPMessageSignalling
 {
 }
 
+#undef GPTP_LOG_SUBSYSTEM
+#define GPTP_LOG_SUBSYSTEM GPTP_LOG_SUBSYS_GENERAL
+
 void PTPMessageSignalling::setintervals(int8_t linkDelayInterval, int8_t timeSyncInterval, int8_t announceInterval)
 {
 	tlv.setLinkDelayInterval(linkDelayInterval);
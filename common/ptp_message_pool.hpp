@@ -0,0 +1,198 @@
+/******************************************************************************
+
+  Copyright (c) 2009-2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#ifndef PTP_MESSAGE_POOL_HPP
+#define PTP_MESSAGE_POOL_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <new>
+
+/**@file*/
+
+/**
+ * @brief Number of blocks added to the message pool each time it runs
+ * dry. A port keeps only a handful of messages alive at once, so the first
+ * chunk normally serves the whole run.
+ */
+#define PTP_MESSAGE_POOL_CHUNK 64
+
+/**
+ * @brief Message pool usage counters
+ */
+struct PTPMessagePoolStats {
+	uint64_t allocations;	/*!< Blocks handed out in total */
+	uint64_t heap_fallbacks;	/*!< Requests too large for a block */
+	unsigned chunks;	/*!< Chunks allocated from the heap */
+	unsigned in_use;	/*!< Blocks currently handed out */
+	unsigned high_water;	/*!< Most blocks handed out at once */
+};
+
+/**
+ * @brief Fixed-block free list backing PTP message objects
+ *
+ * Every block has the same size, chosen to fit the largest message class,
+ * so freed blocks are reused by any message type without fragmentation.
+ * The list grows by PTP_MESSAGE_POOL_CHUNK blocks when empty and chunks
+ * are never returned to the heap. Messages are built by the receive thread
+ * and may be deleted by the timer thread, so the list is guarded by a
+ * spinlock; the critical section is a couple of pointer moves.
+ */
+class PTPMessagePool {
+private:
+	struct FreeBlock {
+		FreeBlock *next;
+	};
+
+	std::atomic_flag busy;
+	FreeBlock *free_list;
+	size_t block_size;
+	PTPMessagePoolStats stats;
+
+	void lock() {
+		while( busy.test_and_set( std::memory_order_acquire ))
+			;
+	}
+	void unlock() {
+		busy.clear( std::memory_order_release );
+	}
+
+	/* Called with the lock held */
+	bool grow() {
+		char *chunk = (char *) ::operator new
+			( block_size * PTP_MESSAGE_POOL_CHUNK, std::nothrow );
+		if( chunk == NULL )
+			return false;
+		for( unsigned i = 0; i < PTP_MESSAGE_POOL_CHUNK; ++i ) {
+			FreeBlock *block = (FreeBlock *)( chunk + i*block_size );
+			block->next = free_list;
+			free_list = block;
+		}
+		++stats.chunks;
+		return true;
+	}
+public:
+	/**
+	 * @brief  Creates an empty pool
+	 * @param  size Block size in bytes, rounded up to the platform's
+	 * maximum alignment
+	 */
+	PTPMessagePool( size_t size ) {
+		const size_t align = alignof( max_align_t );
+		block_size = ( size + align - 1 ) & ~( align - 1 );
+		free_list = NULL;
+		busy.clear();
+		stats.allocations = 0;
+		stats.heap_fallbacks = 0;
+		stats.chunks = 0;
+		stats.in_use = 0;
+		stats.high_water = 0;
+	}
+
+	/**
+	 * @brief  Gets the block size
+	 * @return Block size in bytes
+	 */
+	size_t getBlockSize() const {
+		return block_size;
+	}
+
+	/**
+	 * @brief  Hands out one block
+	 * @param  size Size of the object to be placed in the block. Larger
+	 * objects are allocated from the heap.
+	 * @return Pointer to the block
+	 * @throw  std::bad_alloc if the heap is exhausted
+	 */
+	void *allocate( size_t size ) {
+		FreeBlock *block;
+
+		if( size > block_size ) {
+			lock();
+			++stats.heap_fallbacks;
+			unlock();
+			return ::operator new( size );
+		}
+
+		lock();
+		if( free_list == NULL && !grow() ) {
+			unlock();
+			throw std::bad_alloc();
+		}
+		block = free_list;
+		free_list = block->next;
+		++stats.allocations;
+		if( ++stats.in_use > stats.high_water )
+			stats.high_water = stats.in_use;
+		unlock();
+
+		return block;
+	}
+
+	/**
+	 * @brief  Returns a block to the pool
+	 * @param  ptr Block returned by allocate()
+	 * @param  size The size passed to allocate()
+	 * @return void
+	 */
+	void release( void *ptr, size_t size ) {
+		FreeBlock *block = (FreeBlock *) ptr;
+
+		if( ptr == NULL )
+			return;
+		if( size > block_size ) {
+			::operator delete( ptr );
+			return;
+		}
+
+		lock();
+		block->next = free_list;
+		free_list = block;
+		--stats.in_use;
+		unlock();
+	}
+
+	/**
+	 * @brief  Gets a snapshot of the usage counters
+	 * @param  out [out] Counters
+	 * @return void
+	 */
+	void getStats( PTPMessagePoolStats *out ) {
+		lock();
+		*out = stats;
+		unlock();
+	}
+};
+
+#endif/*PTP_MESSAGE_POOL_HPP*/
@@ -0,0 +1,356 @@
+/******************************************************************************
+
+  Copyright (c) 2009-2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+/*
+ * Counts malloc() calls per PTP message on the daemon's own message path.
+ *
+ *  rx: buildPTPMessage() parses a received frame of each type into its
+ *      PTPMessage* class, as the receive loop does, with the RX timestamp
+ *      supplied so no retry timer is created
+ *  tx: the port constructors build the message of each type a master or
+ *      Pdelay responder sends
+ *
+ * Messages come from the PTPMessageCommon pool (ptp_message_pool.hpp) and
+ * hold PortIdentity and ClockQuality by value. The port is an EtherPort
+ * on the simulated HAL of linux/sim, so the tool needs no network
+ * interface. The last few messages are kept alive, as the port keeps the
+ * last Sync and Pdelay messages around. The first pass is a warm-up (the
+ * pool's first chunk, the socket address map); the counts are taken over
+ * the passes after it.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <avbts_message.hpp>
+#include <avbts_clock.hpp>
+#include <ether_port.hpp>
+#include <gptp_log.hpp>
+#include <gptp_profile.hpp>
+
+#include "sim_hal.hpp"
+#include "loopback_net.hpp"
+
+#define MESSAGE_TYPES 6		/* Sync, FollowUp, Pdelay x3, Announce */
+#define LIVE_MESSAGES 4		/* Messages the port holds on to */
+#define FRAME_SIZE 128
+
+extern "C" void *__libc_malloc( size_t size );
+extern "C" void *__libc_calloc( size_t count, size_t size );
+extern "C" void *__libc_realloc( void *ptr, size_t size );
+
+static uint64_t malloc_calls = 0;
+
+/* operator new ends up here as well */
+extern "C" void *malloc( size_t size )
+{
+	++malloc_calls;
+	return __libc_malloc( size );
+}
+
+extern "C" void *calloc( size_t count, size_t size )
+{
+	++malloc_calls;
+	return __libc_calloc( count, size );
+}
+
+extern "C" void *realloc( void *ptr, size_t size )
+{
+	++malloc_calls;
+	return __libc_realloc( ptr, size );
+}
+
+struct MessageFrame {
+	const char *name;
+	MessageType type;
+	int length;
+	char buf[FRAME_SIZE];
+};
+
+static const uint8_t master_clock[PTP_CLOCK_IDENTITY_LENGTH] =
+	{ 0x02, 0x00, 0x00, 0xff, 0xfe, 0x00, 0x00, 0x01 };
+
+static phy_delay_map_t no_phy_delay;
+
+static uint64_t nsNow()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void storeShort( char *buf, uint16_t value )
+{
+	value = PLAT_htons( value );
+	memcpy( buf, &value, sizeof( value ));
+}
+
+/* A frame as the grandmaster (or the Pdelay peer) would send it */
+static void buildFrame
+( MessageFrame *frame, const char *name, MessageType type, int length )
+{
+	char *buf = frame->buf;
+
+	frame->name = name;
+	frame->type = type;
+	frame->length = length;
+	memset( buf, 0, sizeof( frame->buf ));
+	buf[PTP_COMMON_HDR_TRANSSPEC_MSGTYPE( PTP_COMMON_HDR_OFFSET )] =
+		(char) (( 1 << 4 ) | type );
+	buf[PTP_COMMON_HDR_PTP_VERSION( PTP_COMMON_HDR_OFFSET )] = GPTP_VERSION;
+	storeShort( buf + PTP_COMMON_HDR_MSG_LENGTH( PTP_COMMON_HDR_OFFSET ),
+		    (uint16_t) length );
+	memcpy( buf + PTP_COMMON_HDR_SOURCE_CLOCK_ID( PTP_COMMON_HDR_OFFSET ),
+		master_clock, sizeof( master_clock ));
+	storeShort( buf + PTP_COMMON_HDR_SOURCE_PORT_ID( PTP_COMMON_HDR_OFFSET ),
+		    1 );
+
+	if( type == ANNOUNCE_MESSAGE ) {
+		char *tlv = buf + PTP_COMMON_HDR_LENGTH + PTP_ANNOUNCE_LENGTH;
+
+		buf[PTP_ANNOUNCE_GRANDMASTER_PRIORITY1( PTP_ANNOUNCE_OFFSET )] =
+			100;
+		buf[PTP_ANNOUNCE_GRANDMASTER_PRIORITY2( PTP_ANNOUNCE_OFFSET )] =
+			(char) 248;
+		memcpy( buf + PTP_ANNOUNCE_GRANDMASTER_IDENTITY
+			( PTP_ANNOUNCE_OFFSET ), master_clock,
+			sizeof( master_clock ));
+		/* Path trace with the grandmaster alone */
+		storeShort( tlv, PATH_TRACE_TLV_TYPE );
+		storeShort( tlv + 2, PTP_CLOCK_IDENTITY_LENGTH );
+		memcpy( tlv + 4, master_clock, sizeof( master_clock ));
+	}
+}
+
+static void setSequence( MessageFrame *frame, uint16_t sequence )
+{
+	storeShort( frame->buf + PTP_COMMON_HDR_SEQUENCE_ID
+		    ( PTP_COMMON_HDR_OFFSET ), sequence );
+}
+
+static PTPMessageCommon *buildTx( EtherPort *port, MessageType type )
+{
+	switch( type ) {
+	case SYNC_MESSAGE:
+		return new PTPMessageSync( port );
+	case FOLLOWUP_MESSAGE:
+		return new PTPMessageFollowUp( port );
+	case PATH_DELAY_REQ_MESSAGE:
+		return new PTPMessagePathDelayReq( port );
+	case PATH_DELAY_RESP_MESSAGE:
+		return new PTPMessagePathDelayResp( port );
+	case PATH_DELAY_FOLLOWUP_MESSAGE:
+		return new PTPMessagePathDelayRespFollowUp( port );
+	default:
+		return new PTPMessageAnnounce( port );
+	}
+}
+
+/*
+ * Builds count messages of each type through the rx or the tx path and
+ * adds the malloc() calls made for each type to calls[]
+ */
+static bool runPass
+( EtherPort *port, MessageFrame *frames, LinkLayerAddress *remote,
+  bool rx, unsigned count, uint64_t *calls, uint64_t *elapsed )
+{
+	PTPMessageCommon *live[LIVE_MESSAGES] = { NULL };
+	uint64_t start = nsNow();
+	unsigned n;
+
+	for( n = 0; n < count * MESSAGE_TYPES; ++n ) {
+		MessageFrame *frame = &frames[n % MESSAGE_TYPES];
+		Timestamp rx_timestamp( n, 0, 0 );
+		PTPMessageCommon *msg;
+		uint64_t before;
+
+		setSequence( frame, (uint16_t) ( n / MESSAGE_TYPES ));
+		before = malloc_calls;
+		if( rx )
+			msg = buildPTPMessage
+				( frame->buf, frame->length, remote, port,
+				  &rx_timestamp );
+		else
+			msg = buildTx( port, frame->type );
+		if( msg == NULL ) {
+			fprintf( stderr, "%s was not built\n", frame->name );
+			return false;
+		}
+		delete live[n % LIVE_MESSAGES];
+		live[n % LIVE_MESSAGES] = msg;
+		calls[n % MESSAGE_TYPES] += malloc_calls - before;
+	}
+	for( n = 0; n < LIVE_MESSAGES; ++n )
+		delete live[n];
+	*elapsed += nsNow() - start;
+
+	return true;
+}
+
+static void usage( char *arg0 )
+{
+	fprintf( stderr,
+		 "%s [-n <messages>]\n"
+		 "\t-n Number of messages of each type per path "
+		 "(default 100000)\n",
+		 arg0 );
+}
+
+int main( int argc, char **argv )
+{
+	unsigned count = 100000;
+	SimScheduler sched;
+	SimTimerQueueFactory timerq_factory( &sched );
+	SimLockFactory lock_factory;
+	SimConditionFactory condition_factory;
+	SimThreadFactory thread_factory;
+	SimTimerFactory timer_factory;
+	SimOscillator phc( 0, 0, 0, 1 );
+	LoopbackSwitch sw( &sched, 1 );
+	LinkLayerAddress remote( 0x020000000001ULL );
+	MessageFrame frames[MESSAGE_TYPES];
+	PortInit_t portInit;
+	PTPMessagePoolStats stats;
+	uint64_t calls[2][MESSAGE_TYPES] = { { 0 } };
+	uint64_t elapsed[2] = { 0, 0 };
+	uint64_t scratch[MESSAGE_TYPES];
+	IEEE1588Clock *clock;
+	EtherPort *port;
+	int opt, path, t;
+
+	while(( opt = getopt( argc, argv, "n:h" )) != -1 ) {
+		switch( opt ) {
+		case 'n':
+			count = (unsigned) strtoul( optarg, NULL, 0 );
+			break;
+		default:
+			usage( argv[0] );
+			return 1;
+		}
+	}
+	if( count == 0 ) {
+		usage( argv[0] );
+		return 1;
+	}
+
+	GPTP_LOG_REGISTER();
+	gptplogSetLevels( "error" );
+
+	sw.connect( sw.addPort( "bench0", LinkLayerAddress( 0x020000000101ULL )),
+		    sw.addPort( "peer0", remote ), 0, 0, 0 );
+	OSNetworkInterfaceFactory::registerFactory
+		( factory_name_t( "default" ),
+		  new LoopbackNetworkInterfaceFactory( &sw ));
+
+	clock = new IEEE1588Clock
+		( false, true, 248, &timerq_factory, NULL, &lock_factory,
+		  ClockServoConfig() );
+	portInit.clock = clock;
+	portInit.index = 1;
+	portInit.timestamper = new SimTimestamper( &sched, &phc, 8 );
+	portInit.net_label = new InterfaceName( (char *) "bench0", 6 );
+	portInit.virtual_label = NULL;
+	portInit.profile = gPTPProfileFactory::createStandardProfile();
+	portInit.isGM = false;
+	portInit.testMode = false;
+	portInit.linkUp = true;
+	portInit.allowNegativeCorrField = false;
+	portInit.initialLogSyncInterval = LOG2_INTERVAL_INVALID;
+	portInit.initialLogPdelayReqInterval = LOG2_INTERVAL_INVALID;
+	portInit.operLogPdelayReqInterval = LOG2_INTERVAL_INVALID;
+	portInit.operLogSyncInterval = LOG2_INTERVAL_INVALID;
+	portInit.condition_factory = &condition_factory;
+	portInit.thread_factory = &thread_factory;
+	portInit.timer_factory = &timer_factory;
+	portInit.lock_factory = &lock_factory;
+	portInit.phy_delay = &no_phy_delay;
+	portInit.syncReceiptThreshold =
+		CommonPort::DEFAULT_SYNC_RECEIPT_THRESH;
+	portInit.neighborPropDelayThreshold =
+		CommonPort::NEIGHBOR_PROP_DELAY_THRESH;
+	port = new EtherPort( &portInit );
+	if( !port->init_port() ) {
+		fprintf( stderr, "Failed to initialize the port\n" );
+		return 1;
+	}
+
+	buildFrame( &frames[0], "Sync", SYNC_MESSAGE,
+		    PTP_COMMON_HDR_LENGTH + PTP_SYNC_LENGTH );
+	buildFrame( &frames[1], "Follow_Up", FOLLOWUP_MESSAGE,
+		    PTP_COMMON_HDR_LENGTH + PTP_FOLLOWUP_LENGTH +
+		    sizeof( FollowUpTLV ));
+	buildFrame( &frames[2], "Pdelay_Req", PATH_DELAY_REQ_MESSAGE,
+		    PTP_COMMON_HDR_LENGTH + PTP_PDELAY_REQ_LENGTH );
+	buildFrame( &frames[3], "Pdelay_Resp", PATH_DELAY_RESP_MESSAGE,
+		    PTP_COMMON_HDR_LENGTH + PTP_PDELAY_RESP_LENGTH );
+	buildFrame( &frames[4], "Pdelay_Resp_Follow_Up",
+		    PATH_DELAY_FOLLOWUP_MESSAGE,
+		    PTP_COMMON_HDR_LENGTH + PTP_PDELAY_FOLLOWUP_LENGTH );
+	buildFrame( &frames[5], "Announce", ANNOUNCE_MESSAGE,
+		    PTP_COMMON_HDR_LENGTH + PTP_ANNOUNCE_LENGTH + 4 +
+		    PTP_CLOCK_IDENTITY_LENGTH );
+
+	for( path = 0; path < 2; ++path ) {
+		uint64_t warmup = 0;
+
+		if( !runPass( port, frames, &remote, path == 0, 1, scratch,
+			      &warmup ) ||
+		    !runPass( port, frames, &remote, path == 0, count,
+			      calls[path], &elapsed[path] ))
+			return 1;
+	}
+
+	PTPMessageCommon::getPoolStats( &stats );
+
+	printf( "%u messages of each type per path, malloc calls/message:\n",
+		count );
+	printf( "%-22s %8s %8s\n", "", "rx", "tx" );
+	for( t = 0; t < MESSAGE_TYPES; ++t )
+		printf( "%-22s %8.3f %8.3f\n", frames[t].name,
+			(double) calls[0][t] / count,
+			(double) calls[1][t] / count );
+	printf( "rx: %6.1f ns/message, tx: %6.1f ns/message\n",
+		(double) elapsed[0] / ( count * MESSAGE_TYPES ),
+		(double) elapsed[1] / ( count * MESSAGE_TYPES ));
+	printf( "pool: %u chunk(s), peak %u blocks, %llu heap fallbacks\n",
+		stats.chunks, stats.high_water,
+		(unsigned long long) stats.heap_fallbacks );
+
+	GPTP_LOG_UNREGISTER();
+
+	return 0;
+}
@@ -0,0 +1,336 @@
+/******************************************************************************
+
+  Copyright (c) 2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+/*
+ * Offline analysis of a Sync capture written by the daemon's -CAPTURE
+ * option. Reads every file of the set, orders the records by number and
+ * replays those of one port into an IngressEventMonitor, as the
+ * measurements the monitor would have taken, with the outlier checks of
+ * IngressEventMonitor::record_sync_ingress(). Then prints the metrics
+ * ClockQualityAnalyzer derives from the monitor and the servo output
+ * over the capture. Files still being written can be read; records
+ * being written are skipped.
+ *
+ * Usage: capture_analyzer [-p <port>] [-w <seconds>] [-c] <path>
+ *
+ *   -p  port to analyze (default: the port of the first record)
+ *   -w  analysis window in seconds ending at the last record (default 0,
+ *       the whole capture)
+ *   -c  print the certification report instead of the compliance report
+ *
+ * <path> is the path given to -CAPTURE, without the .<index> suffix.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "avbts_capture.hpp"
+#include "gptp_clock_quality.hpp"
+
+using namespace OpenAvnu::gPTP;
+
+static void usage( const char *arg0 )
+{
+	fprintf( stderr, "Usage: %s [-p <port>] [-w <seconds>] [-c] <path>\n",
+		 arg0 );
+}
+
+static bool recordBefore
+( const GPTPCaptureRecord &a, const GPTPCaptureRecord &b )
+{
+	return a.sequence < b.sequence;
+}
+
+/* Maps <path>.<index> and checks that it was written in this format */
+static const GPTPCaptureFileHeader *mapFile
+( const char *path, unsigned index, size_t *size )
+{
+	GPTPCaptureFileHeader expected;
+	const GPTPCaptureFileHeader *header;
+	char name[PATH_MAX];
+	struct stat st;
+	void *map;
+	int fd;
+
+	snprintf( name, sizeof(name), "%s.%u", path, index );
+	fd = open( name, O_RDONLY );
+	if( fd == -1 ) {
+		fprintf( stderr, "%s: %s\n", name, strerror( errno ));
+		return NULL;
+	}
+	if( fstat( fd, &st ) != 0 ||
+	    (size_t) st.st_size < GPTP_CAPTURE_HEADER_SIZE ) {
+		fprintf( stderr, "%s: not a capture file\n", name );
+		close( fd );
+		return NULL;
+	}
+	*size = st.st_size;
+	map = mmap( NULL, *size, PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+	if( map == MAP_FAILED ) {
+		fprintf( stderr, "%s: %s\n", name, strerror( errno ));
+		return NULL;
+	}
+	header = (const GPTPCaptureFileHeader *) map;
+
+	memset( &expected, 0, sizeof(expected) );
+	gptpCaptureDescribe( &expected );
+	if( memcmp( header->magic, expected.magic, sizeof(expected.magic) ) != 0 ||
+	    header->byte_order != expected.byte_order ||
+	    header->version != expected.version ) {
+		fprintf( stderr, "%s: not a capture file of this version "
+			 "and byte order\n", name );
+	} else if( header->header_size != expected.header_size ||
+		   header->record_size != expected.record_size ||
+		   header->field_count != expected.field_count ||
+		   memcmp( header->fields, expected.fields,
+			   sizeof(expected.fields) ) != 0 ) {
+		fprintf( stderr, "%s: unexpected record layout\n", name );
+	} else if( header->file_index != index || header->capacity == 0 ||
+		   *size < GPTP_CAPTURE_HEADER_SIZE +
+		   header->capacity * sizeof(GPTPCaptureRecord) ) {
+		fprintf( stderr, "%s: inconsistent header\n", name );
+	} else {
+		return header;
+	}
+	munmap( map, *size );
+	return NULL;
+}
+
+/* Appends the complete records of a file, in slot order. Each record is
+   validated by its sequence; the header counters are only advisory. */
+static void readRecords
+( const GPTPCaptureFileHeader *header, std::vector<GPTPCaptureRecord> &records )
+{
+	const GPTPCaptureRecord *slots = (const GPTPCaptureRecord *)
+		((const char *) header + GPTP_CAPTURE_HEADER_SIZE );
+	uint64_t slot;
+
+	for( slot = 0; slot < header->capacity; ++slot ) {
+		GPTPCaptureRecord record;
+		uint64_t sequence =
+			__atomic_load_n( &slots[slot].sequence, __ATOMIC_ACQUIRE );
+		if( sequence == 0 ) {
+			continue;
+		}
+		memcpy( &record, &slots[slot], sizeof(record) );
+		__atomic_thread_fence( __ATOMIC_ACQUIRE );
+		if( __atomic_load_n( &slots[slot].sequence, __ATOMIC_RELAXED ) !=
+		    sequence ) {
+			continue;
+		}
+
+		/* A record left from an earlier pass over the set is stale */
+		record.sequence = sequence;
+		if( (sequence - 1) % header->capacity != slot ||
+		    (sequence - 1) / header->capacity % header->file_count !=
+		    header->file_index ) {
+			continue;
+		}
+		records.push_back( record );
+	}
+}
+
+int main( int argc, char **argv )
+{
+	std::vector<GPTPCaptureRecord> records;
+	const GPTPCaptureFileHeader *first;
+	uint32_t window_seconds = 0;
+	bool certification = false;
+	int port_number = -1;
+	size_t size;
+	unsigned i;
+	int opt;
+
+	while(( opt = getopt( argc, argv, "p:w:c" )) != -1 ) {
+		switch( opt ) {
+		case 'p':
+			port_number = atoi( optarg );
+			break;
+		case 'w':
+			window_seconds = strtoul( optarg, NULL, 0 );
+			break;
+		case 'c':
+			certification = true;
+			break;
+		default:
+			usage( argv[0] );
+			return 1;
+		}
+	}
+	if( optind + 1 != argc ) {
+		usage( argv[0] );
+		return 1;
+	}
+
+	first = mapFile( argv[optind], 0, &size );
+	if( first == NULL ) {
+		return 1;
+	}
+	for( i = 0; i < first->file_count; ++i ) {
+		const GPTPCaptureFileHeader *header = first;
+		size_t file_size = size;
+
+		if( i > 0 ) {
+			header = mapFile( argv[optind], i, &file_size );
+			if( header == NULL ) {
+				return 1;
+			}
+			if( header->file_count != first->file_count ||
+			    header->capacity != first->capacity ) {
+				fprintf( stderr, "%s.%u: not of the same capture "
+					 "as %s.0\n", argv[optind], i,
+					 argv[optind] );
+				return 1;
+			}
+		}
+		readRecords( header, records );
+		if( i > 0 ) {
+			munmap( (void *) header, file_size );
+		}
+	}
+	std::sort( records.begin(), records.end(), recordBefore );
+
+	printf( "Capture: %s, %u files of %llu records\n", argv[optind],
+		first->file_count, (unsigned long long) first->capacity );
+	printf( "Profile: %.*s, Sync interval 2^%d s\n",
+		(int) sizeof(first->profile_name), first->profile_name,
+		first->log_sync_interval );
+	if( records.empty() ) {
+		printf( "No records\n" );
+		return 0;
+	}
+	printf( "Records: %llu to %llu, %llu missing\n",
+		(unsigned long long) records.front().sequence,
+		(unsigned long long) records.back().sequence,
+		(unsigned long long)
+		( records.back().sequence - records.front().sequence + 1 -
+		  records.size() ));
+	if( port_number < 0 ) {
+		port_number = records.front().port_number;
+	}
+
+	ClockQualityConfig config;
+	config.profile_type = first->profile_type <=
+		static_cast<uint8_t>( ProfileType::AVNU_BASE ) ?
+		static_cast<ProfileType>( first->profile_type ) :
+		ProfileType::STANDARD;
+	config.measurement_interval_ms = first->log_sync_interval >= 0 ?
+		1000u << std::min<int>( first->log_sync_interval, 20 ) :
+		std::max( 1000u >> std::min<int>( -first->log_sync_interval, 31 ), 1u );
+	config.max_history_measurements = records.size();
+	IngressEventMonitor monitor( config );
+	monitor.enable_monitoring( config.measurement_interval_ms );
+
+	/* Local time steps back when the servo steps the clock phase; the
+	   monitor needs timestamps that do not decrease */
+	uint64_t last_timestamp_ns = 0;
+	uint64_t replayed = 0, without_sync = 0, time_steps = 0;
+	uint64_t syntonized = 0, phase_steps = 0;
+	double ppm_sum = 0.0;
+	float ppm_min = 0.0f, ppm_max = 0.0f;
+	for( std::vector<GPTPCaptureRecord>::const_iterator record = records.begin();
+	     record != records.end(); ++record ) {
+		if( record->port_number != port_number ) {
+			continue;
+		}
+		++replayed;
+
+		ClockQualityMeasurement measurement;
+		measurement.timestamp_ns = record->sync_arrival_ns;
+		if( measurement.timestamp_ns < last_timestamp_ns ) {
+			measurement.timestamp_ns = last_timestamp_ns;
+			++time_steps;
+		}
+		last_timestamp_ns = measurement.timestamp_ns;
+		if( record->flags & GPTP_CAPTURE_FLAG_SYNC ) {
+			measurement.t1_master_tx_ns = record->origin_ns;
+			measurement.path_delay_ns = record->link_delay_ns;
+			measurement.correction_field_ns = record->correction_ns;
+		} else {
+			++without_sync;
+		}
+		measurement.t2_slave_rx_ns = record->sync_arrival_ns;
+		measurement.offset_from_master_ns = record->master_offset_ns;
+		measurement.valid = monitor.is_measurement_valid( measurement );
+		monitor.record_measurement( measurement );
+
+		if( record->flags & GPTP_CAPTURE_FLAG_PHASE_STEP ) {
+			++phase_steps;
+		}
+		if( record->flags & GPTP_CAPTURE_FLAG_SYNTONIZED ) {
+			if( syntonized++ == 0 ) {
+				ppm_min = ppm_max = record->ppm;
+			}
+			ppm_min = std::min( ppm_min, record->ppm );
+			ppm_max = std::max( ppm_max, record->ppm );
+			ppm_sum += record->ppm;
+		}
+	}
+
+	printf( "Port %d: %llu records, %llu without Follow_Up values, "
+		"%llu local time steps back\n", port_number,
+		(unsigned long long) replayed, (unsigned long long) without_sync,
+		(unsigned long long) time_steps );
+	if( syntonized > 0 ) {
+		printf( "Servo: %llu adjustments, %llu phase steps, "
+			"ppm %.3f to %.3f, mean %.3f\n",
+			(unsigned long long) syntonized,
+			(unsigned long long) phase_steps, ppm_min, ppm_max,
+			ppm_sum / syntonized );
+	}
+	if( replayed == 0 ) {
+		return 0;
+	}
+	printf( "\n" );
+
+	ClockQualityAnalyzer analyzer( config );
+	ClockQualityMetrics metrics =
+		analyzer.analyze_measurements( monitor, window_seconds, last_timestamp_ns );
+	if( certification ) {
+		printf( "%s", analyzer.generate_certification_report( metrics ).c_str() );
+	} else {
+		printf( "%s", analyzer.generate_compliance_report( metrics ).c_str() );
+	}
+	return 0;
+}
@@ -0,0 +1,659 @@
+/******************************************************************************
+
+  Copyright (c) 2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+/*
+ * Clock quality statistics harness. Feeds synthetic ingress measurements
+ * into an IngressEventMonitor and, after every measurement, compares the
+ * metrics ClockQualityAnalyzer derives from the monitor's incrementally
+ * maintained windows, and from its measurement ring with each supported
+ * set of vectorized kernels, with those of the batch computation over
+ * the measurement history, and the ring's scans with loops over the
+ * history. Stability, which the batch paths recompute over the whole
+ * history, is compared every 97 measurements, and at the end of each
+ * stream against the textbook ADEV, TDEV and MTIE sums. The history is
+ * then exported as TLVs, whole, in Signalling-sized pieces and through a
+ * file, and must import back exactly. Any difference is reported and
+ * makes the exit status non-zero. Then times the three
+ * paths on a full history without stability, and the stability analysis
+ * per sample.
+ *
+ * Synthetic streams, 8 measurements/s:
+ *
+ *   locked     20 ns noise around a 5 ns bias
+ *   acquire    exponential decay from 20 us into lock, then 40 ns noise
+ *   outliers   30 ns noise with 2% of measurements off by up to 1 us
+ *   invalid    10% invalid measurements (missing T1 or path delay > 1 ms)
+ *   offset     50 us constant offset with 10 ns noise
+ *
+ * Usage: clock_quality_bench [-n <measurements>] [-h <history>] [-q <queries>]
+ *
+ *   -n  measurements per stream (default 20000)
+ *   -h  monitor history limit (default 10000)
+ *   -q  queries timed per path (default 1000)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "gptp_clock_quality.hpp"
+#include "gptp_clock_quality_tlv.hpp"
+
+using namespace OpenAvnu::gPTP;
+
+#define INTERVAL_NS 125000000ULL	/* 8 measurements/s */
+#define START_NS 1000000000000ULL	/* first timestamp, 1000 s */
+
+static const uint32_t windows[] = { 0, 10, 300 };
+
+enum Stream { LOCKED, ACQUIRE, OUTLIERS, INVALID, OFFSET, STREAM_COUNT };
+
+static const char *stream_names[] = {
+	"locked", "acquire", "outliers", "invalid", "offset"
+};
+
+static std::vector<const TimeErrorKernels *> supported_kernels;
+
+static double gaussian()
+{
+	double u1 = ( random() + 1.0 ) / ( RAND_MAX + 2.0 );
+	double u2 = ( random() + 1.0 ) / ( RAND_MAX + 2.0 );
+	return sqrt( -2 * log( u1 )) * cos( 2 * M_PI * u2 );
+}
+
+static ClockQualityMeasurement synthesize( Stream stream, uint32_t i )
+{
+	ClockQualityMeasurement m;
+	double error = 0;
+
+	m.timestamp_ns = START_NS + i * INTERVAL_NS;
+	m.t1_master_tx_ns = m.timestamp_ns;
+	m.path_delay_ns = 500;
+	m.valid = true;
+
+	switch( stream ) {
+	case LOCKED:
+		error = 5 + 20 * gaussian();
+		break;
+	case ACQUIRE:
+		error = 20000 * exp( -( i / 40.0 )) + 40 * gaussian();
+		break;
+	case OUTLIERS:
+		error = 30 * gaussian();
+		if( random() % 50 == 0 )
+			error += ( random() % 2000 ) - 1000;
+		break;
+	case INVALID:
+		error = 30 * gaussian();
+		if( random() % 10 == 0 )
+			m.valid = false;
+		break;
+	case OFFSET:
+		error = 50000 + 10 * gaussian();
+		break;
+	default:
+		break;
+	}
+
+	m.offset_from_master_ns = llround( error );
+	m.t2_slave_rx_ns = m.t1_master_tx_ns + m.path_delay_ns +
+		m.offset_from_master_ns;
+	return m;
+}
+
+static bool close_enough( double a, double b )
+{
+	return fabs( a - b ) <= 1e-9 * fmax( 1.0, fmax( fabs( a ), fabs( b )));
+}
+
+#define COMPARE_INT( field )						\
+	if( batch.field != other.field ) {				\
+		fprintf( stderr, "%s: %s differs, batch %lld got %lld\n", \
+			 what, #field, (long long) batch.field,		\
+			 (long long) other.field );			\
+		equal = false;						\
+	}
+
+#define COMPARE_DOUBLE( field )						\
+	if( !close_enough( batch.field, other.field )) {		\
+		fprintf( stderr, "%s: %s differs, batch %.12g got %.12g\n", \
+			 what, #field, batch.field, other.field );	\
+		equal = false;						\
+	}
+
+static bool compare_point
+( const char *what, const TimeStabilityPoint &batch,
+  const TimeStabilityPoint &other )
+{
+	bool equal = true;
+
+	COMPARE_INT( tau_samples );
+	COMPARE_DOUBLE( tau_s );
+	COMPARE_DOUBLE( adev );
+	COMPARE_DOUBLE( tdev_ns );
+	COMPARE_INT( mtie_ns );
+
+	return equal;
+}
+
+/*
+ * Stability covers all measurements since monitoring was enabled, so the
+ * monitor's matches the batch analysis only while nothing has been
+ * dropped from the history.
+ */
+static bool compare
+( const char *what, const ClockQualityMetrics &batch,
+  const ClockQualityMetrics &other, bool compare_stability )
+{
+	bool equal = true;
+
+	COMPARE_INT( mean_time_error_ns );
+	COMPARE_INT( max_time_error_ns );
+	COMPARE_INT( min_time_error_ns );
+	COMPARE_DOUBLE( std_dev_ns );
+	COMPARE_DOUBLE( rms_error_ns );
+	COMPARE_INT( lock_time_seconds );
+	COMPARE_INT( is_locked );
+	COMPARE_INT( observation_window_s );
+	COMPARE_INT( consecutive_good_measurements );
+	COMPARE_INT( total_measurements );
+	COMPARE_INT( outlier_count );
+	COMPARE_INT( meets_80ns_requirement );
+	COMPARE_INT( meets_lock_time_requirement );
+	COMPARE_INT( meets_stability_requirement );
+	COMPARE_INT( measurement_start_time );
+	COMPARE_INT( last_measurement_time );
+
+	if( !compare_stability )
+		return equal;
+	COMPARE_DOUBLE( frequency_stability_ppb );
+	if( batch.stability.size() != other.stability.size()) {
+		fprintf( stderr, "%s: %zu stability points, batch %zu\n", what,
+			 other.stability.size(), batch.stability.size() );
+		return false;
+	}
+	for( size_t k = 0; k < batch.stability.size(); ++k ) {
+		char point[160];
+		snprintf( point, sizeof( point ), "%s tau %u", what,
+			  batch.stability[k].tau_samples );
+		equal &= compare_point( point, batch.stability[k],
+					other.stability[k] );
+	}
+
+	return equal;
+}
+
+/*
+ * Checks the ring's scans against the history over a range starting at
+ * a varying offset, so that ranges wrapping around the ring end are
+ * covered.
+ */
+static bool compare_scans
+( const char *name, uint32_t i, const std::deque<ClockQualityMeasurement> &history,
+  const MeasurementRing &ring, int64_t target_accuracy_ns )
+{
+	size_t first = i % ( history.size() + 1 );
+	size_t count = history.size() - first;
+	uint32_t within = 0, valid = 0, valid_within = 0;
+	bool equal = true;
+
+	for( size_t j = first; j < history.size(); ++j ) {
+		int64_t error = history[j].offset_from_master_ns;
+		within += llabs( error ) <= 80;
+		valid += history[j].valid;
+		valid_within += history[j].valid &&
+			llabs( error ) <= target_accuracy_ns;
+	}
+
+	if( ring.count_within( first, count, 80 ) != within ||
+	    ring.count_valid( first, count ) != valid ||
+	    ring.count_valid_within( first, count, target_accuracy_ns ) !=
+	    valid_within ) {
+		fprintf( stderr, "%s #%u: ring scans differ from history\n",
+			 name, i );
+		equal = false;
+	}
+
+	return equal;
+}
+
+/*
+ * ADEV, TDEV and MTIE of the valid measurements straight from their
+ * definitions, O(n tau) per octave
+ */
+static std::vector<TimeStabilityPoint> reference_stability
+( const std::deque<ClockQualityMeasurement> &history, double nominal_interval_s )
+{
+	std::vector<TimeStabilityPoint> points;
+	std::vector<int64_t> x;
+	uint64_t first_ns = 0, last_ns = 0;
+
+	for( const ClockQualityMeasurement &m : history ) {
+		if( !m.valid )
+			continue;
+		if( x.empty() )
+			first_ns = m.timestamp_ns;
+		last_ns = m.timestamp_ns;
+		x.push_back( m.offset_from_master_ns );
+	}
+	size_t n = x.size();
+	double interval_s = n >= 2 && last_ns > first_ns ?
+		( last_ns - first_ns ) / 1e9 / ( n - 1 ) : nominal_interval_s;
+
+	for( uint32_t k = 0; k < TimeStabilityAnalyzer::DEFAULT_OCTAVES; ++k ) {
+		size_t m = (size_t) 1 << k;
+		if( n < 3 * m )
+			break;
+
+		double adev_sum = 0, tdev_sum = 0;
+		int64_t mtie = 0;
+		for( size_t i = 0; i + 2 * m < n; ++i ) {
+			double d = x[i + 2 * m] - 2 * x[i + m] + x[i];
+			adev_sum += d * d;
+		}
+		for( size_t j = 0; j + 3 * m <= n; ++j ) {
+			int64_t sum = 0;
+			for( size_t i = j; i < j + m; ++i )
+				sum += x[i + 2 * m] - 2 * x[i + m] + x[i];
+			tdev_sum += (double) sum * sum;
+		}
+		for( size_t j = 0; j + m < n; ++j ) {
+			auto range = std::minmax_element
+				( x.begin() + j, x.begin() + j + m + 1 );
+			mtie = std::max( mtie, *range.second - *range.first );
+		}
+
+		TimeStabilityPoint point;
+		point.tau_samples = m;
+		point.tau_s = m * interval_s;
+		point.adev = sqrt( adev_sum / ( 2.0 * ( n - 2 * m ))) / 1e9 /
+			point.tau_s;
+		point.tdev_ns = sqrt( tdev_sum / ( 6.0 * m * m * ( n - 3 * m + 1 )));
+		point.mtie_ns = mtie;
+		points.push_back( point );
+	}
+	return points;
+}
+
+static bool same_history
+( const char *what, const std::deque<ClockQualityMeasurement> &expected,
+  const std::deque<ClockQualityMeasurement> &imported )
+{
+	if( expected.size() != imported.size()) {
+		fprintf( stderr, "%s: imported %zu measurements, exported %zu\n",
+			 what, imported.size(), expected.size() );
+		return false;
+	}
+	for( size_t i = 0; i < expected.size(); ++i ) {
+		const ClockQualityMeasurement &a = expected[i], &b = imported[i];
+		if( a.timestamp_ns != b.timestamp_ns ||
+		    a.t1_master_tx_ns != b.t1_master_tx_ns ||
+		    a.t2_slave_rx_ns != b.t2_slave_rx_ns ||
+		    a.path_delay_ns != b.path_delay_ns ||
+		    a.offset_from_master_ns != b.offset_from_master_ns ||
+		    a.correction_field_ns != b.correction_field_ns ||
+		    a.valid != b.valid ) {
+			fprintf( stderr, "%s: measurement %zu differs after "
+				 "import\n", what, i );
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool import_matches
+( const char *what, const std::vector<uint8_t> &tlv_data,
+  const std::deque<ClockQualityMeasurement> &history,
+  const ClockQualityConfig &config )
+{
+	IngressEventMonitor imported( config );
+	if( !imported.import_tlv_data( tlv_data )) {
+		fprintf( stderr, "%s: import failed\n", what );
+		return false;
+	}
+	return same_history( what, history, imported.get_measurement_history() );
+}
+
+/*
+ * Exports the monitor's history whole, in Signalling-sized TLVs and
+ * through a file, and imports each back into a fresh monitor
+ */
+static uint32_t verify_tlv
+( Stream stream, const IngressEventMonitor &monitor,
+  const ClockQualityConfig &config )
+{
+	std::deque<ClockQualityMeasurement> history =
+		monitor.get_measurement_history();
+	const char *name = stream_names[stream];
+	uint32_t failures = 0;
+	char what[64];
+
+	std::vector<uint8_t> whole = monitor.export_tlv_data();
+	snprintf( what, sizeof( what ), "%s TLV", name );
+	failures += !import_matches( what, whole, history, config );
+
+	/* Every piece must be even and fit a Signalling message */
+	std::vector<uint8_t> pieces;
+	ClockQualityTlvVectorSink vector_sink( pieces );
+	monitor.export_tlv_data( vector_sink, CLOCK_QUALITY_TLV_SIGNALLING_LENGTH );
+	size_t tlv_count = 0;
+	for( size_t pos = 0; pos + 4 <= pieces.size(); ++tlv_count ) {
+		size_t length = pieces[pos + 2] << 8 | pieces[pos + 3];
+		if( length > CLOCK_QUALITY_TLV_SIGNALLING_LENGTH ||
+		    length % 2 != 0 ) {
+			fprintf( stderr, "%s Signalling TLV: length %zu\n",
+				 name, length );
+			++failures;
+		}
+		pos += 4 + length;
+	}
+	snprintf( what, sizeof( what ), "%s Signalling TLVs", name );
+	failures += !import_matches( what, pieces, history, config );
+
+	FILE *file = tmpfile();
+	std::vector<uint8_t> read_back( whole.size() + 1 );
+	ClockQualityTlvFileSink file_sink( file );
+	monitor.export_tlv_data( file_sink, CLOCK_QUALITY_TLV_MAX_LENGTH );
+	rewind( file );
+	read_back.resize( fread( read_back.data(), 1, read_back.size(), file ));
+	fclose( file );
+	snprintf( what, sizeof( what ), "%s TLV file", name );
+	failures += !import_matches( what, read_back, history, config );
+
+	/* A truncated export must import nothing */
+	IngressEventMonitor truncated( config );
+	whole.pop_back();
+	if( truncated.import_tlv_data( whole ) ||
+	    truncated.get_measurement_count() != 0 ) {
+		fprintf( stderr, "%s: truncated TLV imported\n", name );
+		++failures;
+	}
+
+	printf( "%-10s TLV round trip, %.1f bytes/measurement, %zu "
+		"Signalling TLVs\n", name, (double) read_back.size() /
+		history.size(), tlv_count );
+	return failures;
+}
+
+static uint64_t elapsed_ns( const struct timespec &start )
+{
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return ( now.tv_sec - start.tv_sec ) * 1000000000ULL +
+		now.tv_nsec - start.tv_nsec;
+}
+
+/*
+ * Queries at the newest measurement and, every 97 measurements, at a
+ * time between measurements and at an earlier time, which the monitor
+ * has to handle by replaying its history.
+ */
+static uint32_t verify
+( Stream stream, uint32_t count, const ClockQualityConfig &config )
+{
+	ClockQualityConfig statistics_config = config;
+	statistics_config.stability_analysis_enabled = false;
+	IngressEventMonitor monitor( config );
+	ClockQualityAnalyzer full_analyzer( config );
+	ClockQualityAnalyzer statistics_analyzer( statistics_config );
+	uint32_t failures = 0;
+	char what[128];
+
+	srandom( 1 + stream );
+	monitor.enable_monitoring( config.measurement_interval_ms );
+
+	for( uint32_t i = 0; i < count; ++i ) {
+		ClockQualityMeasurement m = synthesize( stream, i );
+		monitor.record_measurement( m );
+
+		uint64_t now[3] = { m.timestamp_ns, 0, 0 };
+		int queries = 1;
+		const ClockQualityAnalyzer &analyzer = i % 97 == 0 ?
+			full_analyzer : statistics_analyzer;
+		if( i % 97 == 0 ) {
+			now[queries++] = m.timestamp_ns + INTERVAL_NS / 2;
+			now[queries++] = m.timestamp_ns - 7 * INTERVAL_NS;
+		}
+
+		std::deque<ClockQualityMeasurement> history =
+			monitor.get_measurement_history();
+		if( !compare_scans( stream_names[stream], i, history,
+				    monitor.get_measurement_ring(),
+				    config.target_accuracy_ns ))
+			++failures;
+
+		for( int q = 0; q < queries; ++q ) {
+			for( uint32_t window : windows ) {
+				ClockQualityMetrics batch =
+					analyzer.analyze_measurements
+					( history, window, now[q] );
+				ClockQualityMetrics streaming =
+					analyzer.analyze_measurements
+					( monitor, window, now[q] );
+
+				snprintf( what, sizeof( what ),
+					  "%s #%u window %us", stream_names[stream],
+					  i, window );
+				if( !compare( what, batch, streaming,
+					      i < config.max_history_measurements ))
+					++failures;
+
+				/* The ring analysis with every kernel set */
+				for( const TimeErrorKernels *kernels :
+					     supported_kernels ) {
+					select_time_error_kernels
+						( kernels->isa );
+					ClockQualityMetrics scanned =
+						analyzer.analyze_measurements
+						( monitor.get_measurement_ring(),
+						  window, now[q] );
+					snprintf( what, sizeof( what ),
+						  "%s #%u window %us ring %s",
+						  stream_names[stream], i,
+						  window, kernels->name );
+					if( !compare( what, batch, scanned, true ))
+						++failures;
+				}
+			}
+		}
+	}
+
+	/* The streaming sums, reordered, agree with the textbook ones to rounding */
+	std::deque<ClockQualityMeasurement> history =
+		monitor.get_measurement_history();
+	std::vector<TimeStabilityPoint> reference = reference_stability
+		( history, config.measurement_interval_ms / 1000.0 );
+	ClockQualityMetrics batch = full_analyzer.analyze_measurements( history );
+	for( size_t k = 0; k < reference.size(); ++k ) {
+		const TimeStabilityPoint &point = k < batch.stability.size() ?
+			batch.stability[k] : TimeStabilityPoint();
+		if( k >= batch.stability.size() ||
+		    point.tau_samples != reference[k].tau_samples ||
+		    fabs( point.adev - reference[k].adev ) >
+		    1e-9 * reference[k].adev ||
+		    fabs( point.tdev_ns - reference[k].tdev_ns ) >
+		    1e-9 * reference[k].tdev_ns ||
+		    point.mtie_ns != reference[k].mtie_ns ) {
+			fprintf( stderr, "%s: stability at tau %u differs from "
+				 "reference, ADEV %.9g/%.9g TDEV %.9g/%.9g "
+				 "MTIE %lld/%lld\n", stream_names[stream],
+				 reference[k].tau_samples, point.adev,
+				 reference[k].adev, point.tdev_ns,
+				 reference[k].tdev_ns, (long long) point.mtie_ns,
+				 (long long) reference[k].mtie_ns );
+			++failures;
+		}
+	}
+	if( reference.size() != batch.stability.size()) {
+		fprintf( stderr, "%s: %zu stability points, reference %zu\n",
+			 stream_names[stream], batch.stability.size(),
+			 reference.size() );
+		++failures;
+	}
+
+	failures += verify_tlv( stream, monitor, config );
+
+	return failures;
+}
+
+static void benchmark( uint32_t history, uint32_t queries )
+{
+	ClockQualityConfig config;
+	config.max_history_measurements = history;
+	config.stability_analysis_enabled = false;
+	IngressEventMonitor monitor( config );
+	ClockQualityAnalyzer analyzer( config );
+	struct timespec start;
+	uint64_t now = 0;
+	volatile int64_t sink = 0;
+
+	srandom( 1 );
+	monitor.enable_monitoring( config.measurement_interval_ms );
+	for( uint32_t i = 0; i < history; ++i ) {
+		ClockQualityMeasurement m = synthesize( LOCKED, i );
+		monitor.record_measurement( m );
+		now = m.timestamp_ns;
+	}
+
+	std::deque<ClockQualityMeasurement> snapshot =
+		monitor.get_measurement_history();
+
+	for( uint32_t window : windows ) {
+		uint64_t batch_ns, ring_ns, streaming_ns;
+
+		clock_gettime( CLOCK_MONOTONIC, &start );
+		for( uint32_t q = 0; q < queries; ++q )
+			sink += analyzer.analyze_measurements
+				( snapshot, window, now ).mean_time_error_ns;
+		batch_ns = elapsed_ns( start );
+
+		clock_gettime( CLOCK_MONOTONIC, &start );
+		for( uint32_t q = 0; q < queries; ++q )
+			sink += analyzer.analyze_measurements
+				( monitor.get_measurement_ring(), window,
+				  now ).mean_time_error_ns;
+		ring_ns = elapsed_ns( start );
+
+		/* One measurement per query, so the windows have to move */
+		clock_gettime( CLOCK_MONOTONIC, &start );
+		for( uint32_t q = 0; q < queries; ++q ) {
+			ClockQualityMeasurement m =
+				synthesize( LOCKED, history + q );
+			monitor.record_measurement( m );
+			sink += analyzer.analyze_measurements
+				( monitor, window,
+				  m.timestamp_ns ).mean_time_error_ns;
+		}
+		streaming_ns = elapsed_ns( start );
+		history += queries;
+
+		printf( "window %4us: batch %9.1f us/query, ring %s %7.2f "
+			"us/query, streaming %5.2f us/query (with insert)\n",
+			window, batch_ns / 1000.0 / queries,
+			get_time_error_kernels().name,
+			ring_ns / 1000.0 / queries,
+			streaming_ns / 1000.0 / queries );
+	}
+
+	TimeStabilityAnalyzer stability;
+	uint32_t samples = 1000000;
+	clock_gettime( CLOCK_MONOTONIC, &start );
+	for( uint32_t i = 0; i < samples; ++i )
+		stability.add_sample( START_NS + i * INTERVAL_NS,
+				      ( i * 2654435761U ) % 41 );
+	printf( "stability: %.1f ns/sample over %u octaves\n",
+		elapsed_ns( start ) / (double) samples,
+		TimeStabilityAnalyzer::DEFAULT_OCTAVES );
+	sink += stability.get_results( 0.125 ).size();
+}
+
+int main( int argc, char **argv )
+{
+	uint32_t count = 20000;
+	uint32_t history = 10000;
+	uint32_t queries = 1000;
+	uint32_t failures = 0;
+	int c;
+
+	while(( c = getopt( argc, argv, "n:h:q:" )) != -1 ) {
+		switch( c ) {
+		case 'n':
+			count = strtoul( optarg, NULL, 0 );
+			break;
+		case 'h':
+			history = strtoul( optarg, NULL, 0 );
+			break;
+		case 'q':
+			queries = strtoul( optarg, NULL, 0 );
+			break;
+		default:
+			fprintf( stderr, "Usage: %s [-n <measurements>] "
+				 "[-h <history>] [-q <queries>]\n", argv[0] );
+			return 1;
+		}
+	}
+
+	const TimeErrorKernelIsa isas[] = {
+		TimeErrorKernelIsa::SCALAR, TimeErrorKernelIsa::SSE2,
+		TimeErrorKernelIsa::AVX2
+	};
+	const TimeErrorKernels &preferred = get_time_error_kernels();
+	for( TimeErrorKernelIsa isa : isas ) {
+		if( get_time_error_kernels( isa ) != NULL )
+			supported_kernels.push_back
+				( get_time_error_kernels( isa ));
+	}
+
+	ClockQualityConfig config;
+	config.max_history_measurements = history;
+
+	for( int stream = 0; stream < STREAM_COUNT; ++stream ) {
+		uint32_t stream_failures =
+			verify( (Stream) stream, count, config );
+		printf( "%-10s %u measurements, %s\n", stream_names[stream],
+			count, stream_failures == 0 ? "streaming and ring match batch" :
+			"MISMATCH" );
+		failures += stream_failures;
+	}
+	select_time_error_kernels( preferred.isa );
+
+	benchmark( history, queries );
+
+	return failures == 0 ? 0 : 1;
+}
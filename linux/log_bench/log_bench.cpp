@@ -0,0 +1,211 @@
+/******************************************************************************
+
+  Copyright (c) 2009-2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+/*
+ * Measures the cost of the GPTP_LOG_* macros on the calling thread, per
+ * call of a function with three DEBUG sites (see log_sites.cpp):
+ *
+ *  compiled out:      GPTP_LOG_COMPILE_LEVEL below DEBUG, sites removed
+ *  runtime disabled:  compiled in, timer subsystem level set to STATUS
+ *  enabled (async):   compiled in and enabled, records queued to the
+ *                     background writer (output goes to /dev/null)
+ *
+ * An empty loop is timed as the baseline. "evaluated" shows whether the
+ * arguments of disabled sites were computed.
+ *
+ * Before timing, messages with every integer length modifier the daemon
+ * uses, including glibc's %Ld and %qd for long long, are logged through
+ * the background writer and must read back exactly as snprintf()
+ * formats them. The writer sleeps until a record arrives, so they must
+ * also be written within a second, without gptplogUnregister() flushing
+ * them. Any failure exits with status 2.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "gptp_log.hpp"
+
+#define ITERATIONS 1000000UL
+#define ASYNC_ITERATIONS 100000UL
+
+volatile uint64_t evaluated = 0;
+
+void runSitesOn( unsigned long iterations );
+void runSitesOff( unsigned long iterations );
+
+static void emptyLoop( unsigned long iterations )
+{
+	for( unsigned long i = 0; i < iterations; ++i )
+		__asm__ __volatile__( "" );
+}
+
+static double nowNs()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run
+( const char *name, void (*fn)( unsigned long ), unsigned long iterations )
+{
+	uint64_t before = evaluated;
+	double start = nowNs();
+
+	fn( iterations );
+
+	double ns = ( nowNs() - start ) / iterations;
+	printf( "%-18s %8.2f ns/call  arguments evaluated %llu times\n", name,
+		ns, (unsigned long long)( evaluated - before ));
+}
+
+#define FORMAT_CHECKS 3
+
+static const char *const check_formats[FORMAT_CHECKS] = {
+	"%Ld %Lu %Lx",
+	"%qd %qu",
+	"%lld %ld %d %hd %zu %jd",
+};
+
+/* Logs check i and formats the text it must read back as */
+#define LOG_CHECK( i, ... )						\
+	do {								\
+		snprintf( expected[i], sizeof( expected[i] ),		\
+			  check_formats[i], __VA_ARGS__ );		\
+		gptpLog( GPTP_LOG_LVL_ERROR, "CHECK", NULL, 0,		\
+			 check_formats[i], __VA_ARGS__ );		\
+	} while( 0 )
+
+static unsigned countLines( const char *path )
+{
+	unsigned lines = 0;
+	FILE *in = fopen( path, "r" );
+	int c;
+
+	if( in == NULL )
+		return 0;
+	while(( c = fgetc( in )) != EOF )
+		lines += ( c == '\n' );
+	fclose( in );
+
+	return lines;
+}
+
+/*
+ * Logs check_formats[] through the background writer into a temporary
+ * file, waits for the writer to write them, and compares each line with
+ * the snprintf() output. Leaves stderr on /dev/null.
+ */
+static bool checkFormats()
+{
+	char expected[FORMAT_CHECKS][128];
+	char path[] = "/tmp/log_bench.XXXXXX";
+	char line[256];
+	bool ok = true;
+	FILE *in;
+	int fd, i, waited;
+
+	fd = mkstemp( path );
+	if( fd == -1 || freopen( path, "w", stderr ) == NULL )
+		return false;
+	close( fd );
+
+	gptplogRegister();
+	LOG_CHECK( 0, (long long) -1234567890123LL, 18446744073709551615ULL,
+		   0xfedcba9876543210ULL );
+	LOG_CHECK( 1, (long long) INT64_MIN, (unsigned long long) UINT64_MAX );
+	LOG_CHECK( 2, (long long) -9000000000LL, -7L, -3, (short) -2,
+		   (size_t) 42, (intmax_t) -1 );
+	for( waited = 0; waited < 1000 && countLines( path ) < FORMAT_CHECKS;
+	     ++waited )
+		usleep( 1000 );
+	if( waited == 1000 ) {
+		printf( "The writer did not write the records within 1 s\n" );
+		ok = false;
+	}
+	gptplogUnregister();
+
+	if( freopen( "/dev/null", "w", stderr ) == NULL )
+		return false;
+	in = fopen( path, "r" );
+	unlink( path );
+	if( in == NULL )
+		return false;
+	for( i = 0; i < FORMAT_CHECKS; ++i ) {
+		const char *msg;
+
+		if( fgets( line, sizeof( line ), in ) == NULL ) {
+			printf( "\"%s\" was not logged\n", check_formats[i] );
+			ok = false;
+			break;
+		}
+		line[strcspn( line, "\n" )] = '\0';
+		msg = strstr( line, "] " );
+		if( msg == NULL || strcmp( msg + 2, expected[i] ) != 0 ) {
+			printf( "\"%s\" logged as \"%s\", expected \"%s\"\n",
+				check_formats[i], msg ? msg + 2 : line,
+				expected[i] );
+			ok = false;
+		}
+	}
+	fclose( in );
+
+	return ok;
+}
+
+int main( void )
+{
+	if( !checkFormats() ) {
+		printf( "FAIL: formats differ through the background writer\n" );
+		return 2;
+	}
+
+	run( "baseline", emptyLoop, ITERATIONS );
+	run( "compiled out", runSitesOff, ITERATIONS );
+
+	gptplogSetLevel( GPTP_LOG_SUBSYS_TIMER, GPTP_LOG_LVL_STATUS );
+	run( "runtime disabled", runSitesOn, ITERATIONS );
+
+	gptplogRegister();
+	gptplogSetLevel( GPTP_LOG_SUBSYS_TIMER, GPTP_LOG_LVL_VERBOSE );
+	run( "enabled (async)", runSitesOn, ASYNC_ITERATIONS );
+	gptplogUnregister();
+
+	return 0;
+}
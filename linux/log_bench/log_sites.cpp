@@ -0,0 +1,73 @@
+/******************************************************************************
+
+  Copyright (c) 2009-2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+/*
+ * Log sites timed by log_bench. Built twice, once with every level
+ * compiled in (SITES_LEVEL=7, runSitesOn) and once with SITES_LEVEL=5
+ * (runSitesOff), where the DEBUG sites below expand to nothing.
+ * SITES_LEVEL overrides the GPTP_LOG_COMPILE_LEVEL the daemon is built
+ * with.
+ *
+ * The loop mirrors IEEE1588Clock::addEventTimerLocked(): several DEBUG
+ * lines per call whose arguments include a function call. evaluated
+ * counts how often that argument was actually computed.
+ */
+
+#include <stdint.h>
+
+#undef GPTP_LOG_COMPILE_LEVEL
+#define GPTP_LOG_COMPILE_LEVEL SITES_LEVEL
+#include "gptp_log.hpp"
+
+#undef GPTP_LOG_SUBSYSTEM
+#define GPTP_LOG_SUBSYSTEM GPTP_LOG_SUBSYS_TIMER
+
+extern volatile uint64_t evaluated;
+
+static inline uint64_t threadId()
+{
+	return ++evaluated;
+}
+
+void SITES_FN( unsigned long iterations )
+{
+	for( unsigned long i = 0; i < iterations; ++i ) {
+		GPTP_LOG_DEBUG( "addEventTimerLocked: target=%p, event=%d, "
+				"time_ns=%llu, thread_id=%llu", (void *) &i,
+				(int) i, (unsigned long long) i * 1000,
+				(unsigned long long) threadId() );
+		GPTP_LOG_DEBUG( "addEventTimerLocked: lock acquired" );
+		GPTP_LOG_DEBUG( "addEventTimerLocked: lock released (%d)",
+				(int) i );
+	}
+}
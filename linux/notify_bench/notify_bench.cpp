@@ -0,0 +1,343 @@
+/******************************************************************************
+
+  Copyright (c) 2009-2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+/*
+ * Checks and times the change notification path (change log in the
+ * shared memory segment, futex wakeup and the change log socket) against
+ * a synthetic daemon:
+ *
+ *  latency: events are raised 1 ms apart; three consumers report the
+ *           delay from raising an event to having read it, and the CPU
+ *           time they used:
+ *             futex   sleeps in LinuxSharedMemoryReader::waitForEvent()
+ *             socket  reads the LinuxChangeLogServer socket
+ *             poll    checks the counter every 100 us, as a client
+ *                     polling the segment would
+ *  burst:   events are raised back to back; the futex consumer must
+ *           account for every event as read or lost, and a socket
+ *           client that does not read must be disconnected rather than
+ *           slow down the writer
+ *
+ * The segment and the socket are created under private names; the
+ * daemon's /ptp segment is not touched.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "linux_shm_reader.hpp"
+#include "linux_change_log.hpp"
+
+#define BENCH_SHM_NAME SHM_NAME "_notify_bench"
+#define BENCH_SOCKET "/tmp/gptp_notify_bench.sock"
+#define LATENCY_EVENTS 2000
+#define LATENCY_SPACING_NS 1000000
+#define POLL_INTERVAL_US 100
+#define BURST_EVENTS 100000
+
+static gPtpShmSegment *segment;
+static LinuxChangeLogServer server;
+static volatile bool consumers_stop;
+
+struct ConsumerResult {
+	int fd;
+	uint32_t first;
+	std::vector<int64_t> latency;
+	uint32_t received;
+	uint32_t lost;
+	uint64_t cpu_ns;
+	bool disconnected;
+};
+
+static int64_t clockNs( clockid_t clk )
+{
+	struct timespec ts;
+	clock_gettime( clk, &ts );
+	return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static gPtpShmSegment *createSegment( const char *name )
+{
+	int fd = shm_open( name, O_RDWR | O_CREAT, 0600 );
+	if( fd < 0 || ftruncate( fd, SHM_SIZE ) < 0 )
+		return NULL;
+	void *addr = mmap( NULL, SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	close( fd );
+	if( addr == MAP_FAILED )
+		return NULL;
+
+	gPtpShmSegment *seg = (gPtpShmSegment *) addr;
+	memset( seg, 0, SHM_SIZE );
+	seg->header.version = GPTP_SHM_VERSION;
+	seg->header.data_size = sizeof( gPtpTimeData );
+	seg->header.slot_size = sizeof( gPtpShmPortSlot );
+	seg->header.port_slots = GPTP_SHM_PORT_SLOTS;
+	seg->header.event_size = sizeof( gPtpChangeEvent );
+	seg->header.event_log = GPTP_SHM_EVENT_LOG;
+	__atomic_store_n( &seg->header.magic, GPTP_SHM_MAGIC, __ATOMIC_RELEASE );
+
+	return seg;
+}
+
+/* What LinuxSharedMemoryIPC does for each change */
+static void raiseEvent( uint8_t type, int64_t value )
+{
+	gPtpChangeEvent event;
+
+	memset( &event, 0, sizeof( event ));
+	event.port_number = 1;
+	event.type = type;
+	event.value = value;
+	// The consumers measure latency against this
+	event.local_time = clockNs( CLOCK_MONOTONIC );
+	gptpShmEventWrite( segment, &event );
+	syscall( SYS_futex, &segment->events.counter, FUTEX_WAKE, INT_MAX,
+		 NULL, NULL, 0 );
+	server.notify();
+}
+
+static void record( ConsumerResult *result, const gPtpChangeEvent *event )
+{
+	result->latency.push_back( clockNs( CLOCK_MONOTONIC ) - (int64_t) event->local_time );
+	++result->received;
+}
+
+static void *futexConsumer( void *arg )
+{
+	ConsumerResult *result = (ConsumerResult *) arg;
+	LinuxSharedMemoryReader reader;
+	gPtpChangeEvent event;
+	uint32_t last;
+
+	if( !reader.open( BENCH_SHM_NAME )) {
+		fprintf( stderr, "futex consumer cannot map the segment\n" );
+		return NULL;
+	}
+	last = reader.eventCount();
+	while( !consumers_stop ) {
+		if( !reader.waitForEvent( last, 100 ))
+			continue;
+		while( reader.readEvent( &last, &event, GPTP_EVENT_ALL, &result->lost ))
+			record( result, &event );
+	}
+	result->cpu_ns = clockNs( CLOCK_THREAD_CPUTIME_ID );
+	return NULL;
+}
+
+static void *pollConsumer( void *arg )
+{
+	ConsumerResult *result = (ConsumerResult *) arg;
+	LinuxSharedMemoryReader reader;
+	gPtpChangeEvent event;
+	uint32_t last;
+
+	if( !reader.open( BENCH_SHM_NAME )) {
+		fprintf( stderr, "poll consumer cannot map the segment\n" );
+		return NULL;
+	}
+	last = reader.eventCount();
+	while( !consumers_stop ) {
+		while( reader.readEvent( &last, &event, GPTP_EVENT_ALL, &result->lost ))
+			record( result, &event );
+		usleep( POLL_INTERVAL_US );
+	}
+	result->cpu_ns = clockNs( CLOCK_THREAD_CPUTIME_ID );
+	return NULL;
+}
+
+static void *socketConsumer( void *arg )
+{
+	ConsumerResult *result = (ConsumerResult *) arg;
+	gPtpChangeEvent event;
+	uint32_t expected = result->first;
+
+	while( read( result->fd, &event, sizeof( event )) == (ssize_t) sizeof( event )) {
+		if( event.sequence != expected )
+			result->lost += event.sequence - expected;
+		expected = event.sequence + 1;
+		record( result, &event );
+	}
+	result->disconnected = !consumers_stop;
+	result->cpu_ns = clockNs( CLOCK_THREAD_CPUTIME_ID );
+	close( result->fd );
+	return NULL;
+}
+
+static int64_t percentile( std::vector<int64_t> &v, double p )
+{
+	if( v.empty() )
+		return 0;
+	std::sort( v.begin(), v.end() );
+	return v[(size_t) ( p * ( v.size() - 1 ))];
+}
+
+static void report( const char *name, ConsumerResult *result, double seconds )
+{
+	printf( "latency:   %-6s  %5u events, %u lost, median %6.1f us, "
+		"p99 %6.1f us, max %7.1f us, CPU %5.2f%%\n",
+		name, result->received, result->lost,
+		percentile( result->latency, 0.5 ) / 1000.0,
+		percentile( result->latency, 0.99 ) / 1000.0,
+		percentile( result->latency, 1.0 ) / 1000.0,
+		result->cpu_ns / 1e7 / seconds );
+}
+
+/*
+ * Connects to the server and waits until it has accepted the client,
+ * which then gets the events after the current one
+ */
+static void connectClient( ConsumerResult *result )
+{
+	result->fd = gptpChangeLogConnect( BENCH_SOCKET );
+	if( result->fd < 0 ) {
+		perror( "connect " BENCH_SOCKET );
+		exit( 1 );
+	}
+	usleep( 10000 );
+	result->first = __atomic_load_n( &segment->events.counter, __ATOMIC_ACQUIRE ) + 1;
+}
+
+static bool latencyTest()
+{
+	ConsumerResult futex_result = ConsumerResult();
+	ConsumerResult poll_result = ConsumerResult();
+	ConsumerResult socket_result = ConsumerResult();
+	pthread_t futex_thread, poll_thread, socket_thread;
+	int64_t start, next;
+	double seconds;
+
+	consumers_stop = false;
+	pthread_create( &futex_thread, NULL, futexConsumer, &futex_result );
+	pthread_create( &poll_thread, NULL, pollConsumer, &poll_result );
+	connectClient( &socket_result );
+	pthread_create( &socket_thread, NULL, socketConsumer, &socket_result );
+
+	start = next = clockNs( CLOCK_MONOTONIC );
+	for( int i = 0; i < LATENCY_EVENTS; ++i ) {
+		struct timespec ts;
+
+		next += LATENCY_SPACING_NS;
+		ts.tv_sec = next / 1000000000LL;
+		ts.tv_nsec = next % 1000000000LL;
+		clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL );
+		raiseEvent( 1 << ( i % 4 ), i );
+	}
+	usleep( 10000 );
+	seconds = ( clockNs( CLOCK_MONOTONIC ) - start ) / 1e9;
+
+	consumers_stop = true;
+	pthread_join( futex_thread, NULL );
+	pthread_join( poll_thread, NULL );
+	server.stop();
+	pthread_join( socket_thread, NULL );
+
+	report( "futex", &futex_result, seconds );
+	report( "socket", &socket_result, seconds );
+	report( "poll", &poll_result, seconds );
+
+	return futex_result.received == LATENCY_EVENTS && futex_result.lost == 0 &&
+		socket_result.received == LATENCY_EVENTS && socket_result.lost == 0 &&
+		poll_result.received + poll_result.lost == LATENCY_EVENTS;
+}
+
+static bool burstTest()
+{
+	ConsumerResult futex_result = ConsumerResult();
+	ConsumerResult socket_result = ConsumerResult();
+	pthread_t futex_thread, socket_thread;
+	int64_t start, elapsed;
+
+	if( !server.start( BENCH_SOCKET, getgid(), segment ))
+		return false;
+
+	consumers_stop = false;
+	pthread_create( &futex_thread, NULL, futexConsumer, &futex_result );
+	// This client does not read until the burst is over
+	connectClient( &socket_result );
+
+	start = clockNs( CLOCK_MONOTONIC );
+	for( int i = 0; i < BURST_EVENTS; ++i )
+		raiseEvent( GPTP_EVENT_PORT_STATE, i );
+	elapsed = clockNs( CLOCK_MONOTONIC ) - start;
+	usleep( 100000 );
+
+	// Reads what was queued before the server gave up on the client
+	pthread_create( &socket_thread, NULL, socketConsumer, &socket_result );
+	usleep( 100000 );
+	consumers_stop = true;
+	pthread_join( futex_thread, NULL );
+	server.stop();
+	pthread_join( socket_thread, NULL );
+
+	printf( "burst:     %u events raised in %.1f ms, %.2f us each\n",
+		BURST_EVENTS, elapsed / 1e6, elapsed / 1e3 / BURST_EVENTS );
+	printf( "burst:     futex   %u read, %u lost\n",
+		futex_result.received, futex_result.lost );
+	printf( "burst:     stalled socket client %s after %u events\n",
+		socket_result.disconnected ? "disconnected" : "still connected",
+		socket_result.received );
+
+	return futex_result.received + futex_result.lost == BURST_EVENTS &&
+		socket_result.disconnected;
+}
+
+int main()
+{
+	bool ok;
+
+	segment = createSegment( BENCH_SHM_NAME );
+	if( segment == NULL ) {
+		perror( "shm_open " BENCH_SHM_NAME );
+		return 1;
+	}
+	if( !server.start( BENCH_SOCKET, getgid(), segment )) {
+		fprintf( stderr, "Cannot start the change log server\n" );
+		shm_unlink( BENCH_SHM_NAME );
+		return 1;
+	}
+
+	ok = latencyTest();
+	ok = burstTest() && ok;
+
+	munmap( segment, SHM_SIZE );
+	shm_unlink( BENCH_SHM_NAME );
+
+	printf( "%s\n", ok ? "PASS" : "FAIL" );
+	return ok ? 0 : 1;
+}
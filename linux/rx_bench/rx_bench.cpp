@@ -0,0 +1,294 @@
+/******************************************************************************
+
+  Copyright (c) 2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+/*
+ * Compares the receive CPU cost per frame of the two LinuxNetworkInterface
+ * receive paths:
+ *
+ *  single: select() + recvmsg() + control message walk for every frame,
+ *          as LinuxNetworkInterface::nrecv() does
+ *  batch:  epoll_wait() + one recvmmsg() into a LinuxReceiveRing per burst,
+ *          as LinuxNetworkInterface::receiveLoop() does
+ *
+ * Frames are PTP sized UDP datagrams on the loopback interface with software
+ * RX timestamping enabled, so every frame carries an SO_TIMESTAMPING control
+ * message like hardware timestamped frames do. Only the receiving side is
+ * timed, using the thread CPU clock.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/net_tstamp.h>
+
+#include "linux_rx_ring.hpp"
+
+#define FRAME_SIZE 90		/* Pdelay_Resp with Ethernet header */
+#define BUFFER_SIZE 128		/* Matches RECEIVE_LOOP_BUFFER_SIZE */
+#define RING_SIZE 16		/* Matches RECEIVE_LOOP_BATCH */
+
+static uint64_t cpuNow()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_THREAD_CPUTIME_ID, &ts );
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int openReceiver( struct sockaddr_in *addr )
+{
+	socklen_t len = sizeof( *addr );
+	int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+	int size = 4 * 1024 * 1024;
+	int sd;
+
+	sd = socket( AF_INET, SOCK_DGRAM, 0 );
+	if( sd == -1 )
+		return -1;
+
+	memset( addr, 0, sizeof( *addr ));
+	addr->sin_family = AF_INET;
+	addr->sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+	if( bind( sd, (struct sockaddr *) addr, sizeof( *addr )) == -1 ||
+	    getsockname( sd, (struct sockaddr *) addr, &len ) == -1 ||
+	    setsockopt( sd, SOL_SOCKET, SO_TIMESTAMPING, &flags,
+			sizeof( flags )) == -1 ) {
+		close( sd );
+		return -1;
+	}
+	setsockopt( sd, SOL_SOCKET, SO_RCVBUF, &size, sizeof( size ));
+
+	return sd;
+}
+
+static bool sendBurst
+( int sd, struct sockaddr_in *addr, unsigned burst, uint16_t *sequence )
+{
+	uint8_t frame[FRAME_SIZE];
+	unsigned i;
+
+	memset( frame, 0, sizeof( frame ));
+	for( i = 0; i < burst; ++i ) {
+		frame[0] = (uint8_t) (i & 0x3);	/* Event message types */
+		frame[30] = (uint8_t) (*sequence >> 8);
+		frame[31] = (uint8_t) *sequence;
+		++*sequence;
+		if( sendto( sd, frame, sizeof( frame ), 0,
+			    (struct sockaddr *) addr, sizeof( *addr )) == -1 ) {
+			fprintf( stderr, "sendto() failed: %s\n", strerror( errno ));
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static uint64_t consume( const uint8_t *payload, const struct timespec *ts )
+{
+	/* Stand-in for handing the frame and its timestamp to the parser */
+	return payload[31] + ( ts != NULL ? ts[0].tv_nsec : 0 );
+}
+
+/* One frame per select()/recvmsg() round trip, as nrecv() */
+static unsigned receiveSingle( int sd, unsigned burst, uint64_t *sink )
+{
+	uint8_t buf[BUFFER_SIZE];
+	union {
+		char control_data[CMSG_SPACE(256)];
+		struct cmsghdr cm;
+	} control;
+	struct sockaddr_in remote;
+	struct iovec sgentry;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	unsigned received = 0;
+
+	while( received < burst ) {
+		struct timeval timeout = { 0, 16000 };
+		const struct timespec *ts = NULL;
+		fd_set readfds;
+
+		FD_ZERO( &readfds );
+		FD_SET( sd, &readfds );
+		if( select( sd+1, &readfds, NULL, NULL, &timeout ) <= 0 )
+			break;
+
+		memset( &msg, 0, sizeof( msg ));
+		sgentry.iov_base = buf;
+		sgentry.iov_len = sizeof( buf );
+		msg.msg_iov = &sgentry;
+		msg.msg_iovlen = 1;
+		msg.msg_name = &remote;
+		msg.msg_namelen = sizeof( remote );
+		msg.msg_control = &control;
+		msg.msg_controllen = sizeof( control );
+		if( recvmsg( sd, &msg, 0 ) < 0 )
+			break;
+
+		for( cmsg = CMSG_FIRSTHDR( &msg ); cmsg != NULL;
+		     cmsg = CMSG_NXTHDR( &msg, cmsg )) {
+			if( cmsg->cmsg_level == SOL_SOCKET &&
+			    cmsg->cmsg_type == SO_TIMESTAMPING ) {
+				ts = (const struct timespec *) CMSG_DATA( cmsg );
+				break;
+			}
+		}
+		*sink += consume( buf, ts );
+		++received;
+	}
+
+	return received;
+}
+
+/* Batches drained with recvmmsg() after one epoll wakeup, as receiveLoop() */
+static unsigned receiveBatch
+( int sd, int epoll_fd, LinuxReceiveRing *ring, unsigned burst,
+  uint64_t *sink )
+{
+	struct epoll_event ev;
+	unsigned received = 0;
+	int nframes;
+	int i;
+
+	while( received < burst ) {
+		if( epoll_wait( epoll_fd, &ev, 1, 16 ) <= 0 )
+			break;
+		while(( nframes = ring->receive( sd, MSG_DONTWAIT )) > 0 ) {
+			for( i = 0; i < nframes; ++i ) {
+				*sink += consume
+					( ring->getPayload( i ),
+					  ring->getTimestamps( i ));
+			}
+			received += nframes;
+		}
+	}
+
+	return received;
+}
+
+static void usage( char *arg0 )
+{
+	fprintf( stderr,
+		 "%s [-b <burst size>] [-n <bursts>]\n"
+		 "\t-b Frames sent back to back before receiving (default 32)\n"
+		 "\t-n Number of bursts per mode (default 20000)\n",
+		 arg0 );
+}
+
+int main( int argc, char **argv )
+{
+	struct sockaddr_in addr;
+	struct epoll_event ev;
+	unsigned burst = 32;
+	unsigned bursts = 20000;
+	uint64_t cpu[2] = { 0, 0 };
+	uint64_t frames[2] = { 0, 0 };
+	uint64_t sink = 0;
+	uint16_t sequence = 0;
+	int rx, tx, epoll_fd;
+	int opt;
+	unsigned n;
+
+	while(( opt = getopt( argc, argv, "b:n:h" )) != -1 ) {
+		switch( opt ) {
+		case 'b':
+			burst = (unsigned) strtoul( optarg, NULL, 0 );
+			break;
+		case 'n':
+			bursts = (unsigned) strtoul( optarg, NULL, 0 );
+			break;
+		default:
+			usage( argv[0] );
+			return 1;
+		}
+	}
+	if( burst == 0 || bursts == 0 ) {
+		usage( argv[0] );
+		return 1;
+	}
+
+	rx = openReceiver( &addr );
+	tx = socket( AF_INET, SOCK_DGRAM, 0 );
+	epoll_fd = epoll_create1( 0 );
+	if( rx == -1 || tx == -1 || epoll_fd == -1 ) {
+		fprintf( stderr, "Failed to open sockets: %s\n", strerror( errno ));
+		return 1;
+	}
+	memset( &ev, 0, sizeof( ev ));
+	ev.events = EPOLLIN;
+	ev.data.fd = rx;
+	epoll_ctl( epoll_fd, EPOLL_CTL_ADD, rx, &ev );
+
+	LinuxReceiveRing ring( RING_SIZE, BUFFER_SIZE );
+
+	for( n = 0; n < bursts; ++n ) {
+		uint64_t start;
+		int mode = n & 1;	/* Interleave modes to share noise */
+
+		if( !sendBurst( tx, &addr, burst, &sequence ))
+			return 1;
+
+		start = cpuNow();
+		if( mode == 0 )
+			frames[0] += receiveSingle( rx, burst, &sink );
+		else
+			frames[1] += receiveBatch( rx, epoll_fd, &ring, burst, &sink );
+		cpu[mode] += cpuNow() - start;
+	}
+
+	if( frames[0] == 0 || frames[1] == 0 ) {
+		fprintf( stderr, "No frames received\n" );
+		return 1;
+	}
+
+	printf( "burst %u, %llu frames per mode\n", burst,
+		(unsigned long long) frames[0] );
+	printf( "single: %8.1f ns/frame\n", (double) cpu[0] / frames[0] );
+	printf( "batch:  %8.1f ns/frame\n", (double) cpu[1] / frames[1] );
+	printf( "ratio:  %8.2fx\n",
+		( (double) cpu[0] / frames[0] ) / ( (double) cpu[1] / frames[1] ));
+
+	close( epoll_fd );
+	close( tx );
+	close( rx );
+
+	return sink == 0 ? 1 : 0;
+}
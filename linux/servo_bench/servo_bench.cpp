@@ -0,0 +1,426 @@
+/******************************************************************************
+
+  Copyright (c) 2009-2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+/*
+ * Offline servo harness. Replays offset traces through every clock
+ * servo (gptp_servo.hpp) in closed loop and reports, per trace and
+ * servo, the lock time and the steady-state phase error.
+ *
+ * A trace is a text file with one sync per line:
+ *
+ *   <time s> <master_local_offset ns> <rate ratio> <applied ppm>
+ *
+ * i.e. the arguments IEEE1588Clock::setMasterOffset() received and the
+ * frequency adjustment that was in force during the interval ending at
+ * that sync; lines starting with '#' are ignored. The adjustment is
+ * added back to recover the free-running oscillator, which each servo
+ * then steers as the daemon would: the first sample steps the phase,
+ * samples beyond PHASE_ERROR_THRESHOLD are held and the returned
+ * adjustment applies until the next sync.
+ *
+ * Before the table, every trace is also replayed through the pi servo
+ * and, alongside it, through the PI loop as setMasterOffset() ran it
+ * before the servo interface existed. Both see the arguments the daemon
+ * computes (integer offset, FrequencyRatio rate) and every returned
+ * adjustment must be the same float; any difference exits with status 2.
+ *
+ * Without trace arguments, synthetic traces are generated:
+ *
+ *   hw_8hz    8 syncs/s, 20 ns timestamp noise, +30 ppm, 2 ppb/sqrt(s) wander
+ *   sw_1hz    1 sync/s, 500 ns timestamp noise, -50 ppm, 5 ppb/sqrt(s) wander
+ *   thermal   8 syncs/s, 20 ns timestamp noise, +10 ppm, 1 ppm swing over 300 s
+ *
+ * Usage: servo_bench [-b <lock band ns>] [-s <key>=<value>]...
+ *                    [-w <dir>] [<trace>...]
+ *
+ *   -b  RMS phase error over 8 syncs the clock must stay within to
+ *       count as locked (default 1000 ns)
+ *   -s  [servo] key from gptp_cfg.ini applied to every servo
+ *   -w  also write the synthetic traces to <dir>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <string>
+#include <vector>
+
+#include "gptp_servo.hpp"
+#include "gptp_log.hpp"
+#include "ptptypes.hpp"
+
+#define PHASE_ERROR_THRESHOLD 1000000000.0	/* as in avbts_clock.hpp */
+#define PHASE_ERROR_MAX_COUNT 6
+#define SYNTHETIC_DURATION_S 600
+#define LOCK_WINDOW 8		/* samples averaged to decide lock */
+
+struct TraceSample {
+	double time;		/* s */
+	double offset;		/* master_local_offset, ns */
+	double ratio;		/* master/local rate ratio */
+	double applied;		/* ppm in force over the last interval */
+};
+
+struct Trace {
+	std::string name;
+	std::vector<TraceSample> samples;
+};
+
+struct ReplayResult {
+	double lock_time;	/* s, negative if never locked */
+	double rms;		/* ns, second half of the trace */
+	double max_error;	/* ns, second half of the trace */
+	double ppm_rms;		/* ppm change per sync, second half */
+};
+
+/*
+ * The PI loop of IEEE1588Clock::setMasterOffset() before ClockServo,
+ * statement for statement
+ */
+struct OldPILoop {
+	float _ppm;
+
+	OldPILoop() : _ppm( 0 ) {}
+	float sample
+	( long double phase_error, FrequencyRatio master_local_freq_offset,
+	  int8_t sync_interval )
+	{
+		float syncPerSec = (float)(1.0 / pow((float)2, sync_interval));
+		_ppm += (float) ((INTEGRAL * syncPerSec * phase_error) + PROPORTIONAL*((master_local_freq_offset-1.0)*1000000));
+
+		if( _ppm < LOWER_FREQ_LIMIT ) _ppm = LOWER_FREQ_LIMIT;
+		if( _ppm > UPPER_FREQ_LIMIT ) _ppm = UPPER_FREQ_LIMIT;
+		return _ppm;
+	}
+};
+
+static double gaussian()
+{
+	double u1 = ( random() + 1.0 ) / ( RAND_MAX + 2.0 );
+	double u2 = ( random() + 1.0 ) / ( RAND_MAX + 2.0 );
+	return sqrt( -2 * log( u1 )) * cos( 2 * M_PI * u2 );
+}
+
+/*
+ * Free-running oscillator: e is master minus local time in ns, d the
+ * master minus local rate in ns/s. The daemon sees e with timestamp
+ * noise, and the rate as the ratio of master and local intervals
+ * between consecutive syncs.
+ */
+static Trace synthesize
+( const char *name, double interval, double noise, double freq_ppm,
+  double wander_ppb, double swing_ppm, double swing_period )
+{
+	Trace trace;
+	double e = 0, d = freq_ppm * 1000;
+	double measured, previous = 0;
+	unsigned count = (unsigned) ( SYNTHETIC_DURATION_S / interval );
+
+	trace.name = name;
+	srandom( 1 );
+	for( unsigned k = 0; k < count; ++k ) {
+		double t = k * interval;
+		double swing = swing_ppm * 1000 *
+			sin( 2 * M_PI * t / ( swing_period > 0 ? swing_period : 1 ));
+		TraceSample sample;
+
+		if( k > 0 ) {
+			d += wander_ppb * sqrt( interval ) * gaussian();
+			e += ( d + swing ) * interval;
+		}
+		measured = e + noise * gaussian();
+
+		sample.time = t;
+		sample.offset = -measured;
+		// The first sync after start only initializes the rate
+		sample.ratio = k == 0 ? 1.0 :
+			1.0 + ( measured - previous ) / ( interval * 1e9 );
+		sample.applied = 0;
+		trace.samples.push_back( sample );
+		previous = measured;
+	}
+
+	return trace;
+}
+
+static bool loadTrace( const char *path, Trace *trace )
+{
+	FILE *f = fopen( path, "r" );
+	char line[256];
+
+	if( f == NULL ) {
+		perror( path );
+		return false;
+	}
+	trace->name = path;
+	while( fgets( line, sizeof( line ), f ) != NULL ) {
+		TraceSample sample;
+
+		if( line[0] == '#' || line[0] == '\n' )
+			continue;
+		if( sscanf( line, "%lf %lf %lf %lf", &sample.time, &sample.offset,
+			    &sample.ratio, &sample.applied ) != 4 ) {
+			fprintf( stderr, "%s: bad line: %s", path, line );
+			fclose( f );
+			return false;
+		}
+		trace->samples.push_back( sample );
+	}
+	fclose( f );
+
+	if( trace->samples.size() < 2 ) {
+		fprintf( stderr, "%s: fewer than two samples\n", path );
+		return false;
+	}
+	return true;
+}
+
+static bool writeTrace( const char *dir, const Trace &trace )
+{
+	std::string path = std::string( dir ) + "/" + trace.name + ".trace";
+	FILE *f = fopen( path.c_str(), "w" );
+
+	if( f == NULL ) {
+		perror( path.c_str() );
+		return false;
+	}
+	fprintf( f, "# time_s master_local_offset_ns rate_ratio applied_ppm\n" );
+	for( size_t i = 0; i < trace.samples.size(); ++i ) {
+		const TraceSample &s = trace.samples[i];
+		fprintf( f, "%.6f %.1f %.12f %.6f\n", s.time, s.offset, s.ratio, s.applied );
+	}
+	fclose( f );
+	return true;
+}
+
+/*
+ * With old_loop set, the pi servo is fed exactly what the daemon passes
+ * it, the old loop runs alongside, and the samples where the two differ
+ * are counted in *differ.
+ */
+static ReplayResult replay
+( const Trace &trace, const ClockServoConfig &config, double band,
+  OldPILoop *old_loop = NULL, unsigned *differ = NULL )
+{
+	const std::vector<TraceSample> &samples = trace.samples;
+	ClockServo *servo = ClockServo::create( config );
+	double interval = samples[1].time - samples[0].time;
+	int8_t sync_interval = (int8_t) lround( log2( interval ));
+	double recorded = 0;	/* recorded adjustment integrated, ns */
+	double steered = 0;	/* this servo's adjustment integrated, ns */
+	double stepped = 0;	/* phase steps applied, ns */
+	double ppm = 0, last_ppm = 0;
+	bool set_point = true, rate_valid = true;
+	int violations = 0;
+	double window[LOCK_WINDOW], window_sum = 0;
+	double last_outside = samples[0].time;
+	bool outside_at_end = false;
+	double sum_sq = 0, max_error = 0, ppm_sq = 0;
+	unsigned steady = 0;
+	size_t half = samples.size() / 2;
+	ReplayResult result;
+
+	for( size_t k = 0; k < samples.size(); ++k ) {
+		const TraceSample &s = samples[k];
+		double dt = k > 0 ? s.time - samples[k - 1].time : 0;
+		double e, d;
+
+		recorded += s.applied * 1000 * dt;
+		steered += ppm * 1000 * dt;
+
+		e = -s.offset + recorded - steered - stepped;
+		d = rate_valid ?
+			( s.ratio - 1.0 ) * 1e9 + ( s.applied - ppm ) * 1000 : 0;
+		rate_valid = true;
+
+		if( set_point || violations > PHASE_ERROR_MAX_COUNT ) {
+			// IEEE1588Clock steps the phase and restarts the rate
+			// measurement
+			set_point = false;
+			violations = 0;
+			stepped += e;
+			e = 0;
+			servo->reset();
+			rate_valid = false;
+		}
+
+		if( fabs( e ) > PHASE_ERROR_THRESHOLD ) {
+			++violations;
+		} else if( old_loop != NULL ) {
+			long double phase_error = (long double) -(int64_t) llround( -e );
+			FrequencyRatio ratio = 1.0 + d / 1e9;
+			float old_ppm;
+
+			violations = 0;
+			ppm = servo->sample
+				( (double) phase_error,
+				  (double) (( ratio - 1.0 ) * 1000000 ),
+				  pow( 2.0, sync_interval ));
+			old_ppm = old_loop->sample( phase_error, ratio, sync_interval );
+			if( (float) ppm != old_ppm )
+				++*differ;
+		} else {
+			violations = 0;
+			ppm = servo->sample( e, d / 1000, interval );
+		}
+
+		// Locked while the RMS of the last LOCK_WINDOW errors is
+		// within the band, so single noise spikes do not count
+		if( k >= LOCK_WINDOW )
+			window_sum -= window[k % LOCK_WINDOW];
+		window[k % LOCK_WINDOW] = e * e;
+		window_sum += e * e;
+		if( k + 1 < LOCK_WINDOW ||
+		    sqrt( window_sum / LOCK_WINDOW ) > band ) {
+			last_outside = s.time;
+			outside_at_end = true;
+		} else {
+			outside_at_end = false;
+		}
+		if( k >= half ) {
+			sum_sq += e * e;
+			ppm_sq += ( ppm - last_ppm ) * ( ppm - last_ppm );
+			if( fabs( e ) > max_error )
+				max_error = fabs( e );
+			++steady;
+		}
+		last_ppm = ppm;
+	}
+	delete servo;
+
+	result.lock_time = outside_at_end ? -1 : last_outside - samples[0].time;
+	result.rms = sqrt( sum_sq / steady );
+	result.max_error = max_error;
+	result.ppm_rms = sqrt( ppm_sq / steady );
+	return result;
+}
+
+int main( int argc, char **argv )
+{
+	std::vector<Trace> traces;
+	std::vector<std::pair<std::string, std::string> > settings;
+	const char *write_dir = NULL;
+	double band = 1000;
+	static const ClockServoType types[] =
+		{ CLOCK_SERVO_PI, CLOCK_SERVO_ADAPTIVE_PI, CLOCK_SERVO_KALMAN,
+		  CLOCK_SERVO_LQR };
+	int i;
+
+	// Lock and unlock messages would drown the table
+	gptplogSetLevels( "warning" );
+
+	for( i = 1; i < argc && argv[i][0] == '-'; ++i ) {
+		if( strcmp( argv[i], "-b" ) == 0 && i + 1 < argc ) {
+			band = atof( argv[++i] );
+		} else if( strcmp( argv[i], "-s" ) == 0 && i + 1 < argc ) {
+			std::string kv = argv[++i];
+			size_t eq = kv.find( '=' );
+			ClockServoConfig check;
+
+			if( eq == std::string::npos ||
+			    !check.set( kv.substr( 0, eq ).c_str(), kv.substr( eq + 1 ).c_str() )) {
+				fprintf( stderr, "Invalid servo setting %s\n", argv[i] );
+				return 1;
+			}
+			settings.push_back( std::make_pair( kv.substr( 0, eq ), kv.substr( eq + 1 )));
+		} else if( strcmp( argv[i], "-w" ) == 0 && i + 1 < argc ) {
+			write_dir = argv[++i];
+		} else {
+			fprintf( stderr, "%s [-b <lock band ns>] [-s <key>=<value>]... "
+				 "[-w <dir>] [<trace>...]\n", argv[0] );
+			return 1;
+		}
+	}
+
+	if( i < argc ) {
+		for( ; i < argc; ++i ) {
+			Trace trace;
+			if( !loadTrace( argv[i], &trace ))
+				return 1;
+			traces.push_back( trace );
+		}
+	} else {
+		traces.push_back( synthesize( "hw_8hz", 0.125, 20, 30, 2, 0, 0 ));
+		traces.push_back( synthesize( "sw_1hz", 1.0, 500, -50, 5, 0, 0 ));
+		traces.push_back( synthesize( "thermal", 0.125, 20, 10, 0, 1, 300 ));
+		for( size_t t = 0; write_dir != NULL && t < traces.size(); ++t ) {
+			if( !writeTrace( write_dir, traces[t] ))
+				return 1;
+		}
+	}
+
+	if( settings.empty() ) {
+		unsigned total = 0, differ = 0;
+		ClockServoConfig config;
+
+		config.type = CLOCK_SERVO_PI;
+		for( size_t t = 0; t < traces.size(); ++t ) {
+			OldPILoop old_loop;
+
+			replay( traces[t], config, band, &old_loop, &differ );
+			total += traces[t].samples.size();
+		}
+		printf( "pi servo against the old loop: %u samples, %u differ\n",
+			total, differ );
+		if( differ != 0 )
+			return 2;
+	}
+
+	printf( "%-16s %-12s %12s %12s %12s %14s\n", "trace", "servo",
+		"lock time", "rms", "max", "ppm step rms" );
+	for( size_t t = 0; t < traces.size(); ++t ) {
+		for( size_t s = 0; s < sizeof( types ) / sizeof( types[0] ); ++s ) {
+			ClockServoConfig config;
+			ReplayResult r;
+			char lock[32];
+
+			config.type = types[s];
+			for( size_t k = 0; k < settings.size(); ++k )
+				config.set( settings[k].first.c_str(), settings[k].second.c_str() );
+
+			r = replay( traces[t], config, band );
+			if( r.lock_time < 0 )
+				snprintf( lock, sizeof( lock ), "never" );
+			else
+				snprintf( lock, sizeof( lock ), "%.1f s", r.lock_time );
+			printf( "%-16s %-12s %12s %9.1f ns %9.1f ns %14.4f\n",
+				traces[t].name.c_str(),
+				ClockServoConfig::typeName( config.type ),
+				lock, r.rms, r.max_error, r.ppm_rms );
+		}
+	}
+
+	return 0;
+}
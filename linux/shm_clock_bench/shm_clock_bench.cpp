@@ -0,0 +1,281 @@
+/******************************************************************************
+
+  Copyright (c) 2009-2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+/*
+ * Checks and times the shared memory clock conversion
+ * (linux_shm_clock.hpp) against a synthetic daemon:
+ *
+ *  accuracy:  a writer publishes parameter sets with rate errors up to
+ *             +/-200 ppm; for each, conversions of readings up to 10 s
+ *             away from the snapshot are compared with the long double
+ *             formulas from ipcdef.hpp
+ *  coherence: writer threads for ports 1 and 2 publish updates in a
+ *             tight loop while a client following port 1 refreshes and
+ *             checks that every snapshot it gets is one that port's
+ *             writer published
+ *  speed:     conversions per second from PHC, CLOCK_REALTIME and
+ *             CLOCK_MONOTONIC readings, and now(CLOCK_REALTIME)
+ *             including the clock_gettime() call
+ *
+ * The segment is created under a private name; the daemon's /ptp
+ * segment is not touched.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <math.h>
+
+#include "linux_shm_clock.hpp"
+
+#define PARAMETER_SETS 1000
+#define POINTS_PER_SET 1000
+#define MAX_DISTANCE_NS 10000000000LL	/* readings up to 10 s from the snapshot */
+#define COHERENCE_READS 1000000
+#define SPEED_CONVERSIONS 50000000UL
+#define COHERENCE_T0 1500000000000000000LL
+
+static gPtpShmSegment *segment;
+static volatile bool writer_stop;
+
+static gPtpShmSegment *createSegment( const char *name )
+{
+	int fd = shm_open( name, O_RDWR | O_CREAT, 0600 );
+	if( fd < 0 || ftruncate( fd, SHM_SIZE ) < 0 )
+		return NULL;
+	void *addr = mmap( NULL, SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	close( fd );
+	if( addr == MAP_FAILED )
+		return NULL;
+
+	gPtpShmSegment *seg = (gPtpShmSegment *) addr;
+	memset( seg, 0, SHM_SIZE );
+	seg->header.version = GPTP_SHM_VERSION;
+	seg->header.data_size = sizeof( gPtpTimeData );
+	seg->header.slot_size = sizeof( gPtpShmPortSlot );
+	seg->header.port_slots = GPTP_SHM_PORT_SLOTS;
+	seg->header.event_size = sizeof( gPtpChangeEvent );
+	seg->header.event_log = GPTP_SHM_EVENT_LOG;
+	__atomic_store_n( &seg->header.magic, GPTP_SHM_MAGIC, __ATOMIC_RELEASE );
+
+	return seg;
+}
+
+static void publish( const gPtpTimeData *data, unsigned slot = 0 )
+{
+	gPtpShmPortSlot *port = &segment->port[slot];
+
+	gptpShmWriteBegin( &port->sequence );
+	port->port_number = slot + 1;
+	memcpy( &port->data, data, sizeof( *data ));
+	gptpShmWriteEnd( &port->sequence );
+}
+
+static int64_t randomRange( int64_t range )
+{
+	int64_t r = ((int64_t) random() << 31 ) ^ random();
+	return r % ( 2 * range + 1 ) - range;
+}
+
+static bool accuracyTest()
+{
+	LinuxSharedMemoryClock clock;
+	gPtpTimeData data;
+	int64_t max_error = 0;
+
+	memset( &data, 0, sizeof( data ));
+	publish( &data );
+	if( !clock.open( SHM_NAME "_clock_bench" ))
+		return false;
+
+	for( int set = 0; set < PARAMETER_SETS; ++set ) {
+		data.local_time = 1600000000000000000LL + randomRange( 100000000000000000LL );
+		data.ml_phoffset = randomRange( 1000000000LL );
+		data.ls_phoffset = randomRange( 40000000000000000LL );
+		data.ml_freqoffset = 1.0L + randomRange( 200000 ) * 1e-9L;
+		data.ls_freqoffset = 1.0L + randomRange( 200000 ) * 1e-9L;
+		publish( &data );
+		if( !clock.refresh() )
+			return false;
+
+		long double system_ref = (long double) data.local_time + data.ls_phoffset;
+		for( int i = 0; i < POINTS_PER_SET; ++i ) {
+			int64_t realtime = (int64_t) system_ref + randomRange( MAX_DISTANCE_NS );
+			long double local = data.local_time +
+				( realtime - system_ref ) * data.ls_freqoffset;
+			long double master = ( data.local_time - data.ml_phoffset ) +
+				( local - data.local_time ) * data.ml_freqoffset;
+
+			int64_t error = llabs( clock.fromRealtime( realtime ) - (int64_t) llroundl( master ));
+			if( error > max_error )
+				max_error = error;
+		}
+	}
+
+	printf( "accuracy:  %d sets x %d readings within 10 s, max error %lld ns\n",
+		PARAMETER_SETS, POINTS_PER_SET, (long long) max_error );
+
+	return max_error <= 1;
+}
+
+/*
+ * Update k: every field derived from k so a torn snapshot shows. One
+ * writer per port slot, as in the daemon.
+ */
+static void *coherenceWriter( void *arg )
+{
+	unsigned slot = *(unsigned *) arg;
+	gPtpTimeData data;
+
+	memset( &data, 0, sizeof( data ));
+	data.ml_freqoffset = 1.0L;
+	data.ls_freqoffset = 1.0L;
+	for( int64_t k = 1; !writer_stop; ++k ) {
+		data.local_time = COHERENCE_T0 + k * 1000;
+		data.ml_phoffset = k;
+		data.ls_phoffset = -k;
+		data.sync_count = (uint32_t) k;
+		publish( &data, slot );
+	}
+
+	return NULL;
+}
+
+static bool coherenceTest()
+{
+	LinuxSharedMemoryClock clock;
+	pthread_t writer[2];
+	unsigned slot[2] = { 0, 1 };
+	long torn = 0, refreshes = 0;
+
+	if( !clock.open( SHM_NAME "_clock_bench", 1 ))
+		return false;
+
+	writer_stop = false;
+	for( int i = 0; i < 2; ++i )
+		pthread_create( &writer[i], NULL, coherenceWriter, &slot[i] );
+	for( int i = 0; i < COHERENCE_READS; ++i ) {
+		if( !clock.refresh() )
+			continue;
+		const GptpTimeConversion *conv = clock.getConversion();
+		int64_t k = conv->local_ref - conv->master_ref;
+		if( k <= 0 )
+			continue;
+		++refreshes;
+		if( conv->local_ref != COHERENCE_T0 + k * 1000 ||
+		    conv->system_ref != conv->local_ref - k )
+			++torn;
+	}
+	writer_stop = true;
+	for( int i = 0; i < 2; ++i )
+		pthread_join( writer[i], NULL );
+
+	printf( "coherence: %ld snapshots of port 1 taken while ports 1 and 2 "
+		"were updated, %ld torn\n", refreshes, torn );
+
+	return torn == 0;
+}
+
+static double nowNs()
+{
+	return (double) gptpClockNs( CLOCK_MONOTONIC );
+}
+
+static void speedTest()
+{
+	LinuxSharedMemoryClock clock;
+	gPtpTimeData data;
+	volatile int64_t sink = 0;
+	int64_t sum;
+	double start, ns;
+
+	memset( &data, 0, sizeof( data ));
+	data.local_time = gptpClockNs( CLOCK_REALTIME );
+	data.ml_phoffset = 1234;
+	data.ls_phoffset = -5678;
+	data.ml_freqoffset = 1.0000123L;
+	data.ls_freqoffset = 0.9999876L;
+	publish( &data );
+	clock.open( SHM_NAME "_clock_bench" );
+
+	const char *names[] = { "PHC", "CLOCK_REALTIME", "CLOCK_MONOTONIC" };
+	for( int which = 0; which < 3; ++which ) {
+		int64_t t = data.local_time;
+		sum = 0;
+		start = nowNs();
+		for( unsigned long i = 0; i < SPEED_CONVERSIONS; ++i, t += 977 ) {
+			if( which == 0 )
+				sum += clock.fromPhc( t );
+			else if( which == 1 )
+				sum += clock.fromRealtime( t );
+			else
+				sum += clock.fromMonotonic( t );
+		}
+		ns = ( nowNs() - start ) / SPEED_CONVERSIONS;
+		sink = sink + sum;
+		printf( "speed:     %-16s %6.2f ns, %6.1f M conversions/s\n",
+			names[which], ns, 1e3 / ns );
+	}
+
+	start = nowNs();
+	for( unsigned long i = 0; i < SPEED_CONVERSIONS / 10; ++i ) {
+		int64_t master = 0;
+		clock.now( CLOCK_REALTIME, &master );
+		sink = sink + master;
+	}
+	ns = ( nowNs() - start ) / ( SPEED_CONVERSIONS / 10 );
+	printf( "speed:     %-16s %6.2f ns, %6.1f M conversions/s\n",
+		"now(REALTIME)", ns, 1e3 / ns );
+}
+
+int main( void )
+{
+	bool ok;
+
+	segment = createSegment( SHM_NAME "_clock_bench" );
+	if( segment == NULL ) {
+		fprintf( stderr, "Failed to create shared memory\n" );
+		return 1;
+	}
+	srandom( 1 );
+
+	ok = accuracyTest();
+	ok = coherenceTest() && ok;
+	speedTest();
+
+	shm_unlink( SHM_NAME "_clock_bench" );
+
+	return ok ? 0 : 1;
+}
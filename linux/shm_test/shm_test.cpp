@@ -31,67 +31,20 @@
 
 ******************************************************************************/
 
-#include <iostream>
-#include <fstream>
-
 #include <stdio.h>
 #include <stdint.h>
-#include <sys/mman.h>
-#include <sys/stat.h>        /* For mode constants */
-#include <fcntl.h>           /* For O_* constants */
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
-#include <pthread.h>
 
-#include "linux_ipc.hpp"
+#include "linux_shm_clock.hpp"
 
-static inline uint64_t getCpuFrequency(void)
+static void printPortData(uint16_t port_number, const gPtpTimeData *ptpData,
+                          uint32_t generation)
 {
-    uint64_t freq = 0;
-    std::string line;
-    std::ifstream cpuinfo("/proc/cpuinfo");
-    if (cpuinfo.is_open())
-    {
-        while ( getline (cpuinfo,line) )
-        {
-            if(line.find("MHz") != line.npos)
-                break;
-        }
-        cpuinfo.close();
-    }
-    else std::cout << "Unable to open file";
-
-    size_t pos = line.find(":");
-    if (pos != line.npos) {
-        std::string mhz_str = line.substr(pos+2, line.npos - pos);
-        double freq1 = strtod(mhz_str.c_str(), NULL);
-        freq = freq1 * 1000000ULL;
-    }
-    return freq;
-}
-
-int main(int argc, char *argv[])
-{
-    int shm_fd = shm_open(SHM_NAME, O_RDONLY, 0666);
-
-    if( shm_fd < 0) {
-        fprintf(stderr, "shm_open(). %s\n", strerror(errno));
-        return -1;
-    }
-    char *addr = (char*)mmap(NULL, SHM_SIZE, PROT_READ, MAP_SHARED, shm_fd, 0);
-
-    if( addr == MAP_FAILED ) {
-        fprintf(stderr, "Error on mmap. Aborting.\n");
-        return -1;
-    }
     fprintf(stdout, "--------------------------------------------\n");
-    int buf_offset = 0;
-    buf_offset += sizeof(pthread_mutex_t);
-    gPtpTimeData *ptpData = (gPtpTimeData*)(addr+buf_offset);
-    /*TODO: Scale to ns*/
-    uint64_t freq = getCpuFrequency();
-    printf("Frequency %lu Hz\n", freq);
+    fprintf(stdout, "port slot %u, generation %u\n\n", (unsigned int) port_number,
+            generation);
 
     fprintf(stdout, "ml phoffset %ld\n", ptpData->ml_phoffset);
     fprintf(stdout, "ml freq offset %Lf\n", ptpData->ml_freqoffset);
@@ -127,6 +80,161 @@ int main(int argc, char *argv[])
     fprintf(stdout, "asCapable %s\n", ptpData->asCapable ? "True" : "False");
     fprintf(stdout, "Port State %d\n", (int)ptpData->port_state);
     fprintf(stdout, "process_id %d\n\n", (int)ptpData->process_id);
+}
+
+static void printEvent(const gPtpChangeEvent *event)
+{
+    switch( event->type ) {
+    case GPTP_EVENT_GRANDMASTER:
+        fprintf(stdout, "#%u port %u: grandmaster %02x:%02x:%02x:%02x:%02x:%02x:%02x:%02x "
+                "domain %u\n", event->sequence, (unsigned int) event->port_number,
+                event->clock_identity[0], event->clock_identity[1],
+                event->clock_identity[2], event->clock_identity[3],
+                event->clock_identity[4], event->clock_identity[5],
+                event->clock_identity[6], event->clock_identity[7],
+                (unsigned int) event->domain_number);
+        break;
+    case GPTP_EVENT_PORT_STATE:
+        fprintf(stdout, "#%u port %u: port state %lld\n", event->sequence,
+                (unsigned int) event->port_number, (long long) event->value);
+        break;
+    case GPTP_EVENT_AS_CAPABLE:
+        fprintf(stdout, "#%u port %u: asCapable %s\n", event->sequence,
+                (unsigned int) event->port_number, event->value ? "True" : "False");
+        break;
+    case GPTP_EVENT_PHASE_STEP:
+        fprintf(stdout, "#%u port %u: phase step %lld ns\n", event->sequence,
+                (unsigned int) event->port_number, (long long) event->value);
+        break;
+    default:
+        fprintf(stdout, "#%u port %u: unknown event %u\n", event->sequence,
+                (unsigned int) event->port_number, (unsigned int) event->type);
+        break;
+    }
+    fflush(stdout);
+}
+
+/* Sleeps on the change log counter and prints each event */
+static int followEvents(const char *name)
+{
+    LinuxSharedMemoryReader reader;
+    gPtpChangeEvent event;
+    uint32_t last, lost = 0;
+
+    if( !reader.open(name) ) {
+        fprintf(stderr, "Cannot map %s, or it was not written by a version %u "
+                "daemon. %s\n", name, GPTP_SHM_VERSION, strerror(errno));
+        return -1;
+    }
+    last = reader.eventCount();
+    for( ;; ) {
+        reader.waitForEvent(last);
+        while( reader.readEvent(&last, &event, GPTP_EVENT_ALL, &lost) )
+            printEvent(&event);
+        if( lost != 0 ) {
+            fprintf(stdout, "%u events lost\n", lost);
+            lost = 0;
+        }
+    }
+    return 0;
+}
+
+/* Prints the events streamed on a daemon's change log socket */
+static int streamEvents(const char *path)
+{
+    gPtpChangeEvent event;
+    uint32_t expected = 0;
+    ssize_t len;
+    int fd;
+
+    fd = gptpChangeLogConnect(path);
+    if( fd < 0 ) {
+        fprintf(stderr, "Cannot connect to %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    while( (len = read(fd, &event, sizeof(event))) == (ssize_t) sizeof(event) ) {
+        if( expected != 0 && event.sequence != expected )
+            fprintf(stdout, "%u events lost\n", event.sequence - expected);
+        expected = event.sequence + 1;
+        printEvent(&event);
+    }
+    if( len < 0 )
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    close(fd);
+    return len < 0 ? -1 : 0;
+}
+
+static void usage(const char *arg0)
+{
+    fprintf(stderr, "%s [<shared memory name> [<port number>]]\n"
+            "%s -w [<shared memory name>]   wait for changes\n"
+            "%s -n <socket path>            read the change log socket\n",
+            arg0, arg0, arg0);
+}
+
+int main(int argc, char *argv[])
+{
+    if( argc > 1 && strcmp(argv[1], "-w") == 0 ) {
+        if( argc > 3 || (argc > 2 && argv[2][0] != '/') ) {
+            usage(argv[0]);
+            return -1;
+        }
+        return followEvents(argc > 2 ? argv[2] : SHM_NAME);
+    }
+    if( argc > 1 && strcmp(argv[1], "-n") == 0 ) {
+        if( argc != 3 ) {
+            usage(argv[0]);
+            return -1;
+        }
+        return streamEvents(argv[2]);
+    }
+
+    const char *name = argc > 1 ? argv[1] : SHM_NAME;
+    int only_port = argc > 2 ? atoi(argv[2]) : 0;
+    LinuxSharedMemoryReader reader;
+    gPtpShmGrandmaster gm;
+    gPtpTimeData data;
+    uint32_t generation;
+
+    if( argc > 3 || (argc > 1 && argv[1][0] != '/') ) {
+        usage(argv[0]);
+        return -1;
+    }
+    if( !reader.open(name) ) {
+        fprintf(stderr, "Cannot map %s, or it was not written by a version %u "
+                "daemon. %s\n", name, GPTP_SHM_VERSION, strerror(errno));
+        return -1;
+    }
+
+    if( reader.readGrandmaster(&gm, &generation) ) {
+        fprintf(stdout, "grandmaster %02x:%02x:%02x:%02x:%02x:%02x:%02x:%02x "
+                "domain %u (port %u, %u changes)\n",
+                gm.gptp_grandmaster_id[0], gm.gptp_grandmaster_id[1],
+                gm.gptp_grandmaster_id[2], gm.gptp_grandmaster_id[3],
+                gm.gptp_grandmaster_id[4], gm.gptp_grandmaster_id[5],
+                gm.gptp_grandmaster_id[6], gm.gptp_grandmaster_id[7],
+                (unsigned int) gm.gptp_domain_number,
+                (unsigned int) gm.port_number, generation);
+    }
+
+    for( uint16_t port = 1; port <= GPTP_SHM_PORT_SLOTS; ++port ) {
+        if( only_port != 0 ? port != only_port : !reader.isPortActive(port) )
+            continue;
+        if( !reader.selectPort(port) || !reader.read(&data, &generation) ) {
+            fprintf(stderr, "No consistent snapshot of port %u, the daemon "
+                    "may have died during an update.\n", (unsigned int) port);
+            return -1;
+        }
+        printPortData(port, &data, generation);
+
+        LinuxSharedMemoryClock clock;
+        int64_t master;
+        if( clock.open(name, port) && clock.now(CLOCK_REALTIME, &master) ) {
+            fprintf(stdout, "gPTP time now %lld.%09lld\n\n",
+                    (long long) (master / 1000000000LL),
+                    (long long) (master % 1000000000LL));
+        }
+    }
 
     return 0;
 }
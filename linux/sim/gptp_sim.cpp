@@ -0,0 +1,530 @@
+/******************************************************************************
+
+  Copyright (c) 2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+/*
+ * Runs a grandmaster and N slaves, each a real IEEE1588Clock with real
+ * EtherPorts, against each other in virtual time. The grandmaster has one
+ * port per slave and every link goes through a LoopbackSwitch. The HAL
+ * underneath is simulated:
+ *
+ *  - each port has its own virtual PHC, a SimTimestamper; the ports of a
+ *    clock share that clock's SimOscillator, which has a frequency offset,
+ *    a random walk (wander) and optional frequency steps, as from
+ *    temperature
+ *  - each link has a one way delay per direction, so it can be asymmetric,
+ *    and Gaussian jitter
+ *  - timestamps are quantized to the timestamp clock period
+ *  - timers run on the same virtual time scheduler as the frames
+ *
+ * Sync, Follow_Up, Pdelay and Announce go through the unmodified message
+ * processing, BMCA, IEEE1588Clock::setMasterOffset() and the clock servo,
+ * so changes to any of them can be evaluated without hardware. The true
+ * offset of each slave PHC from the grandmaster PHC is sampled every
+ * 125 ms of virtual time.
+ *
+ * Reported, as the worst over all slaves:
+ *
+ *   lock time   last virtual time at which the RMS of the last 8 offset
+ *               samples was outside the lock band
+ *   rms/mean/max offset after lock; a link asymmetry shows as a mean of
+ *               half the asymmetry
+ *   rate error  remaining frequency difference at the end of the run
+ *   phase steps steps, rather than slews, of a slave clock
+ *   link delay  error of the Pdelay measured link delay
+ *   speed       virtual seconds simulated per wall clock second
+ *
+ * With more than one slave each one is also listed. The exit status is 2
+ * if any slave did not end up locked, asCapable and in the slave state
+ * with the grandmaster chosen by BMCA, so runs can serve as regression
+ * checks.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include <avbts_clock.hpp>
+#include <ether_port.hpp>
+#include <gptp_log.hpp>
+#include <gptp_profile.hpp>
+
+#include "sim_hal.hpp"
+#include "loopback_net.hpp"
+
+#define PROBE_INTERVAL_NS 125000000ULL
+#define LOCK_WINDOW 8			/* samples averaged to decide lock */
+#define GM_PRIORITY1 100
+#define SLAVE_PRIORITY1 248
+
+/* Locally administered MAC for port of node, node 0 is the grandmaster */
+#define SIM_MAC( node, port ) \
+	( 0x020000000000ULL | ((uint64_t) ( node ) << 8 ) | (( port ) + 1 ))
+
+struct SimHal {
+	SimScheduler sched;
+	SimTimerQueueFactory timerq_factory;
+	SimLockFactory lock_factory;
+	SimConditionFactory condition_factory;
+	SimThreadFactory thread_factory;
+	SimTimerFactory timer_factory;
+
+	SimHal() : timerq_factory( &sched ) {}
+};
+
+struct SimNode {
+	SimOscillator *phc;
+	IEEE1588Clock *clock;
+	std::vector<EtherPort *> ports;
+};
+
+struct FrequencyStep {
+	SimScheduler *sched;
+	std::vector<SimNode> *slaves;
+	double ppm;
+};
+
+struct OffsetSample {
+	double time;
+	double offset;
+};
+
+struct Probe {
+	SimScheduler *sched;
+	SimNode *master;
+	std::vector<SimNode> *slaves;
+	std::vector< std::vector<OffsetSample> > samples;
+};
+
+struct SlaveResult {
+	bool locked;
+	double lock_time;
+	double rms;
+	double mean;
+	double max;
+};
+
+static phy_delay_map_t no_phy_delay;
+
+static void applyFrequencyStep( void *arg )
+{
+	FrequencyStep *step = (FrequencyStep *) arg;
+
+	for( size_t i = 0; i < step->slaves->size(); ++i )
+		(*step->slaves)[i].phc->stepFrequency
+			( step->sched->now(), step->ppm );
+	delete step;
+}
+
+static void sampleOffset( void *arg )
+{
+	Probe *probe = (Probe *) arg;
+	uint64_t now = probe->sched->now();
+	int64_t master_time = probe->master->phc->read( now );
+
+	for( size_t i = 0; i < probe->slaves->size(); ++i ) {
+		OffsetSample sample;
+
+		sample.time = (double) now / NS_PER_SECOND;
+		sample.offset = (double)
+			( (*probe->slaves)[i].phc->read( now ) - master_time );
+		probe->samples[i].push_back( sample );
+	}
+
+	probe->sched->schedule( now + PROBE_INTERVAL_NS, sampleOffset, probe );
+}
+
+static void createClock
+( SimNode *node, uint8_t priority1, SimOscillator *phc, SimHal *hal,
+  const ClockServoConfig &servo )
+{
+	node->phc = phc;
+	node->clock = new IEEE1588Clock
+		( false, true, priority1, &hal->timerq_factory, NULL,
+		  &hal->lock_factory, servo );
+}
+
+static bool addPort
+( SimNode *node, const char *name, SimHal *hal, unsigned tick_ns )
+{
+	PortInit_t portInit;
+	EtherPort *port;
+
+	portInit.clock = node->clock;
+	portInit.index = (uint16_t) ( node->ports.size() + 1 );
+	portInit.timestamper =
+		new SimTimestamper( &hal->sched, node->phc, tick_ns );
+	portInit.net_label = new InterfaceName( (char *) name, strlen( name ));
+	portInit.virtual_label = NULL;
+	portInit.profile = gPTPProfileFactory::createStandardProfile();
+	portInit.isGM = false;
+	portInit.testMode = false;
+	portInit.linkUp = true;
+	portInit.allowNegativeCorrField = false;
+	portInit.initialLogSyncInterval = LOG2_INTERVAL_INVALID;
+	portInit.initialLogPdelayReqInterval = LOG2_INTERVAL_INVALID;
+	portInit.operLogPdelayReqInterval = LOG2_INTERVAL_INVALID;
+	portInit.operLogSyncInterval = LOG2_INTERVAL_INVALID;
+	portInit.condition_factory = &hal->condition_factory;
+	portInit.thread_factory = &hal->thread_factory;
+	portInit.timer_factory = &hal->timer_factory;
+	portInit.lock_factory = &hal->lock_factory;
+	portInit.phy_delay = &no_phy_delay;
+	portInit.syncReceiptThreshold =
+		CommonPort::DEFAULT_SYNC_RECEIPT_THRESH;
+	portInit.neighborPropDelayThreshold =
+		CommonPort::NEIGHBOR_PROP_DELAY_THRESH;
+
+	port = new EtherPort( &portInit );
+	if( !port->init_port() ) {
+		fprintf( stderr, "Failed to initialize port %s\n", name );
+		return false;
+	}
+	node->ports.push_back( port );
+
+	return true;
+}
+
+/* Lock: the RMS of the last LOCK_WINDOW samples is within the band */
+static void analyzeOffsets
+( const std::vector<OffsetSample> &samples, double band,
+  SlaveResult *result )
+{
+	double window[LOCK_WINDOW], window_sum = 0;
+	size_t lock_index = samples.size();
+
+	for( size_t k = 0; k < samples.size(); ++k ) {
+		double e = samples[k].offset;
+		if( k >= LOCK_WINDOW )
+			window_sum -= window[k % LOCK_WINDOW];
+		window[k % LOCK_WINDOW] = e * e;
+		window_sum += e * e;
+		if( k + 1 < LOCK_WINDOW ||
+		    sqrt( window_sum / LOCK_WINDOW ) > band )
+			lock_index = k + 1;
+	}
+
+	result->locked = lock_index < samples.size();
+	result->lock_time = result->rms = result->mean = result->max = 0;
+	if( !result->locked )
+		return;
+
+	double sum = 0, sum_sq = 0;
+	size_t n = samples.size() - lock_index;
+
+	for( size_t k = lock_index; k < samples.size(); ++k ) {
+		double e = samples[k].offset;
+		sum += e;
+		sum_sq += e * e;
+		if( fabs( e ) > result->max )
+			result->max = fabs( e );
+	}
+	result->lock_time = lock_index > 0 ? samples[lock_index - 1].time : 0;
+	result->rms = sqrt( sum_sq / n );
+	result->mean = sum / n;
+}
+
+static double wallSeconds()
+{
+	struct timespec now;
+
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void usage( const char *name )
+{
+	fprintf( stderr,
+		 "%s [options]\n"
+		 "\t-t <s>        virtual seconds to run (600)\n"
+		 "\t-n <slaves>   number of slaves, one grandmaster port each "
+		 "(1, at most %d)\n"
+		 "\t-S <seed>     random seed (1)\n"
+		 "\t-d <ns>       mean one way link delay (500)\n"
+		 "\t-a <ns>       master to slave delay minus slave to master "
+		 "delay (0)\n"
+		 "\t-j <ns>       link jitter, standard deviation (20)\n"
+		 "\t-q <ns>       timestamp resolution (8)\n"
+		 "\t-f <ppm>      slave frequency offset (30)\n"
+		 "\t-F <ppm>      grandmaster frequency offset (0)\n"
+		 "\t-o <ns>       initial slave phase offset (1000000)\n"
+		 "\t-w <ppb>      slave frequency wander per root second (1)\n"
+		 "\t-T <s>:<ppm>  slave frequency step at a virtual time, may be "
+		 "repeated\n"
+		 "\t-b <ns>       lock band, RMS over 8 samples (1000)\n"
+		 "\t-s <k>=<v>    clock servo setting, as in the [servo] "
+		 "section\n"
+		 "\t-L <levels>   log levels (warning)\n", name, MAX_PORTS );
+}
+
+int main( int argc, char **argv )
+{
+	double duration = 600;
+	int slave_count = 1;
+	uint64_t seed = 1;
+	double delay = 500;
+	double asymmetry = 0;
+	double jitter = 20;
+	unsigned tick_ns = 8;
+	double slave_ppm = 30;
+	double master_ppm = 0;
+	double initial_offset = 1000000;
+	double wander = 1;
+	double band = 1000;
+	const char *log_levels = "warning";
+	std::vector< std::pair<double, double> > steps;
+	ClockServoConfig servo;
+	int i;
+
+	for( i = 1; i < argc; ++i ) {
+		const char *opt = argv[i];
+		const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+		if( opt[0] != '-' || opt[1] == '\0' || opt[2] != '\0' ||
+		    value == NULL ) {
+			usage( argv[0] );
+			return 1;
+		}
+		++i;
+
+		switch( opt[1] ) {
+		case 't': duration = atof( value ); break;
+		case 'n': slave_count = atoi( value ); break;
+		case 'S': seed = strtoull( value, NULL, 0 ); break;
+		case 'd': delay = atof( value ); break;
+		case 'a': asymmetry = atof( value ); break;
+		case 'j': jitter = atof( value ); break;
+		case 'q': tick_ns = (unsigned) atoi( value ); break;
+		case 'f': slave_ppm = atof( value ); break;
+		case 'F': master_ppm = atof( value ); break;
+		case 'o': initial_offset = atof( value ); break;
+		case 'w': wander = atof( value ); break;
+		case 'b': band = atof( value ); break;
+		case 'L': log_levels = value; break;
+		case 'T': {
+			double at, ppm;
+			if( sscanf( value, "%lf:%lf", &at, &ppm ) != 2 ) {
+				fprintf( stderr, "Invalid step %s\n", value );
+				return 1;
+			}
+			steps.push_back( std::make_pair( at, ppm ));
+			break;
+		}
+		case 's': {
+			std::string kv = value;
+			size_t eq = kv.find( '=' );
+			if( eq == std::string::npos ||
+			    !servo.set( kv.substr( 0, eq ).c_str(),
+						kv.substr( eq + 1 ).c_str() )) {
+				fprintf( stderr, "Invalid servo setting %s\n",
+					 value );
+				return 1;
+			}
+			break;
+		}
+		default:
+			usage( argv[0] );
+			return 1;
+		}
+	}
+
+	if( slave_count < 1 || slave_count > MAX_PORTS ) {
+		fprintf( stderr, "Number of slaves must be 1 to %d\n",
+			 MAX_PORTS );
+		return 1;
+	}
+	if( !gptplogSetLevels( log_levels )) {
+		fprintf( stderr, "Invalid log levels %s\n", log_levels );
+		return 1;
+	}
+	GPTP_LOG_REGISTER();
+
+	SimHal hal;
+	LoopbackSwitch sw( &hal.sched, seed * 3 + 1 );
+	SimOscillator master_phc( master_ppm, 0, 0, seed * 3 + 2 );
+	std::vector<SimOscillator *> slave_phcs;
+	std::vector<SimNode> slaves( slave_count );
+	SimNode master;
+	Probe probe;
+	char name[16];
+
+	for( int s = 0; s < slave_count; ++s ) {
+		int gm_end, slave_end;
+
+		snprintf( name, sizeof( name ), "gm%d", s );
+		gm_end = sw.addPort( name, LinkLayerAddress( SIM_MAC( 0, s )));
+		snprintf( name, sizeof( name ), "slave%d", s );
+		slave_end = sw.addPort
+			( name, LinkLayerAddress( SIM_MAC( s + 1, 0 )));
+		sw.connect( gm_end, slave_end,
+			    (uint64_t) ( delay + asymmetry / 2 ),
+			    (uint64_t) ( delay - asymmetry / 2 ), jitter );
+		slave_phcs.push_back( new SimOscillator
+			( slave_ppm, wander, (int64_t) initial_offset,
+			  seed * 3 + 3 + s * 7919 ));
+	}
+	OSNetworkInterfaceFactory::registerFactory
+		( factory_name_t( "default" ),
+		  new LoopbackNetworkInterfaceFactory( &sw ));
+
+	createClock( &master, GM_PRIORITY1, &master_phc, &hal, servo );
+	for( int s = 0; s < slave_count; ++s ) {
+		snprintf( name, sizeof( name ), "gm%d", s );
+		if( !addPort( &master, name, &hal, tick_ns ))
+			return 1;
+	}
+	for( int s = 0; s < slave_count; ++s ) {
+		createClock( &slaves[s], SLAVE_PRIORITY1, slave_phcs[s], &hal, servo );
+		snprintf( name, sizeof( name ), "slave%d", s );
+		if( !addPort( &slaves[s], name, &hal, tick_ns ))
+			return 1;
+	}
+
+	for( size_t k = 0; k < steps.size(); ++k ) {
+		FrequencyStep *step = new FrequencyStep;
+		step->sched = &hal.sched;
+		step->slaves = &slaves;
+		step->ppm = steps[k].second;
+		hal.sched.schedule
+			( (uint64_t) ( steps[k].first * NS_PER_SECOND ),
+			  applyFrequencyStep, step );
+	}
+
+	probe.sched = &hal.sched;
+	probe.master = &master;
+	probe.slaves = &slaves;
+	probe.samples.resize( slave_count );
+	hal.sched.schedule( PROBE_INTERVAL_NS, sampleOffset, &probe );
+
+	for( size_t p = 0; p < master.ports.size(); ++p )
+		master.ports[p]->processEvent( POWERUP );
+	for( int s = 0; s < slave_count; ++s )
+		slaves[s].ports[0]->processEvent( POWERUP );
+
+	double wall_start = wallSeconds();
+	hal.sched.runUntil( (uint64_t) ( duration * NS_PER_SECOND ));
+	double wall = wallSeconds() - wall_start;
+
+	std::vector<SlaveResult> results( slave_count );
+	SlaveResult worst = { true, 0, 0, 0, 0 };
+	double worst_rate = 0, worst_delay = 0;
+	unsigned phase_steps = 0;
+	int in_sync = 0;
+	bool pass = true;
+
+	for( int s = 0; s < slave_count; ++s ) {
+		EtherPort *port = slaves[s].ports[0];
+		SlaveResult *r = &results[s];
+		double rate;
+		uint64_t link_delay;
+		bool ok;
+
+		analyzeOffsets( probe.samples[s], band, r );
+		rate = slave_phcs[s]->rateError() - master_phc.rateError();
+		if( port->getLinkDelay( &link_delay ) &&
+		    fabs( (double) link_delay - delay ) > fabs( worst_delay ))
+			worst_delay = (double) link_delay - delay;
+		if( fabs( rate ) > fabs( worst_rate ))
+			worst_rate = rate;
+		if( slave_phcs[s]->getPhaseSteps() > phase_steps )
+			phase_steps = slave_phcs[s]->getPhaseSteps();
+
+		worst.locked = worst.locked && r->locked;
+		if( r->lock_time > worst.lock_time )
+			worst.lock_time = r->lock_time;
+		if( r->rms > worst.rms )
+			worst.rms = r->rms;
+		if( fabs( r->mean ) > fabs( worst.mean ))
+			worst.mean = r->mean;
+		if( r->max > worst.max )
+			worst.max = r->max;
+
+		ok = r->locked && port->getPortState() == PTP_SLAVE &&
+			port->getAsCapable() &&
+			slaves[s].clock->getGrandmasterClockIdentity() ==
+			master.clock->getClockIdentity();
+		if( ok )
+			++in_sync;
+		pass = pass && ok;
+	}
+
+	printf( "virtual time       %.0f s\n", duration );
+	printf( "servo              %s\n",
+		ClockServoConfig::typeName( servo.type ));
+	printf( "slaves in sync     %d of %d\n", in_sync, slave_count );
+	if( !worst.locked ) {
+		printf( "lock time          never (band %.0f ns)\n", band );
+	} else {
+		printf( "lock time          %.3f s (band %.0f ns)\n",
+			worst.lock_time, band );
+		printf( "offset rms         %.1f ns\n", worst.rms );
+		printf( "offset mean        %.1f ns\n", worst.mean );
+		printf( "offset max         %.1f ns\n", worst.max );
+	}
+	printf( "rate error         %.4f ppm\n", worst_rate );
+	printf( "phase steps        %u\n", phase_steps );
+	printf( "link delay error   %.0f ns\n", worst_delay );
+	printf( "frames             %llu\n",
+		(unsigned long long) sw.frameCount() );
+	printf( "events             %llu\n",
+		(unsigned long long) hal.sched.eventCount() );
+	printf( "wall time          %.3f s (%.0fx real time)\n", wall,
+		wall > 0 ? duration / wall : 0.0 );
+
+	if( slave_count > 1 ) {
+		printf( "\nslave  state      asCapable  lock s    rms ns   "
+			"mean ns  max ns\n" );
+		for( int s = 0; s < slave_count; ++s ) {
+			EtherPort *port = slaves[s].ports[0];
+			SlaveResult *r = &results[s];
+
+			printf( "%-6d %-10s %-10s ", s,
+				port->getPortState() == PTP_SLAVE ?
+				"slave" : "not slave",
+				port->getAsCapable() ? "yes" : "no" );
+			if( r->locked )
+				printf( "%-9.3f %-8.1f %-8.1f %.1f\n",
+					r->lock_time, r->rms, r->mean,
+					r->max );
+			else
+				printf( "never\n" );
+		}
+	}
+
+	GPTP_LOG_UNREGISTER();
+	return pass ? 0 : 2;
+}
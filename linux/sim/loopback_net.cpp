@@ -0,0 +1,252 @@
+/******************************************************************************
+
+  Copyright (c) 2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#include "loopback_net.hpp"
+
+#include <string.h>
+
+#include <ether_port.hpp>
+#include <gptp_cfg.hpp>
+#include <gptp_log.hpp>
+
+#undef GPTP_LOG_SUBSYSTEM
+#define GPTP_LOG_SUBSYSTEM GPTP_LOG_SUBSYS_NET
+
+LoopbackSwitch::LoopbackSwitch( SimScheduler *sched, uint64_t seed ) :
+	random( seed )
+{
+	this->sched = sched;
+	frames = 0;
+}
+
+int LoopbackSwitch::addPort( const char *name, LinkLayerAddress address )
+{
+	Port port;
+
+	port.name = name;
+	port.address = address;
+	port.iface = NULL;
+	port.peer = -1;
+	port.delay_ns = 0;
+	port.jitter_ns = 0.0;
+	port.last_arrival = 0;
+	ports.push_back( port );
+
+	return (int) ports.size() - 1;
+}
+
+bool LoopbackSwitch::connect
+( int a, int b, uint64_t delay_ab, uint64_t delay_ba, double jitter_ns )
+{
+	if( a < 0 || b < 0 || a == b || a >= (int) ports.size() ||
+	    b >= (int) ports.size() || ports[a].peer != -1 ||
+	    ports[b].peer != -1 )
+		return false;
+
+	ports[a].peer = b;
+	ports[a].delay_ns = delay_ab;
+	ports[a].jitter_ns = jitter_ns;
+	ports[b].peer = a;
+	ports[b].delay_ns = delay_ba;
+	ports[b].jitter_ns = jitter_ns;
+
+	return true;
+}
+
+int LoopbackSwitch::findPort( const char *name ) const
+{
+	for( size_t i = 0; i < ports.size(); ++i ) {
+		if( ports[i].name == name )
+			return (int) i;
+	}
+
+	return -1;
+}
+
+void LoopbackSwitch::attach( int port, LoopbackNetworkInterface *iface )
+{
+	ports[port].iface = iface;
+}
+
+bool LoopbackSwitch::transmit
+( int from, const uint8_t *payload, size_t length )
+{
+	Port *port = &ports[from];
+	LoopbackNetworkInterface *to;
+	double delay;
+	uint64_t arrival;
+	Frame *frame;
+
+	if( port->peer == -1 || length > LOOPBACK_FRAME_MAX )
+		return false;
+	to = ports[port->peer].iface;
+	if( to == NULL )
+		return false;
+
+	delay = port->delay_ns + port->jitter_ns * random.gaussian();
+	if( delay < 0.0 )
+		delay = 0.0;
+	arrival = sched->now() + (uint64_t) delay;
+	// A queue does not reorder frames
+	if( arrival < port->last_arrival )
+		arrival = port->last_arrival;
+	port->last_arrival = arrival;
+
+	frame = new Frame;
+	frame->to = to;
+	frame->source = port->address;
+	frame->length = length;
+	memcpy( frame->data, payload, length );
+	sched->schedule( arrival, deliver, frame );
+	++frames;
+
+	return true;
+}
+
+void LoopbackSwitch::deliver( void *arg )
+{
+	Frame *frame = (Frame *) arg;
+
+	frame->to->receive( &frame->source, frame->data, frame->length );
+	delete frame;
+}
+
+LoopbackNetworkInterface::LoopbackNetworkInterface
+( LoopbackSwitch *sw, int port, SimTimestamper *timestamper )
+{
+	this->sw = sw;
+	this->port = port;
+	this->timestamper = timestamper;
+	handler = NULL;
+	handler_arg = NULL;
+}
+
+net_result LoopbackNetworkInterface::send
+( LinkLayerAddress *, uint16_t, uint8_t *payload, size_t length,
+  bool timestamp )
+{
+	if( timestamp && length >= PTP_COMMON_HDR_LENGTH ) {
+		uint16_t sequence;
+
+		memcpy( &sequence,
+			payload + PTP_COMMON_HDR_SEQUENCE_ID( PTP_COMMON_HDR_OFFSET ),
+			sizeof( sequence ));
+		timestamper->recordTx
+			( payload[PTP_COMMON_HDR_TRANSSPEC_MSGTYPE
+				  ( PTP_COMMON_HDR_OFFSET )] & 0x0F,
+			  PLAT_ntohs( sequence ), timestamper->stamp() );
+	}
+
+	if( !sw->transmit( port, payload, length )) {
+		GPTP_LOG_ERROR( "Loopback switch dropped a %zu byte frame",
+				length );
+		return net_trfail;
+	}
+
+	return net_succeed;
+}
+
+net_result LoopbackNetworkInterface::nrecv
+( LinkLayerAddress *, uint8_t *, size_t & )
+{
+	// Frames are only delivered through receiveLoop()
+	return net_trfail;
+}
+
+void LoopbackNetworkInterface::receive
+( LinkLayerAddress *source, uint8_t *payload, size_t length )
+{
+	Timestamp rx_timestamp;
+
+	if( handler == NULL )
+		return;
+
+	rx_timestamp = SimTimestamper::toTimestamp
+		( timestamper->stamp(), timestamper->getVersion() );
+	handler( handler_arg, source, payload, length, &rx_timestamp );
+}
+
+void LoopbackNetworkInterface::watchNetLink( CommonPort *pPort )
+{
+	EtherPort *ether_port = dynamic_cast<EtherPort *>( pPort );
+
+	// The link never goes down
+	if( ether_port != NULL ) {
+		ether_port->setLinkUpState( true );
+		ether_port->setLinkSpeed( LINKSPEED_1G );
+	}
+}
+
+net_result LoopbackNetworkInterface::receiveLoop
+( CommonPort *, net_frame_handler handler, void *arg )
+{
+	this->handler = handler;
+	handler_arg = arg;
+
+	return net_succeed;
+}
+
+void LoopbackNetworkInterface::stopReceiveLoop()
+{
+	handler = NULL;
+}
+
+bool LoopbackNetworkInterfaceFactory::createInterface
+( OSNetworkInterface **iface, InterfaceLabel *iflabel,
+  CommonTimestamper *timestamper )
+{
+	InterfaceName *ifname = dynamic_cast<InterfaceName *>( iflabel );
+	SimTimestamper *sim_timestamper =
+		dynamic_cast<SimTimestamper *>( timestamper );
+	LoopbackNetworkInterface *loopback_iface;
+	char name[64];
+	int port;
+
+	if( ifname == NULL || sim_timestamper == NULL ||
+	    !ifname->toString( name, sizeof( name )))
+		return false;
+
+	port = sw->findPort( name );
+	if( port == -1 ) {
+		GPTP_LOG_ERROR( "No loopback switch port for interface %s",
+				name );
+		return false;
+	}
+
+	loopback_iface = new LoopbackNetworkInterface
+		( sw, port, sim_timestamper );
+	sw->attach( port, loopback_iface );
+	*iface = loopback_iface;
+
+	return true;
+}
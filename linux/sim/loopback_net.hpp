@@ -0,0 +1,186 @@
+/******************************************************************************
+
+  Copyright (c) 2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#ifndef LOOPBACK_NET_HPP
+#define LOOPBACK_NET_HPP
+
+/**@file*/
+
+#include "sim_hal.hpp"
+
+#include <string>
+#include <vector>
+
+#include <avbts_osnet.hpp>
+
+#define LOOPBACK_FRAME_MAX 256	/*!< Largest frame carried by the switch */
+
+class LoopbackNetworkInterface;
+
+/**
+ * @brief In-memory switch connecting simulated interfaces
+ *
+ * gPTP frames are link local, a bridge that is not time aware would drop
+ * them, so each switch port is patched to exactly one other port and
+ * forwards everything it receives there. Each direction of a connection has
+ * its own delay and Gaussian jitter so links can be asymmetric. Frames in
+ * one direction are never reordered.
+ */
+class LoopbackSwitch {
+private:
+	struct Port {
+		std::string name;
+		LinkLayerAddress address;
+		LoopbackNetworkInterface *iface;
+		int peer;		/* -1 while not connected */
+		uint64_t delay_ns;	/* to the peer */
+		double jitter_ns;
+		uint64_t last_arrival;
+	};
+	struct Frame {
+		LoopbackNetworkInterface *to;
+		LinkLayerAddress source;
+		size_t length;
+		uint8_t data[LOOPBACK_FRAME_MAX];
+	};
+
+	SimScheduler *sched;
+	SimRandom random;
+	std::vector<Port> ports;
+	uint64_t frames;
+
+	static void deliver( void *arg );
+public:
+	LoopbackSwitch( SimScheduler *sched, uint64_t seed );
+
+	/**
+	 * @brief  Adds a switch port. A gPTP port whose net_label is name is
+	 * attached to it by LoopbackNetworkInterfaceFactory.
+	 * @param  name Interface name
+	 * @param  address MAC address of the interface
+	 * @return Switch port number
+	 */
+	int addPort( const char *name, LinkLayerAddress address );
+
+	/**
+	 * @brief  Patches two switch ports together
+	 * @param  a First port
+	 * @param  b Second port
+	 * @param  delay_ab Mean delay of frames sent by a, in ns
+	 * @param  delay_ba Mean delay of frames sent by b, in ns
+	 * @param  jitter_ns Standard deviation added to each frame
+	 * @return false if either port does not exist or is already connected
+	 */
+	bool connect
+	( int a, int b, uint64_t delay_ab, uint64_t delay_ba,
+	  double jitter_ns );
+
+	/**
+	 * @brief  Looks up a switch port by interface name
+	 * @return Switch port number, -1 if there is none
+	 */
+	int findPort( const char *name ) const;
+
+	/**
+	 * @brief  Attaches an interface to a switch port
+	 * @return void
+	 */
+	void attach( int port, LoopbackNetworkInterface *iface );
+
+	LinkLayerAddress getAddress( int port ) const {
+		return ports[port].address;
+	}
+
+	/**
+	 * @brief  Queues a frame for the port patched to the sending one
+	 * @return false if nothing is attached at the far end or the frame is
+	 * too large
+	 */
+	bool transmit( int from, const uint8_t *payload, size_t length );
+
+	uint64_t frameCount() const { return frames; }
+};
+
+/**
+ * @brief OSNetworkInterface attached to a LoopbackSwitch port. Frames are
+ * stamped with the PHC of the port's SimTimestamper.
+ */
+class LoopbackNetworkInterface : public OSNetworkInterface {
+	friend class LoopbackSwitch;
+private:
+	LoopbackSwitch *sw;
+	int port;
+	SimTimestamper *timestamper;
+	net_frame_handler handler;
+	void *handler_arg;
+
+	void receive
+	( LinkLayerAddress *source, uint8_t *payload, size_t length );
+public:
+	LoopbackNetworkInterface
+	( LoopbackSwitch *sw, int port, SimTimestamper *timestamper );
+
+	net_result send
+	( LinkLayerAddress *addr, uint16_t etherType, uint8_t *payload,
+	  size_t length, bool timestamp );
+	net_result nrecv
+	( LinkLayerAddress *addr, uint8_t *payload, size_t &length );
+	void getLinkLayerAddress( LinkLayerAddress *addr ) {
+		*addr = sw->getAddress( port );
+	}
+	void watchNetLink( CommonPort *pPort );
+	bool supportsReceiveLoop() { return true; }
+	net_result receiveLoop
+	( CommonPort *pPort, net_frame_handler handler, void *arg );
+	void stopReceiveLoop();
+	unsigned getPayloadOffset() { return 0; }
+};
+
+/**
+ * @brief Builds LoopbackNetworkInterface objects for the ports of a
+ * LoopbackSwitch. The port's timestamper must be a SimTimestamper.
+ */
+class LoopbackNetworkInterfaceFactory : public OSNetworkInterfaceFactory {
+private:
+	LoopbackSwitch *sw;
+
+	bool createInterface
+	( OSNetworkInterface **iface, InterfaceLabel *iflabel,
+	  CommonTimestamper *timestamper );
+public:
+	LoopbackNetworkInterfaceFactory( LoopbackSwitch *sw ) {
+		this->sw = sw;
+	}
+};
+
+#endif/*LOOPBACK_NET_HPP*/
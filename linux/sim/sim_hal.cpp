@@ -0,0 +1,356 @@
+/******************************************************************************
+
+  Copyright (c) 2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#include "sim_hal.hpp"
+
+#include <math.h>
+
+#include <gptp_log.hpp>
+
+#undef GPTP_LOG_SUBSYSTEM
+#define GPTP_LOG_SUBSYSTEM GPTP_LOG_SUBSYS_TIMER
+
+uint64_t SimScheduler::schedule
+( uint64_t at_ns, sim_event_handler func, void *arg )
+{
+	uint64_t id = next_id++;
+	Entry entry;
+
+	if( at_ns < now_ns )
+		at_ns = now_ns;
+	entry.func = func;
+	entry.arg = arg;
+	events[std::make_pair( at_ns, id )] = entry;
+	by_id[id] = at_ns;
+
+	return id;
+}
+
+bool SimScheduler::cancel( uint64_t id )
+{
+	std::map< uint64_t, uint64_t >::iterator iter = by_id.find( id );
+
+	if( iter == by_id.end() )
+		return false;
+	events.erase( std::make_pair( iter->second, id ));
+	by_id.erase( iter );
+
+	return true;
+}
+
+void SimScheduler::runUntil( uint64_t end_ns )
+{
+	while( !events.empty() && events.begin()->first.first <= end_ns ) {
+		EventMap_t::iterator first = events.begin();
+		Entry entry = first->second;
+
+		now_ns = first->first.first;
+		by_id.erase( first->first.second );
+		events.erase( first );
+		++dispatched;
+		entry.func( entry.arg );
+	}
+	if( now_ns < end_ns )
+		now_ns = end_ns;
+}
+
+double SimRandom::gaussian()
+{
+	double u, v, s;
+
+	if( have_spare ) {
+		have_spare = false;
+		return spare;
+	}
+
+	// Marsaglia polar method
+	do {
+		u = 2.0 * uniform() - 1.0;
+		v = 2.0 * uniform() - 1.0;
+		s = u * u + v * v;
+	} while( s >= 1.0 || s == 0.0 );
+	s = sqrt( -2.0 * log( s ) / s );
+	spare = v * s;
+	have_spare = true;
+
+	return u * s;
+}
+
+SimOscillator::SimOscillator
+( double offset_ppm, double wander_ppb, int64_t initial_ns, uint64_t seed )
+	: random( seed )
+{
+	last_ns = 0;
+	phc_ns = initial_ns;
+	phc_frac = 0.0;
+	this->offset_ppm = offset_ppm;
+	wander_ppm = 0.0;
+	wander_sigma = wander_ppb / 1000.0;
+	adjust_ppm = 0.0;
+	phase_steps = 0;
+}
+
+void SimOscillator::advance( uint64_t now_ns )
+{
+	double elapsed;
+	double whole;
+
+	if( now_ns <= last_ns )
+		return;
+
+	elapsed = (double) ( now_ns - last_ns );
+	phc_frac += elapsed * ( 1.0 + rateError() / 1000000.0 );
+	whole = floor( phc_frac );
+	phc_ns += (int64_t) whole;
+	phc_frac -= whole;
+
+	// The random walk moves with the square root of the elapsed time
+	if( wander_sigma > 0.0 )
+		wander_ppm += wander_sigma * sqrt( elapsed / NS_PER_SECOND ) *
+			random.gaussian();
+
+	last_ns = now_ns;
+}
+
+int64_t SimOscillator::read( uint64_t now_ns )
+{
+	advance( now_ns );
+	return phc_ns;
+}
+
+void SimOscillator::adjustRate( uint64_t now_ns, double ppm )
+{
+	advance( now_ns );
+	adjust_ppm = ppm;
+}
+
+void SimOscillator::adjustPhase( uint64_t now_ns, int64_t phase_ns )
+{
+	advance( now_ns );
+	phc_ns += phase_ns;
+	++phase_steps;
+}
+
+void SimOscillator::stepFrequency( uint64_t now_ns, double ppm )
+{
+	advance( now_ns );
+	offset_ppm += ppm;
+}
+
+#undef GPTP_LOG_SUBSYSTEM
+#define GPTP_LOG_SUBSYSTEM GPTP_LOG_SUBSYS_NET
+
+SimTimestamper::SimTimestamper
+( SimScheduler *sched, SimOscillator *phc, unsigned tick_ns )
+{
+	this->sched = sched;
+	this->phc = phc;
+	this->tick_ns = tick_ns > 0 ? tick_ns : 1;
+	version = 1;
+}
+
+int64_t SimTimestamper::stamp()
+{
+	int64_t now = phc->read( sched->now() );
+
+	return now - now % tick_ns;
+}
+
+void SimTimestamper::recordTx( int type, uint16_t sequence, int64_t time_ns )
+{
+	tx_stamps[std::make_pair( type, sequence )] = time_ns;
+}
+
+Timestamp SimTimestamper::toTimestamp( int64_t time_ns, uint8_t version )
+{
+	uint64_t seconds = (uint64_t) time_ns / NS_PER_SECOND;
+
+	return Timestamp
+		( (uint32_t) ( (uint64_t) time_ns % NS_PER_SECOND ),
+		  (uint32_t) seconds, (uint16_t) ( seconds >> 32 ), version );
+}
+
+bool SimTimestamper::HWTimestamper_adjclockrate( float frequency_offset ) const
+{
+	phc->adjustRate( sched->now(), frequency_offset );
+	return true;
+}
+
+bool SimTimestamper::HWTimestamper_adjclockphase( int64_t phase_adjust )
+{
+	phc->adjustPhase( sched->now(), phase_adjust );
+	return true;
+}
+
+bool SimTimestamper::HWTimestamper_gettime
+( Timestamp *system_time, Timestamp *device_time, uint32_t *local_clock,
+  uint32_t *nominal_clock_rate ) const
+{
+	// The system clock is the virtual time itself
+	*system_time = toTimestamp( sched->now(), version );
+	*device_time = toTimestamp( phc->read( sched->now() ), version );
+	*local_clock = 0;
+	*nominal_clock_rate = 0;
+
+	return true;
+}
+
+int SimTimestamper::HWTimestamper_txtimestamp
+( PortIdentity *, PTPMessageId messageId, Timestamp &timestamp,
+  unsigned &clock_value, bool )
+{
+	std::map< std::pair< int, uint16_t >, int64_t >::iterator iter =
+		tx_stamps.find( std::make_pair
+				( (int) messageId.getMessageType(),
+				  messageId.getSequenceId() ));
+
+	if( iter == tx_stamps.end() ) {
+		GPTP_LOG_ERROR( "No simulated TX timestamp for type %d seq %u",
+				messageId.getMessageType(),
+				messageId.getSequenceId() );
+		return GPTP_EC_FAILURE;
+	}
+	timestamp = toTimestamp( iter->second, version );
+	clock_value = 0;
+	tx_stamps.erase( iter );
+
+	return GPTP_EC_SUCCESS;
+}
+
+int SimTimestamper::HWTimestamper_rxtimestamp
+( PortIdentity *, PTPMessageId, Timestamp &, unsigned &, bool )
+{
+	// Receive timestamps travel with the frame
+	return GPTP_EC_FAILURE;
+}
+
+#undef GPTP_LOG_SUBSYSTEM
+#define GPTP_LOG_SUBSYSTEM GPTP_LOG_SUBSYS_TIMER
+
+void SimTimerQueue::fire( void *arg )
+{
+	Event *ev = (Event *) arg;
+
+	ev->queue->pending.erase( ev->id );
+	ev->func( ev->arg );
+	ev->queue->release( ev );
+}
+
+void SimTimerQueue::release( Event *ev )
+{
+	if( ev->rm )
+		delete ev->arg;
+	delete ev;
+}
+
+void SimTimerQueue::cancel( std::vector< Event * > &matched )
+{
+	for( std::vector< Event * >::iterator iter = matched.begin();
+	     iter != matched.end(); ++iter ) {
+		sched->cancel( (*iter)->id );
+		pending.erase( (*iter)->id );
+		release( *iter );
+	}
+}
+
+bool SimTimerQueue::addEvent
+( unsigned long micros, int type, ostimerq_handler func,
+  event_descriptor_t *arg, bool rm, unsigned *event )
+{
+	Event *ev = new Event;
+
+	ev->queue = this;
+	ev->type = type;
+	ev->func = func;
+	ev->arg = arg;
+	ev->rm = rm;
+	ev->id = sched->schedule
+		( sched->now() + (uint64_t) micros * 1000, fire, ev );
+	pending[ev->id] = ev;
+
+	if( event != NULL )
+		*event = (unsigned) ev->id;
+
+	return true;
+}
+
+bool SimTimerQueue::cancelEvent( int type, unsigned *event )
+{
+	std::vector< Event * > matched;
+
+	for( std::map< uint64_t, Event * >::iterator iter = pending.begin();
+	     iter != pending.end(); ++iter ) {
+		Event *ev = iter->second;
+		if( ev->type != type )
+			continue;
+		if( event != NULL && (unsigned) ev->id != *event )
+			continue;
+		matched.push_back( ev );
+	}
+
+	cancel( matched );
+
+	return event == NULL || !matched.empty();
+}
+
+bool SimTimerQueue::cancelPortEvent( CommonPort *target, int type )
+{
+	std::vector< Event * > matched;
+
+	for( std::map< uint64_t, Event * >::iterator iter = pending.begin();
+	     iter != pending.end(); ++iter ) {
+		Event *ev = iter->second;
+		if( ev->type == type && ev->arg != NULL &&
+		    ev->arg->port == target )
+			matched.push_back( ev );
+	}
+
+	cancel( matched );
+
+	return true;
+}
+
+SimTimerQueue::~SimTimerQueue()
+{
+	for( std::map< uint64_t, Event * >::iterator iter = pending.begin();
+	     iter != pending.end(); ++iter ) {
+		sched->cancel( iter->first );
+		release( iter->second );
+	}
+}
+
+OSTimerQueue *SimTimerQueueFactory::createOSTimerQueue
+( IEEE1588Clock * )
+{
+	return new SimTimerQueue( sched );
+}
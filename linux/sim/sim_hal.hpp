@@ -0,0 +1,383 @@
+/******************************************************************************
+
+  Copyright (c) 2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#ifndef SIM_HAL_HPP
+#define SIM_HAL_HPP
+
+/**@file*/
+
+#include <stdint.h>
+#include <map>
+#include <vector>
+
+#include <avbts_oslock.hpp>
+#include <avbts_oscondition.hpp>
+#include <avbts_osthread.hpp>
+#include <avbts_ostimer.hpp>
+#include <avbts_ostimerq.hpp>
+#include <ether_tstamper.hpp>
+
+/*
+ * Virtual time HAL for running the common gPTP code without a NIC. All
+ * activity - timer queue callbacks and frame deliveries - is an event on a
+ * single SimScheduler, executed in time order on the calling thread, so a
+ * run is deterministic for a given seed and as fast as the CPU allows.
+ */
+
+typedef void (*sim_event_handler) ( void *arg );
+
+/**
+ * @brief Discrete event scheduler keeping the virtual time of the simulation
+ */
+class SimScheduler {
+private:
+	struct Entry {
+		sim_event_handler func;
+		void *arg;
+	};
+	/* Ordered by (time, insertion order) so equal times run FIFO */
+	typedef std::map< std::pair< uint64_t, uint64_t >, Entry > EventMap_t;
+
+	EventMap_t events;
+	std::map< uint64_t, uint64_t > by_id;	/* id to time */
+	uint64_t now_ns;
+	uint64_t next_id;
+	uint64_t dispatched;
+public:
+	SimScheduler() : now_ns( 0 ), next_id( 1 ), dispatched( 0 ) {}
+
+	/**
+	 * @brief  Current virtual time
+	 * @return Nanoseconds since the start of the simulation
+	 */
+	uint64_t now() const { return now_ns; }
+
+	/**
+	 * @brief  Number of events run so far
+	 * @return event count
+	 */
+	uint64_t eventCount() const { return dispatched; }
+
+	/**
+	 * @brief  Runs func( arg ) at virtual time at_ns
+	 * @return Non-zero id for cancel()
+	 */
+	uint64_t schedule( uint64_t at_ns, sim_event_handler func, void *arg );
+
+	/**
+	 * @brief  Removes an event that has not run yet
+	 * @param  id Value returned by schedule()
+	 * @return false if the event already ran or was cancelled
+	 */
+	bool cancel( uint64_t id );
+
+	/**
+	 * @brief  Runs events in time order until the next one is later than
+	 * end_ns, then advances the virtual time to end_ns
+	 * @return void
+	 */
+	void runUntil( uint64_t end_ns );
+};
+
+/**
+ * @brief Deterministic pseudo random source (xorshift64*), the same
+ * sequence on every platform for a given seed
+ */
+class SimRandom {
+private:
+	uint64_t state;
+	bool have_spare;
+	double spare;
+public:
+	SimRandom( uint64_t seed = 1 ) { reseed( seed ); }
+
+	void reseed( uint64_t seed ) {
+		state = seed != 0 ? seed : 0x9E3779B97F4A7C15ULL;
+		have_spare = false;
+	}
+
+	uint64_t next() {
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		return state * 0x2545F4914F6CDD1DULL;
+	}
+
+	/**
+	 * @brief  Uniform value in [0, 1)
+	 */
+	double uniform() {
+		return (next() >> 11) * (1.0 / 9007199254740992.0);
+	}
+
+	/**
+	 * @brief  Normally distributed value with zero mean and unit variance
+	 */
+	double gaussian();
+};
+
+/**
+ * @brief Free running oscillator driving a simulated PHC
+ *
+ * The fractional frequency error is the sum of a fixed offset, a random
+ * walk (wander) and temperature steps applied during the run. Rate and
+ * phase adjustments made through the timestamper are applied on top, as
+ * a PHC adjfreq/adjtime would.
+ */
+class SimOscillator {
+private:
+	SimRandom random;
+	uint64_t last_ns;	/* virtual time of the last update */
+	int64_t phc_ns;
+	double phc_frac;	/* sub-nanosecond part of phc_ns */
+	double offset_ppm;
+	double wander_ppm;	/* current random walk value */
+	double wander_sigma;	/* ppm per square root second */
+	double adjust_ppm;
+	unsigned phase_steps;
+
+	void advance( uint64_t now_ns );
+public:
+	/**
+	 * @brief  Creates an oscillator
+	 * @param  offset_ppm Initial frequency error
+	 * @param  wander_ppb Random walk of the frequency, ppb per square
+	 * root second
+	 * @param  initial_ns PHC time at virtual time zero
+	 * @param  seed Random seed for the wander
+	 */
+	SimOscillator
+	( double offset_ppm, double wander_ppb, int64_t initial_ns,
+	  uint64_t seed );
+
+	/**
+	 * @brief  Reads the PHC
+	 * @param  now_ns Current virtual time
+	 * @return PHC time in ns
+	 */
+	int64_t read( uint64_t now_ns );
+
+	/**
+	 * @brief  Frequency error including the adjustment, relative to the
+	 * virtual time
+	 * @return ppm
+	 */
+	double rateError() const {
+		return offset_ppm + wander_ppm + adjust_ppm;
+	}
+
+	void adjustRate( uint64_t now_ns, double ppm );
+	void adjustPhase( uint64_t now_ns, int64_t phase_ns );
+
+	/**
+	 * @brief  Adds a step to the free running frequency, as a
+	 * temperature change would
+	 */
+	void stepFrequency( uint64_t now_ns, double ppm );
+
+	unsigned getPhaseSteps() const { return phase_steps; }
+};
+
+/**
+ * @brief EtherTimestamper reading a SimOscillator. Transmit timestamps
+ * are captured by the simulated network when a frame is sent; receive
+ * timestamps are handed to the port with the frame.
+ */
+class SimTimestamper : public EtherTimestamper {
+private:
+	SimScheduler *sched;
+	SimOscillator *phc;
+	unsigned tick_ns;
+	std::map< std::pair< int, uint16_t >, int64_t > tx_stamps;
+public:
+	/**
+	 * @param  sched Scheduler providing the virtual time
+	 * @param  phc Oscillator used as the PHC
+	 * @param  tick_ns Timestamp resolution, e.g. 8 for a 125 MHz clock
+	 */
+	SimTimestamper
+	( SimScheduler *sched, SimOscillator *phc, unsigned tick_ns );
+
+	/**
+	 * @brief  PHC time quantized to the timestamp resolution
+	 * @return PHC time in ns
+	 */
+	int64_t stamp();
+
+	/**
+	 * @brief  Records the transmit timestamp of an event message
+	 * @param  type PTP message type
+	 * @param  sequence PTP sequence id
+	 * @param  time_ns PHC time the frame left the port
+	 */
+	void recordTx( int type, uint16_t sequence, int64_t time_ns );
+
+	static Timestamp toTimestamp( int64_t time_ns, uint8_t version );
+
+	bool HWTimestamper_adjclockrate( float frequency_offset ) const;
+	bool HWTimestamper_adjclockphase( int64_t phase_adjust );
+	bool HWTimestamper_gettime
+	( Timestamp *system_time, Timestamp *device_time,
+	  uint32_t *local_clock, uint32_t *nominal_clock_rate ) const;
+	int HWTimestamper_txtimestamp
+	( PortIdentity *identity, PTPMessageId messageId,
+	  Timestamp &timestamp, unsigned &clock_value, bool last );
+	int HWTimestamper_rxtimestamp
+	( PortIdentity *identity, PTPMessageId messageId,
+	  Timestamp &timestamp, unsigned &clock_value, bool last );
+};
+
+/**
+ * @brief OSTimerQueue running its events on a SimScheduler
+ */
+class SimTimerQueue : public OSTimerQueue {
+	friend class SimTimerQueueFactory;
+private:
+	struct Event {
+		SimTimerQueue *queue;
+		uint64_t id;
+		int type;
+		ostimerq_handler func;
+		event_descriptor_t *arg;
+		bool rm;
+	};
+	SimScheduler *sched;
+	std::map< uint64_t, Event * > pending;
+
+	static void fire( void *arg );
+	void release( Event *ev );
+	void cancel( std::vector< Event * > &matched );
+protected:
+	SimTimerQueue( SimScheduler *sched ) : sched( sched ) {}
+public:
+	bool addEvent
+	( unsigned long micros, int type, ostimerq_handler func,
+	  event_descriptor_t *arg, bool rm, unsigned *event );
+	bool cancelEvent( int type, unsigned *event );
+	bool cancelPortEvent( CommonPort *target, int type );
+	~SimTimerQueue();
+};
+
+/**
+ * @brief Creates SimTimerQueue objects sharing one scheduler
+ */
+class SimTimerQueueFactory : public OSTimerQueueFactory {
+private:
+	SimScheduler *sched;
+public:
+	SimTimerQueueFactory( SimScheduler *sched ) : sched( sched ) {}
+	OSTimerQueue *createOSTimerQueue( IEEE1588Clock *clock );
+};
+
+/**
+ * @brief OSLock for the single threaded simulation; only counts
+ */
+class SimLock : public OSLock {
+	friend class SimLockFactory;
+private:
+	unsigned depth;
+protected:
+	SimLock() : depth( 0 ) {}
+	~SimLock() {}
+public:
+	OSLockResult lock() { ++depth; return oslock_ok; }
+	OSLockResult trylock() { ++depth; return oslock_ok; }
+	OSLockResult unlock() {
+		if( depth == 0 )
+			return oslock_fail;
+		--depth;
+		return oslock_ok;
+	}
+};
+
+class SimLockFactory : public OSLockFactory {
+public:
+	OSLock *createLock( OSLockType ) const { return new SimLock(); }
+};
+
+/**
+ * @brief OSCondition that never blocks. Everything a port would wait for
+ * has already happened when the simulation calls wait().
+ */
+class SimCondition : public OSCondition {
+public:
+	bool wait() { return true; }
+	bool wait_prelock() { return true; }
+	bool signal() { return true; }
+};
+
+class SimConditionFactory : public OSConditionFactory {
+public:
+	OSCondition *createCondition() const { return new SimCondition(); }
+};
+
+/**
+ * @brief OSThread running its function to completion inside start().
+ * Port threads return at once because the simulated network interface
+ * uses an event driven receive loop and does not watch a real link.
+ */
+class SimThread : public OSThread {
+private:
+	OSThreadExitCode exit_code;
+public:
+	SimThread() : exit_code( osthread_ok ) {}
+	bool start( OSThreadFunction function, void *arg ) {
+		exit_code = function( arg );
+		return true;
+	}
+	bool join( OSThreadExitCode &exit_code ) {
+		exit_code = this->exit_code;
+		return true;
+	}
+};
+
+class SimThreadFactory : public OSThreadFactory {
+public:
+	OSThread *createThread() const { return new SimThread(); }
+};
+
+/**
+ * @brief OSTimer returning at once. The simulated timestamps are always
+ * available, so the retry sleeps never matter.
+ */
+class SimTimer : public OSTimer {
+public:
+	unsigned long sleep( unsigned long micro ) { return micro; }
+};
+
+class SimTimerFactory : public OSTimerFactory {
+public:
+	OSTimer *createTimer() const { return new SimTimer(); }
+};
+
+#endif/*SIM_HAL_HPP*/
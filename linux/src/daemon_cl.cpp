@@ -46,7 +46,10 @@
 #include "linux_hal_generic.hpp"
 #endif
 
+#include "linux_crossts.hpp"
 #include "linux_hal_persist_file.hpp"
+#include "linux_capture_file.hpp"
+#include "linux_hal_timerfd.hpp"
 #include <ctype.h>
 #include <inttypes.h>
 #include <signal.h>
@@ -77,6 +80,9 @@ void print_usage( char *arg0 ) {
 			"[-T] [-L] [-E] [-GM] [-N] [-INITSYNC <value>] [-OPERSYNC <value>] "
 			"[-INITPDELAY <value>] [-OPERPDELAY <value>] "
 			"[-F <path to gptp_cfg.ini file>] "
+			"[-TIMERQ <timerfd|signal>] [-XTS <rate>[,<window>]] "
+			"[-LOG <[subsystem=]level,...>] [-SHM <name>] [-NOTIFY <path>] "
+			"[-CAPTURE <path>[,<files>[,<records>]]] "
 			"\n",
 			arg0 );
 	fprintf
@@ -85,6 +91,8 @@ void print_usage( char *arg0 ) {
 		  "\t-P pulse per second\n"
 		  "\t-M <filename> save/restore state\n"
 		  "\t-G <group> group id for shared memory\n"
+		  "\t-SHM <name> shared memory name (default " SHM_NAME "), one per daemon\n"
+		  "\t-NOTIFY <path> stream state changes on a Unix domain socket\n"
 		  "\t-R <priority 1> priority 1 value\n"
 		  "\t-D Phy Delay <gb_tx_delay,gb_rx_delay,mb_tx_delay,mb_rx_delay>\n"
 		  "\t-T force master (ignored when Automotive Profile set)\n"
@@ -99,6 +107,17 @@ void print_usage( char *arg0 ) {
 		  "\t-INITPDELAY <value> initial pdelay interval (Log base 2. 0 = 1 second)\n"
 		  "\t-OPERPDELAY <value> operational pdelay interval (Log base 2. 0 = 1 sec)\n"
 		  "\t-F <path-to-ini-file>\n"
+		  "\t-TIMERQ <timerfd|signal> timer queue backend (default timerfd)\n"
+		  "\t-XTS <rate>[,<window>] estimate the PHC against the system clock\n"
+		  "\t     from <rate> cross timestamps a second in the background,\n"
+		  "\t     fitted over the last <window> (default 32)\n"
+		  "\t-LOG <[subsystem=]level,...> runtime log levels, subsystems:\n"
+		  "\t     general, timer, net, servo, bmca, pdelay; levels: critical,\n"
+		  "\t     error, exception, warning, info, status, debug, verbose\n"
+		  "\t-CAPTURE <path>[,<files>[,<records>]] record every Sync processed\n"
+		  "\t     as slave to <files> rotating files <path>.0, <path>.1, ...\n"
+		  "\t     of <records> records each (default %u of %u)\n",
+		  GPTP_CAPTURE_FILES_DEFAULT, GPTP_CAPTURE_RECORDS_DEFAULT
 		);
 }
 
@@ -153,11 +172,18 @@ int main(int argc, char **argv)
 	off_t restoredatacount = 0;
 	bool restorefailed = false;
 	LinuxIPCArg *ipc_arg = NULL;
+	const char *ipc_group = NULL;
+	const char *ipc_shm_name = NULL;
+	const char *ipc_notify_path = NULL;
 	bool use_config_file = false;
 	char config_file_path[512];
 	memset(config_file_path, 0, 512);
 
 	GPTPPersist *pGPTPPersist = NULL;
+	GPTPCapture *capture = NULL;
+	const char *capture_path = NULL;
+	unsigned capture_files = GPTP_CAPTURE_FILES_DEFAULT;
+	unsigned capture_records = GPTP_CAPTURE_RECORDS_DEFAULT;
 	LinuxThreadFactory *thread_factory = new LinuxThreadFactory();
 
 	// Block SIGUSR1
@@ -184,7 +210,7 @@ int main(int argc, char **argv)
 	portInit.index = 0;
 	portInit.timestamper = NULL;
 	portInit.net_label = NULL;
-	portInit.profile = createStandardProfile(); // Initialize with default standard profile
+	portInit.profile = gPTPProfileFactory::createStandardProfile(); // Initialize with default standard profile
 	portInit.isGM = false;
 	portInit.testMode = false;
 	portInit.linkUp = false;
@@ -206,7 +232,10 @@ int main(int argc, char **argv)
 		new LinuxNetworkInterfaceFactory;
 	OSNetworkInterfaceFactory::registerFactory
 		(factory_name_t("default"), default_factory);
-	LinuxTimerQueueFactory *timerq_factory = new LinuxTimerQueueFactory();
+	OSTimerQueueFactory *timerq_factory = NULL;
+	bool use_signal_timerq = false;
+	unsigned crossts_rate = 0;
+	unsigned crossts_window = CROSSTS_WINDOW_DEFAULT;
 	LinuxLockFactory *lock_factory = new LinuxLockFactory();
 	LinuxTimerFactory *timer_factory = new LinuxTimerFactory();
 	LinuxConditionFactory *condition_factory = new LinuxConditionFactory();
@@ -250,11 +279,29 @@ int main(int argc, char **argv)
 			}
 			else if( strcmp(argv[i] + 1,  "G") == 0 ) {
 				if( i+1 < argc ) {
-					ipc_arg = new LinuxIPCArg(argv[++i]);
+					ipc_group = argv[++i];
 				} else {
 					printf( "Must specify group name on the command line\n" );
 				}
 			}
+			else if( strcmp(argv[i] + 1,  "SHM") == 0 ) {
+				if( i+1 < argc && argv[i+1][0] == '/' ) {
+					ipc_shm_name = argv[++i];
+				} else {
+					fprintf( stderr, "Shared memory name must start with '/'\n" );
+					print_usage(argv[0]);
+					return -1;
+				}
+			}
+			else if( strcmp(argv[i] + 1,  "NOTIFY") == 0 ) {
+				if( i+1 < argc ) {
+					ipc_notify_path = argv[++i];
+				} else {
+					fprintf( stderr, "Must specify change log socket path\n" );
+					print_usage(argv[0]);
+					return -1;
+				}
+			}
 			else if( strcmp(argv[i] + 1,  "P") == 0 ) {
 				pps = true;
 			}
@@ -308,7 +355,7 @@ int main(int argc, char **argv)
 					( phy_delay[2], phy_delay[3] );
 			}
 			else if (strcmp(argv[i] + 1, "V") == 0) {
-				portInit.profile = createAutomotiveProfile();
+				portInit.profile = gPTPProfileFactory::createAutomotiveProfile();
 			}
 			else if (strcmp(argv[i] + 1, "GM") == 0) {
 				portInit.isGM = true;
@@ -320,13 +367,13 @@ int main(int argc, char **argv)
 				if (i + 1 < argc) {
 					++i;
 					if (strcmp(argv[i], "standard") == 0) {
-						portInit.profile = createStandardProfile();
+						portInit.profile = gPTPProfileFactory::createStandardProfile();
 					} else if (strcmp(argv[i], "automotive") == 0) {
-						portInit.profile = createAutomotiveProfile();
+						portInit.profile = gPTPProfileFactory::createAutomotiveProfile();
 					} else if (strcmp(argv[i], "milan") == 0) {
-						portInit.profile = createMilanProfile();
+						portInit.profile = gPTPProfileFactory::createMilanProfile();
 					} else if (strcmp(argv[i], "avnu_base") == 0) {
-						portInit.profile = createAvnuBaseProfile();
+						portInit.profile = gPTPProfileFactory::createAvnuBaseProfile();
 					} else {
 						fprintf(stderr, "Invalid profile: %s. Supported: standard, automotive, milan, avnu_base\n", argv[i]);
 						print_usage(argv[0]);
@@ -353,6 +400,76 @@ int main(int argc, char **argv)
 			else if (strcmp(argv[i] + 1, "OPERPDELAY") == 0) {
 				portInit.operLogPdelayReqInterval = atoi(argv[++i]);
 			}
+			else if (strcmp(argv[i] + 1, "TIMERQ") == 0) {
+				if (i + 1 < argc) {
+					++i;
+					if (strcmp(argv[i], "timerfd") == 0) {
+						use_signal_timerq = false;
+					} else if (strcmp(argv[i], "signal") == 0) {
+						use_signal_timerq = true;
+					} else {
+						fprintf(stderr, "Invalid timer queue: %s. Supported: timerfd, signal\n", argv[i]);
+						print_usage(argv[0]);
+						return -1;
+					}
+				} else {
+					fprintf(stderr, "Timer queue backend must be specified.\n");
+					print_usage(argv[0]);
+					return -1;
+				}
+			}
+			else if (strcmp(argv[i] + 1, "XTS") == 0) {
+				if( i+1 >= argc ||
+				    sscanf( argv[++i], "%u,%u", &crossts_rate,
+					    &crossts_window ) < 1 ||
+				    crossts_rate == 0 ||
+				    crossts_window < CROSSTS_MIN_SAMPLES ||
+				    crossts_window > CROSSTS_WINDOW_MAX ) {
+					fprintf( stderr, "Invalid cross timestamp "
+						 "rate and window, the window "
+						 "must be %u to %u samples\n",
+						 CROSSTS_MIN_SAMPLES,
+						 CROSSTS_WINDOW_MAX );
+					print_usage(argv[0]);
+					return -1;
+				}
+			}
+			else if (strcmp(argv[i] + 1, "CAPTURE") == 0) {
+				char *sizes;
+
+				if( i+1 >= argc ) {
+					fprintf( stderr, "Capture path must be specified\n" );
+					print_usage(argv[0]);
+					return -1;
+				}
+				capture_path = argv[++i];
+				sizes = strchr( argv[i], ',' );
+				if( sizes != NULL ) {
+					*sizes++ = '\0';
+					if( sscanf( sizes, "%u,%u", &capture_files,
+						    &capture_records ) < 1 ||
+					    capture_files == 0 ||
+					    capture_files > GPTP_CAPTURE_FILES_MAX ||
+					    capture_records < GPTP_CAPTURE_RECORDS_MIN ) {
+						fprintf( stderr, "Invalid capture size, "
+							 "1 to %u files of at least "
+							 "%u records\n",
+							 GPTP_CAPTURE_FILES_MAX,
+							 GPTP_CAPTURE_RECORDS_MIN );
+						print_usage(argv[0]);
+						return -1;
+					}
+				}
+			}
+			else if (strcmp(argv[i] + 1, "LOG") == 0) {
+				if (i + 1 < argc && gptplogSetLevels(argv[i + 1])) {
+					++i;
+				} else {
+					fprintf(stderr, "Invalid log level list.\n");
+					print_usage(argv[0]);
+					return -1;
+				}
+			}
 			else if (strcmp(argv[i] + 1, "F") == 0)
 			{
 				if( i+1 < argc ) {
@@ -374,6 +491,11 @@ int main(int argc, char **argv)
 	}
 	portInit.phy_delay = &ether_phy_delay;
 
+	if( ipc_group != NULL || ipc_shm_name != NULL || ipc_notify_path != NULL ) {
+		ipc_arg = new LinuxIPCArg
+			( ipc_group != NULL ? ipc_group : DEFAULT_GROUPNAME, ipc_shm_name,
+			  ipc_notify_path );
+	}
 	if( !ipc->init( ipc_arg ) ) {
 		delete ipc;
 		ipc = NULL;
@@ -406,28 +528,14 @@ int main(int argc, char **argv)
 		return -1;
 	}
 
-	pClock = new IEEE1588Clock
-		( false, syntonize, priority1, timerq_factory, ipc,
-		  lock_factory );
-
-	if( restoredataptr != NULL ) {
-		if( !restorefailed )
-			restorefailed =
-				!pClock->restoreSerializedState( restoredataptr, &restoredatacount );
-		restoredataptr = ((char *)restoredata) + (restoredatalength - restoredatacount);
+	if( use_signal_timerq ) {
+		GPTP_LOG_INFO("Using SIGUSR1 timer queue");
+		timerq_factory = new LinuxTimerQueueFactory();
+	} else {
+		GPTP_LOG_INFO("Using timerfd timer queue");
+		timerq_factory = new LinuxTimerFdQueueFactory();
 	}
 
-	// TODO: The setting of values into temporary variables should be changed to
-	// just set directly into the portInit struct.
-	portInit.clock = pClock;
-	portInit.index = 1;
-	portInit.timestamper = timestamper;
-	portInit.net_label = ifname;
-	portInit.condition_factory = condition_factory;
-	portInit.thread_factory = thread_factory;
-	portInit.timer_factory = timer_factory;
-	portInit.lock_factory = lock_factory;
-
 	if(use_config_file)
 	{
 		GptpIniParser iniParser(config_file_path);
@@ -462,12 +570,56 @@ int main(int argc, char **argv)
 			}
 
 			portInit.allowNegativeCorrField = iniParser.getAllowNegativeCorrField();
+
+			iniParser.applyServoConfig( portInit.profile.servo );
+			GPTP_LOG_INFO("Clock servo: %s",
+				      ClockServoConfig::typeName( portInit.profile.servo.type ));
 			GPTP_LOG_INFO("SyncFollowUp with negative correction field: %s",
 						  portInit.allowNegativeCorrField ? "permitted" : "forbidden");
 		}
 
 	}
 
+	// The clock creates its servo, so the [servo] section is read first
+	pClock = new IEEE1588Clock
+		( false, syntonize, priority1, timerq_factory, ipc,
+		  lock_factory, portInit.profile.servo );
+
+	if( restoredataptr != NULL ) {
+		if( !restorefailed )
+			restorefailed =
+				!pClock->restoreSerializedState( restoredataptr, &restoredatacount );
+		restoredataptr = ((char *)restoredata) + (restoredatalength - restoredatacount);
+	}
+
+	// TODO: The setting of values into temporary variables should be changed to
+	// just set directly into the portInit struct.
+	portInit.clock = pClock;
+	portInit.index = 1;
+	portInit.timestamper = timestamper;
+	portInit.net_label = ifname;
+	portInit.condition_factory = condition_factory;
+	portInit.thread_factory = thread_factory;
+	portInit.timer_factory = timer_factory;
+	portInit.lock_factory = lock_factory;
+
+	if( capture_path != NULL ) {
+		capture = makeLinuxGPTPCaptureFile();
+		if( capture->initCapture
+		    ( capture_path, capture_files, capture_records,
+		      portInit.profile.profile_name.c_str(),
+		      (uint8_t) portInit.profile.get_clock_quality_profile_type(),
+		      portInit.operLogSyncInterval != LOG2_INTERVAL_INVALID ?
+		      portInit.operLogSyncInterval :
+		      portInit.profile.sync_interval_log )) {
+			pClock->setCapture( capture );
+		} else {
+			GPTP_LOG_ERROR("Failed to create capture files");
+			delete capture;
+			capture = NULL;
+		}
+	}
+
 	pPort = new EtherPort(&portInit);
 
 	if (!pPort->init_port()) {
@@ -485,7 +637,7 @@ int main(int argc, char **argv)
 		restoredataptr = ((char *)restoredata) + (restoredatalength - restoredatacount);
 	}
 
-	if (portInit.profile.type == GPTP_PROFILE_AUTOMOTIVE) {
+	if (portInit.profile.profile_name == "automotive") {
 		if (portInit.isGM) {
 			port_state = PTP_MASTER;
 		}
@@ -499,6 +651,14 @@ int main(int argc, char **argv)
 		pPort->setPortState( port_state );
 	}
 
+#ifndef ARCH_INTELCE
+	if( crossts_rate > 0 &&
+	    !((LinuxTimestamperGeneric *) timestamper)->startCrossTimestamping
+	    ( crossts_rate, crossts_window )) {
+		GPTP_LOG_ERROR("Failed to start background cross timestamping");
+	}
+#endif
+
 	// Start PPS if requested
 	if( pps ) {
 		if( !timestamper->HWTimestamper_PPS_start()) {
@@ -563,6 +723,23 @@ int main(int argc, char **argv)
 	pPort->joinLinkWatchThread(linkExitCode);
 	GPTP_LOG_INFO("All threads terminated");
 
+	if( capture ) {
+		pClock->setCapture( NULL );
+		if( !capture->closeCapture() )
+			GPTP_LOG_ERROR("Failed to write out capture files");
+		delete capture;
+	}
+
+	PTPMessagePoolStats pool_stats;
+	PTPMessageCommon::getPoolStats( &pool_stats );
+	GPTP_LOG_INFO
+		( "Message pool: %u of %u blocks used at peak, "
+		  "%llu allocations, %llu heap fallbacks",
+		  pool_stats.high_water,
+		  pool_stats.chunks * PTP_MESSAGE_POOL_CHUNK,
+		  (unsigned long long) pool_stats.allocations,
+		  (unsigned long long) pool_stats.heap_fallbacks );
+
 	if( ipc ) delete ipc;
 
 	GPTP_LOG_UNREGISTER();
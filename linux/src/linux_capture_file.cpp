@@ -0,0 +1,236 @@
+/******************************************************************************
+
+  Copyright (c) 2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <gptp_log.hpp>
+#include "linux_capture_file.hpp"
+
+class LinuxGPTPCaptureFile : public GPTPCapture {
+private:
+	struct CaptureFile {
+		int fd;
+		GPTPCaptureFileHeader *header;
+		GPTPCaptureRecord *records;
+	};
+
+	CaptureFile files[GPTP_CAPTURE_FILES_MAX];
+	unsigned file_count;
+	uint64_t file_records;
+	size_t file_size;
+	uint64_t appended;	/* Records numbered so far, taken atomically */
+
+	/* Resets the header of a file about to take records again */
+	/* Header fields only move forward, whatever order writers finish in */
+	static void raise( uint64_t *field, uint64_t value ) {
+		uint64_t current = __atomic_load_n( field, __ATOMIC_RELAXED );
+
+		while( current < value &&
+		       !__atomic_compare_exchange_n
+		       ( field, &current, value, true, __ATOMIC_RELEASE,
+			 __ATOMIC_RELAXED ))
+			;
+	}
+
+	void startFile( CaptureFile *file, uint64_t file_sequence ) {
+		GPTPCaptureFileHeader *header = file->header;
+		struct timespec now;
+
+		clock_gettime( CLOCK_REALTIME, &now );
+		__atomic_store_n( &header->record_count, 0, __ATOMIC_RELAXED );
+		__atomic_store_n( &header->file_sequence, file_sequence, __ATOMIC_RELAXED );
+		__atomic_store_n
+			( &header->start_time_ns,
+			  (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec,
+			  __ATOMIC_RELEASE );
+	}
+
+	bool openFile
+	( CaptureFile *file, const char *path, unsigned index,
+	  const GPTPCaptureFileHeader *prototype ) {
+		char name[PATH_MAX];
+		int err;
+
+		if( snprintf( name, sizeof(name), "%s.%u", path, index ) >=
+		    (int) sizeof(name) ) {
+			GPTP_LOG_ERROR( "Capture file path too long" );
+			return false;
+		}
+
+		file->fd = open( name, O_RDWR | O_CREAT | O_TRUNC,
+				 S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH );
+		if( file->fd == -1 ) {
+			GPTP_LOG_ERROR( "Failed to open capture file %s: %s",
+					name, strerror( errno ));
+			return false;
+		}
+
+		/* Allocate every block now, rather than on a page fault
+		   in the PTP thread, and fail now if the disk is full */
+		err = posix_fallocate( file->fd, 0, file_size );
+		if( err != 0 ) {
+			GPTP_LOG_ERROR( "Failed to allocate capture file %s: %s",
+					name, strerror( err ));
+			return false;
+		}
+
+		void *map = mmap( NULL, file_size, PROT_READ | PROT_WRITE,
+				  MAP_SHARED | MAP_POPULATE, file->fd, 0 );
+		if( map == MAP_FAILED ) {
+			GPTP_LOG_ERROR( "Failed to map capture file %s: %s",
+					name, strerror( errno ));
+			return false;
+		}
+		file->header = (GPTPCaptureFileHeader *) map;
+		file->records = (GPTPCaptureRecord *)
+			((char *) map + GPTP_CAPTURE_HEADER_SIZE );
+
+		memcpy( file->header, prototype, sizeof(*prototype) );
+		file->header->file_index = index;
+		file->header->file_sequence = index;
+		return true;
+	}
+
+protected:
+	void append( const GPTPCaptureRecord &record ) {
+		uint64_t number =
+			__atomic_fetch_add( &appended, 1, __ATOMIC_RELAXED );
+		uint64_t file_sequence = number / file_records;
+		uint64_t slot = number % file_records;
+		CaptureFile *file = &files[file_sequence % file_count];
+		GPTPCaptureRecord *entry = &file->records[slot];
+
+		if( slot == 0 ) {
+			startFile( file, file_sequence );
+		}
+
+		/* Readers take a record once its number matches its slot and
+		   is unchanged after they copied the rest */
+		__atomic_store_n( &entry->sequence, 0, __ATOMIC_RELAXED );
+		__atomic_thread_fence( __ATOMIC_RELEASE );
+		memcpy( (char *) entry + sizeof(entry->sequence),
+			(const char *) &record + sizeof(record.sequence),
+			sizeof(record) - sizeof(record.sequence) );
+		__atomic_store_n( &entry->sequence, number + 1, __ATOMIC_RELEASE );
+
+		/* Advisory, see GPTPCaptureFileHeader. A concurrent
+		   startFile() may still reset it; the next record raises it
+		   again. */
+		raise( &file->header->file_sequence, file_sequence );
+		raise( &file->header->record_count, slot + 1 );
+	}
+
+public:
+	LinuxGPTPCaptureFile() {
+		file_count = 0;
+		file_records = 0;
+		file_size = 0;
+		appended = 0;
+	}
+
+	~LinuxGPTPCaptureFile() {
+		closeCapture();
+	}
+
+	bool initCapture
+	( const char *path, unsigned file_count, uint32_t file_records,
+	  const char *profile_name, uint8_t profile_type,
+	  int8_t log_sync_interval ) {
+		GPTPCaptureFileHeader prototype;
+		unsigned i;
+
+		closeCapture();
+		if( file_count == 0 || file_count > GPTP_CAPTURE_FILES_MAX ||
+		    file_records < GPTP_CAPTURE_RECORDS_MIN ) {
+			GPTP_LOG_ERROR( "Invalid capture file count or size" );
+			return false;
+		}
+
+		memset( &prototype, 0, sizeof(prototype) );
+		gptpCaptureDescribe( &prototype );
+		prototype.file_count = file_count;
+		prototype.capacity = file_records;
+		strncpy( prototype.profile_name, profile_name,
+			 sizeof(prototype.profile_name) - 1 );
+		prototype.profile_type = profile_type;
+		prototype.log_sync_interval = log_sync_interval;
+
+		this->file_records = file_records;
+		file_size = GPTP_CAPTURE_HEADER_SIZE +
+			(size_t) file_records * sizeof(GPTPCaptureRecord);
+		appended = 0;
+		for( i = 0; i < file_count; ++i ) {
+			this->file_count = i + 1;
+			files[i].fd = -1;
+			files[i].header = NULL;
+			if( !openFile( &files[i], path, i, &prototype )) {
+				closeCapture();
+				return false;
+			}
+		}
+
+		GPTP_LOG_STATUS( "Capturing Syncs to %u files of %u records at %s",
+				 file_count, file_records, path );
+		return true;
+	}
+
+	bool closeCapture(void) {
+		bool ok = true;
+		unsigned i;
+
+		for( i = 0; i < file_count; ++i ) {
+			if( files[i].header != NULL ) {
+				if( msync( files[i].header, file_size, MS_SYNC ) != 0 )
+					ok = false;
+				munmap( files[i].header, file_size );
+			}
+			if( files[i].fd != -1 )
+				close( files[i].fd );
+		}
+		file_count = 0;
+		return ok;
+	}
+};
+
+GPTPCapture *makeLinuxGPTPCaptureFile()
+{
+	return new LinuxGPTPCaptureFile();
+}
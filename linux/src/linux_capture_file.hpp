@@ -0,0 +1,57 @@
+/******************************************************************************
+
+  Copyright (c) 2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#ifndef LINUX_CAPTURE_FILE_HPP
+#define LINUX_CAPTURE_FILE_HPP
+
+#include "avbts_capture.hpp"
+
+/**@file*/
+
+#define GPTP_CAPTURE_FILES_DEFAULT 4		/*!< Files in a capture set */
+#define GPTP_CAPTURE_FILES_MAX 64		/*!< Most files in a capture set */
+#define GPTP_CAPTURE_RECORDS_DEFAULT 262144	/*!< Records per file, 16 MiB */
+#define GPTP_CAPTURE_RECORDS_MIN 16		/*!< Fewest records per file */
+
+/**
+ * @brief  Creates a GPTPCapture writing to memory mapped files
+ *
+ * initCapture() creates the whole file set at its final size and maps
+ * it with its pages faulted in, so appending a record is a copy into
+ * memory and an atomic increment, without system calls. The kernel
+ * writes the pages back; records survive the daemon exiting abnormally.
+ * @return Pointer to the GPTPCapture instance or NULL on failure
+ */
+GPTPCapture *makeLinuxGPTPCaptureFile();
+
+#endif	/* LINUX_CAPTURE_FILE_HPP */
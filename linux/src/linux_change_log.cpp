@@ -0,0 +1,266 @@
+/******************************************************************************
+
+  Copyright (c) 2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#include <linux_change_log.hpp>
+#include <gptp_log.hpp>
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+
+#define CHANGE_LOG_BACKLOG 4
+
+LinuxChangeLogServer::LinuxChangeLogServer()
+{
+	listen_fd = -1;
+	event_fd = -1;
+	client_count = 0;
+	thread_valid = false;
+	stopping = false;
+	segment = NULL;
+	sent = 0;
+	path[0] = '\0';
+}
+
+LinuxChangeLogServer::~LinuxChangeLogServer()
+{
+	stop();
+}
+
+bool LinuxChangeLogServer::start
+( const char *socket_path, gid_t gid, const gPtpShmSegment *shm_segment )
+{
+	struct sockaddr_un addr;
+
+	if( strlen( socket_path ) >= sizeof( addr.sun_path )) {
+		GPTP_LOG_ERROR( "Change log socket path too long: %s", socket_path );
+		return false;
+	}
+
+	segment = shm_segment;
+	sent = __atomic_load_n( &segment->events.counter, __ATOMIC_ACQUIRE );
+	stopping = false;
+
+	event_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+	if( event_fd < 0 ) {
+		GPTP_LOG_ERROR( "eventfd(): %s", strerror( errno ));
+		goto exit_error;
+	}
+
+	listen_fd = socket
+		( AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+	if( listen_fd < 0 ) {
+		GPTP_LOG_ERROR( "Change log socket: %s", strerror( errno ));
+		goto exit_error;
+	}
+
+	memset( &addr, 0, sizeof( addr ));
+	addr.sun_family = AF_UNIX;
+	strncpy( addr.sun_path, socket_path, sizeof( addr.sun_path ) - 1 );
+	unlink( addr.sun_path );
+	if( bind( listen_fd, (struct sockaddr *) &addr, sizeof( addr )) < 0 ) {
+		GPTP_LOG_ERROR( "Failed to bind change log socket %s: %s",
+				socket_path, strerror( errno ));
+		goto exit_error;
+	}
+	strncpy( path, socket_path, sizeof( path ) - 1 );
+	path[sizeof( path ) - 1] = '\0';
+
+	if( chown( path, -1, gid ) < 0 || chmod( path, 0660 ) < 0 ) {
+		GPTP_LOG_ERROR( "Failed to set permission of change log socket "
+				"%s (%s)", path, strerror( errno ));
+	}
+	if( listen( listen_fd, CHANGE_LOG_BACKLOG ) < 0 ) {
+		GPTP_LOG_ERROR( "listen(%s): %s", path, strerror( errno ));
+		goto exit_error;
+	}
+
+	if( pthread_create( &thread, NULL, threadMain, this ) != 0 ) {
+		GPTP_LOG_ERROR( "Failed to start change log thread" );
+		goto exit_error;
+	}
+	thread_valid = true;
+
+	GPTP_LOG_STATUS( "Streaming change log on %s", path );
+	return true;
+
+ exit_error:
+	stop();
+	return false;
+}
+
+void LinuxChangeLogServer::notify()
+{
+	uint64_t one = 1;
+
+	if( event_fd >= 0 && write( event_fd, &one, sizeof( one )) < 0 &&
+	    errno != EAGAIN ) {
+		GPTP_LOG_ERROR( "Failed to wake change log thread: %s",
+				strerror( errno ));
+	}
+}
+
+void LinuxChangeLogServer::stop()
+{
+	if( thread_valid ) {
+		__atomic_store_n( &stopping, true, __ATOMIC_RELEASE );
+		notify();
+		pthread_join( thread, NULL );
+		thread_valid = false;
+	}
+	while( client_count > 0 )
+		dropClient( client_count - 1 );
+	if( listen_fd >= 0 ) {
+		close( listen_fd );
+		listen_fd = -1;
+	}
+	if( path[0] != '\0' ) {
+		unlink( path );
+		path[0] = '\0';
+	}
+	if( event_fd >= 0 ) {
+		close( event_fd );
+		event_fd = -1;
+	}
+}
+
+void *LinuxChangeLogServer::threadMain( void *arg )
+{
+	((LinuxChangeLogServer *) arg)->run();
+	return NULL;
+}
+
+void LinuxChangeLogServer::acceptClient()
+{
+	int fd = accept4( listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC );
+
+	if( fd < 0 ) {
+		if( errno != EAGAIN && errno != EINTR )
+			GPTP_LOG_ERROR( "Change log accept(): %s", strerror( errno ));
+		return;
+	}
+	if( client_count == GPTP_CHANGE_LOG_CLIENTS ) {
+		GPTP_LOG_ERROR( "Change log client refused, %u clients connected",
+				client_count );
+		close( fd );
+		return;
+	}
+	// New clients get the events raised from now on
+	clients[client_count++] = fd;
+	GPTP_LOG_INFO( "Change log client connected (%u)", client_count );
+}
+
+void LinuxChangeLogServer::dropClient( unsigned index )
+{
+	close( clients[index] );
+	clients[index] = clients[--client_count];
+}
+
+void LinuxChangeLogServer::forward()
+{
+	uint32_t counter = __atomic_load_n( &segment->events.counter, __ATOMIC_ACQUIRE );
+	gPtpChangeEvent event;
+
+	while( sent != counter ) {
+		++sent;
+		// Overwritten if this thread fell a whole log behind; clients
+		// see the gap in the sequence numbers
+		if( !gptpShmEventRead( segment, sent, &event ))
+			continue;
+		for( unsigned i = 0; i < client_count; ) {
+			if( send( clients[i], &event, sizeof( event ),
+				  MSG_DONTWAIT | MSG_NOSIGNAL ) < 0 ) {
+				GPTP_LOG_ERROR( "Change log client dropped: %s",
+						strerror( errno ));
+				dropClient( i );
+				continue;
+			}
+			++i;
+		}
+	}
+}
+
+void LinuxChangeLogServer::run()
+{
+	struct pollfd fds[2 + GPTP_CHANGE_LOG_CLIENTS];
+
+	while( !__atomic_load_n( &stopping, __ATOMIC_ACQUIRE )) {
+		unsigned nfds = 2;
+
+		fds[0].fd = event_fd;
+		fds[0].events = POLLIN;
+		fds[1].fd = listen_fd;
+		fds[1].events = POLLIN;
+		// Clients never send; readable means closed
+		for( unsigned i = 0; i < client_count; ++i ) {
+			fds[nfds].fd = clients[i];
+			fds[nfds++].events = POLLIN;
+		}
+
+		if( poll( fds, nfds, -1 ) < 0 ) {
+			if( errno == EINTR )
+				continue;
+			GPTP_LOG_ERROR( "Change log poll(): %s", strerror( errno ));
+			break;
+		}
+
+		if( fds[0].revents & POLLIN ) {
+			uint64_t count;
+
+			if( read( event_fd, &count, sizeof( count )) < 0 &&
+			    errno != EAGAIN ) {
+				GPTP_LOG_ERROR( "Change log eventfd: %s",
+						strerror( errno ));
+			}
+			forward();
+		}
+		// Walk backwards so dropping a client does not skip another
+		for( unsigned i = nfds; i > 2; --i ) {
+			if( fds[i - 1].revents != 0 ) {
+				for( unsigned c = 0; c < client_count; ++c ) {
+					if( clients[c] == fds[i - 1].fd ) {
+						GPTP_LOG_INFO( "Change log client disconnected" );
+						dropClient( c );
+						break;
+					}
+				}
+			}
+		}
+		if( fds[1].revents & POLLIN )
+			acceptClient();
+	}
+}
@@ -0,0 +1,116 @@
+/******************************************************************************
+
+  Copyright (c) 2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#ifndef LINUX_CHANGE_LOG_HPP
+#define LINUX_CHANGE_LOG_HPP
+
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/un.h>
+
+#include <linux_ipc.hpp>
+
+/**@file*/
+
+#define GPTP_CHANGE_LOG_CLIENTS 16	/*!< Clients served at once by the change log socket */
+
+/**
+ * @brief Streams the shared memory change log on a Unix domain socket.
+ *
+ * The socket is a SOCK_SEQPACKET socket bound to a path; each message
+ * is one gPtpChangeEvent. The server thread is itself a consumer of the
+ * change log in the segment: LinuxSharedMemoryIPC calls notify() after
+ * appending events and the thread forwards every event it has not sent
+ * yet to the connected clients. Sends never block. A client whose
+ * socket buffer is full is disconnected; it can reconnect and will see
+ * the gap in the event sequence numbers.
+ */
+class LinuxChangeLogServer {
+private:
+	int listen_fd;
+	int event_fd;
+	int clients[GPTP_CHANGE_LOG_CLIENTS];
+	unsigned client_count;
+	pthread_t thread;
+	bool thread_valid;
+	bool stopping;
+	const gPtpShmSegment *segment;
+	uint32_t sent;
+	char path[sizeof(((struct sockaddr_un *) 0)->sun_path)];
+
+	void acceptClient();
+	void dropClient( unsigned index );
+	void forward();
+	void run();
+	static void *threadMain( void *arg );
+
+	LinuxChangeLogServer( const LinuxChangeLogServer & );
+	LinuxChangeLogServer &operator=( const LinuxChangeLogServer & );
+public:
+	/**
+	 * @brief Creates a server that is not listening
+	 */
+	LinuxChangeLogServer();
+
+	/**
+	 * @brief Stops the server
+	 */
+	~LinuxChangeLogServer();
+
+	/**
+	 * @brief Binds the socket and starts the server thread
+	 * @param socket_path [in] Path to bind to. A stale socket left at
+	 * the path is replaced.
+	 * @param gid Group allowed to connect, as for the shared memory
+	 * @param shm_segment [in] Segment whose change log is streamed
+	 * @return TRUE if the server is running, FALSE otherwise
+	 */
+	bool start
+	( const char *socket_path, gid_t gid, const gPtpShmSegment *shm_segment );
+
+	/**
+	 * @brief Wakes the server thread after events were appended to the
+	 * change log. Does not block.
+	 * @return void
+	 */
+	void notify();
+
+	/**
+	 * @brief Stops the server thread, disconnects the clients and
+	 * removes the socket
+	 * @return void
+	 */
+	void stop();
+};
+
+#endif/*LINUX_CHANGE_LOG_HPP*/
@@ -0,0 +1,371 @@
+/******************************************************************************
+
+  Copyright (c) 2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#include <linux_crossts.hpp>
+#include <gptp_log.hpp>
+
+#include <algorithm>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#define CROSSTS_WIDTH_FACTOR 2		/* pairing wider than this x median is an outlier */
+#define CROSSTS_WIDTH_SLACK_NS 100	/* ...plus this, so narrow widths are not rejected */
+#define CROSSTS_OUTLIER_SIGMA 4.0	/* residual outlier threshold, in robust sigmas */
+#define CROSSTS_RESIDUAL_FLOOR_NS 20.0	/* never reject residuals below this */
+#define CROSSTS_STALE_INTERVALS 4	/* model unused if no sample for this many intervals */
+#define CROSSTS_LOG_SECONDS 60		/* period of the diagnostics log */
+
+LinuxCrossTimestampEstimator::LinuxCrossTimestampEstimator()
+{
+	sample_fn = NULL;
+	sample_arg = NULL;
+	interval_ns = 0;
+	window = 0;
+	thread_valid = false;
+	stopping = false;
+	pthread_mutex_init( &lock, NULL );
+	{
+		pthread_condattr_t attr;
+
+		pthread_condattr_init( &attr );
+		pthread_condattr_setclock( &attr, CLOCK_MONOTONIC );
+		pthread_cond_init( &wake, &attr );
+		pthread_condattr_destroy( &attr );
+	}
+	count = 0;
+	next = 0;
+	frequency_ppm = 0.0;
+	generation = 0;
+	model_valid = false;
+	ref_system_ns = 0;
+	ref_device_ns = 0;
+	slope = 0.0;
+	last_sample_ns = 0;
+	memset( &stats, 0, sizeof( stats ));
+}
+
+LinuxCrossTimestampEstimator::~LinuxCrossTimestampEstimator()
+{
+	stop();
+	pthread_cond_destroy( &wake );
+	pthread_mutex_destroy( &lock );
+}
+
+bool LinuxCrossTimestampEstimator::start
+( crossts_sample_t sample, void *arg, unsigned rate_hz,
+  unsigned window_samples )
+{
+	if( thread_valid || sample == NULL || rate_hz == 0 ||
+	    window_samples < CROSSTS_MIN_SAMPLES ||
+	    window_samples > CROSSTS_WINDOW_MAX )
+		return false;
+
+	sample_fn = sample;
+	sample_arg = arg;
+	interval_ns = 1000000000LL / rate_hz;
+	window = window_samples;
+	stopping = false;
+
+	if( pthread_create( &thread, NULL, threadMain, this ) != 0 ) {
+		GPTP_LOG_ERROR( "Failed to start cross timestamp thread" );
+		return false;
+	}
+	thread_valid = true;
+
+	GPTP_LOG_STATUS( "Cross timestamping in the background at %u Hz, "
+			 "%u sample window", rate_hz, window );
+	return true;
+}
+
+void LinuxCrossTimestampEstimator::stop()
+{
+	if( !thread_valid )
+		return;
+
+	pthread_mutex_lock( &lock );
+	stopping = true;
+	pthread_cond_signal( &wake );
+	pthread_mutex_unlock( &lock );
+	pthread_join( thread, NULL );
+	thread_valid = false;
+
+	pthread_mutex_lock( &lock );
+	model_valid = false;
+	count = 0;
+	next = 0;
+	pthread_mutex_unlock( &lock );
+}
+
+void *LinuxCrossTimestampEstimator::threadMain( void *arg )
+{
+	((LinuxCrossTimestampEstimator *) arg)->run();
+	return NULL;
+}
+
+void LinuxCrossTimestampEstimator::run()
+{
+	struct timespec deadline;
+	uint64_t log_every = (uint64_t) CROSSTS_LOG_SECONDS * 1000000000ULL /
+		interval_ns;
+	unsigned failures = 0;
+
+	clock_gettime( CLOCK_MONOTONIC, &deadline );
+
+	pthread_mutex_lock( &lock );
+	while( !stopping ) {
+		int64_t system_ns, device_ns, width_ns;
+		unsigned sampled_generation;
+		bool ok;
+
+		deadline.tv_nsec += interval_ns;
+		while( deadline.tv_nsec >= 1000000000 ) {
+			deadline.tv_nsec -= 1000000000;
+			++deadline.tv_sec;
+		}
+		while( !stopping &&
+		       pthread_cond_timedwait( &wake, &lock, &deadline ) == 0 )
+			;
+		if( stopping )
+			break;
+
+		// Sample without the lock, estimate() must not wait on the ioctl
+		sampled_generation = generation;
+		pthread_mutex_unlock( &lock );
+		ok = sample_fn( sample_arg, &system_ns, &device_ns, &width_ns );
+		pthread_mutex_lock( &lock );
+
+		if( !ok ) {
+			if( ++failures == window ) {
+				GPTP_LOG_ERROR( "Cross timestamp sampling is failing" );
+				model_valid = false;
+			}
+			continue;
+		}
+		failures = 0;
+		// An adjustment raced with the sample, its pairing is mixed
+		if( sampled_generation != generation )
+			continue;
+
+		samples[next].system_ns = system_ns;
+		samples[next].device_ns = device_ns;
+		samples[next].width_ns = width_ns;
+		next = ( next + 1 ) % window;
+		if( count < window )
+			++count;
+		last_sample_ns = system_ns;
+		++stats.taken;
+		fit();
+
+		if( model_valid && stats.taken % log_every == 0 ) {
+			GPTP_LOG_INFO
+				( "Cross timestamp model: %u of %u samples, "
+				  "rate %+.3f ppm, residual rms %.1f ns, "
+				  "max %.1f ns", stats.samples, stats.window,
+				  stats.rate_ppm, stats.residual_rms,
+				  stats.residual_max );
+		}
+	}
+	pthread_mutex_unlock( &lock );
+}
+
+/*
+ * Least squares fit of (device - system) against system, relative to the
+ * newest sample so the doubles only hold short intervals. Called with the
+ * lock held.
+ */
+void LinuxCrossTimestampEstimator::fit()
+{
+	const Sample *ref = &samples[( next + window - 1 ) % window];
+	bool used[CROSSTS_WINDOW_MAX];
+	double x[CROSSTS_WINDOW_MAX], y[CROSSTS_WINDOW_MAX];
+	double scratch[CROSSTS_WINDOW_MAX];
+	double a = 0.0, b = 0.0, threshold, sum_sq, max;
+	unsigned i, n, pass;
+
+	stats.window = count;
+	model_valid = false;
+	if( count < CROSSTS_MIN_SAMPLES )
+		return;
+
+	// Pairings much wider than usual were disturbed, e.g. by an interrupt
+	for( i = 0; i < count; ++i )
+		scratch[i] = (double) samples[i].width_ns;
+	std::nth_element( scratch, scratch + count / 2, scratch + count );
+	threshold = scratch[count / 2] * CROSSTS_WIDTH_FACTOR +
+		CROSSTS_WIDTH_SLACK_NS;
+	for( i = 0; i < count; ++i ) {
+		x[i] = (double) ( samples[i].system_ns - ref->system_ns );
+		y[i] = (double) ( samples[i].device_ns - ref->device_ns ) - x[i];
+		used[i] = samples[i].width_ns <= threshold;
+	}
+
+	for( pass = 0; pass < 2; ++pass ) {
+		double sx = 0, sy = 0, sxx = 0, sxy = 0, d;
+
+		n = 0;
+		for( i = 0; i < count; ++i ) {
+			if( !used[i] )
+				continue;
+			sx += x[i];
+			sy += y[i];
+			sxx += x[i] * x[i];
+			sxy += x[i] * y[i];
+			++n;
+		}
+		if( n < CROSSTS_MIN_SAMPLES )
+			return;
+		d = n * sxx - sx * sx;
+		if( d <= 0.0 )
+			return;
+		b = ( n * sxy - sx * sy ) / d;
+		a = ( sy - b * sx ) / n;
+		if( pass == 1 )
+			break;
+
+		// Reject residuals far outside the median absolute residual
+		n = 0;
+		for( i = 0; i < count; ++i ) {
+			if( used[i] )
+				scratch[n++] = fabs( y[i] - a - b * x[i] );
+		}
+		std::nth_element( scratch, scratch + n / 2, scratch + n );
+		threshold = std::max
+			( CROSSTS_OUTLIER_SIGMA * 1.4826 * scratch[n / 2],
+			  CROSSTS_RESIDUAL_FLOOR_NS );
+		for( i = 0; i < count; ++i ) {
+			if( used[i] && fabs( y[i] - a - b * x[i] ) > threshold )
+				used[i] = false;
+		}
+	}
+
+	sum_sq = 0.0;
+	max = 0.0;
+	for( i = 0; i < count; ++i ) {
+		double r;
+
+		if( !used[i] )
+			continue;
+		r = y[i] - a - b * x[i];
+		sum_sq += r * r;
+		if( fabs( r ) > max )
+			max = fabs( r );
+	}
+
+	ref_system_ns = ref->system_ns;
+	ref_device_ns = ref->device_ns + (int64_t) llround( a );
+	slope = b;
+	model_valid = true;
+
+	stats.samples = n;
+	stats.rejected = count - n;
+	stats.rate_ppm = b * 1000000.0;
+	stats.residual_rms = sqrt( sum_sq / n );
+	stats.residual_max = max;
+}
+
+bool LinuxCrossTimestampEstimator::estimate
+( int64_t system_ns, int64_t *device_ns )
+{
+	int64_t elapsed;
+	bool ok;
+
+	pthread_mutex_lock( &lock );
+	ok = model_valid &&
+		system_ns - last_sample_ns <=
+		CROSSTS_STALE_INTERVALS * interval_ns;
+	if( ok ) {
+		elapsed = system_ns - ref_system_ns;
+		*device_ns = ref_device_ns + elapsed +
+			(int64_t) llround( slope * elapsed );
+	}
+	pthread_mutex_unlock( &lock );
+
+	return ok;
+}
+
+void LinuxCrossTimestampEstimator::frequencyAdjusted
+( int64_t system_ns, double ppm )
+{
+	double ratio;
+	int64_t pivot;
+	unsigned i;
+
+	pthread_mutex_lock( &lock );
+	ratio = ( 1.0 + ppm / 1000000.0 ) / ( 1.0 + frequency_ppm / 1000000.0 );
+	frequency_ppm = ppm;
+	++generation;
+	if( count > 0 ) {
+		// Device time elapsed before the pivot is rescaled to the new
+		// rate, as if it had always applied
+		if( model_valid ) {
+			int64_t elapsed = system_ns - ref_system_ns;
+			pivot = ref_device_ns + elapsed +
+				(int64_t) llround( slope * elapsed );
+		} else {
+			pivot = samples[( next + window - 1 ) % window].device_ns;
+		}
+		for( i = 0; i < count; ++i ) {
+			samples[i].device_ns = pivot - (int64_t) llround
+				( (double) ( pivot - samples[i].device_ns ) *
+				  ratio );
+		}
+		fit();
+	}
+	pthread_mutex_unlock( &lock );
+}
+
+void LinuxCrossTimestampEstimator::phaseAdjusted( int64_t phase_ns )
+{
+	unsigned i;
+
+	pthread_mutex_lock( &lock );
+	++generation;
+	for( i = 0; i < count; ++i )
+		samples[i].device_ns += phase_ns;
+	if( model_valid )
+		ref_device_ns += phase_ns;
+	pthread_mutex_unlock( &lock );
+}
+
+bool LinuxCrossTimestampEstimator::getStats( LinuxCrossTimestampStats *out )
+{
+	bool ok;
+
+	pthread_mutex_lock( &lock );
+	*out = stats;
+	ok = model_valid;
+	pthread_mutex_unlock( &lock );
+
+	return ok;
+}
@@ -0,0 +1,186 @@
+/******************************************************************************
+
+  Copyright (c) 2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#ifndef LINUX_CROSSTS_HPP
+#define LINUX_CROSSTS_HPP
+
+#include <pthread.h>
+#include <stdint.h>
+
+/**@file*/
+
+#define CROSSTS_WINDOW_MAX 128		/*!< Largest sliding window, in samples */
+#define CROSSTS_WINDOW_DEFAULT 32	/*!< Sliding window used when none is given */
+#define CROSSTS_MIN_SAMPLES 4		/*!< Samples needed before the model is used */
+
+/**
+ * @brief Takes one cross timestamp: a system time and the device time
+ * read at that instant
+ * @param arg [in] Argument given to LinuxCrossTimestampEstimator::start()
+ * @param system_ns [out] System (CLOCK_REALTIME) time in ns
+ * @param device_ns [out] Device time in ns
+ * @param width_ns [out] Uncertainty of the pairing, the time the system
+ * clock advanced around the device read. 0 for a precise cross timestamp.
+ * @return FALSE if no sample could be taken
+ */
+typedef bool (*crossts_sample_t)
+( void *arg, int64_t *system_ns, int64_t *device_ns, int64_t *width_ns );
+
+/**
+ * @brief Diagnostics of the cross timestamp model
+ */
+struct LinuxCrossTimestampStats {
+	unsigned samples;		/*!< Samples in the current fit */
+	unsigned window;		/*!< Samples in the sliding window */
+	unsigned rejected;		/*!< Samples of the window left out as outliers */
+	uint64_t taken;			/*!< Samples taken since start */
+	double rate_ppm;		/*!< Device rate relative to the system clock */
+	double residual_rms;		/*!< RMS of the fit residuals, ns */
+	double residual_max;		/*!< Largest absolute fit residual, ns */
+};
+
+/**
+ * @brief Background estimator of the device clock against the system
+ * clock.
+ *
+ * A thread takes cross timestamps at a fixed rate into a sliding window
+ * and fits device time against system time by least squares. Samples
+ * whose pairing is much wider than the window's median, or whose residual
+ * is far outside the spread of the others, are left out and the fit is
+ * redone. estimate() then answers from the model with one read of the
+ * system clock instead of a PHC ioctl.
+ *
+ * Frequency and phase adjustments of the device clock are reported with
+ * frequencyAdjusted() and phaseAdjusted(); the samples in the window are
+ * rewritten as if the adjustment had always applied, so the model stays
+ * usable across servo updates.
+ */
+class LinuxCrossTimestampEstimator {
+private:
+	struct Sample {
+		int64_t system_ns;
+		int64_t device_ns;
+		int64_t width_ns;
+	};
+
+	crossts_sample_t sample_fn;
+	void *sample_arg;
+	int64_t interval_ns;
+	unsigned window;
+
+	pthread_t thread;
+	bool thread_valid;
+	bool stopping;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+
+	/* Protected by lock */
+	Sample samples[CROSSTS_WINDOW_MAX];
+	unsigned count;
+	unsigned next;
+	double frequency_ppm;
+	unsigned generation;		/* bumped by each adjustment */
+	bool model_valid;
+	int64_t ref_system_ns;		/* model: device = ref_device + */
+	int64_t ref_device_ns;		/* (1 + slope) * (system - ref_system) */
+	double slope;
+	int64_t last_sample_ns;
+	LinuxCrossTimestampStats stats;
+
+	void fit();
+	void run();
+	static void *threadMain( void *arg );
+
+	LinuxCrossTimestampEstimator( const LinuxCrossTimestampEstimator & );
+	LinuxCrossTimestampEstimator &operator=
+	( const LinuxCrossTimestampEstimator & );
+public:
+	LinuxCrossTimestampEstimator();
+
+	/**
+	 * @brief Stops the sampling thread
+	 */
+	~LinuxCrossTimestampEstimator();
+
+	/**
+	 * @brief  Starts sampling
+	 * @param  sample [in] Function taking one cross timestamp
+	 * @param  arg [in] Passed to sample
+	 * @param  rate_hz Samples per second
+	 * @param  window_samples Sliding window length, at most
+	 * CROSSTS_WINDOW_MAX
+	 * @return TRUE if the thread is running, FALSE otherwise
+	 */
+	bool start
+	( crossts_sample_t sample, void *arg, unsigned rate_hz,
+	  unsigned window_samples );
+
+	/**
+	 * @brief  Stops the sampling thread. The model is no longer used.
+	 * @return void
+	 */
+	void stop();
+
+	/**
+	 * @brief  Device time at a system time, from the model
+	 * @param  system_ns System (CLOCK_REALTIME) time in ns
+	 * @param  device_ns [out] Estimated device time in ns
+	 * @return FALSE if there is no model or it is stale; the caller must
+	 * take a cross timestamp itself
+	 */
+	bool estimate( int64_t system_ns, int64_t *device_ns );
+
+	/**
+	 * @brief  Reports a new frequency adjustment of the device clock
+	 * @param  system_ns System time of the adjustment, in ns
+	 * @param  ppm New frequency adjustment, as given to the clock
+	 * @return void
+	 */
+	void frequencyAdjusted( int64_t system_ns, double ppm );
+
+	/**
+	 * @brief  Reports a step of the device clock
+	 * @param  phase_ns Step added to the device time, in ns
+	 * @return void
+	 */
+	void phaseAdjusted( int64_t phase_ns );
+
+	/**
+	 * @brief  Gets the diagnostics of the current fit
+	 * @param  stats [out] Diagnostics
+	 * @return FALSE if there is no model yet
+	 */
+	bool getStats( LinuxCrossTimestampStats *stats );
+};
+
+#endif/*LINUX_CROSSTS_HPP*/
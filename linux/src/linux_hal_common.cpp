@@ -39,6 +39,7 @@
 #include <pthread.h>
 #include <sched.h>
 #include <linux_ipc.hpp>
+#include <linux_change_log.hpp>
 
 #include <sys/mman.h>
 #include <fcntl.h>
@@ -57,12 +58,18 @@
 #include <sys/stat.h>
 
 #include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 #include <netinet/in.h>
 #include <linux/netlink.h>
 #include <linux/rtnetlink.h>
 #include <linux/sockios.h>
 #include <gptp_cfg.hpp>
 
+#undef GPTP_LOG_SUBSYSTEM
+#define GPTP_LOG_SUBSYSTEM GPTP_LOG_SUBSYS_NET
+
 Timestamp tsToTimestamp(struct timespec *ts)
 {
 	Timestamp ret;
@@ -82,6 +89,19 @@ Timestamp tsToTimestamp(struct timespec *ts)
 LinuxNetworkInterface::~LinuxNetworkInterface() {
 	if ( sd_event != -1 ) close( sd_event );
 	if ( sd_general != -1 ) close( sd_general );
+	if ( stop_event_fd != -1 ) close( stop_event_fd );
+}
+
+void LinuxNetworkInterface::stopReceiveLoop()
+{
+	uint64_t one = 1;
+
+	if( stop_event_fd == -1 )
+		return;
+	if( write( stop_event_fd, &one, sizeof( one )) != sizeof( one )) {
+		GPTP_LOG_ERROR( "Failed to signal receive loop stop: %s",
+				strerror( errno ));
+	}
 }
 
 net_result LinuxNetworkInterface::send
@@ -309,53 +329,88 @@ bool LinuxNetworkInterface::getLinkSpeed( int sd, uint32_t *speed )
 	return true;
 }
 
-void LinuxNetworkInterface::watchNetLink( CommonPort *iPort )
+bool LinuxNetworkInterface::openNetLink
+( int *netLinkSocket, int *inetSocket )
 {
-	fd_set netLinkFD;
-	int netLinkSocket;
-	int inetSocket;
 	struct sockaddr_nl addr;
-	uint32_t link_speed = INVALID_LINKSPEED;
-
-	EtherPort *pPort =
-		dynamic_cast<EtherPort *>(iPort);
-	if( pPort == NULL )
-	{
-		GPTP_LOG_ERROR("NETLINK socket open error");
-		return;
-	}
 
-	netLinkSocket = socket (AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
-	if (netLinkSocket < 0) {
+	*netLinkSocket = socket (AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+	if (*netLinkSocket < 0) {
 		GPTP_LOG_ERROR("NETLINK socket open error");
-		return;
+		return false;
 	}
 
 	memset((void *) &addr, 0, sizeof (addr));
 
 	addr.nl_family = AF_NETLINK;
-	addr.nl_pid = getpid ();
+	addr.nl_pid = 0;
 	addr.nl_groups = RTMGRP_LINK;
 
-	if (bind (netLinkSocket, (struct sockaddr *) &addr, sizeof (addr)) < 0) {
+	if (bind (*netLinkSocket, (struct sockaddr *) &addr, sizeof (addr)) < 0) {
 		GPTP_LOG_ERROR("Socket (netLinkSocket) bind failed %s", strerror(errno));
-		close (netLinkSocket);
-		return;
+		close (*netLinkSocket);
+		return false;
 	}
 
 	/*
 	 * Open an INET family socket to be passed to getLinkSpeed() which calls
-	 * ioctl() because NETLINK sockets do not support ioctl(). Since we will
-	 * enter an infinite loop, there are no apparent close() calls for the
-	 * open sockets, but they will be closed on process termination.
+	 * ioctl() because NETLINK sockets do not support ioctl().
 	 */
-	inetSocket = socket (AF_INET, SOCK_STREAM, 0);
-	if (inetSocket < 0) {
+	*inetSocket = socket (AF_INET, SOCK_STREAM, 0);
+	if (*inetSocket < 0) {
 		GPTP_LOG_ERROR("watchNetLink error opening socket: %s", strerror(errno));
-		close (netLinkSocket);
+		close (*netLinkSocket);
+		return false;
+	}
+
+	return true;
+}
+
+void LinuxNetworkInterface::processNetLink
+( int netLinkSocket, int inetSocket, EtherPort *pPort )
+{
+	uint32_t link_speed = INVALID_LINKSPEED;
+	bool prev_link_up = pPort->getLinkUpState();
+
+	x_readEvent(netLinkSocket, pPort, ifindex);
+
+	// Don't do anything else if link state is the same
+	if( prev_link_up == pPort->getLinkUpState() )
+		return;
+
+	if( pPort->getLinkUpState() )
+	{
+		if ( !getLinkSpeed( inetSocket, &link_speed ) )
+		{
+			link_speed = INVALID_LINKSPEED;
+		}
+	}
+	pPort->setLinkSpeed( link_speed );
+}
+
+void LinuxNetworkInterface::watchNetLink( CommonPort *iPort )
+{
+	fd_set netLinkFD;
+	int netLinkSocket;
+	int inetSocket;
+	uint32_t link_speed = INVALID_LINKSPEED;
+
+	EtherPort *pPort =
+		dynamic_cast<EtherPort *>(iPort);
+	if( pPort == NULL )
+	{
+		GPTP_LOG_ERROR("NETLINK socket open error");
 		return;
 	}
 
+	/*
+	 * Since we will enter an infinite loop, there are no apparent close()
+	 * calls for the open sockets, but they will be closed on process
+	 * termination.
+	 */
+	if( !openNetLink( &netLinkSocket, &inetSocket ))
+		return;
+
 	x_initLinkUpStatus(pPort, ifindex);
 
 	if( pPort->getLinkUpState() )
@@ -364,6 +419,13 @@ void LinuxNetworkInterface::watchNetLink( CommonPort *iPort )
 	}
 	pPort->setLinkSpeed( link_speed );
 
+	// The receive loop watches its own netlink socket
+	if( supportsReceiveLoop() ) {
+		close(netLinkSocket);
+		close(inetSocket);
+		return;
+	}
+
 	pPort->setLinkThreadRunning(true);
 
 	while ( pPort->getLinkThreadRunning() ) {
@@ -377,21 +439,7 @@ void LinuxNetworkInterface::watchNetLink( CommonPort *iPort )
 		if (retval == -1)
 			; // Error on select. We will ignore and keep going
 		else if (retval) {
-			bool prev_link_up = pPort->getLinkUpState();
-			x_readEvent(netLinkSocket, pPort, ifindex);
-
-			// Don't do anything else if link state is the same
-			if( prev_link_up == pPort->getLinkUpState() )
-				continue;
-
-			if( pPort->getLinkUpState() )
-			{
-				if ( !getLinkSpeed( inetSocket, &link_speed ) )
-				{
-					link_speed = INVALID_LINKSPEED;
-				}
-			}
-			pPort->setLinkSpeed( link_speed );
+			processNetLink( netLinkSocket, inetSocket, pPort );
 		}
 		else {
 			GPTP_LOG_VERBOSE("Net link event timeout");
@@ -403,6 +451,9 @@ void LinuxNetworkInterface::watchNetLink( CommonPort *iPort )
 }
 
 
+#undef GPTP_LOG_SUBSYSTEM
+#define GPTP_LOG_SUBSYSTEM GPTP_LOG_SUBSYS_TIMER
+
 struct LinuxTimerQueuePrivate {
 	pthread_t signal_thread;
 	bool thread_id_valid;
@@ -417,6 +468,14 @@ struct LinuxTimerQueueActionArg {
 	bool rm;
 };
 
+static void destroyTimerQueueActionArg( LinuxTimerQueueActionArg *arg ) {
+	if( arg->rm ) {
+		delete arg->inner_arg;
+	}
+	timer_delete( arg->timer_handle );
+	delete arg;
+}
+
 LinuxTimerQueue::~LinuxTimerQueue() {
 
 	if( _private != NULL ) {
@@ -465,13 +524,9 @@ void *LinuxTimerQueueHandler( void *arg ) {
 		iter = timerq->timerQueueMap.find(info.si_value.sival_int);
 		if( iter != timerq->timerQueueMap.end() ) {
 		    struct LinuxTimerQueueActionArg *arg = iter->second;
-			timerq->timerQueueMap.erase(iter);
+			timerq->removeEvent(iter);
 			timerq->LinuxTimerQueueAction( arg );
-			if( arg->rm ) {
-				delete arg->inner_arg;
-			}
-			timer_delete(arg->timer_handle);
-			delete arg;
+			destroyTimerQueueActionArg( arg );
 		}
 		if( timerq->lock->unlock() != oslock_ok ) {
 			break;
@@ -487,6 +542,23 @@ void LinuxTimerQueue::LinuxTimerQueueAction( LinuxTimerQueueActionArg *arg ) {
 	return;
 }
 
+void LinuxTimerQueue::removeEvent( LinuxTimerQueueMap_t::iterator iter ) {
+	LinuxTimerQueueActionArg *arg = iter->second;
+	CommonPort *port = arg->inner_arg != NULL ? arg->inner_arg->port : NULL;
+	std::pair<LinuxTimerQueueIndex_t::iterator, LinuxTimerQueueIndex_t::iterator>
+		range = timerQueueIndex.equal_range
+		( LinuxTimerQueueKey( port, arg->type ));
+
+	for( LinuxTimerQueueIndex_t::iterator index_iter = range.first;
+	     index_iter != range.second; ++index_iter ) {
+		if( index_iter->second == iter->first ) {
+			timerQueueIndex.erase( index_iter );
+			break;
+		}
+	}
+	timerQueueMap.erase( iter );
+}
+
 OSTimerQueue *LinuxTimerQueueFactory::createOSTimerQueue
 	( IEEE1588Clock *clock ) {
 	LinuxTimerQueue *ret = new LinuxTimerQueue();
@@ -525,9 +597,10 @@ bool LinuxTimerQueue::addEvent
 	outer_arg->func = func;
 	outer_arg->type = type;
 
-	// Find key that we can use
+	// Find key that we can use. Keys are handed out in sequence so the
+	// probe only loops after wrapping onto a still pending event.
 	while( timerQueueMap.find( key ) != timerQueueMap.end() ) {
-		++key;
+		key = (key + 1) & INT_MAX;
 	}
 
 	{
@@ -540,9 +613,18 @@ bool LinuxTimerQueue::addEvent
 			 (CLOCK_MONOTONIC, &outer_arg->sevp, &outer_arg->timer_handle)
 			 == -1) {
 			GPTP_LOG_ERROR("timer_create failed - %s", strerror(errno));
+			delete outer_arg;
 			return false;
 		}
 		timerQueueMap[key] = outer_arg;
+		timerQueueIndex.insert
+			( std::make_pair
+			  ( LinuxTimerQueueKey
+			    ( arg != NULL ? arg->port : NULL, type ), key ));
+		if( event != NULL ) {
+			*event = (unsigned) key;
+		}
+		key = (key + 1) & INT_MAX;
 
 		memset(&its, 0, sizeof(its));
 		its.it_value.tv_sec = micros / 1000000;
@@ -560,15 +642,24 @@ bool LinuxTimerQueue::addEvent
 
 bool LinuxTimerQueue::cancelEvent( int type, unsigned *event ) {
 	LinuxTimerQueueMap_t::iterator iter;
+
+	if( event != NULL ) {
+		iter = timerQueueMap.find( (int) *event );
+		if( iter == timerQueueMap.end() || iter->second->type != type ) {
+			return false;
+		}
+		LinuxTimerQueueActionArg *arg = iter->second;
+		removeEvent( iter );
+		destroyTimerQueueActionArg( arg );
+		return true;
+	}
+
 	for( iter = timerQueueMap.begin(); iter != timerQueueMap.end();) {
 		if( (iter->second)->type == type ) {
 			// Delete element
-			if( (iter->second)->rm ) {
-				delete (iter->second)->inner_arg;
-			}
-			timer_delete(iter->second->timer_handle);
-			delete iter->second;
-			timerQueueMap.erase(iter++);
+			LinuxTimerQueueActionArg *arg = iter->second;
+			removeEvent( iter++ );
+			destroyTimerQueueActionArg( arg );
 		} else {
 			++iter;
 		}
@@ -577,6 +668,29 @@ bool LinuxTimerQueue::cancelEvent( int type, unsigned *event ) {
 	return true;
 }
 
+bool LinuxTimerQueue::cancelPortEvent( CommonPort *target, int type ) {
+	std::pair<LinuxTimerQueueIndex_t::iterator, LinuxTimerQueueIndex_t::iterator>
+		range = timerQueueIndex.equal_range
+		( LinuxTimerQueueKey( target, type ));
+
+	while( range.first != range.second ) {
+		LinuxTimerQueueMap_t::iterator iter =
+			timerQueueMap.find( range.first->second );
+		LinuxTimerQueueActionArg *arg = iter->second;
+
+		// removeEvent() invalidates the index entry, look it up again
+		removeEvent( iter );
+		destroyTimerQueueActionArg( arg );
+		range = timerQueueIndex.equal_range
+			( LinuxTimerQueueKey( target, type ));
+	}
+
+	return true;
+}
+
+
+#undef GPTP_LOG_SUBSYSTEM
+#define GPTP_LOG_SUBSYSTEM GPTP_LOG_SUBSYS_GENERAL
 
 void* OSThreadCallback( void* input ) {
 	OSThreadArg *arg = (OSThreadArg*) input;
@@ -863,16 +977,21 @@ LinuxThread::~LinuxThread() {
 	if( _private != NULL ) delete _private;
 }
 
+#undef GPTP_LOG_SUBSYSTEM
+#define GPTP_LOG_SUBSYSTEM GPTP_LOG_SUBSYS_NET
+
 LinuxSharedMemoryIPC::~LinuxSharedMemoryIPC() {
-	munmap(master_offset_buffer, SHM_SIZE);
-	shm_unlink(SHM_NAME);
+	stop();
+	pthread_mutex_destroy( &update_lock );
 }
 
 bool LinuxSharedMemoryIPC::init( OS_IPC_ARG *barg ) {
 	LinuxIPCArg *arg;
 	struct group *grp;
 	const char *group_name;
-	pthread_mutexattr_t shared;
+	const char *name = SHM_NAME;
+	const char *notify_path = NULL;
+	gPtpShmSegment *segment;
 	mode_t oldumask = umask(0);
 
 	if( barg == NULL ) {
@@ -884,21 +1003,30 @@ bool LinuxSharedMemoryIPC::init( OS_IPC_ARG *barg ) {
 			goto exit_error;
 		} else {
 			group_name = arg->group_name;
+			if( arg->shm_name != NULL )
+				name = arg->shm_name;
+			notify_path = arg->notify_path;
 		}
 	}
+	strncpy( shm_name, name, NAME_MAX );
+	shm_name[NAME_MAX] = '\0';
+
 	grp = getgrnam( group_name );
 	if( grp == NULL ) {
 		GPTP_LOG_ERROR( "Group %s not found, will try root (0) instead", group_name );
 	}
 
-	shm_fd = shm_open( SHM_NAME, O_RDWR | O_CREAT, 0660 );
+	shm_fd = shm_open( shm_name, O_RDWR | O_CREAT, 0660 );
 	if( shm_fd == -1 ) {
-		GPTP_LOG_ERROR( "shm_open(): %s", strerror(errno) );
+		GPTP_LOG_ERROR( "shm_open(%s): %s", shm_name, strerror(errno) );
 		goto exit_error;
 	}
-	(void) umask(oldumask);
-	if (fchown(shm_fd, -1, grp != NULL ? grp->gr_gid : 0) < 0) {
-		GPTP_LOG_ERROR("shm_open(): Failed to set ownership");
+	if( fchown( shm_fd, -1, grp != NULL ? grp->gr_gid : 0 ) < 0 ) {
+		GPTP_LOG_ERROR( "shm_open(): Failed to set ownership" );
+	}
+	if( fchmod( shm_fd, 0660 ) < 0 ) {
+		GPTP_LOG_ERROR( "Failed to set permission of shared memory %s (%s)",
+				shm_name, strerror(errno) );
 	}
 	if( ftruncate( shm_fd, SHM_SIZE ) == -1 ) {
 		GPTP_LOG_ERROR( "ftruncate()" );
@@ -909,32 +1037,170 @@ bool LinuxSharedMemoryIPC::init( OS_IPC_ARG *barg ) {
 		  shm_fd, 0 );
 	if( master_offset_buffer == (char *) -1 ) {
 		GPTP_LOG_ERROR( "mmap()" );
+		master_offset_buffer = NULL;
 		goto exit_unlink;
 	}
-	/*create mutex attr */
-	err = pthread_mutexattr_init(&shared);
-	if(err != 0) {
-		GPTP_LOG_ERROR
-			("mutex attr initialization failed - %s",
-			 strerror(errno));
-		goto exit_unlink;
-	}
-	pthread_mutexattr_setpshared(&shared,1);
-	/*create a mutex */
-	err = pthread_mutex_init((pthread_mutex_t *) master_offset_buffer, &shared);
-	if(err != 0) {
-		GPTP_LOG_ERROR
-			("sharedmem - Mutex initialization failed - %s",
-			 strerror(errno));
-		goto exit_unlink;
+
+	// The segment may be left over from an earlier (or older) daemon
+	segment = (gPtpShmSegment *) master_offset_buffer;
+	__atomic_store_n( &segment->header.magic, 0, __ATOMIC_RELEASE );
+	memset( (char *) segment + sizeof( segment->header ), 0,
+		SHM_SIZE - sizeof( segment->header ));
+	segment->header.version = GPTP_SHM_VERSION;
+	segment->header.data_size = sizeof( gPtpTimeData );
+	segment->header.slot_size = sizeof( gPtpShmPortSlot );
+	segment->header.port_slots = GPTP_SHM_PORT_SLOTS;
+	segment->header.event_size = sizeof( gPtpChangeEvent );
+	segment->header.event_log = GPTP_SHM_EVENT_LOG;
+	segment->header.process_id = getpid();
+	// Readers check the magic first
+	__atomic_store_n( &segment->header.magic, GPTP_SHM_MAGIC, __ATOMIC_RELEASE );
+
+	// The shared memory stays usable without the socket
+	if( notify_path != NULL ) {
+		change_log = new LinuxChangeLogServer();
+		if( !change_log->start
+		    ( notify_path, grp != NULL ? grp->gr_gid : 0, segment )) {
+			delete change_log;
+			change_log = NULL;
+		}
 	}
+
+	umask(oldumask);
 	return true;
+
  exit_unlink:
-	shm_unlink( SHM_NAME );
+	close( shm_fd );
+	shm_fd = -1;
+	shm_unlink( shm_name );
  exit_error:
+	umask(oldumask);
 	return false;
 }
 
+bool LinuxSharedMemoryIPC::publish() {
+	if( master_offset_buffer == NULL )
+		return false;
+
+	gPtpShmSegment *segment = (gPtpShmSegment *) master_offset_buffer;
+
+	for( unsigned slot = 0; slot < GPTP_SHM_PORT_SLOTS; ++slot ) {
+		if( !dirty[slot] )
+			continue;
+		dirty[slot] = false;
+
+		gPtpShmPortSlot *port = &segment->port[slot];
+		// update_lock serializes writers, the sequence is for readers
+		PortState old_state = port->data.port_state;
+		bool old_capable = port->data.asCapable;
+
+		gptpShmWriteBegin( &port->sequence );
+		port->port_number = slot + 1;
+		memcpy( &port->data, &pending[slot], sizeof( port->data ));
+		gptpShmWriteEnd( &port->sequence );
+
+		if( pending[slot].port_state != old_state )
+			raiseEvent( GPTP_EVENT_PORT_STATE, slot + 1,
+				    pending[slot].port_state );
+		if( pending[slot].asCapable != old_capable )
+			raiseEvent( GPTP_EVENT_AS_CAPABLE, slot + 1,
+				    pending[slot].asCapable );
+	}
+
+	// Only touch the shared grandmaster line when it changed
+	if( gm_changed ) {
+		gPtpShmGrandmasterSlot *gm = &segment->grandmaster;
+
+		gptpShmWriteBegin( &gm->sequence );
+		gm->port_number = gm_port;
+		memcpy( gm->gptp_grandmaster_id, gm_id, sizeof( gm_id ));
+		gm->gptp_domain_number = gm_domain;
+		gptpShmWriteEnd( &gm->sequence );
+		gm_changed = false;
+
+		raiseEvent( GPTP_EVENT_GRANDMASTER, gm_port, 0 );
+	}
+
+	wakeConsumers();
+
+	return true;
+}
+
+void LinuxSharedMemoryIPC::raiseEvent
+( gPtpEventType type, uint16_t port_number, int64_t value )
+{
+	gPtpShmSegment *segment = (gPtpShmSegment *) master_offset_buffer;
+	gPtpChangeEvent event;
+
+	memset( &event, 0, sizeof( event ));
+	event.port_number = port_number;
+	event.type = type;
+	event.domain_number = gm_domain;
+	event.value = value;
+	if( port_number != 0 && port_number <= GPTP_SHM_PORT_SLOTS )
+		event.local_time = pending[port_number - 1].local_time;
+	if( type == GPTP_EVENT_GRANDMASTER )
+		memcpy( event.clock_identity, gm_id, sizeof( gm_id ));
+
+	gptpShmEventWrite( segment, &event );
+	++events_raised;
+}
+
+void LinuxSharedMemoryIPC::wakeConsumers()
+{
+	gPtpShmSegment *segment = (gPtpShmSegment *) master_offset_buffer;
+
+	if( events_raised == 0 )
+		return;
+	events_raised = 0;
+
+	// Shared futex: the waiters are other processes
+	if( syscall( SYS_futex, &segment->events.counter, FUTEX_WAKE, INT_MAX,
+		     NULL, NULL, 0 ) < 0 ) {
+		GPTP_LOG_ERROR( "Failed to wake change log consumers: %s",
+				strerror( errno ));
+	}
+	if( change_log != NULL )
+		change_log->notify();
+}
+
+void LinuxSharedMemoryIPC::lockUpdate() {
+	pthread_mutex_lock( &update_lock );
+	++update_depth;
+}
+
+bool LinuxSharedMemoryIPC::unlockUpdate() {
+	bool ret = master_offset_buffer != NULL;
+
+	if( --update_depth == 0 )
+		ret = publish();
+	pthread_mutex_unlock( &update_lock );
+
+	return ret;
+}
+
+gPtpTimeData *LinuxSharedMemoryIPC::pendingData( uint16_t port_number ) {
+	if( port_number == 0 || port_number > GPTP_SHM_PORT_SLOTS ) {
+		if( bad_port != port_number ) {
+			GPTP_LOG_ERROR( "Port %u has no shared memory slot (%u slots)",
+					port_number, GPTP_SHM_PORT_SLOTS );
+			bad_port = port_number;
+		}
+		return NULL;
+	}
+	dirty[port_number - 1] = true;
+
+	return &pending[port_number - 1];
+}
+
+void LinuxSharedMemoryIPC::beginUpdate() {
+	lockUpdate();
+}
+
+bool LinuxSharedMemoryIPC::endUpdate() {
+	return unlockUpdate();
+}
+
 bool LinuxSharedMemoryIPC::update(
 	int64_t ml_phoffset,
 	int64_t ls_phoffset,
@@ -944,50 +1210,51 @@ bool LinuxSharedMemoryIPC::update(
 	uint32_t sync_count,
 	uint32_t pdelay_count,
 	PortState port_state,
-	bool asCapable )
+	bool asCapable,
+	uint16_t port_number )
 {
-	int buf_offset = 0;
-	pid_t process_id = getpid();
-	char *shm_buffer = master_offset_buffer;
-	gPtpTimeData *ptimedata;
-	if( shm_buffer != NULL ) {
-		/* lock */
-		pthread_mutex_lock((pthread_mutex_t *) shm_buffer);
-		buf_offset += sizeof(pthread_mutex_t);
-		ptimedata   = (gPtpTimeData *) (shm_buffer + buf_offset);
-		ptimedata->ml_phoffset = ml_phoffset;
-		ptimedata->ls_phoffset = ls_phoffset;
-		ptimedata->ml_freqoffset = ml_freqoffset;
-		ptimedata->ls_freqoffset = ls_freqoffset;
-		ptimedata->local_time = local_time;
-		ptimedata->sync_count   = sync_count;
-		ptimedata->pdelay_count = pdelay_count;
-		ptimedata->asCapable = asCapable;
-		ptimedata->port_state   = port_state;
-		ptimedata->process_id   = process_id;
-		/* unlock */
-		pthread_mutex_unlock((pthread_mutex_t *) shm_buffer);
-	}
+	gPtpTimeData *data;
+
+	lockUpdate();
+	data = pendingData( port_number );
+	if( data != NULL ) {
+		data->ml_phoffset = ml_phoffset;
+		data->ls_phoffset = ls_phoffset;
+		data->ml_freqoffset = ml_freqoffset;
+		data->ls_freqoffset = ls_freqoffset;
+		data->local_time = local_time;
+		data->sync_count = sync_count;
+		data->pdelay_count = pdelay_count;
+		data->asCapable = asCapable;
+		data->port_state = port_state;
+		data->process_id = getpid();
+	}
+	unlockUpdate();
 	return true;
 }
 
 bool LinuxSharedMemoryIPC::update_grandmaster(
 	uint8_t gptp_grandmaster_id[],
-	uint8_t gptp_domain_number )
+	uint8_t gptp_domain_number,
+	uint16_t port_number )
 {
-	int buf_offset = 0;
-	char *shm_buffer = master_offset_buffer;
-	gPtpTimeData *ptimedata;
-	if( shm_buffer != NULL ) {
-		/* lock */
-		pthread_mutex_lock((pthread_mutex_t *) shm_buffer);
-		buf_offset += sizeof(pthread_mutex_t);
-		ptimedata   = (gPtpTimeData *) (shm_buffer + buf_offset);
-		memcpy(ptimedata->gptp_grandmaster_id, gptp_grandmaster_id, PTP_CLOCK_IDENTITY_LENGTH);
-		ptimedata->gptp_domain_number = gptp_domain_number;
-		/* unlock */
-		pthread_mutex_unlock((pthread_mutex_t *) shm_buffer);
-	}
+	gPtpTimeData *data;
+
+	lockUpdate();
+	data = pendingData( port_number );
+	if( data != NULL ) {
+		memcpy( data->gptp_grandmaster_id, gptp_grandmaster_id,
+			PTP_CLOCK_IDENTITY_LENGTH );
+		data->gptp_domain_number = gptp_domain_number;
+	}
+	if( memcmp( gm_id, gptp_grandmaster_id, sizeof( gm_id )) != 0 ||
+	    gm_domain != gptp_domain_number ) {
+		memcpy( gm_id, gptp_grandmaster_id, sizeof( gm_id ));
+		gm_domain = gptp_domain_number;
+		gm_port = port_number;
+		gm_changed = true;
+	}
+	unlockUpdate();
 	return true;
 }
 
@@ -995,7 +1262,7 @@ bool LinuxSharedMemoryIPC::update_network_interface(
 	uint8_t  clock_identity[],
 	uint8_t  priority1,
 	uint8_t  clock_class,
-	uint16_t  offset_scaled_log_variance,
+	uint16_t offset_scaled_log_variance,
 	uint8_t  clock_accuracy,
 	uint8_t  priority2,
 	uint8_t  domain_number,
@@ -1004,35 +1271,52 @@ bool LinuxSharedMemoryIPC::update_network_interface(
 	int8_t   log_pdelay_interval,
 	uint16_t port_number )
 {
-	int buf_offset = 0;
-	char *shm_buffer = master_offset_buffer;
-	gPtpTimeData *ptimedata;
-	if( shm_buffer != NULL ) {
-		/* lock */
-		pthread_mutex_lock((pthread_mutex_t *) shm_buffer);
-		buf_offset += sizeof(pthread_mutex_t);
-		ptimedata   = (gPtpTimeData *) (shm_buffer + buf_offset);
-		memcpy(ptimedata->clock_identity, clock_identity, PTP_CLOCK_IDENTITY_LENGTH);
-		ptimedata->priority1 = priority1;
-		ptimedata->clock_class = clock_class;
-		ptimedata->offset_scaled_log_variance = offset_scaled_log_variance;
-		ptimedata->clock_accuracy = clock_accuracy;
-		ptimedata->priority2 = priority2;
-		ptimedata->domain_number = domain_number;
-		ptimedata->log_sync_interval = log_sync_interval;
-		ptimedata->log_announce_interval = log_announce_interval;
-		ptimedata->log_pdelay_interval = log_pdelay_interval;
-		ptimedata->port_number   = port_number;
-		/* unlock */
-		pthread_mutex_unlock((pthread_mutex_t *) shm_buffer);
-	}
+	gPtpTimeData *data;
+
+	lockUpdate();
+	data = pendingData( port_number );
+	if( data != NULL ) {
+		memcpy( data->clock_identity, clock_identity,
+			PTP_CLOCK_IDENTITY_LENGTH );
+		data->priority1 = priority1;
+		data->clock_class = clock_class;
+		data->offset_scaled_log_variance = offset_scaled_log_variance;
+		data->clock_accuracy = clock_accuracy;
+		data->priority2 = priority2;
+		data->domain_number = domain_number;
+		data->log_sync_interval = log_sync_interval;
+		data->log_announce_interval = log_announce_interval;
+		data->log_pdelay_interval = log_pdelay_interval;
+		data->port_number = port_number;
+	}
+	unlockUpdate();
 	return true;
 }
 
+bool LinuxSharedMemoryIPC::update_phase_step
+( uint16_t port_number, int64_t phase_step )
+{
+	lockUpdate();
+	if( master_offset_buffer != NULL )
+		raiseEvent( GPTP_EVENT_PHASE_STEP, port_number, phase_step );
+	// Publishing wakes the consumers
+	return unlockUpdate();
+}
+
 void LinuxSharedMemoryIPC::stop() {
+	// The server thread reads the segment
+	if( change_log != NULL ) {
+		delete change_log;
+		change_log = NULL;
+	}
 	if( master_offset_buffer != NULL ) {
 		munmap( master_offset_buffer, SHM_SIZE );
-		shm_unlink( SHM_NAME );
+		master_offset_buffer = NULL;
+		shm_unlink( shm_name );
+	}
+	if( shm_fd != -1 ) {
+		close( shm_fd );
+		shm_fd = -1;
 	}
 }
 
@@ -1117,6 +1401,13 @@ bool LinuxNetworkInterfaceFactory::createInterface
 		goto exit_error;
 	}
 
+	net_iface_l->stop_event_fd = eventfd( 0, EFD_CLOEXEC | EFD_NONBLOCK );
+	if( net_iface_l->stop_event_fd == -1 ) {
+		GPTP_LOG_ERROR
+			( "failed to create stop eventfd: %s", strerror(errno));
+		goto exit_error;
+	}
+
 	net_iface_l->timestamper =
 		dynamic_cast <LinuxTimestamper *>(timestamper);
 	if(net_iface_l->timestamper == NULL) {
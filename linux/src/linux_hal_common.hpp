@@ -43,18 +43,26 @@
 #include "avbts_ostimer.hpp"
 #include "avbts_osthread.hpp"
 #include "avbts_osipc.hpp"
+#include "linux_ipc.hpp"
+#include <limits.h>
+#include <pthread.h>
 #include "ieee1588.hpp"
 #include <ether_tstamper.hpp>
 #include <linux/ethtool.h>
 
 #include <list>
+#include <unordered_map>
 
 #define ONE_WAY_PHY_DELAY 400	/*!< One way phy delay. TX or RX phy delay default value*/
 #define P8021AS_MULTICAST "\x01\x80\xC2\x00\x00\x0E"	/*!< Default multicast address*/
 #define PTP_DEVICE "/dev/ptp"			/*!< Default PTP device prefix */
 #define CLOCKFD 3						/*!< Clock file descriptor */
 #define FD_TO_CLOCKID(fd)       ((~(clockid_t) (fd) << 3) | CLOCKFD)	/*!< Converts an FD to CLOCKID */
+#define RECEIVE_LOOP_BUFFER_SIZE 128	/*!< Receive loop frame buffer size*/
+#define RECEIVE_LOOP_BATCH 16		/*!< Frames read per recvmmsg() call*/
+#define RECEIVE_LOOP_DEFER_MS 1		/*!< Receive retry interval while a TX timestamp is pending*/
 struct timespec;
+class EtherPort;
 
 /**
  * @brief  Converts timestamp in the struct timespec format to Timestamp
@@ -152,8 +160,17 @@ private:
 	int sd_general;
 	LinuxTimestamper *timestamper;
 	int ifindex;
+	int stop_event_fd;
 
 	TicketingLock net_lock;
+
+	net_result recvFrame
+	( LinkLayerAddress *addr, uint8_t *payload, size_t &length,
+	  int flags );
+	void drainErrorQueue();
+	bool openNetLink( int *netLinkSocket, int *inetSocket );
+	void processNetLink
+	( int netLinkSocket, int inetSocket, EtherPort *pPort );
 public:
 	/**
 	 * @brief Sends a packet to a remote address
@@ -215,6 +232,33 @@ public:
 	 */
 	virtual void watchNetLink( CommonPort *pPort );
 
+	/**
+	 * @brief  Reports whether receiveLoop() is implemented by this HAL
+	 * @return TRUE if the epoll receive loop is available
+	 */
+	virtual bool supportsReceiveLoop();
+
+	/**
+	 * @brief  Receives frames from one epoll set instead of polling.
+	 * Waits on the event socket, its error queue (TX timestamps), the
+	 * netlink socket and the stop eventfd without a timeout. Frames are
+	 * read in batches with recvmmsg() while holding the network lock, like
+	 * nrecv(), so no frame is consumed while a TX timestamp is
+	 * outstanding. Each frame is passed with its own RX timestamp.
+	 * @param  pPort [in] Port receiving frames and link events
+	 * @param  handler Frame callback
+	 * @param  arg [in] Argument passed to the handler
+	 * @return net_succeed when stopped, net_fatal on error
+	 */
+	virtual net_result receiveLoop
+	( CommonPort *pPort, net_frame_handler handler, void *arg );
+
+	/**
+	 * @brief  Signals the stop eventfd, making receiveLoop() return
+	 * @return void
+	 */
+	virtual void stopReceiveLoop();
+
 	/**
 	 * @brief Gets the payload offset
 	 * @return payload offset
@@ -233,6 +277,7 @@ protected:
 	LinuxNetworkInterface() {
 		sd_event = -1;
 		sd_general = -1;
+		stop_event_fd = -1;
 	}
 };
 
@@ -395,7 +440,44 @@ struct LinuxTimerQueueActionArg;
 /**
  * @brief Provides a map type for the LinuxTimerQueue class
  */
-typedef std::map < int, struct LinuxTimerQueueActionArg *> LinuxTimerQueueMap_t;
+typedef std::unordered_map < int, struct LinuxTimerQueueActionArg *> LinuxTimerQueueMap_t;
+
+/**
+ * @brief Identifies the timer events armed for one port and event type
+ */
+struct LinuxTimerQueueKey {
+	CommonPort *port;	/*!< Port the event was armed for */
+	int type;		/*!< Event type */
+
+	/**
+	 * @brief  Builds a key from a port and an event type
+	 * @param  port [in] Target port, may be NULL
+	 * @param  type Event type
+	 */
+	LinuxTimerQueueKey( CommonPort *port, int type ) {
+		this->port = port;
+		this->type = type;
+	}
+
+	bool operator==( const LinuxTimerQueueKey &cmp ) const {
+		return port == cmp.port && type == cmp.type;
+	}
+};
+
+/**
+ * @brief Hash function for LinuxTimerQueueKey
+ */
+struct LinuxTimerQueueKeyHash {
+	size_t operator()( const LinuxTimerQueueKey &key ) const {
+		return std::hash<CommonPort *>()( key.port ) * 31 + key.type;
+	}
+};
+
+/**
+ * @brief Provides the (port, event type) to timer key index of LinuxTimerQueue
+ */
+typedef std::unordered_multimap
+< LinuxTimerQueueKey, int, LinuxTimerQueueKeyHash > LinuxTimerQueueIndex_t;
 
 /**
  * @brief  Linux timer queue handler. Deals with linux queues
@@ -418,11 +500,13 @@ class LinuxTimerQueue : public OSTimerQueue {
 	friend void *LinuxTimerQueueHandler( void * arg );
 private:
 	LinuxTimerQueueMap_t timerQueueMap;
+	LinuxTimerQueueIndex_t timerQueueIndex;
 	int key;
 	bool stop;
 	LinuxTimerQueuePrivate_t _private;
 	OSLock *lock;
 	void LinuxTimerQueueAction( LinuxTimerQueueActionArg *arg );
+	void removeEvent( LinuxTimerQueueMap_t::iterator iter );
 protected:
 	/**
 	 * @brief Default constructor
@@ -449,7 +533,7 @@ public:
 	 * @param func Callback
 	 * @param arg inner argument of type event_descriptor_t
 	 * @param rm when true, allows elements to be deleted from the queue
-	 * @param event [inout] Pointer to the event
+	 * @param event [out] If non-null, receives the event handle
 	 * @return TRUE success, FALSE fail
 	 */
 	bool addEvent
@@ -459,10 +543,18 @@ public:
 	/**
 	 * @brief Removes an event from the timer queue
 	 * @param type Event type
-	 * @param event [inout] Pointer to the event
+	 * @param event [in] If non-null, handle of the single event to remove
 	 * @return TRUE success, FALSE fail
 	 */
 	bool cancelEvent( int type, unsigned *event );
+
+	/**
+	 * @brief Removes the events of one type armed for one port
+	 * @param target [in] Port the events were armed for
+	 * @param type Event type
+	 * @return TRUE success, FALSE fail
+	 */
+	bool cancelPortEvent( CommonPort *target, int type );
 };
 
 /**
@@ -599,28 +691,48 @@ public:
 class LinuxIPCArg : public OS_IPC_ARG {
 private:
 	char *group_name;
+	char *shm_name;
+	char *notify_path;
+
+	static char *copyName( const char *name, size_t max ) {
+		if( name == NULL )
+			return NULL;
+		size_t len = strnlen( name, max );
+		char *copy = new char[len+1];
+		strncpy( copy, name, len );
+		copy[len] = '\0';
+		return copy;
+	}
 public:
 	/**
 	 * @brief  Initializes IPCArg object
 	 * @param group_name [in] Group's name
-	 */
-	LinuxIPCArg( char *group_name ) {
-		int len = strnlen(group_name,16);
-		this->group_name = new char[len+1];
-		strncpy( this->group_name, group_name, len+1 );
-		this->group_name[len] = '\0';
+	 * @param shm_name [in] Shared memory name, SHM_NAME if NULL
+	 * @param notify_path [in] Path of the change log socket, or NULL to
+	 * only publish changes through the shared memory
+	 */
+	LinuxIPCArg
+	( const char *group_name, const char *shm_name = NULL,
+	  const char *notify_path = NULL ) {
+		this->group_name = copyName( group_name, 16 );
+		this->shm_name = copyName( shm_name, NAME_MAX );
+		this->notify_path = copyName( notify_path, PATH_MAX );
 	}
 	/**
 	 * @brief Destroys IPCArg internal variables
 	 */
 	virtual ~LinuxIPCArg() {
-		delete group_name;
+		delete [] group_name;
+		delete [] shm_name;
+		delete [] notify_path;
 	}
 	friend class LinuxSharedMemoryIPC;
 };
 
 #define DEFAULT_GROUPNAME "ptp"		/*!< Default groupname for the shared memory interface*/
 
+class LinuxChangeLogServer;
+
 /**
  * @brief Linux shared memory interface
  */
@@ -629,14 +741,93 @@ private:
 	int shm_fd;
 	char *master_offset_buffer;
 	int err;
+	char shm_name[NAME_MAX+1];
+	pthread_mutex_t update_lock;
+	gPtpTimeData pending[GPTP_SHM_PORT_SLOTS];
+	bool dirty[GPTP_SHM_PORT_SLOTS];	/* pending not yet published */
+	unsigned update_depth;		/* update_lock holds by this thread */
+	uint16_t bad_port;		/* last port without a slot, logged */
+	uint8_t gm_id[PTP_CLOCK_IDENTITY_LENGTH];
+	uint8_t gm_domain;
+	uint16_t gm_port;
+	bool gm_changed;
+	unsigned events_raised;
+	LinuxChangeLogServer *change_log;
+
+	/**
+	 * @brief Copies the pending values of each port updated since the
+	 * last call, and the grandmaster if it changed, to their slots under
+	 * the sequence lock. Appends a change log event for each grandmaster,
+	 * port state or asCapable change and wakes the consumers.
+	 * Must be called with update_lock held.
+	 * @return TRUE if the segment is mapped, FALSE otherwise
+	 */
+	bool publish();
+
+	/**
+	 * @brief Takes update_lock, which is recursive so that the update
+	 * calls nest inside beginUpdate() and endUpdate()
+	 * @return void
+	 */
+	void lockUpdate();
+
+	/**
+	 * @brief Releases update_lock, publishing first if this is the
+	 * outermost hold
+	 * @return TRUE unless the segment is not mapped
+	 */
+	bool unlockUpdate();
+
+	/**
+	 * @brief Pending values of a port, marked for the next publish().
+	 * Port n is published in slot n - 1. Must be called with update_lock
+	 * held.
+	 * @param port_number Port number
+	 * @return The values, or NULL if the port has no slot
+	 */
+	gPtpTimeData *pendingData( uint16_t port_number );
+
+	/**
+	 * @brief Appends an event to the change log. Must be called with
+	 * update_lock held; consumers are woken by wakeConsumers().
+	 * @param type One gPtpEventType
+	 * @param port_number Port the change was seen on
+	 * @param value Type dependent value
+	 * @return void
+	 */
+	void raiseEvent( gPtpEventType type, uint16_t port_number, int64_t value );
+
+	/**
+	 * @brief Wakes the processes waiting on the change log counter and
+	 * the change log socket, if events were raised since the last call
+	 * @return void
+	 */
+	void wakeConsumers();
 public:
 	/**
 	 * @brief Initializes the internal flags
 	 */
 	LinuxSharedMemoryIPC() {
-		shm_fd = 0;
+		pthread_mutexattr_t attr;
+
+		shm_fd = -1;
 		err = 0;
 		master_offset_buffer = NULL;
+		shm_name[0] = '\0';
+		pthread_mutexattr_init( &attr );
+		pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE );
+		pthread_mutex_init( &update_lock, &attr );
+		pthread_mutexattr_destroy( &attr );
+		memset( pending, 0, sizeof( pending ));
+		memset( dirty, 0, sizeof( dirty ));
+		update_depth = 0;
+		bad_port = 0;
+		memset( gm_id, 0, sizeof( gm_id ));
+		gm_domain = 0;
+		gm_port = 0;
+		gm_changed = false;
+		events_raised = 0;
+		change_log = NULL;
 	};
 	/**
 	 * @brief Destroys and unlinks shared memory
@@ -644,7 +835,8 @@ public:
 	~LinuxSharedMemoryIPC();
 
 	/**
-	 * @brief  Initializes shared memory with DEFAULT_GROUPNAME case arg is null
+	 * @brief  Initializes shared memory with DEFAULT_GROUPNAME case arg is null,
+	 * and starts the change log socket if the arg names one
 	 * @param  barg Groupname of the shared memory
 	 * @return TRUE if no error, FALSE otherwise
 	 */
@@ -662,6 +854,7 @@ public:
 	 * @param pdelay_count Count of pdelays
 	 * @param port_state Port's state
 	 * @param asCapable asCapable flag
+	 * @param port_number Port the values belong to
 	 *
 	 * @return TRUE
 	 */
@@ -674,19 +867,22 @@ public:
 		uint32_t sync_count,
 		uint32_t pdelay_count,
 		PortState port_state,
-		bool asCapable );
+		bool asCapable,
+		uint16_t port_number );
 
 	/**
 	 * @brief Updates grandmaster IPC values
 	 *
 	 * @param gptp_grandmaster_id Current grandmaster id (all 0's if no grandmaster selected)
 	 * @param gptp_domain_number gPTP domain number
+	 * @param port_number Port the grandmaster was learned on
 	 *
 	 * @return TRUE
 	 */
 	virtual bool update_grandmaster(
 		uint8_t gptp_grandmaster_id[],
-		uint8_t gptp_domain_number );
+		uint8_t gptp_domain_number,
+		uint16_t port_number );
 
 	/**
 	 * @brief Updates network interface IPC values
@@ -718,6 +914,29 @@ public:
 		int8_t   log_pdelay_interval,
 		uint16_t port_number );
 
+	/**
+	 * @brief Defers publishing until endUpdate(). Until then other
+	 * threads' updates wait.
+	 * @return void
+	 */
+	virtual void beginUpdate();
+
+	/**
+	 * @brief Publishes each port slot updated since beginUpdate() as a
+	 * single write, and the grandmaster slot if the grandmaster changed
+	 * @return TRUE if published, FALSE if the segment is not mapped
+	 */
+	virtual bool endUpdate();
+
+	/**
+	 * @brief Appends a GPTP_EVENT_PHASE_STEP event to the change log and
+	 * wakes the consumers
+	 * @param port_number Port whose sync caused the step
+	 * @param phase_step Step applied to the clock, in ns
+	 * @return TRUE if published, FALSE if the segment is not mapped
+	 */
+	virtual bool update_phase_step( uint16_t port_number, int64_t phase_step );
+
 	/**
 	 * @brief unmaps and unlink shared memory
 	 * @return void
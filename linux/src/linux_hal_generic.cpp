@@ -32,9 +32,14 @@
 ******************************************************************************/
 #include <linux_hal_generic.hpp>
 #include <linux_hal_generic_tsprivate.hpp>
+#include <linux_rx_ring.hpp>
 #include <platform.hpp>
+#include <ether_port.hpp>
 #include <avbts_message.hpp>
 #include <sys/select.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <netpacket/packet.h>
 #include <errno.h>
@@ -49,13 +54,17 @@
 #include <syscall.h>
 #include <limits.h>
 
+#undef GPTP_LOG_SUBSYSTEM
+#define GPTP_LOG_SUBSYSTEM GPTP_LOG_SUBSYS_NET
+
 #define TX_PHY_TIME 184
 #define RX_PHY_TIME 382
+#define TX_TIMESTAMP_QUEUE_MAX 16
+#define CROSSTS_IOCTL_SAMPLES 5	/* per background sample, the window filters the rest */
 
-net_result LinuxNetworkInterface::nrecv
-( LinkLayerAddress *addr, uint8_t *payload, size_t &length )
+net_result LinuxNetworkInterface::recvFrame
+( LinkLayerAddress *addr, uint8_t *payload, size_t &length, int flags )
 {
-	fd_set readfds;
 	int err;
 	struct msghdr msg;
 	struct cmsghdr *cmsg;
@@ -65,44 +74,9 @@ net_result LinuxNetworkInterface::nrecv
 	} control;
 	struct sockaddr_ll remote;
 	struct iovec sgentry;
-	net_result ret = net_succeed;
-	bool got_net_lock;
 
 	LinuxTimestamperGeneric *gtimestamper;
 
-	struct timeval timeout = { 0, 16000 }; // 16 ms
-
-	if( !net_lock.lock( &got_net_lock )) {
-		GPTP_LOG_ERROR("A Failed to lock mutex");
-		return net_fatal;
-	}
-	if( !got_net_lock ) {
-		return net_trfail;
-	}
-
-	FD_ZERO( &readfds );
-	FD_SET( sd_event, &readfds );
-
-	err = select( sd_event+1, &readfds, NULL, NULL, &timeout );
-	if( err == 0 ) {
-		ret = net_trfail;
-		goto done;
-	} else if( err == -1 ) {
-		if( err == EINTR ) {
-			// Caught signal
-			GPTP_LOG_ERROR("select() recv signal");
-			ret = net_trfail;
-			goto done;
-		} else {
-			GPTP_LOG_ERROR("select() failed");
-			ret = net_fatal;
-			goto done;
-    }
-	} else if( !FD_ISSET( sd_event, &readfds )) {
-		ret = net_trfail;
-		goto done;
-	}
-
 	memset( &msg, 0, sizeof( msg ));
 
 	msg.msg_iov = &sgentry;
@@ -117,16 +91,17 @@ net_result LinuxNetworkInterface::nrecv
 	msg.msg_control = &control;
 	msg.msg_controllen = sizeof(control);
 
-	err = recvmsg( sd_event, &msg, 0 );
+	err = recvmsg( sd_event, &msg, flags );
 	if( err < 0 ) {
+		if( errno == EAGAIN || errno == EINTR ) {
+			return net_trfail;
+		}
 		if( errno == ENOMSG ) {
 			GPTP_LOG_ERROR("Got ENOMSG: %s:%d", __FILE__, __LINE__);
-			ret = net_trfail;
-			goto done;
+			return net_trfail;
 		}
 		GPTP_LOG_ERROR("recvmsg() failed: %s", strerror(errno));
-		ret = net_fatal;
-		goto done;
+		return net_fatal;
 	}
 	*addr = LinkLayerAddress( remote.sll_addr );
 
@@ -152,6 +127,52 @@ net_result LinuxNetworkInterface::nrecv
 
 	length = err;
 
+	return net_succeed;
+}
+
+net_result LinuxNetworkInterface::nrecv
+( LinkLayerAddress *addr, uint8_t *payload, size_t &length )
+{
+	fd_set readfds;
+	int err;
+	net_result ret = net_succeed;
+	bool got_net_lock;
+
+	struct timeval timeout = { 0, 16000 }; // 16 ms
+
+	if( !net_lock.lock( &got_net_lock )) {
+		GPTP_LOG_ERROR("A Failed to lock mutex");
+		return net_fatal;
+	}
+	if( !got_net_lock ) {
+		return net_trfail;
+	}
+
+	FD_ZERO( &readfds );
+	FD_SET( sd_event, &readfds );
+
+	err = select( sd_event+1, &readfds, NULL, NULL, &timeout );
+	if( err == 0 ) {
+		ret = net_trfail;
+		goto done;
+	} else if( err == -1 ) {
+		if( err == EINTR ) {
+			// Caught signal
+			GPTP_LOG_ERROR("select() recv signal");
+			ret = net_trfail;
+			goto done;
+		} else {
+			GPTP_LOG_ERROR("select() failed");
+			ret = net_fatal;
+			goto done;
+    }
+	} else if( !FD_ISSET( sd_event, &readfds )) {
+		ret = net_trfail;
+		goto done;
+	}
+
+	ret = recvFrame( addr, payload, length, 0 );
+
  done:
 	if( !net_lock.unlock()) {
 		GPTP_LOG_ERROR("A Failed to unlock, %d", err);
@@ -161,6 +182,193 @@ net_result LinuxNetworkInterface::nrecv
 	return ret;
 }
 
+void LinuxNetworkInterface::drainErrorQueue()
+{
+	LinuxTimestamperGeneric *gtimestamper;
+	uint8_t discard[ETHER_HDR_LEN + PTP_COMMON_HDR_LENGTH];
+
+	gtimestamper = dynamic_cast<LinuxTimestamperGeneric *>(timestamper);
+	if( gtimestamper != NULL ) {
+		gtimestamper->drainTXTimestamps();
+		return;
+	}
+
+	// Nobody collects TX timestamps, keep EPOLLERR from spinning
+	while( recv( sd_event, discard, sizeof( discard ), MSG_ERRQUEUE ) >= 0 )
+		;
+}
+
+bool LinuxNetworkInterface::supportsReceiveLoop()
+{
+	return true;
+}
+
+net_result LinuxNetworkInterface::receiveLoop
+( CommonPort *iPort, net_frame_handler handler, void *arg )
+{
+	struct epoll_event ev;
+	struct epoll_event events[3];
+	int epoll_fd;
+	int netLinkSocket;
+	int inetSocket;
+	int nfds;
+	int i;
+	int nframes;
+	int recv_errno;
+	bool got_net_lock;
+	bool rx_deferred = false;
+	bool stop = false;
+	net_result ret = net_succeed;
+	LinuxReceiveRing ring( RECEIVE_LOOP_BATCH, RECEIVE_LOOP_BUFFER_SIZE );
+	LinuxTimestamperGeneric *gtimestamper;
+
+	EtherPort *pPort = dynamic_cast<EtherPort *>(iPort);
+	if( pPort == NULL ) {
+		GPTP_LOG_ERROR("receiveLoop requires an EtherPort");
+		return net_fatal;
+	}
+	gtimestamper = dynamic_cast<LinuxTimestamperGeneric *>(timestamper);
+
+	if( !openNetLink( &netLinkSocket, &inetSocket ))
+		return net_fatal;
+
+	epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+	if( epoll_fd == -1 ) {
+		GPTP_LOG_ERROR("epoll_create1() failed: %s", strerror(errno));
+		close( netLinkSocket );
+		close( inetSocket );
+		return net_fatal;
+	}
+
+	memset( &ev, 0, sizeof( ev ));
+	ev.events = EPOLLIN;
+	ev.data.fd = stop_event_fd;
+	if( epoll_ctl( epoll_fd, EPOLL_CTL_ADD, stop_event_fd, &ev ) == -1 ) {
+		GPTP_LOG_ERROR("epoll_ctl(stop) failed: %s", strerror(errno));
+		ret = net_fatal;
+		goto done;
+	}
+	// EPOLLERR is always reported; it signals queued TX timestamps
+	ev.data.fd = sd_event;
+	if( epoll_ctl( epoll_fd, EPOLL_CTL_ADD, sd_event, &ev ) == -1 ) {
+		GPTP_LOG_ERROR("epoll_ctl(event) failed: %s", strerror(errno));
+		ret = net_fatal;
+		goto done;
+	}
+	ev.data.fd = netLinkSocket;
+	if( epoll_ctl( epoll_fd, EPOLL_CTL_ADD, netLinkSocket, &ev ) == -1 ) {
+		GPTP_LOG_ERROR("epoll_ctl(netlink) failed: %s", strerror(errno));
+		ret = net_fatal;
+		goto done;
+	}
+
+	while( !stop && pPort->getListeningThreadRunning() ) {
+		bool rx_ready = rx_deferred;
+
+		nfds = epoll_wait
+			( epoll_fd, events, sizeof( events )/sizeof( *events ),
+			  rx_deferred ? RECEIVE_LOOP_DEFER_MS : -1 );
+		if( nfds == -1 ) {
+			if( errno == EINTR )
+				continue;
+			GPTP_LOG_ERROR("epoll_wait() failed: %s", strerror(errno));
+			ret = net_fatal;
+			break;
+		}
+
+		for( i = 0; i < nfds; ++i ) {
+			if( events[i].data.fd == stop_event_fd ) {
+				uint64_t count;
+				if( read( stop_event_fd, &count, sizeof( count )) < 0 )
+					GPTP_LOG_VERBOSE("stop eventfd already drained");
+				stop = true;
+			} else if( events[i].data.fd == netLinkSocket ) {
+				processNetLink( netLinkSocket, inetSocket, pPort );
+			} else if( events[i].data.fd == sd_event ) {
+				if( events[i].events & EPOLLERR )
+					drainErrorQueue();
+				if( events[i].events & EPOLLIN )
+					rx_ready = true;
+			}
+		}
+		if( stop || !rx_ready )
+			continue;
+
+		if( !net_lock.lock( &got_net_lock )) {
+			GPTP_LOG_ERROR("A Failed to lock mutex");
+			ret = net_fatal;
+			break;
+		}
+		if( !got_net_lock ) {
+			/*
+			 * A TX timestamp is outstanding. Stop watching EPOLLIN,
+			 * which would spin, and retry shortly.
+			 */
+			if( !rx_deferred ) {
+				ev.events = 0;
+				ev.data.fd = sd_event;
+				epoll_ctl( epoll_fd, EPOLL_CTL_MOD, sd_event, &ev );
+				rx_deferred = true;
+			}
+			continue;
+		}
+		if( rx_deferred ) {
+			ev.events = EPOLLIN;
+			ev.data.fd = sd_event;
+			epoll_ctl( epoll_fd, EPOLL_CTL_MOD, sd_event, &ev );
+			rx_deferred = false;
+		}
+
+		nframes = ring.receive( sd_event, MSG_DONTWAIT );
+		recv_errno = errno;
+
+		if( !net_lock.unlock()) {
+			GPTP_LOG_ERROR("A Failed to unlock");
+			ret = net_fatal;
+			break;
+		}
+		if( nframes == -1 ) {
+			if( recv_errno == EAGAIN || recv_errno == EINTR )
+				continue;
+			if( recv_errno == ENOMSG ) {
+				GPTP_LOG_ERROR("Got ENOMSG: %s:%d", __FILE__, __LINE__);
+				continue;
+			}
+			GPTP_LOG_ERROR("recvmmsg() failed: %s", strerror(recv_errno));
+			ret = net_fatal;
+			break;
+		}
+
+		for( i = 0; i < nframes; ++i ) {
+			LinkLayerAddress remote
+				( (uint8_t *) ring.getRemote( i )->sll_addr );
+			const struct timespec *stamps = ring.getTimestamps( i );
+			uint8_t *payload = ring.getPayload( i );
+			Timestamp device;
+
+			// Only event messages carry a usable device timestamp
+			if( ring.getLength( i ) > 0 && !(payload[0] & 0x8) &&
+			    gtimestamper != NULL && stamps != NULL ) {
+				device = tsToTimestamp
+					( (struct timespec *) &stamps[2] );
+				device._version = gtimestamper->getVersion();
+			} else {
+				stamps = NULL;
+			}
+			handler
+				( arg, &remote, payload, ring.getLength( i ),
+				  stamps != NULL ? &device : NULL );
+		}
+	}
+
+ done:
+	close( epoll_fd );
+	close( netLinkSocket );
+	close( inetSocket );
+
+	return ret;
+}
+
 int findPhcIndex( InterfaceLabel *iface_label ) {
 	int sd;
 	int ret;
@@ -199,7 +407,13 @@ done:
 }
 
 LinuxTimestamperGeneric::~LinuxTimestamperGeneric() {
-	if( _private != NULL ) delete _private;
+	// Stops the sampling thread before the PHC goes away
+	delete crossts;
+	if( _private != NULL ) {
+		if( _private->tx_stamp_event_fd != -1 )
+			close( _private->tx_stamp_event_fd );
+		delete _private;
+	}
 #ifdef WITH_IGBLIB
 	if( igb_private != NULL ) delete igb_private;
 #endif
@@ -211,6 +425,8 @@ LinuxTimestamperGeneric::LinuxTimestamperGeneric() {
 	igb_private = NULL;
 #endif
 	sd = -1;
+	phc_fd = -1;
+	crossts = NULL;
 }
 
 bool LinuxTimestamperGeneric::Adjust( void *tmx ) const {
@@ -232,6 +448,12 @@ bool LinuxTimestamperGeneric::HWTimestamper_init
 	_private = new LinuxTimestamperGenericPrivate;
 
 	pthread_mutex_init( &_private->cross_stamp_lock, NULL );
+	pthread_mutex_init( &_private->tx_stamp_lock, NULL );
+	_private->tx_stamp_event_fd = eventfd( 0, EFD_CLOEXEC | EFD_NONBLOCK );
+	if( _private->tx_stamp_event_fd == -1 ) {
+		GPTP_LOG_ERROR("Failed to create TX timestamp eventfd");
+		return false;
+	}
 
 	// Determine the correct PTP clock interface
 	phc_index = findPhcIndex( iface_label );
@@ -278,17 +500,14 @@ void LinuxTimestamperGeneric::HWTimestamper_reset()
 	}
 }
 
-int LinuxTimestamperGeneric::HWTimestamper_txtimestamp
-( PortIdentity *identity, PTPMessageId messageId, Timestamp &timestamp,
-  unsigned &clock_value, bool last )
+int LinuxTimestamperGeneric::readTXTimestamp
+( PTPMessageId &messageId, Timestamp &timestamp, bool &valid )
 {
 	int err;
-	int ret = GPTP_EC_EAGAIN;
 	struct msghdr msg;
 	struct cmsghdr *cmsg;
 	struct sockaddr_ll remote;
 	struct iovec sgentry;
-	PTPMessageId reflectedMessageId;
 	uint8_t reflected_bytes[ETHER_HDR_LEN + PTP_COMMON_HDR_LENGTH];
 	uint8_t *gptpCommonHeader;
 	uint16_t sequenceId;
@@ -297,7 +516,7 @@ int LinuxTimestamperGeneric::HWTimestamper_txtimestamp
 		struct cmsghdr cm;
 	} control;
 
-	if( sd == -1 ) return -1;
+	valid = false;
 	memset( &msg, 0, sizeof( msg ));
 	memset( reflected_bytes, 0, sizeof( reflected_bytes ));
 
@@ -318,22 +537,13 @@ int LinuxTimestamperGeneric::HWTimestamper_txtimestamp
 	err = recvmsg( sd, &msg, MSG_ERRQUEUE );
 	if( err == -1 ) {
 		if( errno == EAGAIN ) {
-			ret = GPTP_EC_EAGAIN;
-			goto done;
-		}
-		else {
-			ret = GPTP_EC_FAILURE;
-			goto done;
+			return GPTP_EC_EAGAIN;
 		}
+		return GPTP_EC_FAILURE;
 	}
 	sequenceId = PLAT_ntohs(*((uint16_t*)(PTP_COMMON_HDR_SEQUENCE_ID(gptpCommonHeader))));
-	reflectedMessageId.setSequenceId(sequenceId);
-	reflectedMessageId.setMessageType((MessageType)(*PTP_COMMON_HDR_TRANSSPEC_MSGTYPE(gptpCommonHeader) & 0xF));
-	if (messageId != reflectedMessageId) {
-		GPTP_LOG_WARNING("Timestamp discarded due to wrong message id");
-		ret = GPTP_EC_EAGAIN;
-		goto done;
-	}
+	messageId.setSequenceId(sequenceId);
+	messageId.setMessageType((MessageType)(*PTP_COMMON_HDR_TRANSSPEC_MSGTYPE(gptpCommonHeader) & 0xF));
 
 	// Retrieve the timestamp
 	cmsg = CMSG_FIRSTHDR(&msg);
@@ -348,16 +558,178 @@ int LinuxTimestamperGeneric::HWTimestamper_txtimestamp
 			system._version = version;
 			device._version = version;
 			timestamp = device;
-			ret = 0;
+			valid = true;
 			break;
 		}
 		cmsg = CMSG_NXTHDR(&msg,cmsg);
 	}
 
-	if( ret != 0 ) {
+	if( !valid ) {
 		GPTP_LOG_ERROR("Received a error message, but didn't find a valid timestamp");
 	}
 
+	return GPTP_EC_SUCCESS;
+}
+
+bool LinuxTimestamperGeneric::takeTXTimestamp
+( PTPMessageId messageId, Timestamp &timestamp )
+{
+	std::list<LinuxTxTimestamp>::iterator iter;
+	bool found = false;
+
+	pthread_mutex_lock( &_private->tx_stamp_lock );
+	for( iter = _private->tx_stamp_list.begin();
+	     iter != _private->tx_stamp_list.end(); ++iter ) {
+		if( iter->messageId == messageId ) {
+			timestamp = iter->timestamp;
+			_private->tx_stamp_list.erase( iter );
+			found = true;
+			break;
+		}
+	}
+	pthread_mutex_unlock( &_private->tx_stamp_lock );
+
+	return found;
+}
+
+void LinuxTimestamperGeneric::drainTXTimestamps()
+{
+	LinuxTxTimestamp entry;
+	bool valid;
+	uint64_t one = 1;
+	bool queued = false;
+
+	if( sd == -1 || _private == NULL ) return;
+
+	while( readTXTimestamp( entry.messageId, entry.timestamp, valid )
+	       == GPTP_EC_SUCCESS ) {
+		if( !valid )
+			continue;
+
+		pthread_mutex_lock( &_private->tx_stamp_lock );
+		if( _private->tx_stamp_list.size() >= TX_TIMESTAMP_QUEUE_MAX ) {
+			GPTP_LOG_WARNING("TX timestamp discarded, nobody claimed it");
+			_private->tx_stamp_list.pop_front();
+		}
+		_private->tx_stamp_list.push_back( entry );
+		pthread_mutex_unlock( &_private->tx_stamp_lock );
+		queued = true;
+	}
+
+	// Wake a sender blocked in HWTimestamper_txtimestamp_wait()
+	if( queued &&
+	    write( _private->tx_stamp_event_fd, &one, sizeof( one )) == -1 ) {
+		GPTP_LOG_ERROR("Failed to signal TX timestamp: %s", strerror(errno));
+	}
+}
+
+int LinuxTimestamperGeneric::HWTimestamper_txtimestamp_wait
+( PortIdentity *, PTPMessageId messageId, Timestamp &timestamp,
+  unsigned &, unsigned timeout_us )
+{
+	int ret = GPTP_EC_EAGAIN;
+	PTPMessageId reflectedMessageId;
+	struct timespec now, deadline;
+	struct pollfd fds[2];
+	bool valid;
+
+	if( sd == -1 ) return -1;
+
+	clock_gettime( CLOCK_MONOTONIC, &deadline );
+	deadline.tv_sec += timeout_us / 1000000;
+	deadline.tv_nsec += (timeout_us % 1000000) * 1000;
+	if( deadline.tv_nsec >= 1000000000 ) {
+		deadline.tv_nsec -= 1000000000;
+		++deadline.tv_sec;
+	}
+
+	// POLLERR is always reported, no other event is requested on sd
+	fds[0].fd = sd;
+	fds[0].events = 0;
+	fds[1].fd = _private->tx_stamp_event_fd;
+	fds[1].events = POLLIN;
+
+	for( ;; ) {
+		struct timespec remaining;
+		uint64_t count;
+		int err;
+
+		if( takeTXTimestamp( messageId, timestamp )) {
+			ret = GPTP_EC_SUCCESS;
+			break;
+		}
+
+		ret = readTXTimestamp( reflectedMessageId, timestamp, valid );
+		if( ret == GPTP_EC_FAILURE )
+			break;
+		if( ret == GPTP_EC_SUCCESS ) {
+			if( valid && messageId == reflectedMessageId )
+				break;
+			if( valid )
+				GPTP_LOG_WARNING("Timestamp discarded due to wrong message id");
+			continue;
+		}
+
+		clock_gettime( CLOCK_MONOTONIC, &now );
+		remaining.tv_sec = deadline.tv_sec - now.tv_sec;
+		remaining.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+		if( remaining.tv_nsec < 0 ) {
+			remaining.tv_nsec += 1000000000;
+			--remaining.tv_sec;
+		}
+		if( remaining.tv_sec < 0 ) {
+			ret = GPTP_EC_EAGAIN;
+			break;
+		}
+
+		fds[0].revents = 0;
+		fds[1].revents = 0;
+		err = ppoll( fds, 2, &remaining, NULL );
+		if( err == -1 && errno != EINTR ) {
+			GPTP_LOG_ERROR("ppoll() failed: %s", strerror(errno));
+			ret = GPTP_EC_FAILURE;
+			break;
+		}
+		if( err > 0 && (fds[1].revents & POLLIN) &&
+		    read( fds[1].fd, &count, sizeof( count )) == -1 ) {
+			GPTP_LOG_VERBOSE("TX timestamp eventfd already drained");
+		}
+	}
+
+	net_lock->unlock();
+
+	return ret;
+}
+
+int LinuxTimestamperGeneric::HWTimestamper_txtimestamp
+( PortIdentity *identity, PTPMessageId messageId, Timestamp &timestamp,
+  unsigned &clock_value, bool last )
+{
+	int ret = GPTP_EC_EAGAIN;
+	PTPMessageId reflectedMessageId;
+	bool valid;
+
+	if( sd == -1 ) return -1;
+
+	// The receive loop may have already drained it from the error queue
+	if( takeTXTimestamp( messageId, timestamp )) {
+		ret = 0;
+		goto done;
+	}
+
+	ret = readTXTimestamp( reflectedMessageId, timestamp, valid );
+	if( ret != GPTP_EC_SUCCESS ) {
+		goto done;
+	}
+	if (messageId != reflectedMessageId) {
+		GPTP_LOG_WARNING("Timestamp discarded due to wrong message id");
+		ret = GPTP_EC_EAGAIN;
+		goto done;
+	}
+	if( !valid ) {
+		ret = GPTP_EC_EAGAIN;
+	}
+
  done:
 	if( ret == 0 || last ) {
 		net_lock->unlock();
@@ -418,13 +790,14 @@ bool LinuxTimestamperGeneric::post_init( int ifindex, int sd, TicketingLock *loc
 static inline ptp_clock_time pct_diff
 ( struct ptp_clock_time *a, struct ptp_clock_time *b ) {
 	ptp_clock_time result;
+	result.sec = a->sec - b->sec;
 	if( a->nsec >= b->nsec ) {
 		result.nsec = a->nsec - b->nsec;
 	} else {
-		--a->sec;
+		// Borrow without touching *a, it is the next sample's start
+		--result.sec;
 		result.nsec = (MAX_NSEC - b->nsec) + a->nsec;
 	}
-	result.sec = a->sec - b->sec;
 
 	return result;
 }
@@ -445,13 +818,10 @@ static inline Timestamp pctTimestamp( struct ptp_clock_time *t ) {
 }
 
 // Use HW cross-timestamp if available
-bool LinuxTimestamperGeneric::HWTimestamper_gettime
-( Timestamp *system_time, Timestamp *device_time, uint32_t *local_clock,
-  uint32_t *nominal_clock_rate ) const
+bool LinuxTimestamperGeneric::readCrossTimestamp
+( Timestamp *system_time, Timestamp *device_time, int64_t *width_ns,
+  unsigned n_samples ) const
 {
-	if( phc_fd == -1 )
-		return false;
-
 #ifdef PTP_HW_CROSSTSTAMP
 	if( precise_timestamp_enabled )
 	{
@@ -461,6 +831,7 @@ bool LinuxTimestamperGeneric::HWTimestamper_gettime
 		{
 			*device_time = pctTimestamp( &offset.device );
 			*system_time = pctTimestamp( &offset.sys_realtime );
+			*width_ns = 0;
 
 			return true;
 		}
@@ -475,7 +846,7 @@ bool LinuxTimestamperGeneric::HWTimestamper_gettime
 		struct ptp_sys_offset offset;
 
 		memset( &offset, 0, sizeof(offset));
-		offset.n_samples = PTP_MAX_SAMPLES;
+		offset.n_samples = n_samples;
 		if( ioctl( phc_fd, PTP_SYS_OFFSET, &offset ) == -1 )
 			return false;
 
@@ -490,11 +861,87 @@ bool LinuxTimestamperGeneric::HWTimestamper_gettime
 			}
 		}
 
-		if (device_time_l)
-			*device_time = pctTimestamp( device_time_l );
-		if (system_time_l)
-			*system_time = pctTimestamp( system_time_l );
+		if( device_time_l == NULL )
+			return false;
+
+		// The device was read between the two system reads around it
+		struct timespec system_mid;
+		int64_t system_ns = pctns( *system_time_l ) + interval / 2;
+		system_mid.tv_sec = system_ns / 1000000000LL;
+		system_mid.tv_nsec = system_ns % 1000000000LL;
+		*device_time = pctTimestamp( device_time_l );
+		*system_time = tsToTimestamp( &system_mid );
+		*width_ns = interval;
 	}
 
 	return true;
 }
+
+bool LinuxTimestamperGeneric::sampleCrossTimestamp
+( void *arg, int64_t *system_ns, int64_t *device_ns, int64_t *width_ns )
+{
+	LinuxTimestamperGeneric *timestamper = (LinuxTimestamperGeneric *) arg;
+	Timestamp system_time, device_time;
+
+	if( !timestamper->readCrossTimestamp
+	    ( &system_time, &device_time, width_ns, CROSSTS_IOCTL_SAMPLES ))
+		return false;
+
+	*system_ns = TIMESTAMP_TO_NS( system_time );
+	*device_ns = TIMESTAMP_TO_NS( device_time );
+
+	return true;
+}
+
+bool LinuxTimestamperGeneric::startCrossTimestamping
+( unsigned rate_hz, unsigned window )
+{
+	if( phc_fd == -1 || crossts != NULL )
+		return false;
+
+	crossts = new LinuxCrossTimestampEstimator();
+	if( !crossts->start( sampleCrossTimestamp, this, rate_hz, window )) {
+		delete crossts;
+		crossts = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+bool LinuxTimestamperGeneric::getCrossTimestampStats
+( LinuxCrossTimestampStats *stats ) const
+{
+	return crossts != NULL && crossts->getStats( stats );
+}
+
+bool LinuxTimestamperGeneric::HWTimestamper_gettime
+( Timestamp *system_time, Timestamp *device_time, uint32_t *local_clock,
+  uint32_t *nominal_clock_rate ) const
+{
+	int64_t width_ns;
+
+	if( phc_fd == -1 )
+		return false;
+
+	if( crossts != NULL ) {
+		struct timespec now;
+		int64_t device_ns;
+
+		clock_gettime( CLOCK_REALTIME, &now );
+		if( crossts->estimate
+		    ( now.tv_sec * 1000000000LL + now.tv_nsec, &device_ns )) {
+			struct timespec device;
+
+			device.tv_sec = device_ns / 1000000000LL;
+			device.tv_nsec = device_ns % 1000000000LL;
+			*system_time = tsToTimestamp( &now );
+			*device_time = tsToTimestamp( &device );
+
+			return true;
+		}
+	}
+
+	return readCrossTimestamp
+		( system_time, device_time, &width_ns, PTP_MAX_SAMPLES );
+}
@@ -35,6 +35,7 @@
 #define LINUX_HAL_GENERIC_HPP
 
 #include <linux_hal_common.hpp>
+#include <linux_crossts.hpp>
 
 /**@file*/
 
@@ -68,10 +69,21 @@ private:
 
 	TicketingLock *net_lock;
 
+	LinuxCrossTimestampEstimator *crossts;
+
 #ifdef WITH_IGBLIB
 	LinuxTimestamperIGBPrivate_t igb_private;
 #endif
 
+	int readTXTimestamp
+	( PTPMessageId &messageId, Timestamp &timestamp, bool &valid );
+	bool readCrossTimestamp
+	( Timestamp *system_time, Timestamp *device_time, int64_t *width_ns,
+	  unsigned n_samples ) const;
+	static bool sampleCrossTimestamp
+	( void *arg, int64_t *system_ns, int64_t *device_ns, int64_t *width_ns );
+	bool takeTXTimestamp( PTPMessageId messageId, Timestamp &timestamp );
+
 public:
 	/**
 	 * @brief Default constructor. Initializes internal variables
@@ -119,6 +131,14 @@ public:
 		rxTimestampList.push_front(*tstamp);
 	}
 
+	/**
+	 * @brief  Reads every TX timestamp queued on the socket error queue
+	 * and keeps it until HWTimestamper_txtimestamp() asks for it. Called
+	 * by the receive loop when the event socket reports EPOLLERR.
+	 * @return void
+	 */
+	void drainTXTimestamps();
+
 	/**
 	 * @brief  Post initialization procedure.
 	 * @param  ifindex struct ifreq.ifr_ifindex value
@@ -129,7 +149,27 @@ public:
 	bool post_init( int ifindex, int sd, TicketingLock *lock );
 
 	/**
-	 * @brief  Gets the ptp clock time information
+	 * @brief  Starts estimating the PHC against the system clock in the
+	 * background, so that HWTimestamper_gettime() does not need an ioctl.
+	 * Must be called after HWTimestamper_init().
+	 * @param  rate_hz Cross timestamps taken per second
+	 * @param  window Cross timestamps the estimate is fitted over
+	 * @return TRUE if the estimator is running, FALSE otherwise
+	 */
+	bool startCrossTimestamping( unsigned rate_hz, unsigned window );
+
+	/**
+	 * @brief  Gets the diagnostics of the background cross timestamp
+	 * estimate
+	 * @param  stats [out] Diagnostics
+	 * @return FALSE if the estimator is not running or has no estimate yet
+	 */
+	bool getCrossTimestampStats( LinuxCrossTimestampStats *stats ) const;
+
+	/**
+	 * @brief  Gets the ptp clock time information. When background cross
+	 * timestamping runs and has a current estimate, the device time is
+	 * computed from it at the current system time.
 	 * @param  system_time [out] System time
 	 * @param  device_time [out] Device time
 	 * @param  local_clock Not Used
@@ -153,6 +193,31 @@ public:
 	( PortIdentity *identity, PTPMessageId messageId, Timestamp &timestamp,
 	  unsigned &clock_value, bool last );
 
+	/**
+	 * @brief  Reports that TX timestamps can be waited for
+	 * @return TRUE
+	 */
+	virtual bool HWTimestamper_txtimestamp_waitable() const {
+		return true;
+	}
+
+	/**
+	 * @brief  Waits for a TX timestamp on POLLERR of the event socket and
+	 * on the eventfd signalled by drainTXTimestamps(), so it completes
+	 * whether the receive loop or the caller reads the error queue.
+	 * Worst case, a timestamp lost by the driver, the caller returns
+	 * GPTP_EC_EAGAIN after timeout_us plus one wakeup.
+	 * @param  identity PTP port identity
+	 * @param  messageId Message ID
+	 * @param  timestamp [out] Timestamp value
+	 * @param  clock_value [out] Clock value
+	 * @param  timeout_us Maximum time to wait in microseconds
+	 * @return GPTP_EC_SUCCESS if no error, GPTP_EC_FAILURE if error and GPTP_EC_EAGAIN on timeout.
+	 */
+	virtual int HWTimestamper_txtimestamp_wait
+	( PortIdentity *identity, PTPMessageId messageId, Timestamp &timestamp,
+	  unsigned &clock_value, unsigned timeout_us );
+
 	/**
 	 * @brief  Gets the RX timestamp from the hardware interface. This
 	 * Currently the RX timestamp is retrieved at LinuxNetworkInterface::nrecv method.
@@ -36,13 +36,24 @@
 #include <linux_hal_generic.hpp>
 #include <syscall.h>
 #include <math.h>
+#include <time.h>
 
 bool LinuxTimestamperGeneric::resetFrequencyAdjustment() {
 	struct timex tx;
 	tx.modes = ADJ_FREQUENCY;
 	tx.freq = 0;
 
-	return Adjust(&tx);
+	if( !Adjust(&tx) )
+		return false;
+	if( crossts != NULL ) {
+		struct timespec now;
+
+		clock_gettime( CLOCK_REALTIME, &now );
+		crossts->frequencyAdjusted
+			( now.tv_sec * 1000000000LL + now.tv_nsec, 0.0 );
+	}
+
+	return true;
 }
 
 bool LinuxTimestamperGeneric::HWTimestamper_adjclockphase( int64_t phase_adjust ) {
@@ -79,6 +90,8 @@ bool LinuxTimestamperGeneric::HWTimestamper_adjclockphase( int64_t phase_adjust
 
 	if( !Adjust( &tx )) {
 		ret = false;
+	} else if( crossts != NULL ) {
+		crossts->phaseAdjusted( phase_adjust );
 	}
 		
 	// Walk list of interfaces re-enabling them
@@ -98,5 +111,15 @@ bool LinuxTimestamperGeneric::HWTimestamper_adjclockrate( float freq_offset ) co
 	tx.freq  = long(freq_offset) << 16;
 	tx.freq += long(fmodf( freq_offset, 1.0 )*65536.0);
 
-	return Adjust(&tx);
+	if( !Adjust(&tx) )
+		return false;
+	if( crossts != NULL ) {
+		struct timespec now;
+
+		clock_gettime( CLOCK_REALTIME, &now );
+		crossts->frequencyAdjusted
+			( now.tv_sec * 1000000000LL + now.tv_nsec, freq_offset );
+	}
+
+	return true;
 }
@@ -37,6 +37,8 @@
 /**@file*/
 
 #include <pthread.h>
+#include <list>
+#include <avbts_message.hpp>
 #ifdef WITH_IGBLIB
 extern "C" {
 #include <igb.h>
@@ -50,12 +52,24 @@ struct LinuxTimestamperIGBPrivate {
 };
 #endif
 
+/**
+ * @brief TX timestamp read from the error queue before its sender asked
+ * for it
+ */
+struct LinuxTxTimestamp {
+	PTPMessageId messageId;					/*!< Reflected message ID */
+	Timestamp timestamp;					/*!< Device TX timestamp */
+};
+
 /**
  * @brief Provides private members for the LinuxTimestamperGeneric class
  */
 struct LinuxTimestamperGenericPrivate {
 	pthread_mutex_t cross_stamp_lock;		/*!< Cross timestamp lock*/
 	clockid_t clockid;						/*!< Clock ID */
+	pthread_mutex_t tx_stamp_lock;			/*!< TX timestamp list lock*/
+	std::list<LinuxTxTimestamp> tx_stamp_list;	/*!< Drained TX timestamps */
+	int tx_stamp_event_fd;					/*!< Signalled when the list grows */
 };
 
 #endif/*LINUX_HAL_TSPRIVATE*/
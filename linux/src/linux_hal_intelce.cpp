@@ -241,3 +241,13 @@ net_result LinuxNetworkInterface::nrecv
 
 	return ret;
 }
+
+bool LinuxNetworkInterface::supportsReceiveLoop() {
+	// CE timestamps are read through the SMD driver, keep polling nrecv()
+	return false;
+}
+
+net_result LinuxNetworkInterface::receiveLoop
+( CommonPort *pPort, net_frame_handler handler, void *arg ) {
+	return net_fatal;
+}
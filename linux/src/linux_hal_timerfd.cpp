@@ -0,0 +1,586 @@
+/******************************************************************************
+
+  Copyright (c) 2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#include <linux_hal_timerfd.hpp>
+#include <avbts_clock.hpp>
+
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+
+#include <vector>
+
+#undef GPTP_LOG_SUBSYSTEM
+#define GPTP_LOG_SUBSYSTEM GPTP_LOG_SUBSYS_TIMER
+
+/*
+ * Event handles carry the slot index in the low bits and a sequence number
+ * in the high bits, so a stale handle never cancels a recycled slot.
+ */
+#define TIMERFD_HANDLE_SLOT_BITS 16
+#define TIMERFD_HANDLE_SLOT_MASK ((1U << TIMERFD_HANDLE_SLOT_BITS) - 1)
+
+struct LinuxTimerFdEvent {
+	uint64_t expiry;		/* CLOCK_MONOTONIC, nanoseconds */
+	size_t heap_index;
+	unsigned slot;
+	unsigned handle;		/* 0 while free or running */
+	CommonPort *port;
+	LinuxTimerFdEvent *key_prev;	/* events sharing (port, type) */
+	LinuxTimerFdEvent *key_next;
+	event_descriptor_t *inner_arg;
+	event_descriptor_t descriptor;	/* inner_arg storage for addPortEvent() */
+	ostimerq_handler func;
+	int type;
+	bool rm;
+};
+
+typedef std::vector<LinuxTimerFdEvent *> LinuxTimerFdHeap_t;
+
+/*
+ * Head of the event list of each (port, type) pair. Entries are never
+ * erased, the number of keys is bounded by ports times event types.
+ */
+typedef std::unordered_map
+< LinuxTimerQueueKey, LinuxTimerFdEvent *, LinuxTimerQueueKeyHash >
+LinuxTimerFdKeyMap_t;
+
+struct LinuxTimerFdQueuePrivate {
+	pthread_t dispatch_thread;
+	bool thread_id_valid;
+	int timer_fd;
+	int stop_fd;
+	int epoll_fd;
+	uint64_t armed;		/* expiry programmed into timer_fd, 0 = none */
+	LinuxTimerFdHeap_t heap;
+	LinuxTimerFdKeyMap_t by_key;
+	/*
+	 * The first TIMERFD_QUEUE_POOL_SIZE slots are backed by the pool and
+	 * never freed. Slots past the pool hold heap allocated events and
+	 * exist only once the pool has been exhausted.
+	 */
+	std::vector<LinuxTimerFdEvent> pool;
+	std::vector<LinuxTimerFdEvent *> slots;
+	std::vector<unsigned> free_slots;
+	std::vector<unsigned> free_overflow_slots;
+	unsigned sequence;
+	unsigned in_use;
+	unsigned high_water;
+	unsigned exhausted;
+};
+
+static uint64_t monotonicNow()
+{
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void heapSwap( LinuxTimerFdHeap_t &heap, size_t a, size_t b )
+{
+	LinuxTimerFdEvent *tmp = heap[a];
+	heap[a] = heap[b];
+	heap[b] = tmp;
+	heap[a]->heap_index = a;
+	heap[b]->heap_index = b;
+}
+
+static void heapSiftUp( LinuxTimerFdHeap_t &heap, size_t i )
+{
+	while( i > 0 ) {
+		size_t parent = (i - 1) / 2;
+		if( heap[parent]->expiry <= heap[i]->expiry )
+			break;
+		heapSwap( heap, parent, i );
+		i = parent;
+	}
+}
+
+static void heapSiftDown( LinuxTimerFdHeap_t &heap, size_t i )
+{
+	size_t size = heap.size();
+	for( ;; ) {
+		size_t left = 2 * i + 1;
+		size_t right = left + 1;
+		size_t smallest = i;
+		if( left < size && heap[left]->expiry < heap[smallest]->expiry )
+			smallest = left;
+		if( right < size && heap[right]->expiry < heap[smallest]->expiry )
+			smallest = right;
+		if( smallest == i )
+			break;
+		heapSwap( heap, smallest, i );
+		i = smallest;
+	}
+}
+
+static void heapPush( LinuxTimerFdHeap_t &heap, LinuxTimerFdEvent *ev )
+{
+	ev->heap_index = heap.size();
+	heap.push_back( ev );
+	heapSiftUp( heap, ev->heap_index );
+}
+
+static void heapRemove( LinuxTimerFdHeap_t &heap, LinuxTimerFdEvent *ev )
+{
+	size_t i = ev->heap_index;
+	size_t last = heap.size() - 1;
+
+	if( i != last ) {
+		heapSwap( heap, i, last );
+	}
+	heap.pop_back();
+	if( i < heap.size() ) {
+		heapSiftDown( heap, i );
+		heapSiftUp( heap, i );
+	}
+}
+
+static LinuxTimerFdEvent *allocEvent( LinuxTimerFdQueuePrivate_t priv )
+{
+	LinuxTimerFdEvent *ev;
+	unsigned slot;
+
+	if( !priv->free_slots.empty() ) {
+		slot = priv->free_slots.back();
+		priv->free_slots.pop_back();
+		ev = &priv->pool[slot];
+	} else {
+		if( priv->exhausted == 0 ) {
+			GPTP_LOG_ERROR
+				( "Timer event pool exhausted (%u events), "
+				  "falling back to heap allocation",
+				  (unsigned) priv->pool.size() );
+		}
+		++priv->exhausted;
+		ev = new LinuxTimerFdEvent;
+		if( !priv->free_overflow_slots.empty() ) {
+			slot = priv->free_overflow_slots.back();
+			priv->free_overflow_slots.pop_back();
+			priv->slots[slot] = ev;
+		} else {
+			slot = priv->slots.size();
+			priv->slots.push_back( ev );
+		}
+	}
+	ev->slot = slot;
+
+	if( ++priv->in_use > priv->high_water )
+		priv->high_water = priv->in_use;
+
+	return ev;
+}
+
+static void releaseEvent( LinuxTimerFdQueuePrivate_t priv, LinuxTimerFdEvent *ev )
+{
+	unsigned slot = ev->slot;
+
+	if( ev->rm ) {
+		delete ev->inner_arg;
+	}
+	ev->handle = 0;
+	--priv->in_use;
+	if( slot >= priv->pool.size() ) {
+		priv->slots[slot] = NULL;
+		priv->free_overflow_slots.push_back( slot );
+		delete ev;
+	} else {
+		priv->free_slots.push_back( slot );
+	}
+}
+
+static void linkEvent( LinuxTimerFdQueuePrivate_t priv, LinuxTimerFdEvent *ev )
+{
+	if( ++priv->sequence == 0 )
+		++priv->sequence;
+	ev->handle = ( priv->sequence << TIMERFD_HANDLE_SLOT_BITS ) |
+		(( ev->slot + 1 ) & TIMERFD_HANDLE_SLOT_MASK );
+
+	LinuxTimerFdEvent *&head =
+		priv->by_key[LinuxTimerQueueKey( ev->port, ev->type )];
+	ev->key_prev = NULL;
+	ev->key_next = head;
+	if( head != NULL )
+		head->key_prev = ev;
+	head = ev;
+
+	heapPush( priv->heap, ev );
+}
+
+static void unlinkEvent( LinuxTimerFdQueuePrivate_t priv, LinuxTimerFdEvent *ev )
+{
+	heapRemove( priv->heap, ev );
+
+	if( ev->key_prev != NULL ) {
+		ev->key_prev->key_next = ev->key_next;
+	} else {
+		priv->by_key[LinuxTimerQueueKey( ev->port, ev->type )] =
+			ev->key_next;
+	}
+	if( ev->key_next != NULL )
+		ev->key_next->key_prev = ev->key_prev;
+}
+
+static LinuxTimerFdEvent *findEvent
+( LinuxTimerFdQueuePrivate_t priv, unsigned handle )
+{
+	unsigned slot = handle & TIMERFD_HANDLE_SLOT_MASK;
+
+	if( slot == 0 || slot > priv->slots.size() )
+		return NULL;
+	LinuxTimerFdEvent *ev = priv->slots[slot - 1];
+	if( ev == NULL || ev->handle != handle )
+		return NULL;
+	return ev;
+}
+
+LinuxTimerFdQueue::~LinuxTimerFdQueue()
+{
+	if( _private == NULL )
+		return;
+
+	if( _private->thread_id_valid ) {
+		uint64_t one = 1;
+		if( write( _private->stop_fd, &one, sizeof( one )) < 0 ) {
+			GPTP_LOG_ERROR
+				( "Failed to stop timer dispatch thread: %s",
+				  strerror( errno ));
+		}
+		pthread_join( _private->dispatch_thread, NULL );
+	}
+
+	GPTP_LOG_INFO
+		( "Timer event pool: %u of %u used at peak, %u heap fallbacks",
+		  _private->high_water, (unsigned) _private->pool.size(),
+		  _private->exhausted );
+
+	for( LinuxTimerFdHeap_t::iterator iter = _private->heap.begin();
+	     iter != _private->heap.end(); ++iter ) {
+		releaseEvent( _private, *iter );
+	}
+
+	if( _private->epoll_fd != -1 ) close( _private->epoll_fd );
+	if( _private->stop_fd != -1 ) close( _private->stop_fd );
+	if( _private->timer_fd != -1 ) close( _private->timer_fd );
+	delete _private;
+}
+
+bool LinuxTimerFdQueue::init()
+{
+	struct epoll_event ev;
+
+	_private = new LinuxTimerFdQueuePrivate;
+	_private->thread_id_valid = false;
+	_private->armed = 0;
+	_private->sequence = 0;
+	_private->in_use = 0;
+	_private->high_water = 0;
+	_private->exhausted = 0;
+	_private->stop_fd = -1;
+	_private->epoll_fd = -1;
+
+	/* Preallocate everything the steady state needs */
+	_private->pool.resize( TIMERFD_QUEUE_POOL_SIZE );
+	_private->heap.reserve( TIMERFD_QUEUE_POOL_SIZE );
+	_private->slots.reserve( TIMERFD_QUEUE_POOL_SIZE );
+	_private->free_slots.reserve( TIMERFD_QUEUE_POOL_SIZE );
+	for( unsigned i = 0; i < TIMERFD_QUEUE_POOL_SIZE; ++i ) {
+		_private->pool[i].handle = 0;
+		_private->slots.push_back( &_private->pool[i] );
+		_private->free_slots.push_back( TIMERFD_QUEUE_POOL_SIZE - 1 - i );
+	}
+
+	_private->timer_fd = timerfd_create
+		( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+	if( _private->timer_fd == -1 ) {
+		GPTP_LOG_ERROR( "timerfd_create failed - %s", strerror( errno ));
+		return false;
+	}
+
+	_private->stop_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+	if( _private->stop_fd == -1 ) {
+		GPTP_LOG_ERROR( "eventfd failed - %s", strerror( errno ));
+		return false;
+	}
+
+	_private->epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+	if( _private->epoll_fd == -1 ) {
+		GPTP_LOG_ERROR( "epoll_create1 failed - %s", strerror( errno ));
+		return false;
+	}
+
+	memset( &ev, 0, sizeof( ev ));
+	ev.events = EPOLLIN;
+	ev.data.fd = _private->timer_fd;
+	if( epoll_ctl
+	    ( _private->epoll_fd, EPOLL_CTL_ADD, _private->timer_fd, &ev ) == -1 ) {
+		GPTP_LOG_ERROR( "epoll_ctl(timerfd) failed - %s", strerror( errno ));
+		return false;
+	}
+	ev.data.fd = _private->stop_fd;
+	if( epoll_ctl
+	    ( _private->epoll_fd, EPOLL_CTL_ADD, _private->stop_fd, &ev ) == -1 ) {
+		GPTP_LOG_ERROR( "epoll_ctl(eventfd) failed - %s", strerror( errno ));
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Program the timerfd with the earliest pending expiry. Must be called with
+ * the timer queue lock held.
+ */
+void LinuxTimerFdQueue::rearm()
+{
+	struct itimerspec its;
+	uint64_t next = 0;
+
+	if( !_private->heap.empty() )
+		next = _private->heap.front()->expiry;
+
+	if( next == _private->armed )
+		return;
+
+	memset( &its, 0, sizeof( its ));
+	its.it_value.tv_sec = next / 1000000000ULL;
+	its.it_value.tv_nsec = next % 1000000000ULL;
+	if( timerfd_settime
+	    ( _private->timer_fd, TFD_TIMER_ABSTIME, &its, NULL ) == -1 ) {
+		GPTP_LOG_ERROR( "Failed to arm timerfd: %s", strerror( errno ));
+		return;
+	}
+	_private->armed = next;
+}
+
+/*
+ * Run every event whose expiry has passed. Callbacks run with the timer
+ * queue lock held, the same as LinuxTimerQueueHandler, so they may add or
+ * cancel events re-entrantly.
+ */
+void LinuxTimerFdQueue::dispatch()
+{
+	LinuxTimerFdHeap_t &heap = _private->heap;
+	uint64_t now = monotonicNow();
+
+	while( !heap.empty() && heap.front()->expiry <= now ) {
+		LinuxTimerFdEvent *ev = heap.front();
+		unlinkEvent( _private, ev );
+		/* A callback cancelling its own handle must not find it */
+		ev->handle = 0;
+		ev->func( ev->inner_arg );
+		releaseEvent( _private, ev );
+	}
+
+	/* Force reprogramming, the timerfd has been consumed */
+	_private->armed = 0;
+	rearm();
+}
+
+void *LinuxTimerFdQueueHandler( void *arg )
+{
+	LinuxTimerFdQueue *timerq = (LinuxTimerFdQueue *) arg;
+	LinuxTimerFdQueuePrivate_t priv = timerq->_private;
+	struct epoll_event events[2];
+	bool stop = false;
+
+	GPTP_LOG_DEBUG( "Timer dispatch thread started" );
+	while( !stop ) {
+		bool expired = false;
+		int count = epoll_wait( priv->epoll_fd, events, 2, -1 );
+
+		if( count == -1 ) {
+			if( errno == EINTR )
+				continue;
+			GPTP_LOG_ERROR( "Timer dispatch epoll_wait error: %s",
+					strerror( errno ));
+			break;
+		}
+
+		for( int i = 0; i < count; ++i ) {
+			uint64_t value;
+			if( events[i].data.fd == priv->stop_fd ) {
+				stop = true;
+			} else if( events[i].data.fd == priv->timer_fd ) {
+				/* Drain expiration count, EAGAIN on a stale wakeup */
+				if( read( priv->timer_fd, &value, sizeof( value )) ==
+				    sizeof( value )) {
+					expired = true;
+				}
+			}
+		}
+		if( stop || !expired )
+			continue;
+
+		if( timerq->lock->lock() != oslock_ok ) {
+			break;
+		}
+		timerq->dispatch();
+		if( timerq->lock->unlock() != oslock_ok ) {
+			break;
+		}
+	}
+	GPTP_LOG_DEBUG( "Timer dispatch thread exit" );
+	return NULL;
+}
+
+OSTimerQueue *LinuxTimerFdQueueFactory::createOSTimerQueue
+	( IEEE1588Clock *clock )
+{
+	LinuxTimerFdQueue *ret = new LinuxTimerFdQueue();
+
+	if( !ret->init() ) {
+		delete ret;
+		return NULL;
+	}
+
+	ret->lock = clock->timerQLock();
+	if( pthread_create
+		( &(ret->_private->dispatch_thread),
+		  NULL, LinuxTimerFdQueueHandler, ret ) != 0 ) {
+		delete ret;
+		return NULL;
+	}
+	ret->_private->thread_id_valid = true;
+	return ret;
+}
+
+void LinuxTimerFdQueue::armEvent
+( LinuxTimerFdEvent *ev, unsigned long micros, int type,
+  ostimerq_handler func, unsigned *event )
+{
+	ev->expiry = monotonicNow() + (uint64_t) micros * 1000;
+	ev->func = func;
+	ev->type = type;
+
+	linkEvent( _private, ev );
+	if( ev->heap_index == 0 )
+		rearm();
+
+	if( event != NULL )
+		*event = ev->handle;
+}
+
+bool LinuxTimerFdQueue::addEvent
+( unsigned long micros, int type, ostimerq_handler func,
+  event_descriptor_t * arg, bool rm, unsigned *event )
+{
+	LinuxTimerFdEvent *ev = allocEvent( _private );
+
+	ev->port = arg != NULL ? arg->port : NULL;
+	ev->inner_arg = arg;
+	ev->rm = rm;
+	armEvent( ev, micros, type, func, event );
+
+	return true;
+}
+
+bool LinuxTimerFdQueue::addPortEvent
+( unsigned long micros, CommonPort *target, int type,
+  ostimerq_handler func, unsigned *event )
+{
+	LinuxTimerFdEvent *ev = allocEvent( _private );
+
+	ev->descriptor.port = target;
+	ev->descriptor.event = (Event) type;
+	ev->port = target;
+	ev->inner_arg = &ev->descriptor;
+	ev->rm = false;
+	armEvent( ev, micros, type, func, event );
+
+	return true;
+}
+
+void LinuxTimerFdQueue::getPoolStats
+( unsigned *capacity, unsigned *high_water, unsigned *exhausted )
+{
+	*capacity = _private->pool.size();
+	*high_water = _private->high_water;
+	*exhausted = _private->exhausted;
+}
+
+bool LinuxTimerFdQueue::cancelEvent( int type, unsigned *event )
+{
+	LinuxTimerFdHeap_t &heap = _private->heap;
+	std::vector<LinuxTimerFdEvent *> matched;
+
+	if( event != NULL ) {
+		LinuxTimerFdEvent *ev = findEvent( _private, *event );
+		if( ev == NULL || ev->type != type )
+			return false;
+		unlinkEvent( _private, ev );
+		releaseEvent( _private, ev );
+		rearm();
+		return true;
+	}
+
+	for( LinuxTimerFdHeap_t::iterator iter = heap.begin();
+	     iter != heap.end(); ++iter ) {
+		if( (*iter)->type == type )
+			matched.push_back( *iter );
+	}
+
+	for( std::vector<LinuxTimerFdEvent *>::iterator iter = matched.begin();
+	     iter != matched.end(); ++iter ) {
+		unlinkEvent( _private, *iter );
+		releaseEvent( _private, *iter );
+	}
+
+	if( !matched.empty() )
+		rearm();
+
+	return true;
+}
+
+bool LinuxTimerFdQueue::cancelPortEvent( CommonPort *target, int type )
+{
+	LinuxTimerFdKeyMap_t::iterator iter =
+		_private->by_key.find( LinuxTimerQueueKey( target, type ));
+
+	if( iter == _private->by_key.end() || iter->second == NULL )
+		return true;
+
+	while( iter->second != NULL ) {
+		LinuxTimerFdEvent *ev = iter->second;
+		unlinkEvent( _private, ev );
+		releaseEvent( _private, ev );
+	}
+	rearm();
+
+	return true;
+}
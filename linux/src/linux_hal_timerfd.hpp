@@ -0,0 +1,180 @@
+/******************************************************************************
+
+  Copyright (c) 2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#ifndef LINUX_HAL_TIMERFD_HPP
+#define LINUX_HAL_TIMERFD_HPP
+
+#include <linux_hal_common.hpp>
+
+/**@file*/
+
+/**
+ * @brief Number of preallocated events per timer queue. Each port keeps
+ * fewer than ten timers armed, so this covers several ports per clock
+ * without touching the heap.
+ */
+#define TIMERFD_QUEUE_POOL_SIZE 64
+
+struct LinuxTimerFdEvent;
+struct LinuxTimerFdQueuePrivate;
+/**
+ * @brief Provides a private type for the LinuxTimerFdQueue class
+ */
+typedef struct LinuxTimerFdQueuePrivate * LinuxTimerFdQueuePrivate_t;
+
+/**
+ * @brief  LinuxTimerFdQueue dispatch thread. Waits on the timerfd and
+ * the stop eventfd and runs every expired event.
+ * @param  arg [in] LinuxTimerFdQueue object
+ * @return NULL
+ */
+void *LinuxTimerFdQueueHandler( void *arg );
+
+/**
+ * @brief Extends OSTimerQueue to Linux using a single timerfd.
+ *
+ * Pending events are kept in a binary min-heap ordered by their
+ * CLOCK_MONOTONIC expiry. Only the earliest expiry is programmed into the
+ * timerfd, so adding or cancelling an event costs O(log n) and at most one
+ * timerfd_settime() call. Expired events are dispatched from an epoll loop
+ * instead of SIGUSR1. Events are also indexed by handle and by
+ * (port, type) so they can be found without scanning the heap.
+ *
+ * Events come from a fixed-size per-queue pool. Events added with
+ * addPortEvent() carry their event_descriptor_t inside the pool entry, so
+ * steady-state operation does not allocate. Once the pool is exhausted,
+ * events are allocated from the heap and counted.
+ */
+class LinuxTimerFdQueue : public OSTimerQueue {
+	friend class LinuxTimerFdQueueFactory;
+	friend void *LinuxTimerFdQueueHandler( void *arg );
+private:
+	LinuxTimerFdQueuePrivate_t _private;
+	OSLock *lock;
+
+	void rearm();
+	void dispatch();
+	void armEvent
+	( LinuxTimerFdEvent *ev, unsigned long micros, int type,
+	  ostimerq_handler func, unsigned *event );
+protected:
+	/**
+	 * @brief Default constructor
+	 */
+	LinuxTimerFdQueue() {
+		_private = NULL;
+		lock = NULL;
+	}
+
+	/**
+	 * @brief Creates the timerfd, the stop eventfd and the epoll set
+	 * @return TRUE if success, FALSE otherwise.
+	 */
+	virtual bool init();
+public:
+	/**
+	 * @brief Stops the dispatch thread and releases pending events
+	 */
+	~LinuxTimerFdQueue();
+
+	/**
+	 * @brief Add an event to the timer queue
+	 * @param micros Time in microsseconds
+	 * @param type  Event type
+	 * @param func Callback
+	 * @param arg inner argument of type event_descriptor_t
+	 * @param rm when true, allows elements to be deleted from the queue
+	 * @param event [out] If non-null, receives the event handle
+	 * @return TRUE success, FALSE fail
+	 */
+	bool addEvent
+	( unsigned long micros, int type, ostimerq_handler func,
+	  event_descriptor_t * arg, bool rm, unsigned *event );
+
+	/**
+	 * @brief Removes an event from the timer queue
+	 * @param type Event type
+	 * @param event [in] If non-null, handle of the single event to remove
+	 * @return TRUE success, FALSE fail
+	 */
+	bool cancelEvent( int type, unsigned *event );
+
+	/**
+	 * @brief Removes the events of one type armed for one port in
+	 * constant time, using the (port, type) index
+	 * @param target [in] Port the events were armed for
+	 * @param type Event type
+	 * @return TRUE success, FALSE fail
+	 */
+	bool cancelPortEvent( CommonPort *target, int type );
+
+	/**
+	 * @brief Add an event for a port using a pooled event descriptor
+	 * @param micros Time in microsseconds
+	 * @param target [in] Port passed to the callback in the descriptor
+	 * @param type  Event type
+	 * @param func Callback
+	 * @param event [out] If non-null, receives the event handle
+	 * @return TRUE success, FALSE fail
+	 */
+	bool addPortEvent
+	( unsigned long micros, CommonPort *target, int type,
+	  ostimerq_handler func, unsigned *event );
+
+	/**
+	 * @brief Reports usage of the preallocated event pool. Must be called
+	 * with the timer queue lock held.
+	 * @param capacity [out] Number of pooled events
+	 * @param high_water [out] Most events pending at once
+	 * @param exhausted [out] Number of events allocated from the heap
+	 * because the pool was empty
+	 * @return void
+	 */
+	void getPoolStats
+	( unsigned *capacity, unsigned *high_water, unsigned *exhausted );
+};
+
+/**
+ * @brief Implements factory design pattern for LinuxTimerFdQueue
+ */
+class LinuxTimerFdQueueFactory : public OSTimerQueueFactory {
+public:
+	/**
+	 * @brief Creates timerfd based timer queue
+	 * @param clock [in] Pointer to IEEE15588Clock type
+	 * @return Pointer to OSTimerQueue
+	 */
+	virtual OSTimerQueue *createOSTimerQueue( IEEE1588Clock *clock );
+};
+
+#endif/*LINUX_HAL_TIMERFD_HPP*/
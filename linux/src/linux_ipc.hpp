@@ -34,10 +34,237 @@
 #ifndef LINUXIPC_HPP
 #define LINUXIPC_HPP
 
+#include <stdint.h>
+#include <string.h>
 #include "ipcdef.hpp"
 
-#define SHM_SIZE (sizeof(gPtpTimeData) + sizeof(pthread_mutex_t))   /*!< Shared memory size*/
-#define SHM_NAME  "/ptp"                                            /*!< Shared memory name*/
+/**@file*/
 
+#define SHM_SIZE (sizeof(gPtpShmSegment))	/*!< Shared memory size*/
+#define SHM_NAME  "/ptp"			/*!< Default shared memory name*/
+
+#define GPTP_SHM_MAGIC		0x67505450	/*!< "gPTP", first word of the segment */
+/**
+ * @brief Layout version. Version 1 was a pthread_mutex_t followed by
+ * gPtpTimeData, version 2 a single gPtpTimeData under a sequence lock,
+ * version 3 per-port slots without the change log.
+ */
+#define GPTP_SHM_VERSION	4
+#define GPTP_SHM_PORT_SLOTS	16	/*!< Port slots per segment */
+#define GPTP_SHM_CACHE_LINE	64	/*!< Slots start on their own cache line */
+#define GPTP_SHM_EVENT_LOG	64	/*!< Change log entries, a power of two */
+
+/**
+ * @brief Kinds of change recorded in the change log. Each is a single
+ * bit so consumers can filter with a mask.
+ */
+typedef enum {
+	GPTP_EVENT_GRANDMASTER = 0x01,	//!< Grandmaster identity or domain changed
+	GPTP_EVENT_PORT_STATE = 0x02,	//!< Port state changed, value is the new PortState
+	GPTP_EVENT_AS_CAPABLE = 0x04,	//!< asCapable changed, value is 0 or 1
+	GPTP_EVENT_PHASE_STEP = 0x08,	//!< Clock phase was stepped, value is the step in ns
+} gPtpEventType;
+
+#define GPTP_EVENT_ALL		0x0F	/*!< Mask matching every gPtpEventType */
+
+/**
+ * @brief Segment header, written once when the daemon creates the
+ * segment. Readers check it before using any slot.
+ */
+typedef struct {
+	uint32_t magic;			//!< GPTP_SHM_MAGIC once the segment is initialized
+	uint32_t version;		//!< GPTP_SHM_VERSION
+	uint32_t data_size;		//!< sizeof(gPtpTimeData) as built into the daemon
+	uint32_t slot_size;		//!< sizeof(gPtpShmPortSlot)
+	uint32_t port_slots;		//!< Number of port slots, GPTP_SHM_PORT_SLOTS
+	uint32_t event_size;		//!< sizeof(gPtpChangeEvent)
+	uint32_t event_log;		//!< Change log entries, GPTP_SHM_EVENT_LOG
+	PID_TYPE process_id;		//!< Daemon that owns the segment
+} __attribute__((aligned(GPTP_SHM_CACHE_LINE))) gPtpShmHeader;
+
+/**
+ * @brief Time data of one port. Slot n carries port number n + 1.
+ */
+typedef struct {
+	uint32_t sequence;		//!< Sequence lock, odd while an update is in progress
+	uint16_t port_number;		//!< Port publishing here, 0 until the first update
+	gPtpTimeData data;		//!< Published time data
+} __attribute__((aligned(GPTP_SHM_CACHE_LINE))) gPtpShmPortSlot;
+
+/**
+ * @brief Grandmaster selected by the daemon, shared by all ports
+ */
+typedef struct {
+	uint32_t sequence;		//!< Sequence lock, odd while an update is in progress
+	uint16_t port_number;		//!< Port that reported the grandmaster last
+	uint8_t gptp_grandmaster_id[PTP_CLOCK_IDENTITY_LENGTH];	//!< Current grandmaster id (all 0's if no grandmaster selected)
+	uint8_t gptp_domain_number;	//!< gPTP domain number
+} __attribute__((aligned(GPTP_SHM_CACHE_LINE))) gPtpShmGrandmasterSlot;
+
+/**
+ * @brief One change, as stored in the change log and as streamed on the
+ * change log socket (host byte order, one record per message)
+ */
+typedef struct {
+	uint32_t sequence;		//!< Event number, starting at 1. In the log, written last.
+	uint16_t port_number;		//!< Port the change was seen on
+	uint8_t type;			//!< One gPtpEventType
+	uint8_t domain_number;		//!< gPTP domain number
+	int64_t value;			//!< Type dependent, see gPtpEventType
+	uint64_t local_time;		//!< Local (PHC) time of the port's last update, in ns
+	uint8_t clock_identity[PTP_CLOCK_IDENTITY_LENGTH];	//!< New grandmaster for GPTP_EVENT_GRANDMASTER, 0's otherwise
+} gPtpChangeEvent;
+
+/**
+ * @brief Number of the last change log entry. Consumers wait on it as a
+ * futex; the daemon wakes them after each batch of changes.
+ */
+typedef struct {
+	uint32_t counter;		//!< Last event number, 0 before the first change
+} __attribute__((aligned(GPTP_SHM_CACHE_LINE))) gPtpShmEventCounter;
+
+/**
+ * @brief Layout of the shared memory segment.
+ *
+ * Each slot is published on its own under a sequence lock: its sequence
+ * is odd while the slot is being written and advances to the next even
+ * value once the write is complete. The writer never waits for readers.
+ * A reader copies a slot between two loads of its sequence and retries
+ * if they differ or are odd (see gptpShmReadBegin() and
+ * gptpShmReadRetry()). A reader that stalls or dies cannot block the
+ * daemon.
+ *
+ * Slots are cache line aligned, so a reader following one port never
+ * touches the lines the daemon writes for the other ports.
+ *
+ * Changes of grandmaster, port state and asCapable, and clock phase
+ * steps, are also appended to a ring of gPtpChangeEvent. Event n is
+ * stored in event_log[n % GPTP_SHM_EVENT_LOG] and events.counter holds
+ * the number of the last one, so a consumer can sleep on the counter
+ * instead of polling the slots (see gptpShmEventRead()).
+ */
+typedef struct {
+	gPtpShmHeader header;
+	gPtpShmGrandmasterSlot grandmaster;
+	gPtpShmPortSlot port[GPTP_SHM_PORT_SLOTS];
+	gPtpShmEventCounter events;
+	gPtpChangeEvent event_log[GPTP_SHM_EVENT_LOG];
+} gPtpShmSegment;
+
+/**
+ * @brief Checks that a mapped segment was written by a compatible daemon
+ * @param segment [in] Mapped segment
+ * @return TRUE if the layout matches this header
+ */
+static inline bool gptpShmCompatible( const gPtpShmSegment *segment )
+{
+	const gPtpShmHeader *header = &segment->header;
+
+	return __atomic_load_n( &header->magic, __ATOMIC_ACQUIRE ) == GPTP_SHM_MAGIC &&
+		header->version == GPTP_SHM_VERSION &&
+		header->data_size == sizeof( gPtpTimeData ) &&
+		header->slot_size == sizeof( gPtpShmPortSlot ) &&
+		header->port_slots == GPTP_SHM_PORT_SLOTS &&
+		header->event_size == sizeof( gPtpChangeEvent ) &&
+		header->event_log == GPTP_SHM_EVENT_LOG;
+}
+
+/**
+ * @brief Starts a write to a slot. Each slot has a single writer.
+ * @param sequence [in] Sequence of the slot
+ */
+static inline void gptpShmWriteBegin( uint32_t *sequence )
+{
+	uint32_t seq = __atomic_load_n( sequence, __ATOMIC_RELAXED );
+	__atomic_store_n( sequence, seq + 1, __ATOMIC_RELAXED );
+	__atomic_thread_fence( __ATOMIC_RELEASE );
+}
+
+/**
+ * @brief Completes a write started with gptpShmWriteBegin()
+ * @param sequence [in] Sequence of the slot
+ */
+static inline void gptpShmWriteEnd( uint32_t *sequence )
+{
+	uint32_t seq = __atomic_load_n( sequence, __ATOMIC_RELAXED );
+	__atomic_store_n( sequence, seq + 1, __ATOMIC_RELEASE );
+}
+
+/**
+ * @brief Starts reading a slot
+ * @param sequence [in] Sequence of the slot
+ * @return Sequence to pass to gptpShmReadRetry(). Odd if a write is in
+ * progress, in which case the read will have to be retried.
+ */
+static inline uint32_t gptpShmReadBegin( const uint32_t *sequence )
+{
+	return __atomic_load_n( sequence, __ATOMIC_ACQUIRE );
+}
+
+/**
+ * @brief Ends reading a slot
+ * @param sequence [in] Sequence of the slot
+ * @param seq Value returned by gptpShmReadBegin()
+ * @return TRUE if the data copied since gptpShmReadBegin() may be torn
+ * and must be read again
+ */
+static inline bool gptpShmReadRetry( const uint32_t *sequence, uint32_t seq )
+{
+	__atomic_thread_fence( __ATOMIC_ACQUIRE );
+	return ( seq & 1 ) != 0 ||
+		__atomic_load_n( sequence, __ATOMIC_RELAXED ) != seq;
+}
+
+/**
+ * @brief Appends an event to the change log. Only the daemon writes the
+ * log, under its update lock. Waking the consumers is left to the caller.
+ * @param segment [in] Mapped segment
+ * @param event [in] Event; its sequence is assigned here
+ * @return Number of the event
+ */
+static inline uint32_t gptpShmEventWrite
+( gPtpShmSegment *segment, const gPtpChangeEvent *event )
+{
+	uint32_t number = __atomic_load_n( &segment->events.counter, __ATOMIC_RELAXED ) + 1;
+	gPtpChangeEvent *entry = &segment->event_log[number % GPTP_SHM_EVENT_LOG];
+
+	// Readers find the entry invalid until it is complete
+	__atomic_store_n( &entry->sequence, 0, __ATOMIC_RELAXED );
+	__atomic_thread_fence( __ATOMIC_RELEASE );
+	entry->port_number = event->port_number;
+	entry->type = event->type;
+	entry->domain_number = event->domain_number;
+	entry->value = event->value;
+	entry->local_time = event->local_time;
+	memcpy( entry->clock_identity, event->clock_identity,
+		sizeof( entry->clock_identity ));
+	__atomic_store_n( &entry->sequence, number, __ATOMIC_RELEASE );
+	__atomic_store_n( &segment->events.counter, number, __ATOMIC_RELEASE );
+
+	return number;
+}
+
+/**
+ * @brief Copies an event out of the change log
+ * @param segment [in] Mapped segment
+ * @param number Event number, at most events.counter
+ * @param event [out] Copy of the event
+ * @return FALSE if the entry was already reused for a later event
+ */
+static inline bool gptpShmEventRead
+( const gPtpShmSegment *segment, uint32_t number, gPtpChangeEvent *event )
+{
+	const gPtpChangeEvent *entry = &segment->event_log[number % GPTP_SHM_EVENT_LOG];
+
+	if( __atomic_load_n( &entry->sequence, __ATOMIC_ACQUIRE ) != number )
+		return false;
+	memcpy( event, (const void *) entry, sizeof( *event ));
+	__atomic_thread_fence( __ATOMIC_ACQUIRE );
+	if( __atomic_load_n( &entry->sequence, __ATOMIC_RELAXED ) != number )
+		return false;
+	event->sequence = number;
+
+	return true;
+}
 
 #endif /*LINUXPIC_HPP*/
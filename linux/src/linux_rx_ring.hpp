@@ -0,0 +1,197 @@
+/******************************************************************************
+
+  Copyright (c) 2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#ifndef LINUX_RX_RING_HPP
+#define LINUX_RX_RING_HPP
+
+/**@file*/
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netpacket/packet.h>
+
+#define RX_RING_CONTROL_SIZE 256	/*!< Control message area per frame*/
+
+/**
+ * @brief Pre-registered frame buffers, addresses and control message areas
+ * for receiving a batch of frames with one recvmmsg() call.
+ *
+ * Every slot is wired to its buffers once at construction. receive() only
+ * resets the lengths the kernel overwrites and walks each frame's control
+ * messages once to locate its SO_TIMESTAMPING data.
+ */
+class LinuxReceiveRing {
+private:
+	unsigned count;
+	size_t frame_size;
+	struct mmsghdr *msgs;
+	struct iovec *iov;
+	struct sockaddr_ll *remote;
+	uint8_t *control;
+	uint8_t *frames;
+	const struct timespec **stamps;
+
+	LinuxReceiveRing( const LinuxReceiveRing & );
+	LinuxReceiveRing &operator=( const LinuxReceiveRing & );
+public:
+	/**
+	 * @brief  Allocates and wires the ring
+	 * @param  count Number of frames read per receive() call
+	 * @param  frame_size Size of each frame buffer
+	 */
+	LinuxReceiveRing( unsigned count, size_t frame_size ) {
+		unsigned i;
+
+		this->count = count;
+		this->frame_size = frame_size;
+		msgs = new struct mmsghdr[count];
+		iov = new struct iovec[count];
+		remote = new struct sockaddr_ll[count];
+		// Keep each control area aligned for struct cmsghdr
+		control = new uint8_t[count * CMSG_SPACE( RX_RING_CONTROL_SIZE )];
+		frames = new uint8_t[count * frame_size];
+		stamps = new const struct timespec *[count];
+
+		memset( msgs, 0, count * sizeof( *msgs ));
+		for( i = 0; i < count; ++i ) {
+			iov[i].iov_base = frames + i * frame_size;
+			iov[i].iov_len = frame_size;
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_name = &remote[i];
+			msgs[i].msg_hdr.msg_control =
+				control + i * CMSG_SPACE( RX_RING_CONTROL_SIZE );
+			stamps[i] = NULL;
+		}
+	}
+
+	/**
+	 * @brief  Releases the ring buffers
+	 */
+	~LinuxReceiveRing() {
+		delete[] stamps;
+		delete[] frames;
+		delete[] control;
+		delete[] remote;
+		delete[] iov;
+		delete[] msgs;
+	}
+
+	/**
+	 * @brief  Reads up to getCount() frames in one system call and decodes
+	 * their timestamps
+	 * @param  sd Socket descriptor
+	 * @param  flags recvmmsg() flags, normally MSG_DONTWAIT
+	 * @return Number of frames received, -1 with errno set on error
+	 */
+	int receive( int sd, int flags ) {
+		struct cmsghdr *cmsg;
+		int received;
+		int i;
+
+		for( i = 0; i < (int) count; ++i ) {
+			msgs[i].msg_hdr.msg_namelen = sizeof( remote[i] );
+			msgs[i].msg_hdr.msg_controllen =
+				CMSG_SPACE( RX_RING_CONTROL_SIZE );
+			msgs[i].msg_hdr.msg_flags = 0;
+		}
+
+		received = recvmmsg( sd, msgs, count, flags, NULL );
+
+		for( i = 0; i < received; ++i ) {
+			stamps[i] = NULL;
+			for( cmsg = CMSG_FIRSTHDR( &msgs[i].msg_hdr );
+			     cmsg != NULL;
+			     cmsg = CMSG_NXTHDR( &msgs[i].msg_hdr, cmsg )) {
+				if( cmsg->cmsg_level == SOL_SOCKET &&
+				    cmsg->cmsg_type == SO_TIMESTAMPING ) {
+					stamps[i] = (const struct timespec *)
+						CMSG_DATA( cmsg );
+					break;
+				}
+			}
+		}
+
+		return received;
+	}
+
+	/**
+	 * @brief  Gets the number of slots in the ring
+	 * @return Frames read per receive() call at most
+	 */
+	unsigned getCount() const {
+		return count;
+	}
+
+	/**
+	 * @brief  Gets a received frame
+	 * @param  i Frame index, lower than the last receive() result
+	 * @return Pointer to the frame payload
+	 */
+	uint8_t *getPayload( unsigned i ) {
+		return frames + i * frame_size;
+	}
+
+	/**
+	 * @brief  Gets the length of a received frame
+	 * @param  i Frame index
+	 * @return Frame length, truncated to the frame buffer size
+	 */
+	size_t getLength( unsigned i ) const {
+		return msgs[i].msg_len < frame_size ?
+			msgs[i].msg_len : frame_size;
+	}
+
+	/**
+	 * @brief  Gets the address a frame was received from
+	 * @param  i Frame index
+	 * @return Source address
+	 */
+	const struct sockaddr_ll *getRemote( unsigned i ) const {
+		return &remote[i];
+	}
+
+	/**
+	 * @brief  Gets the SO_TIMESTAMPING data of a frame: software,
+	 * deprecated and raw hardware timestamps, in that order
+	 * @param  i Frame index
+	 * @return Array of three timespecs or NULL if the frame carried none
+	 */
+	const struct timespec *getTimestamps( unsigned i ) const {
+		return stamps[i];
+	}
+};
+
+#endif/*LINUX_RX_RING_HPP*/
@@ -0,0 +1,294 @@
+/******************************************************************************
+
+  Copyright (c) 2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#ifndef LINUX_SHM_CLOCK_HPP
+#define LINUX_SHM_CLOCK_HPP
+
+#include <time.h>
+
+#include <linux_shm_reader.hpp>
+
+/**@file
+ * Header-only conversion of local clock readings to gPTP time for
+ * clients of the shared memory interface.
+ *
+ * gPtpTimeData describes the clocks relative to the last Sync:
+ *
+ *  master ~= local  - ml_phoffset      Dmaster ~= Dlocal  * ml_freqoffset
+ *  local  ~= system - ls_phoffset      Dlocal  ~= Dsystem * ls_freqoffset
+ *
+ * where local is the PHC, system is CLOCK_REALTIME and both offsets and
+ * local_time are sampled at the same instant. On each update the
+ * long double ratios are turned into fixed-point rate errors once, so a
+ * conversion is two integer multiply-shifts.
+ */
+
+/**
+ * @brief Fractional bits of the fixed-point rate errors, which are
+ * resolved to 2^-40 (about 1e-12). The interval is multiplied in 128
+ * bits, so no interval overflows.
+ */
+#define GPTP_SHM_RATE_SHIFT 40
+
+/**
+ * @brief Fixed-point form of one gPtpTimeData snapshot. All times are
+ * in nanoseconds.
+ */
+typedef struct {
+	int64_t local_ref;		//!< PHC time of the snapshot
+	int64_t master_ref;		//!< gPTP time at local_ref
+	int64_t system_ref;		//!< CLOCK_REALTIME at local_ref
+	int64_t ml_rate;		//!< (ml_freqoffset - 1) << GPTP_SHM_RATE_SHIFT
+	int64_t ls_rate;		//!< (ls_freqoffset - 1) << GPTP_SHM_RATE_SHIFT
+	int64_t monotonic_offset;	//!< CLOCK_REALTIME - CLOCK_MONOTONIC
+} GptpTimeConversion;
+
+/**
+ * @brief Scales an interval by (1 + rate / 2^GPTP_SHM_RATE_SHIFT), rounded
+ * @param delta Interval in ns
+ * @param rate Fixed-point rate error
+ * @return Scaled interval in ns
+ */
+static inline int64_t gptpScaleInterval( int64_t delta, int64_t rate )
+{
+	return delta + (int64_t)(((__int128) delta * rate +
+				 ( 1LL << ( GPTP_SHM_RATE_SHIFT - 1 ))) >> GPTP_SHM_RATE_SHIFT );
+}
+
+/**
+ * @brief Converts a frequency ratio to a fixed-point rate error
+ * @param ratio Frequency ratio, close to 1.0
+ * @return ( ratio - 1 ) << GPTP_SHM_RATE_SHIFT, rounded
+ */
+static inline int64_t gptpRateFromRatio( FrequencyRatio ratio )
+{
+	long double scaled = ( ratio - 1.0L ) * (long double)( 1ULL << GPTP_SHM_RATE_SHIFT );
+	return (int64_t)( scaled < 0 ? scaled - 0.5L : scaled + 0.5L );
+}
+
+/**
+ * @brief Builds the fixed-point conversion for a snapshot
+ * @param conv [out] Conversion
+ * @param data [in] Snapshot read from the shared memory
+ * @param monotonic_offset CLOCK_REALTIME - CLOCK_MONOTONIC in ns
+ * @return void
+ */
+static inline void gptpTimeConversionInit
+( GptpTimeConversion *conv, const gPtpTimeData *data, int64_t monotonic_offset )
+{
+	conv->local_ref = (int64_t) data->local_time;
+	conv->master_ref = conv->local_ref - data->ml_phoffset;
+	conv->system_ref = conv->local_ref + data->ls_phoffset;
+	conv->ml_rate = gptpRateFromRatio( data->ml_freqoffset );
+	conv->ls_rate = gptpRateFromRatio( data->ls_freqoffset );
+	conv->monotonic_offset = monotonic_offset;
+}
+
+/**
+ * @brief PHC time to gPTP time
+ */
+static inline int64_t gptpMasterFromLocal( const GptpTimeConversion *conv, int64_t local )
+{
+	return conv->master_ref + gptpScaleInterval( local - conv->local_ref, conv->ml_rate );
+}
+
+/**
+ * @brief CLOCK_REALTIME to PHC time
+ */
+static inline int64_t gptpLocalFromRealtime( const GptpTimeConversion *conv, int64_t realtime )
+{
+	return conv->local_ref + gptpScaleInterval( realtime - conv->system_ref, conv->ls_rate );
+}
+
+/**
+ * @brief CLOCK_REALTIME to gPTP time
+ */
+static inline int64_t gptpMasterFromRealtime( const GptpTimeConversion *conv, int64_t realtime )
+{
+	return gptpMasterFromLocal( conv, gptpLocalFromRealtime( conv, realtime ));
+}
+
+/**
+ * @brief CLOCK_MONOTONIC to gPTP time
+ */
+static inline int64_t gptpMasterFromMonotonic( const GptpTimeConversion *conv, int64_t monotonic )
+{
+	return gptpMasterFromRealtime( conv, monotonic + conv->monotonic_offset );
+}
+
+/**
+ * @brief Reads a clock in nanoseconds
+ * @param clk Clock id, including dynamic PHC clock ids
+ * @return Time in ns, or -1 on error
+ */
+static inline int64_t gptpClockNs( clockid_t clk )
+{
+	struct timespec ts;
+
+	if( clock_gettime( clk, &ts ) < 0 )
+		return -1;
+	return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief Converts local clock readings to gPTP time using the data the
+ * daemon publishes in shared memory.
+ *
+ * Call refresh() periodically, e.g. once per media clock period; it only
+ * copies the segment when the daemon has published something new. The
+ * conversion functions then use the cached fixed-point snapshot and do
+ * not touch the shared memory.
+ */
+class LinuxSharedMemoryClock {
+private:
+	LinuxSharedMemoryReader reader;
+	GptpTimeConversion conv;
+	uint32_t generation;
+	bool valid;
+
+	static int64_t sampleMonotonicOffset() {
+		int64_t before = gptpClockNs( CLOCK_REALTIME );
+		int64_t mono = gptpClockNs( CLOCK_MONOTONIC );
+		int64_t after = gptpClockNs( CLOCK_REALTIME );
+
+		return before + ( after - before ) / 2 - mono;
+	}
+public:
+	/**
+	 * @brief Creates a clock without data
+	 */
+	LinuxSharedMemoryClock() {
+		memset( &conv, 0, sizeof( conv ));
+		generation = 0;
+		valid = false;
+	}
+
+	/**
+	 * @brief Maps the daemon's segment and takes a first snapshot
+	 * @param name [in] Shared memory name
+	 * @param port_number Port whose clock relations are used
+	 * @return TRUE if mapped, FALSE otherwise. isValid() tells whether
+	 * the daemon has published any data yet.
+	 */
+	bool open( const char *name = SHM_NAME, uint16_t port_number = 1 ) {
+		valid = false;
+		if( !reader.open( name, port_number ))
+			return false;
+		refresh( true );
+		return true;
+	}
+
+	/**
+	 * @brief Takes a new snapshot if the daemon published an update
+	 * @param force Take a snapshot even if nothing changed
+	 * @return TRUE if the conversion is usable
+	 */
+	bool refresh( bool force = false ) {
+		gPtpTimeData data;
+
+		if( !force && valid && !reader.hasChanged( generation ))
+			return true;
+		if( !reader.read( &data, &generation ))
+			return valid;
+		// Nothing measured yet
+		if( data.local_time == 0 || data.ml_freqoffset == 0 ||
+		    data.ls_freqoffset == 0 ) {
+			valid = false;
+			return false;
+		}
+		gptpTimeConversionInit( &conv, &data, sampleMonotonicOffset() );
+		valid = true;
+
+		return true;
+	}
+
+	/**
+	 * @brief TRUE once a usable snapshot was taken
+	 */
+	bool isValid() const {
+		return valid;
+	}
+
+	/**
+	 * @brief Current fixed-point snapshot, for use with the
+	 * gptpMasterFrom*() functions
+	 */
+	const GptpTimeConversion *getConversion() const {
+		return &conv;
+	}
+
+	/**
+	 * @brief PHC reading (ns) to gPTP time (ns)
+	 */
+	int64_t fromPhc( int64_t local ) const {
+		return gptpMasterFromLocal( &conv, local );
+	}
+
+	/**
+	 * @brief CLOCK_REALTIME reading (ns) to gPTP time (ns)
+	 */
+	int64_t fromRealtime( int64_t realtime ) const {
+		return gptpMasterFromRealtime( &conv, realtime );
+	}
+
+	/**
+	 * @brief CLOCK_MONOTONIC reading (ns) to gPTP time (ns)
+	 */
+	int64_t fromMonotonic( int64_t monotonic ) const {
+		return gptpMasterFromMonotonic( &conv, monotonic );
+	}
+
+	/**
+	 * @brief Reads a clock and converts the reading to gPTP time
+	 * @param clk CLOCK_REALTIME, CLOCK_MONOTONIC or the dynamic clock id
+	 * of the PHC the daemon uses
+	 * @param master [out] gPTP time in ns
+	 * @return TRUE on success
+	 */
+	bool now( clockid_t clk, int64_t *master ) const {
+		int64_t t;
+
+		if( !valid || ( t = gptpClockNs( clk )) < 0 )
+			return false;
+		if( clk == CLOCK_REALTIME )
+			*master = fromRealtime( t );
+		else if( clk == CLOCK_MONOTONIC )
+			*master = fromMonotonic( t );
+		else
+			*master = fromPhc( t );
+
+		return true;
+	}
+};
+
+#endif/*LINUX_SHM_CLOCK_HPP*/
@@ -0,0 +1,418 @@
+/******************************************************************************
+
+  Copyright (c) 2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+#ifndef LINUX_SHM_READER_HPP
+#define LINUX_SHM_READER_HPP
+
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <linux/futex.h>
+
+#include <linux_ipc.hpp>
+
+/**@file
+ * Header-only client side of the gPTP shared memory interface. Clients
+ * include this file and link with -lrt; nothing else from the daemon is
+ * needed.
+ */
+
+/**
+ * @brief Attempts gptpShmReadBegin() .. gptpShmReadRetry() makes before
+ * giving up. An update takes well under a microsecond, so running out
+ * means the daemon died in the middle of one.
+ */
+#define GPTP_SHM_READ_RETRIES 10000
+
+/**
+ * @brief Failed attempts between calls to sched_yield() while a read
+ * keeps racing with the writer
+ */
+#define GPTP_SHM_READ_SPINS 64
+
+/**
+ * @brief Copies a slot under its sequence lock
+ * @param sequence [in] Sequence of the slot
+ * @param src [in] Slot data
+ * @param dst [out] Copy
+ * @param size Bytes to copy
+ * @param generation [out] If non-null, updates published before this one
+ * @return TRUE if a consistent copy was taken within GPTP_SHM_READ_RETRIES
+ */
+static inline bool gptpShmReadSlot
+( const uint32_t *sequence, const void *src, void *dst, size_t size,
+  uint32_t *generation )
+{
+	for( unsigned i = 0; i < GPTP_SHM_READ_RETRIES; ++i ) {
+		uint32_t seq = gptpShmReadBegin( sequence );
+
+		if(( seq & 1 ) == 0 ) {
+			memcpy( dst, src, size );
+			if( !gptpShmReadRetry( sequence, seq )) {
+				if( generation != NULL )
+					*generation = seq / 2;
+				return true;
+			}
+		}
+		if( i % GPTP_SHM_READ_SPINS == GPTP_SHM_READ_SPINS - 1 )
+			sched_yield();
+	}
+
+	return false;
+}
+
+/**
+ * @brief Connects to the change log socket a daemon started with
+ * -NOTIFY. Each read() of the returned socket yields one
+ * gPtpChangeEvent, starting with the first change after the connection;
+ * a gap in the sequence numbers means events were dropped. The daemon
+ * disconnects clients that do not keep up.
+ * @param path [in] Socket path given to the daemon
+ * @return Connected socket, or -1 with errno set
+ */
+static inline int gptpChangeLogConnect( const char *path )
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if( strlen( path ) >= sizeof( addr.sun_path )) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	memset( &addr, 0, sizeof( addr ));
+	addr.sun_family = AF_UNIX;
+	strncpy( addr.sun_path, path, sizeof( addr.sun_path ) - 1 );
+
+	fd = socket( AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0 );
+	if( fd < 0 )
+		return -1;
+	if( connect( fd, (struct sockaddr *) &addr, sizeof( addr )) < 0 ) {
+		int saved = errno;
+		::close( fd );
+		errno = saved;
+		return -1;
+	}
+
+	return fd;
+}
+
+/**
+ * @brief Grandmaster as published in the grandmaster slot
+ */
+typedef struct {
+	uint16_t port_number;		//!< Port that reported it last
+	uint8_t gptp_grandmaster_id[PTP_CLOCK_IDENTITY_LENGTH];	//!< All 0's if no grandmaster selected
+	uint8_t gptp_domain_number;	//!< gPTP domain number
+} gPtpShmGrandmaster;
+
+/**
+ * @brief Client side of the gPTP shared memory interface.
+ *
+ * Maps the segment published by LinuxSharedMemoryIPC read-only and
+ * returns consistent snapshots of one port's gPtpTimeData and of the
+ * grandmaster. Reading never blocks the daemon; a snapshot that raced
+ * with an update is simply taken again. Only the cache lines of the
+ * selected port (and of the grandmaster, if read) are touched.
+ *
+ * Instead of polling, a reader can sleep in waitForEvent() until the
+ * daemon records a grandmaster, port state or asCapable change, or a
+ * clock phase step, and then take the events with readEvent().
+ */
+class LinuxSharedMemoryReader {
+private:
+	int shm_fd;
+	const gPtpShmSegment *segment;
+	const gPtpShmPortSlot *port;
+
+	LinuxSharedMemoryReader( const LinuxSharedMemoryReader & );
+	LinuxSharedMemoryReader &operator=( const LinuxSharedMemoryReader & );
+public:
+	/**
+	 * @brief Creates a reader that is not attached to any segment
+	 */
+	LinuxSharedMemoryReader() {
+		shm_fd = -1;
+		segment = NULL;
+		port = NULL;
+	}
+
+	/**
+	 * @brief Unmaps the segment
+	 */
+	~LinuxSharedMemoryReader() {
+		close();
+	}
+
+	/**
+	 * @brief Maps a daemon's shared memory segment and selects a port
+	 * @param name [in] Shared memory name
+	 * @param port_number Port to follow, see selectPort()
+	 * @return TRUE if mapped and compatible with this reader, FALSE
+	 * otherwise
+	 */
+	bool open( const char *name = SHM_NAME, uint16_t port_number = 1 ) {
+		struct stat st;
+		void *addr;
+
+		close();
+
+		shm_fd = shm_open( name, O_RDONLY, 0 );
+		if( shm_fd < 0 )
+			return false;
+
+		if( fstat( shm_fd, &st ) < 0 || (size_t) st.st_size < SHM_SIZE ) {
+			close();
+			return false;
+		}
+
+		addr = mmap( NULL, SHM_SIZE, PROT_READ, MAP_SHARED, shm_fd, 0 );
+		if( addr == MAP_FAILED ) {
+			close();
+			return false;
+		}
+		segment = (const gPtpShmSegment *) addr;
+
+		if( !gptpShmCompatible( segment ) || !selectPort( port_number )) {
+			close();
+			return false;
+		}
+
+		return true;
+	}
+
+	/**
+	 * @brief Unmaps the segment
+	 * @return void
+	 */
+	void close() {
+		if( segment != NULL ) {
+			munmap( (void *) segment, SHM_SIZE );
+			segment = NULL;
+			port = NULL;
+		}
+		if( shm_fd >= 0 ) {
+			::close( shm_fd );
+			shm_fd = -1;
+		}
+	}
+
+	/**
+	 * @brief Selects the port read() and hasChanged() follow
+	 * @param port_number Port number, 1 to GPTP_SHM_PORT_SLOTS
+	 * @return FALSE if the segment has no slot for the port
+	 */
+	bool selectPort( uint16_t port_number ) {
+		if( segment == NULL || port_number == 0 ||
+		    port_number > GPTP_SHM_PORT_SLOTS )
+			return false;
+		port = &segment->port[port_number - 1];
+		return true;
+	}
+
+	/**
+	 * @brief Checks whether a port has published anything yet
+	 * @param port_number Port number, 1 to GPTP_SHM_PORT_SLOTS
+	 * @return TRUE if the port's slot is in use
+	 */
+	bool isPortActive( uint16_t port_number ) const {
+		if( segment == NULL || port_number == 0 ||
+		    port_number > GPTP_SHM_PORT_SLOTS )
+			return false;
+		return gptpShmReadBegin( &segment->port[port_number - 1].sequence ) != 0;
+	}
+
+	/**
+	 * @brief Takes a consistent copy of the selected port's data
+	 * @param data [out] Copy of the time data
+	 * @param generation [out] If non-null, number of updates published
+	 * before this one. Callers can pass it to hasChanged().
+	 * @return TRUE on success, FALSE if the segment is not mapped or no
+	 * consistent copy could be taken within GPTP_SHM_READ_RETRIES
+	 */
+	bool read( gPtpTimeData *data, uint32_t *generation = NULL ) const {
+		if( port == NULL )
+			return false;
+
+		return gptpShmReadSlot
+			( &port->sequence, (const void *) &port->data, data,
+			  sizeof( *data ), generation );
+	}
+
+	/**
+	 * @brief Takes a consistent copy of the grandmaster slot
+	 * @param gm [out] Grandmaster
+	 * @param generation [out] If non-null, number of grandmaster changes
+	 * published before this one
+	 * @return TRUE on success
+	 */
+	bool readGrandmaster( gPtpShmGrandmaster *gm, uint32_t *generation = NULL ) const {
+		gPtpShmGrandmasterSlot copy;
+
+		if( segment == NULL ||
+		    !gptpShmReadSlot( &segment->grandmaster.sequence,
+				      (const void *) &segment->grandmaster, &copy,
+				      sizeof( copy ), generation ))
+			return false;
+
+		gm->port_number = copy.port_number;
+		memcpy( gm->gptp_grandmaster_id, copy.gptp_grandmaster_id,
+			sizeof( gm->gptp_grandmaster_id ));
+		gm->gptp_domain_number = copy.gptp_domain_number;
+
+		return true;
+	}
+
+	/**
+	 * @brief Checks, without copying, whether the selected port published
+	 * an update since read() returned generation
+	 * @param generation Value returned by read()
+	 * @return TRUE if newer data is available
+	 */
+	bool hasChanged( uint32_t generation ) const {
+		if( port == NULL )
+			return false;
+
+		return gptpShmReadBegin( &port->sequence ) / 2 != generation;
+	}
+
+	/**
+	 * @brief Returns the number of the last change log event. A consumer
+	 * starts from here and passes it to waitForEvent() and readEvent().
+	 * @return Event number, 0 if not mapped or nothing changed yet
+	 */
+	uint32_t eventCount() const {
+		if( segment == NULL )
+			return 0;
+
+		return __atomic_load_n( &segment->events.counter, __ATOMIC_ACQUIRE );
+	}
+
+	/**
+	 * @brief Sleeps until the daemon appends an event after last
+	 * @param last Last event number seen
+	 * @param timeout_ms Longest wait in milliseconds, negative to wait
+	 * without limit
+	 * @return TRUE if there are events after last, FALSE on timeout or
+	 * if the segment is not mapped
+	 */
+	bool waitForEvent( uint32_t last, int timeout_ms = -1 ) const {
+		struct timespec timeout, deadline, now;
+
+		if( segment == NULL )
+			return false;
+
+		if( timeout_ms >= 0 ) {
+			clock_gettime( CLOCK_MONOTONIC, &deadline );
+			deadline.tv_sec += timeout_ms / 1000;
+			deadline.tv_nsec += ( timeout_ms % 1000 ) * 1000000L;
+			if( deadline.tv_nsec >= 1000000000L ) {
+				deadline.tv_nsec -= 1000000000L;
+				++deadline.tv_sec;
+			}
+		}
+
+		while( eventCount() == last ) {
+			struct timespec *wait = NULL;
+
+			if( timeout_ms >= 0 ) {
+				clock_gettime( CLOCK_MONOTONIC, &now );
+				timeout.tv_sec = deadline.tv_sec - now.tv_sec;
+				timeout.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+				if( timeout.tv_nsec < 0 ) {
+					timeout.tv_nsec += 1000000000L;
+					--timeout.tv_sec;
+				}
+				if( timeout.tv_sec < 0 )
+					return false;
+				wait = &timeout;
+			}
+			// Shared futex, returns at once if the counter moved
+			if( syscall( SYS_futex, &segment->events.counter, FUTEX_WAIT,
+				     last, wait, NULL, 0 ) < 0 &&
+			    errno == ETIMEDOUT )
+				return eventCount() != last;
+		}
+
+		return true;
+	}
+
+	/**
+	 * @brief Takes the next event after last whose type is in mask
+	 * @param last [in,out] Last event number seen, advanced past the
+	 * events consumed
+	 * @param event [out] Event
+	 * @param mask Event types wanted, GPTP_EVENT_ALL for every type
+	 * @param lost [out] If non-null, incremented for each event that was
+	 * overwritten before it could be read
+	 * @return TRUE if an event was returned, FALSE if there is none
+	 */
+	bool readEvent
+	( uint32_t *last, gPtpChangeEvent *event,
+	  uint32_t mask = GPTP_EVENT_ALL, uint32_t *lost = NULL ) const {
+		uint32_t counter = eventCount();
+
+		// Skip what the ring no longer holds
+		if( counter - *last > GPTP_SHM_EVENT_LOG ) {
+			if( lost != NULL )
+				*lost += counter - *last - GPTP_SHM_EVENT_LOG;
+			*last = counter - GPTP_SHM_EVENT_LOG;
+		}
+
+		while( *last != counter ) {
+			uint32_t number = *last + 1;
+
+			*last = number;
+			if( !gptpShmEventRead( segment, number, event )) {
+				if( lost != NULL )
+					++*lost;
+				continue;
+			}
+			if(( event->type & mask ) != 0 )
+				return true;
+		}
+
+		return false;
+	}
+};
+
+#endif/*LINUX_SHM_READER_HPP*/
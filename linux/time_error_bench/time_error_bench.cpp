@@ -0,0 +1,416 @@
+/******************************************************************************
+
+  Copyright (c) 2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+/*
+ * Microbenchmark of the time error kernels (gptp_time_error_kernels.hpp),
+ * in the manner of Google Benchmark: every benchmark runs for at least
+ * the minimum time and reports the time per iteration and the
+ * throughput in time errors per second, for each kernel set the CPU
+ * supports and a range of array sizes. Before timing, each kernel set
+ * is checked against straightforward loops on random data, including
+ * extreme values and ranges not aligned to the validity bitmap words;
+ * a mismatch makes the exit status non-zero.
+ *
+ * Usage: time_error_bench [-f <filter>] [-m <min time s>] [-n <max size>]
+ *
+ *   -f  run only benchmarks whose name contains <filter>
+ *   -m  minimum time per benchmark (default 0.2 s)
+ *   -n  largest array size (default 4194304, about 145 hours at 8/s)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "gptp_time_error_kernels.hpp"
+
+using namespace OpenAvnu::gPTP;
+
+#define TARGET_ACCURACY_NS 80
+#define CHECK_ROUNDS 2000
+
+static double min_time = 0.2;
+static const char *filter = NULL;
+
+static double now_s()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Time errors as a locked servo sees them, ~30 ns noise with a few
+ * outliers, and 1% invalid measurements.
+ */
+static void synthesize
+( std::vector<int64_t> &offsets, std::vector<uint64_t> &valid_bits, size_t count )
+{
+	offsets.resize( count );
+	valid_bits.assign(( count + 63 ) / 64, 0 );
+	for( size_t i = 0; i < count; ++i ) {
+		offsets[i] = ( random() % 121 ) - 60;
+		if( random() % 100 == 0 )
+			offsets[i] *= 20;
+		if( random() % 100 != 0 )
+			valid_bits[i / 64] |= 1ULL << ( i % 64 );
+	}
+}
+
+static int64_t random_offset()
+{
+	switch( random() % 8 ) {
+	case 0:
+		return INT64_MAX - random() % 4;
+	case 1:
+		return INT64_MIN + random() % 4;
+	case 2:
+		return (int64_t) random() << 32 | random();
+	default:
+		return ( random() % 401 ) - 200;
+	}
+}
+
+static bool bit( const std::vector<uint64_t> &bits, size_t i )
+{
+	return ( bits[i / 64] >> ( i % 64 )) & 1;
+}
+
+static bool within( int64_t offset, int64_t limit )
+{
+	return offset >= -limit && offset <= limit;
+}
+
+/*
+ * Compares a kernel set with loops over the same data, returning the
+ * number of mismatches.
+ */
+static uint32_t check( const TimeErrorKernels &kernels )
+{
+	std::vector<int64_t> offsets( 256 );
+	std::vector<uint64_t> valid_bits( 4 );
+	uint32_t failures = 0;
+
+	srandom( 1 );
+	for( int round = 0; round < CHECK_ROUNDS; ++round ) {
+		for( size_t i = 0; i < offsets.size(); ++i )
+			offsets[i] = random_offset();
+		for( size_t i = 0; i < valid_bits.size(); ++i )
+			valid_bits[i] = (uint64_t) random() << 33 ^
+				(uint64_t) random() << 11 ^ random();
+
+		size_t begin = random() % 128;
+		size_t count = random() % 65;
+		int64_t limit = round % 3 == 0 ? 0 : random() % 300;
+
+		/* Block kernels */
+		uint64_t mask = 0;
+		int64_t min = INT64_MAX, max = INT64_MIN;
+		uint64_t block_sum = 0, block_squares = 0;
+		uint64_t selection = (uint64_t) random() << 32 | random();
+		for( size_t i = 0; i < count; ++i ) {
+			if( within( offsets[begin + i], limit ))
+				mask |= 1ULL << i;
+			if(( selection >> i ) & 1 ) {
+				uint64_t value = (uint64_t) offsets[begin + i];
+				min = std::min( min, offsets[begin + i] );
+				max = std::max( max, offsets[begin + i] );
+				block_sum += value;
+				block_squares += value * value;
+			}
+		}
+		int64_t kernel_min = INT64_MAX, kernel_max = INT64_MIN;
+		int64_t kernel_sum = 0;
+		uint64_t kernel_squares = 0;
+		kernels.masked_min_max( &offsets[begin], count, selection,
+					&kernel_min, &kernel_max );
+		kernels.masked_sums( &offsets[begin], count, selection,
+				     &kernel_sum, &kernel_squares );
+		if( kernels.within_mask( &offsets[begin], count, limit ) !=
+		    mask || kernel_min != min || kernel_max != max ||
+		    (uint64_t) kernel_sum != block_sum ||
+		    kernel_squares != block_squares ) {
+			fprintf( stderr, "%s: block kernels differ, round %d\n",
+				 kernels.name, round );
+			++failures;
+		}
+
+		/* Scans over an unaligned range */
+		size_t end = begin + random() % ( offsets.size() - begin );
+		TimeErrorSummary summary;
+		uint32_t within_80ns = 0, valid = 0, outliers = 0;
+		uint32_t run = 0, longest = 0;
+		int64_t sum = 0;
+		uint64_t sum_squares = 0;
+		for( size_t i = begin; i < end; ++i ) {
+			within_80ns += within( offsets[i], 80 );
+			if( !bit( valid_bits, i ))
+				continue;
+			++valid;
+			sum += offsets[i];
+			sum_squares += (uint64_t) offsets[i] *
+				(uint64_t) offsets[i];
+			if( within( offsets[i], limit )) {
+				longest = std::max( longest, ++run );
+			} else {
+				++outliers;
+				run = 0;
+			}
+		}
+		scan_time_errors( offsets.data(), valid_bits.data(), begin,
+				  end, limit, summary, kernels );
+		if( summary.within_80ns_count != within_80ns ||
+		    summary.valid_count != valid ||
+		    summary.outlier_count != outliers ||
+		    summary.longest_good_run != longest ||
+		    summary.sum_ns != sum ||
+		    summary.sum_squares != sum_squares ) {
+			fprintf( stderr, "%s: scan differs, round %d\n",
+				 kernels.name, round );
+			++failures;
+		}
+
+		/* Good run search, split in two to exercise the carry */
+		uint32_t length = 1 + random() % 6;
+		size_t expected = end;
+		run = 0;
+		for( size_t i = begin; i < end; ++i ) {
+			run = bit( valid_bits, i ) &&
+				within( offsets[i], limit ) ? run + 1 : 0;
+			if( run >= length ) {
+				expected = i;
+				break;
+			}
+		}
+		size_t middle = begin + ( end - begin ) / 2;
+		uint32_t carry = 0;
+		size_t found = find_good_run
+			( offsets.data(), valid_bits.data(), begin, middle,
+			  limit, length, carry, kernels );
+		if( found == middle )
+			found = find_good_run
+				( offsets.data(), valid_bits.data(), middle,
+				  end, limit, length, carry, kernels );
+		if( found != expected ) {
+			fprintf( stderr, "%s: good run search differs, "
+				 "round %d\n", kernels.name, round );
+			++failures;
+		}
+	}
+
+	return failures;
+}
+
+typedef void ( *BenchmarkFunction )
+( const TimeErrorKernels &kernels, const std::vector<int64_t> &offsets,
+  const std::vector<uint64_t> &valid_bits );
+
+static volatile int64_t sink;
+
+static void bm_within_mask
+( const TimeErrorKernels &kernels, const std::vector<int64_t> &offsets,
+  const std::vector<uint64_t> &valid_bits )
+{
+	uint32_t count = 0;
+	for( size_t i = 0; i < offsets.size(); i += 64 )
+		count += count_set_bits( kernels.within_mask
+					 ( &offsets[i], std::min<size_t>
+					   ( 64, offsets.size() - i ),
+					   TARGET_ACCURACY_NS ));
+	sink += count;
+}
+
+static void bm_masked_min_max
+( const TimeErrorKernels &kernels, const std::vector<int64_t> &offsets,
+  const std::vector<uint64_t> &valid_bits )
+{
+	int64_t min = INT64_MAX, max = INT64_MIN;
+	for( size_t i = 0; i < offsets.size(); i += 64 )
+		kernels.masked_min_max
+			( &offsets[i], std::min<size_t>( 64, offsets.size() - i ),
+			  valid_bits[i / 64], &min, &max );
+	sink += min + max;
+}
+
+static void bm_scan_time_errors
+( const TimeErrorKernels &kernels, const std::vector<int64_t> &offsets,
+  const std::vector<uint64_t> &valid_bits )
+{
+	TimeErrorSummary summary;
+	scan_time_errors( offsets.data(), valid_bits.data(), 0,
+			  offsets.size(), TARGET_ACCURACY_NS, summary, kernels );
+	sink += summary.outlier_count;
+}
+
+static void bm_masked_sums
+( const TimeErrorKernels &kernels, const std::vector<int64_t> &offsets,
+  const std::vector<uint64_t> &valid_bits )
+{
+	int64_t sum = 0;
+	uint64_t sum_squares = 0;
+	for( size_t i = 0; i < offsets.size(); i += 64 )
+		kernels.masked_sums
+			( &offsets[i], std::min<size_t>( 64, offsets.size() - i ),
+			  valid_bits[i / 64], &sum, &sum_squares );
+	sink += sum + sum_squares;
+}
+
+/*
+ * Synthesized time errors are seldom exactly 0, so five in a row within 0ns
+ * are not found and the whole array is searched
+ */
+static void bm_find_good_run
+( const TimeErrorKernels &kernels, const std::vector<int64_t> &offsets,
+  const std::vector<uint64_t> &valid_bits )
+{
+	uint32_t run = 0;
+	sink += find_good_run( offsets.data(), valid_bits.data(), 0,
+			       offsets.size(), 0, 5, run, kernels );
+}
+
+static void format_rate( double rate, char *buffer, size_t size )
+{
+	const char *units[] = { "", "k", "M", "G" };
+	int unit = 0;
+	while( rate >= 1000 && unit < 3 ) {
+		rate /= 1000;
+		++unit;
+	}
+	snprintf( buffer, size, "%.2f%s/s", rate, units[unit] );
+}
+
+static void run
+( const char *name, BenchmarkFunction function,
+  const TimeErrorKernels &kernels, const std::vector<int64_t> &offsets,
+  const std::vector<uint64_t> &valid_bits )
+{
+	char full_name[128], rate[32];
+	uint64_t iterations = 1;
+	double elapsed;
+
+	snprintf( full_name, sizeof( full_name ), "%s/%s/%zu", name,
+		  kernels.name, offsets.size() );
+	if( filter != NULL && strstr( full_name, filter ) == NULL )
+		return;
+
+	/* Grow the iteration count until a run takes the minimum time */
+	for( ;; ) {
+		double start = now_s();
+		for( uint64_t i = 0; i < iterations; ++i )
+			function( kernels, offsets, valid_bits );
+		elapsed = now_s() - start;
+		if( elapsed >= min_time )
+			break;
+		iterations = elapsed < min_time / 100 ? iterations * 10 :
+			(uint64_t)( iterations * 1.4 * min_time / elapsed ) + 1;
+	}
+
+	format_rate( offsets.size() * iterations / elapsed, rate,
+		     sizeof( rate ));
+	printf( "%-40s %12.0f ns %12llu %14s\n", full_name,
+		elapsed * 1e9 / iterations, (unsigned long long) iterations,
+		rate );
+}
+
+int main( int argc, char **argv )
+{
+	size_t max_size = 4194304;
+	uint32_t failures = 0;
+	int c;
+
+	while(( c = getopt( argc, argv, "f:m:n:" )) != -1 ) {
+		switch( c ) {
+		case 'f':
+			filter = optarg;
+			break;
+		case 'm':
+			min_time = atof( optarg );
+			break;
+		case 'n':
+			max_size = strtoul( optarg, NULL, 0 );
+			break;
+		default:
+			fprintf( stderr, "Usage: %s [-f <filter>] "
+				 "[-m <min time s>] [-n <max size>]\n",
+				 argv[0] );
+			return 1;
+		}
+	}
+
+	const TimeErrorKernelIsa isas[] = {
+		TimeErrorKernelIsa::SCALAR, TimeErrorKernelIsa::SSE2,
+		TimeErrorKernelIsa::AVX2
+	};
+	std::vector<const TimeErrorKernels *> supported;
+	for( TimeErrorKernelIsa isa : isas ) {
+		const TimeErrorKernels *kernels = get_time_error_kernels( isa );
+		if( kernels == NULL )
+			continue;
+		uint32_t kernel_failures = check( *kernels );
+		printf( "%-7s %s\n", kernels->name, kernel_failures == 0 ?
+			"matches reference loops" : "MISMATCH" );
+		failures += kernel_failures;
+		supported.push_back( kernels );
+	}
+	printf( "dispatch selects %s\n\n", get_time_error_kernels().name );
+
+	printf( "%-40s %15s %12s %14s\n", "Benchmark", "Time", "Iterations",
+		"Items" );
+	printf( "%s\n", std::string( 84, '-' ).c_str() );
+
+	std::vector<int64_t> offsets;
+	std::vector<uint64_t> valid_bits;
+	for( size_t size = 4096; size <= max_size; size *= 32 ) {
+		srandom( 2 );
+		synthesize( offsets, valid_bits, size );
+		for( const TimeErrorKernels *kernels : supported ) {
+			run( "BM_within_mask", bm_within_mask, *kernels,
+			     offsets, valid_bits );
+			run( "BM_masked_min_max", bm_masked_min_max, *kernels,
+			     offsets, valid_bits );
+			run( "BM_masked_sums", bm_masked_sums, *kernels,
+			     offsets, valid_bits );
+			run( "BM_scan_time_errors", bm_scan_time_errors,
+			     *kernels, offsets, valid_bits );
+			run( "BM_find_good_run", bm_find_good_run, *kernels,
+			     offsets, valid_bits );
+		}
+	}
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,314 @@
+/******************************************************************************
+
+  Copyright (c) 2009-2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+/*
+ * Counts malloc() calls made by the timer queue while ports restart their
+ * timers, the way EtherPort does on every Sync, Announce and Pdelay: each
+ * timer is cancelled with deleteEventTimerLocked() and armed again with
+ * addEventTimerLocked() on a real IEEE1588Clock.
+ *
+ * With the timerfd queue every event comes from the queue's preallocated
+ * pool, so once the (port, event) index has seen each pair the restarts
+ * must not allocate. The tool exits with status 2 if they do. The SIGUSR1
+ * queue is run too, for comparison only. Timers are armed an hour out and
+ * never expire.
+ *
+ * It also checks that a timerfd callback cancelling its own event by
+ * handle is refused and leaves the queue intact, status 2 otherwise.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <avbts_clock.hpp>
+#include <gptp_log.hpp>
+
+#include "linux_hal_common.hpp"
+#include "linux_hal_timerfd.hpp"
+
+#define PORT_EVENTS 6		/* Timers a port keeps armed */
+#define TIMEOUT_NS ( 3600ULL * 1000000000ULL )
+
+extern "C" void *__libc_malloc( size_t size );
+extern "C" void *__libc_calloc( size_t count, size_t size );
+extern "C" void *__libc_realloc( void *ptr, size_t size );
+
+/* The dispatch threads may allocate too */
+static uint64_t malloc_calls = 0;
+
+/* operator new ends up here as well */
+extern "C" void *malloc( size_t size )
+{
+	__atomic_fetch_add( &malloc_calls, 1, __ATOMIC_RELAXED );
+	return __libc_malloc( size );
+}
+
+extern "C" void *calloc( size_t count, size_t size )
+{
+	__atomic_fetch_add( &malloc_calls, 1, __ATOMIC_RELAXED );
+	return __libc_calloc( count, size );
+}
+
+extern "C" void *realloc( void *ptr, size_t size )
+{
+	__atomic_fetch_add( &malloc_calls, 1, __ATOMIC_RELAXED );
+	return __libc_realloc( ptr, size );
+}
+
+static const Event port_events[PORT_EVENTS] = {
+	SYNC_INTERVAL_TIMEOUT_EXPIRES,
+	PDELAY_INTERVAL_TIMEOUT_EXPIRES,
+	SYNC_RECEIPT_TIMEOUT_EXPIRES,
+	ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES,
+	ANNOUNCE_INTERVAL_TIMEOUT_EXPIRES,
+	PDELAY_RESP_RECEIPT_TIMEOUT_EXPIRES
+};
+
+static uint64_t nsNow()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * The ports are only used as (port, event) keys, the timers never expire
+ * so they are never dereferenced
+ */
+static void restartTimers
+( IEEE1588Clock *clock, CommonPort **ports, unsigned port_count,
+  unsigned rounds )
+{
+	for( unsigned r = 0; r < rounds; ++r ) {
+		for( unsigned p = 0; p < port_count; ++p ) {
+			for( unsigned e = 0; e < PORT_EVENTS; ++e ) {
+				clock->deleteEventTimerLocked
+					( ports[p], port_events[e] );
+				clock->addEventTimerLocked
+					( ports[p], port_events[e], TIMEOUT_NS );
+			}
+		}
+	}
+}
+
+static void runQueue
+( const char *name, OSTimerQueueFactory *factory, CommonPort **ports,
+  unsigned port_count, unsigned rounds, uint64_t *calls )
+{
+	LinuxLockFactory lock_factory;
+	IEEE1588Clock *clock;
+	uint64_t before, start, elapsed;
+	unsigned restarts = port_count * PORT_EVENTS * rounds;
+
+	clock = new IEEE1588Clock
+		( false, false, 248, factory, NULL, &lock_factory,
+		  ClockServoConfig() );
+
+	/* Fills the (port, event) index and any lazily built state */
+	restartTimers( clock, ports, port_count, 1 );
+
+	before = __atomic_load_n( &malloc_calls, __ATOMIC_RELAXED );
+	start = nsNow();
+	restartTimers( clock, ports, port_count, rounds );
+	elapsed = nsNow() - start;
+	*calls = __atomic_load_n( &malloc_calls, __ATOMIC_RELAXED ) - before;
+
+	printf( "%-8s %8.3f malloc calls/restart, %6.1f ns/restart\n", name,
+		(double) *calls / restarts, (double) elapsed / restarts );
+
+	for( unsigned p = 0; p < port_count; ++p ) {
+		for( unsigned e = 0; e < PORT_EVENTS; ++e )
+			clock->deleteEventTimerLocked( ports[p], port_events[e] );
+	}
+	delete clock;
+}
+
+static OSTimerQueue *self_cancel_queue;
+static unsigned self_cancel_handle;
+static int self_cancel_result = -1;
+
+static void selfCancel( void * /* arg */ )
+{
+	bool cancelled = self_cancel_queue->cancelEvent
+		( SYNC_INTERVAL_TIMEOUT_EXPIRES, &self_cancel_handle );
+
+	__atomic_store_n( &self_cancel_result, cancelled ? 1 : 0,
+			  __ATOMIC_RELEASE );
+}
+
+/*
+ * The event is already off the queue while its callback runs. Cancelling
+ * it must fail, and must not free its slot a second time: two events
+ * armed afterwards would then share the slot and the first cancel fails.
+ */
+static bool checkSelfCancel( OSTimerQueueFactory *factory )
+{
+	LinuxLockFactory lock_factory;
+	IEEE1588Clock *clock;
+	OSLock *lock;
+	event_descriptor_t descriptor;
+	unsigned first, second;
+	bool ok = true;
+	int result = -1;
+
+	clock = new IEEE1588Clock
+		( false, false, 248, factory, NULL, &lock_factory,
+		  ClockServoConfig() );
+	self_cancel_queue = factory->createOSTimerQueue( clock );
+	lock = clock->timerQLock();
+	memset( &descriptor, 0, sizeof( descriptor ));
+
+	lock->lock();
+	self_cancel_queue->addEvent
+		( 1000, SYNC_INTERVAL_TIMEOUT_EXPIRES, selfCancel, &descriptor,
+		  false, &self_cancel_handle );
+	lock->unlock();
+
+	for( unsigned i = 0; i < 1000 && result == -1; ++i ) {
+		usleep( 1000 );
+		result = __atomic_load_n( &self_cancel_result, __ATOMIC_ACQUIRE );
+	}
+	if( result != 0 ) {
+		printf( "FAIL: self cancel %s\n",
+			result == -1 ? "never ran" : "succeeded" );
+		ok = false;
+	}
+
+	lock->lock();
+	self_cancel_queue->addEvent
+		( TIMEOUT_NS / 1000, SYNC_INTERVAL_TIMEOUT_EXPIRES, selfCancel,
+		  &descriptor, false, &first );
+	self_cancel_queue->addEvent
+		( TIMEOUT_NS / 1000, SYNC_INTERVAL_TIMEOUT_EXPIRES, selfCancel,
+		  &descriptor, false, &second );
+	if( !self_cancel_queue->cancelEvent
+	    ( SYNC_INTERVAL_TIMEOUT_EXPIRES, &first ) ||
+	    !self_cancel_queue->cancelEvent
+	    ( SYNC_INTERVAL_TIMEOUT_EXPIRES, &second )) {
+		printf( "FAIL: events armed after a self cancel share a slot\n" );
+		ok = false;
+	}
+	lock->unlock();
+
+	delete self_cancel_queue;
+	delete clock;
+
+	if( ok )
+		printf( "timerfd  self cancel refused, queue intact\n" );
+	return ok;
+}
+
+static void usage( char *arg0 )
+{
+	fprintf( stderr,
+		 "%s [-p <ports>] [-n <rounds>]\n"
+		 "\t-p Ports restarting timers (default 4)\n"
+		 "\t-n Restarts of every timer (default 100000)\n",
+		 arg0 );
+}
+
+int main( int argc, char **argv )
+{
+	unsigned port_count = 4;
+	unsigned rounds = 100000;
+	uint64_t timerfd_calls, signal_calls;
+	LinuxTimerFdQueueFactory timerfd_factory;
+	LinuxTimerQueueFactory signal_factory;
+	CommonPort **ports;
+	char *port_keys;
+	sigset_t block;
+	int opt;
+
+	while(( opt = getopt( argc, argv, "p:n:h" )) != -1 ) {
+		switch( opt ) {
+		case 'p':
+			port_count = (unsigned) strtoul( optarg, NULL, 0 );
+			break;
+		case 'n':
+			rounds = (unsigned) strtoul( optarg, NULL, 0 );
+			break;
+		default:
+			usage( argv[0] );
+			return 1;
+		}
+	}
+	if( port_count == 0 || rounds == 0 ) {
+		usage( argv[0] );
+		return 1;
+	}
+
+	/* As in the daemon, only the signal dispatch thread takes SIGUSR1 */
+	sigemptyset( &block );
+	sigaddset( &block, SIGUSR1 );
+	pthread_sigmask( SIG_BLOCK, &block, NULL );
+
+	GPTP_LOG_REGISTER();
+	gptplogSetLevels( "error" );
+
+	port_keys = new char[port_count];
+	ports = new CommonPort *[port_count];
+	for( unsigned p = 0; p < port_count; ++p )
+		ports[p] = (CommonPort *) &port_keys[p];
+
+	printf( "%u port(s), %u timers each, %u restarts of each timer\n",
+		port_count, PORT_EVENTS, rounds );
+	runQueue( "timerfd", &timerfd_factory, ports, port_count, rounds,
+		  &timerfd_calls );
+	runQueue( "signal", &signal_factory, ports, port_count, rounds,
+		  &signal_calls );
+
+	if( !checkSelfCancel( &timerfd_factory )) {
+		GPTP_LOG_UNREGISTER();
+		return 2;
+	}
+
+	if( port_count * PORT_EVENTS > TIMERFD_QUEUE_POOL_SIZE ) {
+		printf( "%u timers exceed the %u event pool, heap fallbacks "
+			"expected\n", port_count * PORT_EVENTS,
+			TIMERFD_QUEUE_POOL_SIZE );
+	} else if( timerfd_calls != 0 ) {
+		printf( "FAIL: the timerfd queue allocated in steady state\n" );
+		GPTP_LOG_UNREGISTER();
+		return 2;
+	}
+
+	GPTP_LOG_UNREGISTER();
+
+	return 0;
+}
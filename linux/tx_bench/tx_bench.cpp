@@ -0,0 +1,319 @@
+/******************************************************************************
+
+  Copyright (c) 2009-2012, Intel Corporation
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of the Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+/*
+ * Measures the sender-side CPU cost of one PTP transmission, from the
+ * timer callback up to the sendEventPort()/sendGeneralPort() call, for
+ * the two ways the sendPort() methods build frames:
+ *
+ *  legacy:   zero a 256 byte stack buffer, serialise the common header
+ *            field by field as buildCommonHeader() does, then copy in the
+ *            body fields one memcpy at a time
+ *  template: copy the port's pre-serialised frame (PTPFrameTemplate) and
+ *            patch sequence id, correction field and body in place, as
+ *            PTPMessageCommon::buildFromTemplate() does
+ *
+ * Every iteration sends a Sync, Follow_Up, Pdelay_Req, Pdelay_Resp and
+ * Pdelay_Resp_Follow_Up and reads the clock once for the Sync origin
+ * timestamp. The socket send itself is the same for both and excluded.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "ptp_frame_view.hpp"
+
+#define FOLLOWUP_TLV_LENGTH 32	/* sizeof( FollowUpTLV ) */
+#define PAYLOAD_OFFSET 0	/* LinuxNetworkInterface::getPayloadOffset() */
+#define BLOCK_ROUNDS 1000	/* Rounds timed together */
+
+/* The message fields sendPort() serialises */
+struct MessageFields {
+	MessageType messageType;
+	unsigned char versionPTP;
+	uint16_t messageLength;
+	unsigned char domainNumber;
+	unsigned char flags[PTP_FLAGS_LENGTH];
+	long long correctionField;
+	uint8_t clockIdentity[PTP_CLOCK_IDENTITY_LENGTH];
+	uint16_t portNumber;
+	uint16_t sequenceId;
+	unsigned char control;
+	char logMeanMessageInterval;
+	Timestamp timestamp;
+	uint8_t requestingIdentity[PTP_CLOCK_IDENTITY_LENGTH];
+	uint16_t requestingPort;
+	uint8_t tlv[FOLLOWUP_TLV_LENGTH];
+};
+
+static uint64_t cpuNow()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_THREAD_CPUTIME_ID, &ts );
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static Timestamp clockNow()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_REALTIME, &ts );
+	return Timestamp( ts.tv_nsec, (uint32_t) ts.tv_sec,
+			  (uint16_t)( ts.tv_sec >> 32 ));
+}
+
+/* Same steps as PTPMessageCommon::buildCommonHeader() */
+static void legacyHeader( MessageFields *m, uint8_t *buf )
+{
+	unsigned char tspec_msg_t = m->messageType | 0x10;
+	long long correctionField_BE = PLAT_htonll( m->correctionField );
+	uint16_t messageLength_NO = PLAT_htons( m->messageLength );
+	uint16_t portNumber_NO = PLAT_htons( m->portNumber );
+	uint16_t sequenceId_NO = PLAT_htons( m->sequenceId );
+
+	memcpy( buf + PTP_COMMON_HDR_TRANSSPEC_MSGTYPE(0), &tspec_msg_t, 1 );
+	memcpy( buf + PTP_COMMON_HDR_PTP_VERSION(0), &m->versionPTP, 1 );
+	memcpy( buf + PTP_COMMON_HDR_MSG_LENGTH(0), &messageLength_NO, 2 );
+	memcpy( buf + PTP_COMMON_HDR_DOMAIN_NUMBER(0), &m->domainNumber, 1 );
+	memcpy( buf + PTP_COMMON_HDR_FLAGS(0), m->flags, PTP_FLAGS_LENGTH );
+	memcpy( buf + PTP_COMMON_HDR_CORRECTION(0), &correctionField_BE, 8 );
+	memcpy( buf + PTP_COMMON_HDR_SOURCE_CLOCK_ID(0), m->clockIdentity,
+		PTP_CLOCK_IDENTITY_LENGTH );
+	memcpy( buf + PTP_COMMON_HDR_SOURCE_PORT_ID(0), &portNumber_NO, 2 );
+	memcpy( buf + PTP_COMMON_HDR_SEQUENCE_ID(0), &sequenceId_NO, 2 );
+	memcpy( buf + PTP_COMMON_HDR_CONTROL(0), &m->control, 1 );
+	memcpy( buf + PTP_COMMON_HDR_LOG_MSG_INTRVL(0),
+		&m->logMeanMessageInterval, 1 );
+}
+
+static void legacyTimestamp( uint8_t *p, const Timestamp &ts )
+{
+	uint16_t seconds_ms = PLAT_htons( ts.seconds_ms );
+	uint32_t seconds_ls = PLAT_htonl( ts.seconds_ls );
+	uint32_t nanoseconds = PLAT_htonl( ts.nanoseconds );
+
+	memcpy( p, &seconds_ms, sizeof( seconds_ms ));
+	memcpy( p + 2, &seconds_ls, sizeof( seconds_ls ));
+	memcpy( p + 6, &nanoseconds, sizeof( nanoseconds ));
+}
+
+static uint8_t *legacyBuild( MessageFields *m, uint8_t *buf_t )
+{
+	uint8_t *buf_ptr = buf_t + PAYLOAD_OFFSET;
+
+	memset( buf_t, 0, 256 );
+	legacyHeader( m, buf_ptr );
+	return buf_ptr;
+}
+
+/* Same steps as PTPMessageCommon::buildFromTemplate() */
+static uint8_t *templateBuild
+( MessageFields *m, PTPFrameTemplate *templates, uint8_t *buf_t )
+{
+	PTPFrameTemplate *tmpl = &templates[m->messageType];
+	uint8_t *buf_ptr = buf_t + PAYLOAD_OFFSET;
+
+	if( !tmpl->valid ||
+	    tmpl->size != PAYLOAD_OFFSET + m->messageLength ||
+	    tmpl->versionPTP != m->versionPTP ||
+	    tmpl->domainNumber != m->domainNumber ||
+	    memcmp( tmpl->flags, m->flags, PTP_FLAGS_LENGTH ) != 0 ||
+	    tmpl->logMeanMessageInterval != m->logMeanMessageInterval )
+	{
+		memset( tmpl->frame, 0, sizeof( tmpl->frame ));
+		legacyHeader( m, tmpl->frame + PAYLOAD_OFFSET );
+		tmpl->size = PAYLOAD_OFFSET + m->messageLength;
+		tmpl->versionPTP = m->versionPTP;
+		tmpl->domainNumber = m->domainNumber;
+		memcpy( tmpl->flags, m->flags, PTP_FLAGS_LENGTH );
+		tmpl->logMeanMessageInterval = m->logMeanMessageInterval;
+		tmpl->valid = true;
+	}
+
+	memcpy( buf_t, tmpl->frame, tmpl->size );
+	PtpWire::store16( buf_ptr + PTP_COMMON_HDR_SEQUENCE_ID(0),
+			  m->sequenceId );
+	PtpWire::store64( buf_ptr + PTP_COMMON_HDR_CORRECTION(0),
+			  (uint64_t) m->correctionField );
+	return buf_ptr;
+}
+
+static void initFields( MessageFields *m, MessageType type, uint16_t length )
+{
+	unsigned i;
+
+	*m = MessageFields();
+	m->messageType = type;
+	m->versionPTP = GPTP_VERSION;
+	m->messageLength = length;
+	m->flags[PTP_PTPTIMESCALE_BYTE] = 0x1 << PTP_PTPTIMESCALE_BIT;
+	for( i = 0; i < PTP_CLOCK_IDENTITY_LENGTH; ++i ) {
+		m->clockIdentity[i] = (uint8_t)( 0x10 + i );
+		m->requestingIdentity[i] = (uint8_t)( 0x20 + i );
+	}
+	m->portNumber = 1;
+	m->requestingPort = 1;
+	m->control = MESSAGE_OTHER;
+	m->logMeanMessageInterval = -3;
+}
+
+/* Fills in the body fields of one message, either way of building */
+static void buildBody( MessageFields *m, uint8_t *buf_ptr, bool legacy )
+{
+	uint16_t port_NO;
+
+	switch( m->messageType ) {
+	case SYNC_MESSAGE:
+		m->timestamp = clockNow();
+		/* fall through */
+	case FOLLOWUP_MESSAGE:
+		if( legacy )
+			legacyTimestamp( buf_ptr + PTP_SYNC_OFFSET, m->timestamp );
+		else
+			PtpWire::storeTimestamp
+				( buf_ptr + PTP_SYNC_OFFSET, m->timestamp );
+		if( m->messageType == FOLLOWUP_MESSAGE )
+			memcpy( buf_ptr + PTP_COMMON_HDR_LENGTH +
+				PTP_FOLLOWUP_LENGTH, m->tlv,
+				FOLLOWUP_TLV_LENGTH );
+		break;
+	case PATH_DELAY_RESP_MESSAGE:
+	case PATH_DELAY_FOLLOWUP_MESSAGE:
+		memcpy( buf_ptr + PTP_PDELAY_RESP_REQ_CLOCK_ID
+			(PTP_PDELAY_RESP_OFFSET), m->requestingIdentity,
+			PTP_CLOCK_IDENTITY_LENGTH );
+		port_NO = PLAT_htons( m->requestingPort );
+		memcpy( buf_ptr + PTP_PDELAY_RESP_REQ_PORT_ID
+			(PTP_PDELAY_RESP_OFFSET), &port_NO, sizeof( port_NO ));
+		if( legacy )
+			legacyTimestamp
+				( buf_ptr + PTP_PDELAY_RESP_OFFSET,
+				  m->timestamp );
+		else
+			PtpWire::storeTimestamp
+				( buf_ptr + PTP_PDELAY_RESP_OFFSET,
+				  m->timestamp );
+		break;
+	default:
+		break;
+	}
+}
+
+static void usage( char *arg0 )
+{
+	fprintf( stderr,
+		 "%s [-n <blocks>]\n"
+		 "\t-n Number of blocks of %u five-message rounds, "
+		 "split between modes (default 2000)\n",
+		 arg0, BLOCK_ROUNDS );
+}
+
+int main( int argc, char **argv )
+{
+	MessageFields messages[5];
+	static PTPFrameTemplate templates[PTP_TX_TEMPLATE_COUNT];
+	uint8_t buf_t[256];
+	unsigned count = 2000;
+	uint64_t cpu[2] = { 0, 0 };
+	unsigned blocks[2] = { 0, 0 };
+	uint64_t sink = 0;
+	unsigned n, i;
+	int opt;
+
+	while(( opt = getopt( argc, argv, "n:h" )) != -1 ) {
+		switch( opt ) {
+		case 'n':
+			count = (unsigned) strtoul( optarg, NULL, 0 );
+			break;
+		default:
+			usage( argv[0] );
+			return 1;
+		}
+	}
+	if( count == 0 ) {
+		usage( argv[0] );
+		return 1;
+	}
+
+	initFields( &messages[0], SYNC_MESSAGE,
+		    PTP_COMMON_HDR_LENGTH + PTP_SYNC_LENGTH );
+	initFields( &messages[1], FOLLOWUP_MESSAGE,
+		    PTP_COMMON_HDR_LENGTH + PTP_FOLLOWUP_LENGTH +
+		    FOLLOWUP_TLV_LENGTH );
+	initFields( &messages[2], PATH_DELAY_REQ_MESSAGE,
+		    PTP_COMMON_HDR_LENGTH + PTP_PDELAY_REQ_LENGTH );
+	initFields( &messages[3], PATH_DELAY_RESP_MESSAGE,
+		    PTP_COMMON_HDR_LENGTH + PTP_PDELAY_RESP_LENGTH );
+	initFields( &messages[4], PATH_DELAY_FOLLOWUP_MESSAGE,
+		    PTP_COMMON_HDR_LENGTH + PTP_PDELAY_FOLLOWUP_LENGTH );
+
+	for( n = 0; n < count; ++n ) {
+		int mode = n & 1;	/* Interleave modes to share noise */
+		uint64_t start = cpuNow();
+		unsigned round;
+
+		for( round = 0; round < BLOCK_ROUNDS; ++round ) {
+			for( i = 0; i < 5; ++i ) {
+				MessageFields *m = &messages[i];
+				uint8_t *buf_ptr;
+
+				++m->sequenceId;
+				buf_ptr = mode == 0 ?
+					legacyBuild( m, buf_t ) :
+					templateBuild( m, templates, buf_t );
+				buildBody( m, buf_ptr, mode == 0 );
+				/* Stands in for the send */
+				sink += buf_ptr[PTP_COMMON_HDR_SEQUENCE_ID(0)+1] +
+					buf_ptr[m->messageLength - 1];
+			}
+		}
+		cpu[mode] += cpuNow() - start;
+		++blocks[mode];
+	}
+	if( blocks[1] == 0 ) {
+		usage( argv[0] );
+		return 1;
+	}
+
+	printf( "%u rounds of 5 messages per mode\n",
+		blocks[1] * BLOCK_ROUNDS );
+	printf( "legacy:   %6.1f ns/message\n",
+		(double) cpu[0] / ( blocks[0] * BLOCK_ROUNDS * 5 ));
+	printf( "template: %6.1f ns/message\n",
+		(double) cpu[1] / ( blocks[1] * BLOCK_ROUNDS * 5 ));
+
+	return sink == 0 ? 1 : 0;
+}
@@ -376,12 +376,16 @@ int _tmain(int argc, _TCHAR* argv[])
 						GPTP_LOG_INFO("Using standard profile from configuration file");
 					}
 				}
+
+				iniParser.applyServoConfig(portInit.profile.servo);
+				GPTP_LOG_INFO("Clock servo: %s",
+					ClockServoConfig::typeName(portInit.profile.servo.type));
 			}
 		} else {
 			GPTP_LOG_INFO("Configuration file %s not found, using default values", config_file_path.c_str());
 		}
 	
-		portInit.clock = new IEEE1588Clock(false, false, priority1, timerq_factory, ipc, portInit.lock_factory);  // Do not force slave
+		portInit.clock = new IEEE1588Clock(false, false, priority1, timerq_factory, ipc, portInit.lock_factory, portInit.profile.servo);  // Do not force slave
 	
 		// Configure clock quality based on unified profile system
 		ClockQuality quality;
@@ -736,7 +736,8 @@ bool WindowsNamedPipeIPC::update(
 	uint32_t sync_count,
 	uint32_t pdelay_count,
 	PortState port_state,
-	bool asCapable )
+	bool asCapable,
+	uint16_t )
 {
 	lOffset_.get();
 	lOffset_.local_time = local_time;
@@ -752,7 +753,8 @@ bool WindowsNamedPipeIPC::update(
 
 bool WindowsNamedPipeIPC::update_grandmaster(
 	uint8_t gptp_grandmaster_id[],
-	uint8_t gptp_domain_number )
+	uint8_t gptp_domain_number,
+	uint16_t )
 {
 	lOffset_.get();
 	memcpy(lOffset_.gptp_grandmaster_id, gptp_grandmaster_id, PTP_CLOCK_IDENTITY_LENGTH);
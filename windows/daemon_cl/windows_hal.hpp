@@ -2081,6 +2081,7 @@ public:
 	 * @param  pdelay_count Counts of pdelays
 	 * @param  port_state PortState information
 	 * @param  asCapable asCapable flag
+	 * @param  port_number Port the values belong to
 	 *
 	 * @return TRUE if success; FALSE if error
 	 */
@@ -2093,19 +2094,22 @@ public:
 		uint32_t sync_count,
 		uint32_t pdelay_count,
 		PortState port_state,
-		bool asCapable );
+		bool asCapable,
+		uint16_t port_number );
 
 	/**
 	 * @brief  Updates grandmaster IPC interface values
 	 *
 	 * @param  gptp_grandmaster_id Current grandmaster id (all 0's if no grandmaster selected)
 	 * @param  gptp_domain_number gPTP domain number
+	 * @param  port_number Port the grandmaster was learned on
 	 *
 	 * @return TRUE if success; FALSE if error
 	 */
 	virtual bool update_grandmaster(
 		uint8_t gptp_grandmaster_id[],
-		uint8_t gptp_domain_number );
+		uint8_t gptp_domain_number,
+		uint16_t port_number );
 
 	/**
 	 * @brief Updates network interface IPC interface values